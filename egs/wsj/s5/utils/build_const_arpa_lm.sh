@@ -7,6 +7,8 @@
 # ConstArpaLm format language model.
 
 # begin configuration section
+page_aligned=false  # If true, write G.carpa so that it can be memory-mapped by
+                    # the rescoring programs; older binaries cannot read it.
 # end configuration section
 
 [ -f path.sh ] && . ./path.sh;
@@ -19,6 +21,9 @@ if [ $# != 3 ]; then
   echo "e.g.:"
   echo "  $0 data/local/lm/3-gram.full.arpa.gz data/lang/ data/lang_test_tgmed"
   echo "Options"
+  echo "  --page-aligned (true|false)  # default: false; if true, the output can"
+  echo "                               # be memory-mapped, but not read by older"
+  echo "                               # versions of Kaldi."
   exit 1;
 fi
 
@@ -43,7 +48,7 @@ fi
 
 
 arpa-to-const-arpa --bos-symbol=$bos \
-  --eos-symbol=$eos --unk-symbol=$unk \
+  --eos-symbol=$eos --unk-symbol=$unk --page-aligned=$page_aligned \
   "gunzip -c $arpa_lm | utils/map_arpa_lm.pl $new_lang/words.txt|"  $new_lang/G.carpa  || exit 1;
 
 exit 0;
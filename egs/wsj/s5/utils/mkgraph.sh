@@ -135,7 +135,7 @@ fi
 trap "rm -f $dir/HCLG.fst.$$" EXIT HUP INT PIPE TERM
 if [[ ! -s $dir/HCLG.fst || $dir/HCLG.fst -ot $dir/HCLGa.fst ]]; then
   add-self-loops --self-loop-scale=$loopscale --reorder=true \
-    $model < $dir/HCLGa.fst | fstconvert --fst_type=const > $dir/HCLG.fst.$$ || exit 1;
+    $model < $dir/HCLGa.fst | fstconvert --fst_type=const --fst_align > $dir/HCLG.fst.$$ || exit 1;
   mv $dir/HCLG.fst.$$ $dir/HCLG.fst
   if [ $tscale == 1.0 -a $loopscale == 1.0 ]; then
     # No point doing this test if transition-scale not 1, as it is bound to fail.
@@ -143,9 +143,9 @@ if [[ ! -s $dir/HCLG.fst || $dir/HCLG.fst -ot $dir/HCLGa.fst ]]; then
   fi
 fi
 
-# note: the empty FST has 66 bytes.  this check is for whether the final FST
-# is the empty file or is the empty FST.
-if ! [ $(head -c 67 $dir/HCLG.fst | wc -c) -eq 67 ]; then
+# note: the empty FST has 66 bytes, or 80 when written with --fst_align.  this
+# check is for whether the final FST is the empty file or is the empty FST.
+if ! [ $(head -c 81 $dir/HCLG.fst | wc -c) -eq 81 ]; then
   echo "$0: it looks like the result in $dir/HCLG.fst is empty"
   exit 1
 fi
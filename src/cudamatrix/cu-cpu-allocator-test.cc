@@ -0,0 +1,166 @@
+// cudamatrix/cu-cpu-allocator-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "cudamatrix/cu-cpu-allocator.h"
+#include "cudamatrix/cu-matrix.h"
+
+namespace kaldi {
+
+
+void UnitTestCpuMemoryAllocator() {
+  CpuMemoryAllocator allocator;
+  size_t size1 = 16 * RandInt(10, 1000), size2 = size1 + 16;
+  void *p1 = allocator.Malloc(size1), *p2 = allocator.Malloc(size2);
+  memset(p1, 0, size1);
+  memset(p2, 0, size2);
+  KALDI_ASSERT(reinterpret_cast<size_t>(p1) % 16 == 0 &&
+               reinterpret_cast<size_t>(p2) % 16 == 0);
+  allocator.Free(p1, size1);
+  allocator.Free(p2, size2);
+  KALDI_ASSERT(allocator.MemoryCached() == size1 + size2);
+  // Memory is looked up by its exact size.
+  KALDI_ASSERT(allocator.Malloc(size2) == p2 &&
+               allocator.Malloc(size1) == p1);
+  KALDI_ASSERT(allocator.NumUserAllocations() == 4 &&
+               allocator.NumSystemAllocations() == 2 &&
+               allocator.MemoryCached() == 0);
+  void *p3 = allocator.Malloc(size1);
+  KALDI_ASSERT(p3 != p1 && allocator.NumSystemAllocations() == 3);
+
+  // The total held is limited to memory_factor times the max used, which was
+  // 2 * size1 + size2, so caching p4 requires freeing the least recently
+  // cached memory, p1 and then p3.
+  CpuAllocatorOptions opts;
+  opts.memory_factor = 1.0;
+  allocator.SetOptions(opts);
+  allocator.Free(p1, size1);
+  allocator.Free(p3, size1);
+  allocator.Free(p2, size2);
+  KALDI_ASSERT(allocator.MemoryCached() == 2 * size1 + size2);
+  size_t size3 = size2 + 16;
+  void *p4 = allocator.Malloc(size3);
+  allocator.Free(p4, size3);
+  KALDI_ASSERT(allocator.MemoryCached() == size2 + size3);
+  int64 num_system_allocations = allocator.NumSystemAllocations();
+  KALDI_ASSERT(allocator.Malloc(size2) == p2 &&
+               allocator.Malloc(size3) == p4 &&
+               allocator.NumSystemAllocations() == num_system_allocations);
+  allocator.Free(p2, size2);
+  allocator.Free(p4, size3);
+
+  // Memory not allocated by us (here, allocated as by class Matrix) may be
+  // freed to the cache, with a size smaller than it was allocated with.
+  void *temp, *p5 = KALDI_MEMALIGN(16, size2, &temp);
+  allocator.Free(p5, size1);
+  allocator.ReleaseCachedMemory();
+  KALDI_ASSERT(allocator.MemoryCached() == 0);
+
+  opts.cache_memory = false;
+  allocator.SetOptions(opts);
+  allocator.Free(allocator.Malloc(size1), size1);
+  KALDI_ASSERT(allocator.MemoryCached() == 0 && allocator.MemoryUsed() == 0);
+}
+
+void UnitTestCpuMemoryAllocatorDisown() {
+  // Memory that is disowned (as when it is swapped into a Matrix) no longer
+  // counts as used, so it does not stop us from freeing cached memory of
+  // sizes that are not asked for again.
+  CpuAllocatorOptions opts;
+  opts.memory_factor = 1.0;
+  CpuMemoryAllocator allocator(opts);
+  int32 n = 100;
+  for (int32 i = 1; i <= n; i++) {
+    void *p = allocator.Malloc(16 * i);
+    allocator.Disown(p);
+    KALDI_MEMALIGN_FREE(p);
+    void *q = allocator.Malloc(16 * i + 16);
+    allocator.Free(q, 16 * i + 16);
+  }
+  KALDI_ASSERT(allocator.MemoryUsed() == 0 &&
+               allocator.MemoryCached() <= 16 * n + 16);
+  // Disowning memory we did not allocate does nothing.
+  void *temp, *p = KALDI_MEMALIGN(16, 64, &temp);
+  allocator.Disown(p);
+  KALDI_MEMALIGN_FREE(p);
+  KALDI_ASSERT(allocator.MemoryUsed() == 0);
+}
+
+template<typename Real>
+void UnitTestCuMatrixCpuMemory() {
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    return;  // This only applies to CPU memory.
+#endif
+  CpuMemoryAllocator &allocator = CpuMemoryAllocator::Instantiate();
+  int32 num_rows = RandInt(1, 100), num_cols = RandInt(1, 100);
+  MatrixStrideType stride_type = (RandInt(0, 1) == 0 ? kDefaultStride :
+                                  kStrideEqualNumCols);
+  const Real *data;
+  {
+    CuMatrix<Real> mat(num_rows, num_cols, kUndefined, stride_type);
+    data = mat.Data();
+  }
+  int64 num_system_allocations = allocator.NumSystemAllocations();
+  CuMatrix<Real> mat(num_rows, num_cols, kSetZero, stride_type);
+  KALDI_ASSERT(mat.Data() == data && mat.Sum() == 0.0 &&
+               allocator.NumSystemAllocations() == num_system_allocations);
+
+  // The memory of a CuMatrix may end up in a Matrix and vice versa.
+  mat.SetRandn();
+  Matrix<Real> mat2(mat), mat3(num_rows, num_cols, kUndefined, stride_type);
+  mat.Swap(&mat3);
+  KALDI_ASSERT(mat3.Data() == data);
+  AssertEqual(mat2, mat3);
+  mat.Resize(0, 0);
+  mat3.Resize(0, 0);
+
+  // Memory that goes to a Matrix for good no longer counts as used.
+  size_t memory_used = allocator.MemoryUsed();
+  for (int32 i = 0; i < 10; i++) {
+    CuMatrix<Real> mat4(RandInt(1, 100), RandInt(1, 100));
+    Matrix<Real> mat5;
+    mat4.Swap(&mat5);  // mat5 frees the memory.
+  }
+  KALDI_ASSERT(allocator.MemoryUsed() == memory_used);
+}
+
+
+}  // namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    for (int32 i = 0; i < 10; i++) {
+      UnitTestCpuMemoryAllocator();
+      UnitTestCpuMemoryAllocatorDisown();
+      UnitTestCuMatrixCpuMemory<float>();
+      UnitTestCuMatrixCpuMemory<double>();
+    }
+  }
+  CpuMemoryAllocator::Instantiate().PrintMemoryUsage();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
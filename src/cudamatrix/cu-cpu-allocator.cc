@@ -0,0 +1,175 @@
+// cudamatrix/cu-cpu-allocator.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <new>
+#include "cudamatrix/cu-cpu-allocator.h"
+#include "base/kaldi-utils.h"
+
+namespace kaldi {
+
+
+CpuMemoryAllocator &CpuMemoryAllocator::Instantiate() {
+  static CpuMemoryAllocator *allocator = new CpuMemoryAllocator();
+  return *allocator;
+}
+
+CpuMemoryAllocator::CpuMemoryAllocator(const CpuAllocatorOptions &opts):
+    opts_(opts),
+    cur_bytes_used_(0),
+    max_bytes_used_(0),
+    cur_bytes_cached_(0),
+    num_user_allocations_(0),
+    num_system_allocations_(0) {
+  opts_.Check();
+}
+
+CpuMemoryAllocator::~CpuMemoryAllocator() {
+  ReleaseCachedMemory();
+}
+
+void* CpuMemoryAllocator::Malloc(size_t size) {
+  KALDI_ASSERT(size > 0);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_user_allocations_++;
+    cur_bytes_used_ += size;
+    if (cur_bytes_used_ > max_bytes_used_)
+      max_bytes_used_ = cur_bytes_used_;
+    unordered_map<size_t, std::deque<ListType::iterator> >::iterator
+        iter = map_.find(size);
+    if (iter != map_.end()) {
+      // Use the most recently cached memory of this size.
+      ListType::iterator list_iter = iter->second.back();
+      void *ans = list_iter->second;
+      iter->second.pop_back();
+      if (iter->second.empty())
+        map_.erase(iter);
+      list_.erase(list_iter);
+      cur_bytes_cached_ -= size;
+      used_[ans] = size;
+      return ans;
+    }
+    num_system_allocations_++;
+  }
+  void *ans, *temp;
+  if ((ans = KALDI_MEMALIGN(16, size, &temp)) == NULL) {
+    // Try again after returning the cached memory to the system.
+    ReleaseCachedMemory();
+    if ((ans = KALDI_MEMALIGN(16, size, &temp)) == NULL) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cur_bytes_used_ -= size;
+      throw std::bad_alloc();
+    }
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  used_[ans] = size;
+  return ans;
+}
+
+void CpuMemoryAllocator::Disown(void *ptr) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  unordered_map<void*, size_t>::iterator iter = used_.find(ptr);
+  if (iter != used_.end()) {
+    cur_bytes_used_ -= iter->second;
+    used_.erase(iter);
+  }
+}
+
+void CpuMemoryAllocator::Free(void *ptr, size_t size) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // The memory may have been allocated by class Matrix, in which case we
+  // never counted it as used.
+  unordered_map<void*, size_t>::iterator iter = used_.find(ptr);
+  if (iter != used_.end()) {
+    cur_bytes_used_ -= iter->second;
+    used_.erase(iter);
+  }
+  size_t max_bytes_to_hold =
+      static_cast<size_t>(opts_.memory_factor * max_bytes_used_);
+  if (!opts_.cache_memory || size == 0 ||
+      cur_bytes_used_ + size > max_bytes_to_hold) {
+    KALDI_MEMALIGN_FREE(ptr);
+    return;
+  }
+  FreeCachedMemory(max_bytes_to_hold - cur_bytes_used_ - size);
+  list_.push_back(std::pair<size_t, void*>(size, ptr));
+  map_[size].push_back(--list_.end());
+  cur_bytes_cached_ += size;
+}
+
+void CpuMemoryAllocator::FreeCachedMemory(size_t max_bytes_cached) {
+  while (cur_bytes_cached_ > max_bytes_cached) {
+    KALDI_ASSERT(!list_.empty());
+    size_t size = list_.front().first;
+    void *ptr = list_.front().second;
+    // The front of list_ is the least recently cached element, so it is also
+    // at the front of its deque in map_.
+    std::deque<ListType::iterator> &elements = map_[size];
+    KALDI_ASSERT(!elements.empty() && elements.front() == list_.begin());
+    elements.pop_front();
+    if (elements.empty())
+      map_.erase(size);
+    list_.pop_front();
+    cur_bytes_cached_ -= size;
+    KALDI_MEMALIGN_FREE(ptr);
+  }
+}
+
+void CpuMemoryAllocator::SetOptions(const CpuAllocatorOptions &opts) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  opts_ = opts;
+  opts_.Check();
+  if (!opts_.cache_memory)
+    FreeCachedMemory(0);
+}
+
+void CpuMemoryAllocator::ReleaseCachedMemory() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  FreeCachedMemory(0);
+}
+
+int64 CpuMemoryAllocator::NumUserAllocations() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return num_user_allocations_;
+}
+
+int64 CpuMemoryAllocator::NumSystemAllocations() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return num_system_allocations_;
+}
+
+size_t CpuMemoryAllocator::MemoryCached() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return cur_bytes_cached_;
+}
+
+size_t CpuMemoryAllocator::MemoryUsed() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return cur_bytes_used_;
+}
+
+void CpuMemoryAllocator::PrintMemoryUsage() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  KALDI_LOG << "CPU matrix memory usage: " << cur_bytes_used_
+            << " bytes currently used (max: " << max_bytes_used_ << "), "
+            << cur_bytes_cached_ << " bytes cached; "
+            << num_user_allocations_ << " allocations, of which "
+            << num_system_allocations_ << " were not from the cache.";
+}
+
+
+}  // namespace kaldi
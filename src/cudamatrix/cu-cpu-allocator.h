@@ -0,0 +1,143 @@
+// cudamatrix/cu-cpu-allocator.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef KALDI_CUDAMATRIX_CU_CPU_ALLOCATOR_H_
+#define KALDI_CUDAMATRIX_CU_CPU_ALLOCATOR_H_
+
+#include <deque>
+#include <list>
+#include <mutex>
+#include "base/kaldi-common.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+
+
+struct CpuAllocatorOptions {
+  // If false, memory is returned to the system as soon as it is freed.
+  bool cache_memory;
+
+  // memory_factor is the total amount of (used + cached) memory that we allow
+  // to be held, relative to the max amount of memory that has ever been in use
+  // at one time; c.f. CuAllocatorOptions.
+  BaseFloat memory_factor;
+
+  CpuAllocatorOptions(): cache_memory(true),
+                         memory_factor(1.3) { }
+
+  void Check() {
+    KALDI_ASSERT(memory_factor >= 1.0);
+  }
+};
+
+
+/**
+   Class CpuMemoryAllocator is the CPU counterpart of class CuMemoryAllocator:
+   it caches the memory of class CuMatrix when we are not using a GPU.  Code
+   that repeatedly allocates and frees matrices of the same sizes, such as an
+   NnetComputer that is run chunk by chunk, then does not have to go to the
+   system allocator each time.  This matters most for large matrices, which
+   malloc() gets with mmap(), so all their pages would have to be faulted in
+   again each time they are allocated.
+
+   Cached memory is looked up by its exact size in bytes.  Because CuMatrix
+   may swap its memory with a Matrix, which frees it with KALDI_MEMALIGN_FREE,
+   all the memory we deal with is allocated with KALDI_MEMALIGN and the memory
+   we are given to free may have been allocated by class Matrix; this is why
+   Free() takes the size.  We keep a record of the memory that Malloc() has
+   given out and that has not been freed, so that only that memory counts as
+   in use; memory that goes to a Matrix must be passed to Disown().
+
+   This class is thread safe.
+ */
+class CpuMemoryAllocator {
+ public:
+  /// Returns the allocator used by class CuMatrix.  (It is never destroyed,
+  /// so that CuMatrix objects with static storage can be safely destroyed
+  /// at exit).
+  static CpuMemoryAllocator &Instantiate();
+
+  /// Returns memory of 'size' bytes (which must be nonzero), aligned to 16
+  /// bytes.  Throws std::bad_alloc on failure.
+  void *Malloc(size_t size);
+
+  /// Frees memory that was allocated with KALDI_MEMALIGN (e.g. by Malloc()).
+  /// 'size' must not be greater than the size it was allocated with.
+  void Free(void *ptr, size_t size);
+
+  /// Tells us that 'ptr' will not be given to Free(), because its owner
+  /// (e.g. a Matrix that it was swapped into) will free it with
+  /// KALDI_MEMALIGN_FREE.  Does nothing if 'ptr' was not returned by
+  /// Malloc().
+  void Disown(void *ptr);
+
+  void SetOptions(const CpuAllocatorOptions &opts);
+
+  /// Returns all the cached memory to the system.
+  void ReleaseCachedMemory();
+
+  // The number of times Malloc() has been called.
+  int64 NumUserAllocations() const;
+
+  // The number of times Malloc() could not use cached memory.
+  int64 NumSystemAllocations() const;
+
+  // Memory held in the cache currently, in bytes.
+  size_t MemoryCached() const;
+
+  // Memory returned by Malloc() and not yet freed or disowned, in bytes.
+  size_t MemoryUsed() const;
+
+  void PrintMemoryUsage() const;
+
+  CpuMemoryAllocator(const CpuAllocatorOptions &opts = CpuAllocatorOptions());
+
+  ~CpuMemoryAllocator();
+ private:
+  // Frees the least recently cached memory until the cache holds no more
+  // than 'max_bytes_cached' bytes.  Must be called with mutex_ locked.
+  void FreeCachedMemory(size_t max_bytes_cached);
+
+  CpuAllocatorOptions opts_;
+
+  // The cached memory, as (size in bytes, pointer), with the least recently
+  // cached at the front.
+  typedef std::list<std::pair<size_t, void*> > ListType;
+  ListType list_;
+  // A map from size in bytes to the elements of list_ with that size, in
+  // the same order as they appear in list_.
+  unordered_map<size_t, std::deque<ListType::iterator> > map_;
+
+  // A map from the memory returned by Malloc() that has not been freed or
+  // disowned, to its size in bytes.
+  unordered_map<void*, size_t> used_;
+
+  size_t cur_bytes_used_;  // number of bytes in used_.
+  size_t max_bytes_used_;  // the max over all time, of cur_bytes_used_.
+  size_t cur_bytes_cached_;  // number of bytes in list_.
+  int64 num_user_allocations_;  // number of times user calls Malloc()
+  int64 num_system_allocations_;  // number of times we call KALDI_MEMALIGN.
+
+  mutable std::mutex mutex_;
+};
+
+
+}  // namespace
+
+#endif
@@ -34,6 +34,7 @@
 #include "cudamatrix/cu-common.h"
 #include "cudamatrix/cu-vector.h"
 #include "cudamatrix/cu-device.h"
+#include "cudamatrix/cu-cpu-allocator.h"
 #include "cudamatrix/cu-kernels.h"
 #include "cudamatrix/cu-array.h"
 #include "cudamatrix/cu-math.h"
@@ -81,11 +82,20 @@ void CuMatrix<Real>::Resize(MatrixIndexT rows, MatrixIndexT cols,
     CuDevice::Instantiate().AccuProfile("CuMatrix::Resize", tim);
   } else
 #endif
-  { // Let the initializer of Matrix<Real> handle the allocation,
-    // and then just do Swap which will switch the pointers.
-    // This wastes a few instructions but is simple to code.
-    Matrix<Real> mat(rows, cols, resize_type, stride_type);
-    this->Swap(&mat);
+  { // The memory may later be swapped with a Matrix<Real>, so we use the same
+    // layout that its initializer would use.  CpuMemoryAllocator caches the
+    // memory so that repeated allocations of the same size are cheap.
+    MatrixIndexT skip = ((16 / sizeof(Real)) - cols % (16 / sizeof(Real)))
+        % (16 / sizeof(Real)),
+        stride = (stride_type == kDefaultStride ? cols + skip : cols);
+    size_t bytes = static_cast<size_t>(rows) * static_cast<size_t>(stride) *
+        sizeof(Real);
+    this->data_ = static_cast<Real*>(
+        CpuMemoryAllocator::Instantiate().Malloc(bytes));
+    this->num_rows_ = rows;
+    this->num_cols_ = cols;
+    this->stride_ = stride;
+    if (resize_type == kSetZero) this->SetZero();
   }
 }
 
@@ -101,7 +111,12 @@ void CuMatrix<Real>::Destroy() {
   } else
 #endif
   {
-    if (this->data_ != NULL) KALDI_MEMALIGN_FREE(this->data_);
+    // If this memory came from a Matrix<Real> (via Swap()), it may be larger
+    // than this, but not smaller.
+    if (this->data_ != NULL)
+      CpuMemoryAllocator::Instantiate().Free(
+          this->data_, static_cast<size_t>(this->num_rows_) *
+          static_cast<size_t>(this->stride_) * sizeof(Real));
   }
   this->data_ = NULL;
   this->num_rows_ = 0;
@@ -149,6 +164,9 @@ void CuMatrix<Real>::Swap(Matrix<Real> *mat) {
   } else
 #endif
   {
+    // Our memory will be freed by 'mat', not given back to the allocator.
+    if (this->data_ != NULL)
+      CpuMemoryAllocator::Instantiate().Disown(this->data_);
     std::swap(mat->data_, this->data_);
     std::swap(mat->num_cols_, this->num_cols_);
     std::swap(mat->num_rows_, this->num_rows_);
@@ -69,6 +69,13 @@ class DecodableMatrixScaledMapped: public DecodableInterface {
     return scale_ * (*likes_)(frame, trans_model_.TransitionIdToPdf(tid));
   }
 
+  virtual bool FrameLogLikelihoods(int32 frame,
+                                   std::vector<BaseFloat> *loglikes) {
+    trans_model_.MapPdfLogLikelihoods(likes_->RowData(frame), scale_,
+                                      loglikes);
+    return true;
+  }
+
   // Indices are one-based!  This is for compatibility with OpenFst.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
 
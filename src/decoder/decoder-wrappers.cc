@@ -194,9 +194,12 @@ DecodeUtteranceLatticeFasterClass::~DecodeUtteranceLatticeFasterClass() {
 }
 
 
-// Takes care of output.  Returns true on success.
-bool DecodeUtteranceLatticeFaster(
-    LatticeFasterDecoder &decoder, // not const but is really an input.
+// Takes care of output.  Returns true on success.  This is templated so that
+// it can be used with LatticeFasterDecoder and LatticeBiglmFasterDecoder,
+// which have the same interface.
+template <class Decoder>
+static bool DecodeUtteranceLatticeFasterTpl(
+    Decoder &decoder, // not const but is really an input.
     DecodableInterface &decodable, // not const but is really an input.
     const TransitionModel &trans_model,
     const fst::SymbolTable *word_syms,
@@ -292,6 +295,46 @@ bool DecodeUtteranceLatticeFaster(
   return true;
 }
 
+bool DecodeUtteranceLatticeFaster(
+    LatticeFasterDecoder &decoder,
+    DecodableInterface &decodable,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr) {
+  return DecodeUtteranceLatticeFasterTpl(
+      decoder, decodable, trans_model, word_syms, utt, acoustic_scale,
+      determinize, allow_partial, alignment_writer, words_writer,
+      compact_lattice_writer, lattice_writer, like_ptr);
+}
+
+bool DecodeUtteranceLatticeFaster(
+    LatticeBiglmFasterDecoder &decoder,
+    DecodableInterface &decodable,
+    const TransitionModel &trans_model,
+    const fst::SymbolTable *word_syms,
+    std::string utt,
+    double acoustic_scale,
+    bool determinize,
+    bool allow_partial,
+    Int32VectorWriter *alignment_writer,
+    Int32VectorWriter *words_writer,
+    CompactLatticeWriter *compact_lattice_writer,
+    LatticeWriter *lattice_writer,
+    double *like_ptr) {
+  return DecodeUtteranceLatticeFasterTpl(
+      decoder, decodable, trans_model, word_syms, utt, acoustic_scale,
+      determinize, allow_partial, alignment_writer, words_writer,
+      compact_lattice_writer, lattice_writer, like_ptr);
+}
+
 // Takes care of output.  Returns true on success.
 bool DecodeUtteranceLatticeSimple(
     LatticeSimpleDecoder &decoder, // not const but is really an input.
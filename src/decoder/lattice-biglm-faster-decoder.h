@@ -43,6 +43,15 @@ typedef LatticeFasterDecoderConfig LatticeBiglmFasterDecoderConfig;
     DeterministicOnDemandFst follows through the epsilons in G for you
     (assuming G is a standard backoff language model) and makes it look
     like a determinized FST.
+
+    If HCLG is compiled with a small LM (e.g. a unigram or heavily pruned
+    one), its scores act as a look-ahead for the big LM, since graph
+    compilation pushes them towards the start of the words; this lets us
+    decode with LMs far too large to compile into HCLG, e.g. in const-arpa
+    format.  You can also give it HCL instead of HCLG, and the LM itself
+    instead of the difference; in that case HCL should first be given
+    look-ahead weights with fst::PushLookaheadWeights() (see
+    nnet3-latgen-biglm-faster).
 */
 
 class LatticeBiglmFasterDecoder {
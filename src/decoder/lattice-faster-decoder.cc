@@ -33,7 +33,8 @@ namespace kaldi {
 // instantiate this class once for each thing you have to decode.
 LatticeFasterDecoder::LatticeFasterDecoder(const fst::Fst<fst::StdArc> &fst,
                                            const LatticeFasterDecoderConfig &config):
-    fst_(fst), delete_fst_(false), config_(config), num_toks_(0) {
+    fst_(fst), delete_fst_(false), fst_kind_(GetFstKind(fst)),
+    config_(config), num_toks_(0) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -41,7 +42,8 @@ LatticeFasterDecoder::LatticeFasterDecoder(const fst::Fst<fst::StdArc> &fst,
 
 LatticeFasterDecoder::LatticeFasterDecoder(const LatticeFasterDecoderConfig &config,
                                            fst::Fst<fst::StdArc> *fst):
-    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0) {
+    fst_(*fst), delete_fst_(true), fst_kind_(GetFstKind(*fst)),
+    config_(config), num_toks_(0) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -65,7 +67,7 @@ void LatticeFasterDecoder::InitDecoding() {
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL);
+  Token *start_tok = token_pool_.New(Token(0.0, 0.0, NULL, NULL));
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -268,7 +270,7 @@ inline LatticeFasterDecoder::Token *LatticeFasterDecoder::FindOrAddToken(
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks);
+    Token *new_tok = token_pool_.New(Token(tot_cost, extra_cost, NULL, toks));
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -341,7 +343,7 @@ void LatticeFasterDecoder::PruneForwardLinks(
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -428,7 +430,7 @@ void LatticeFasterDecoder::PruneForwardLinksFinal() {
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -487,7 +489,7 @@ void LatticeFasterDecoder::PruneTokensForFrame(int32 frame_plus_one) {
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_pool_.Delete(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -709,7 +711,19 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
 
   BaseFloat cost_offset = 0.0; // Used to keep probabilities in a good
   // dynamic range.
-  const FstType &fst = dynamic_cast<const FstType&>(fst_);
+  // fst_kind_ was checked in the constructor, so the cast is safe.
+  const FstType &fst = static_cast<const FstType&>(fst_);
+
+  // If the decodable object can give us all the log-likelihoods for this
+  // frame at once, we look them up in frame_loglikes_ below rather than making
+  // a virtual-function call for each arc.
+  const BaseFloat *frame_loglikes = NULL;
+  if (final_toks != NULL &&
+      decodable->FrameLogLikelihoods(frame, &frame_loglikes_)) {
+    KALDI_ASSERT(frame_loglikes_.size() ==
+                 static_cast<size_t>(decodable->NumIndices()) + 1);
+    frame_loglikes = &(frame_loglikes_[0]);
+  }
 
   // First process the best token to get a hopefully
   // reasonably tight bound on the next cutoff.  The only
@@ -723,8 +737,11 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // propagate..
-        BaseFloat new_weight = arc.weight.Value() + cost_offset - 
-            decodable->LogLikelihood(frame, arc.ilabel) + tok->tot_cost;
+        BaseFloat loglike = (frame_loglikes != NULL ?
+                             frame_loglikes[arc.ilabel] :
+                             decodable->LogLikelihood(frame, arc.ilabel));
+        BaseFloat new_weight = arc.weight.Value() + cost_offset -
+            loglike + tok->tot_cost;
         if (new_weight + adaptive_beam < next_cutoff)
           next_cutoff = new_weight + adaptive_beam;
       }
@@ -750,8 +767,12 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
            aiter.Next()) {
         const Arc &arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
-          BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
+          KALDI_PARANOID_ASSERT(frame_loglikes == NULL ||
+                                arc.ilabel < frame_loglikes_.size());
+          BaseFloat loglike = (frame_loglikes != NULL ?
+                               frame_loglikes[arc.ilabel] :
+                               decodable->LogLikelihood(frame, arc.ilabel));
+          BaseFloat ac_cost = cost_offset - loglike,
               graph_cost = arc.weight.Value(),
               cur_cost = tok->tot_cost,
               tot_cost = cur_cost + ac_cost + graph_cost;
@@ -765,8 +786,9 @@ BaseFloat LatticeFasterDecoder::ProcessEmitting(DecodableInterface *decodable) {
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel,
-                                       graph_cost, ac_cost, tok->links);
+          tok->links = link_pool_.New(
+              ForwardLink(next_tok, arc.ilabel, arc.olabel,
+                          graph_cost, ac_cost, tok->links));
         }
       } // for all arcs
     }
@@ -784,12 +806,13 @@ template BaseFloat LatticeFasterDecoder::ProcessEmitting<fst::Fst<fst::StdArc>>(
         DecodableInterface *decodable);
 
 BaseFloat LatticeFasterDecoder::ProcessEmittingWrapper(DecodableInterface *decodable) {
-  if (fst_.Type() == "const") {
-    return LatticeFasterDecoder::ProcessEmitting<fst::ConstFst<Arc>>(decodable);
-  } else if (fst_.Type() == "vector") {
-    return LatticeFasterDecoder::ProcessEmitting<fst::VectorFst<Arc>>(decodable);
-  } else {
-    return LatticeFasterDecoder::ProcessEmitting<fst::Fst<Arc>>(decodable);
+  switch (fst_kind_) {
+    case kConstFst:
+      return ProcessEmitting<fst::ConstFst<Arc> >(decodable);
+    case kVectorFst:
+      return ProcessEmitting<fst::VectorFst<Arc> >(decodable);
+    default:
+      return ProcessEmitting<fst::Fst<Arc> >(decodable);
   }
 }
 
@@ -800,7 +823,8 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
   // Note: "frame" is the time-index we just processed, or -1 if
   // we are processing the nonemitting transitions before the
   // first frame (called from InitDecoding()).
-  const FstType &fst = dynamic_cast<const FstType&>(fst_);
+  // fst_kind_ was checked in the constructor, so the cast is safe.
+  const FstType &fst = static_cast<const FstType&>(fst_);
 
   // Processes nonemitting arcs for one frame.  Propagates within toks_.
   // Note-- this queue structure is is not very optimal as
@@ -830,7 +854,7 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
     // but since most states are emitting it's not a huge issue.
-    tok->DeleteForwardLinks(); // necessary when re-visiting
+    DeleteForwardLinks(tok); // necessary when re-visiting
     tok->links = NULL;
     for (fst::ArcIterator<FstType> aiter(fst, state);
          !aiter.Done();
@@ -845,8 +869,8 @@ void LatticeFasterDecoder::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           &changed);
 
-          tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                       graph_cost, 0, tok->links);
+          tok->links = link_pool_.New(
+              ForwardLink(new_tok, 0, arc.olabel, graph_cost, 0, tok->links));
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -865,15 +889,31 @@ template void LatticeFasterDecoder::ProcessNonemitting<fst::Fst<fst::StdArc>>(
         BaseFloat cutoff);
 
 void LatticeFasterDecoder::ProcessNonemittingWrapper(BaseFloat cost_cutoff) {
-  if (fst_.Type() == "const") {
-    return LatticeFasterDecoder::ProcessNonemitting<fst::ConstFst<Arc>>(cost_cutoff);
-  } else if (fst_.Type() == "vector") {
-    return LatticeFasterDecoder::ProcessNonemitting<fst::VectorFst<Arc>>(cost_cutoff);
-  } else {
-    return LatticeFasterDecoder::ProcessNonemitting<fst::Fst<Arc>>(cost_cutoff);
+  switch (fst_kind_) {
+    case kConstFst:
+      ProcessNonemitting<fst::ConstFst<Arc> >(cost_cutoff);
+      break;
+    case kVectorFst:
+      ProcessNonemitting<fst::VectorFst<Arc> >(cost_cutoff);
+      break;
+    default:
+      ProcessNonemitting<fst::Fst<Arc> >(cost_cutoff);
   }
 }
 
+LatticeFasterDecoder::FstKind LatticeFasterDecoder::GetFstKind(
+    const fst::Fst<fst::StdArc> &fst) {
+  // We test the dynamic type rather than fst.Type(), because e.g. a
+  // ConstFst with 64-bit offsets also reports its type as "const" but
+  // cannot be iterated as fst::ConstFst<fst::StdArc>.
+  if (dynamic_cast<const fst::ConstFst<Arc>*>(&fst) != NULL)
+    return kConstFst;
+  else if (dynamic_cast<const fst::VectorFst<Arc>*>(&fst) != NULL)
+    return kVectorFst;
+  else
+    return kOtherFst;
+}
+
 void LatticeFasterDecoder::DeleteElems(Elem *list) {
   for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
     e_tail = e->tail;
@@ -881,20 +921,30 @@ void LatticeFasterDecoder::DeleteElems(Elem *list) {
   }
 }
 
+void LatticeFasterDecoder::DeleteForwardLinks(Token *tok) {
+  ForwardLink *l = tok->links, *m;
+  while (l != NULL) {
+    m = l->next;
+    link_pool_.Delete(l);
+    l = m;
+  }
+  tok->links = NULL;
+}
+
 void LatticeFasterDecoder::ClearActiveTokens() { // a cleanup routine, at utt end/begin
-  for (size_t i = 0; i < active_toks_.size(); i++) {
-    // Delete all tokens alive on this frame, and any forward
-    // links they may have.
-    for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      tok->DeleteForwardLinks();
-      Token *next_tok = tok->next;
-      delete tok;
-      num_toks_--;
-      tok = next_tok;
-    }
+  // All the tokens and forward links are reachable from active_toks_, so
+  // instead of deleting them one by one we recycle all the memory at once.
+  KALDI_ASSERT(token_pool_.NumInUse() == static_cast<size_t>(num_toks_));
+  if (token_pool_.NumAllocations() > 0) {
+    KALDI_VLOG(2) << "Tokens: " << token_pool_.Info();
+    KALDI_VLOG(2) << "Forward links: " << link_pool_.Info();
   }
+  token_pool_.DeleteAll();
+  link_pool_.DeleteAll();
+  token_pool_.ResetStats();
+  link_pool_.ResetStats();
+  num_toks_ = 0;
   active_toks_.clear();
-  KALDI_ASSERT(num_toks_ == 0);
 }
 
 // static
@@ -30,6 +30,7 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/slab-allocator.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -244,15 +245,6 @@ class LatticeFasterDecoder {
     inline Token(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
                  Token *next):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next) { }
-    inline void DeleteForwardLinks() {
-      ForwardLink *l = links, *m;
-      while (l != NULL) {
-        m = l->next;
-        delete l;
-        l = m;
-      }
-      links = NULL;
-    }
   };
 
   // head of per-frame list of Tokens (list is in topological order),
@@ -353,6 +345,14 @@ class LatticeFasterDecoder {
 
   void ProcessNonemittingWrapper(BaseFloat cost_cutoff);
 
+  /// The FST types for which ProcessEmitting() and ProcessNonemitting() are
+  /// instantiated; anything else goes through the (virtual) fst::Fst interface.
+  enum FstKind { kConstFst, kVectorFst, kOtherFst };
+
+  /// Works out which specialization applies to "fst"; called once from the
+  /// constructor, so the per-frame dispatch in the wrappers is just a switch.
+  static FstKind GetFstKind(const fst::Fst<fst::StdArc> &fst);
+
   // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.  It is indexed by frame-index
@@ -362,14 +362,23 @@ class LatticeFasterDecoder {
   // the graph.
   HashList<StateId, Token*> toks_;
 
+  // Memory for the tokens and forward links is managed by these allocators,
+  // which avoid a call to new/delete for every token and link and let us
+  // recycle all of them at once in ClearActiveTokens().
+  SlabAllocator<Token> token_pool_;
+  SlabAllocator<ForwardLink> link_pool_;
+
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
   // make it class member to avoid internal new/delete.
+  std::vector<BaseFloat> frame_loglikes_;  // used in ProcessEmitting(), if
+  // the decodable object supports FrameLogLikelihoods().
   const fst::Fst<fst::StdArc> &fst_;
   bool delete_fst_;
+  FstKind fst_kind_;  // the concrete type of fst_; see GetFstKind().
   std::vector<BaseFloat> cost_offsets_; // This contains, for each
   // frame, an offset that was added to the acoustic log-likelihoods on that
   // frame in order to keep everything in a nice dynamic range i.e.  close to
@@ -414,6 +423,12 @@ class LatticeFasterDecoder {
   static void TopSortTokens(Token *tok_list,
                             std::vector<Token*> *topsorted_list);
 
+  // Deletes all the forward links of 'tok'.
+  inline void DeleteForwardLinks(Token *tok);
+
+  // Deletes all the tokens and forward links (a cleanup routine, at the
+  // beginning and end of the utterance), and if --verbose >= 2, prints
+  // statistics on the memory allocation for the utterance.
   void ClearActiveTokens();
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(LatticeFasterDecoder);
@@ -0,0 +1,223 @@
+// decoder/lattice-faster-online-decoder-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/lattice-faster-online-decoder.h"
+#include "decoder/decodable-matrix.h"
+#include "hmm/hmm-test-utils.h"
+#include "lat/lattice-functions.h"
+
+namespace kaldi {
+
+// Returns a random decoding graph whose input labels are transition-ids of
+// "trans_model" and whose output labels are the words 1 and 2 (or epsilon).
+// Every state has an emitting arc, so tokens survive to the end, and epsilon
+// arcs only go to higher-numbered states, so there are no epsilon cycles.
+static fst::VectorFst<fst::StdArc> *RandDecodingGraph(
+    const TransitionModel &trans_model) {
+  typedef fst::StdArc Arc;
+  typedef fst::TropicalWeight Weight;
+  fst::VectorFst<Arc> *graph = new fst::VectorFst<Arc>();
+  int32 num_states = RandInt(2, 6),
+      num_tids = trans_model.NumTransitionIds();
+  for (int32 s = 0; s < num_states; s++)
+    graph->AddState();
+  graph->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 num_arcs = RandInt(1, 3);
+    for (int32 i = 0; i < num_arcs; i++) {
+      int32 word = (RandInt(0, 9) == 0 ? RandInt(1, 2) : 0);
+      graph->AddArc(s, Arc(RandInt(1, num_tids), word,
+                           Weight(2.0 * RandUniform()),
+                           RandInt(0, num_states - 1)));
+    }
+    if (s + 1 < num_states && RandInt(0, 3) == 0)
+      graph->AddArc(s, Arc(0, RandInt(0, 2), Weight(RandUniform()),
+                           RandInt(s + 1, num_states - 1)));
+    if (RandInt(0, 2) == 0)
+      graph->SetFinal(s, Weight(RandUniform()));
+  }
+  return graph;
+}
+
+// Outputs the word sequence and the weight of the best path in "clat".
+static void GetBestPath(const CompactLattice &clat,
+                        std::vector<int32> *words,
+                        LatticeWeight *weight) {
+  CompactLattice best_path_clat;
+  CompactLatticeShortestPath(clat, &best_path_clat);
+  Lattice best_path;
+  ConvertLattice(best_path_clat, &best_path);
+  std::vector<int32> alignment;
+  KALDI_ASSERT(fst::GetLinearSymbolSequence(best_path, &alignment, words,
+                                            weight));
+}
+
+// This checks that GetLatticeIncremental() gives the same result as
+// determinizing the whole raw lattice, at random points while decoding and
+// after FinalizeDecoding().  If "prune" is false, the beams are so wide that
+// nothing is pruned, so the results must be equivalent; otherwise it checks
+// that the best paths are the same.
+void TestGetLatticeIncremental(bool prune) {
+  ContextDependency *ctx_dep = NULL;
+  TransitionModel *trans_model = GenRandTransitionModel(&ctx_dep);
+  fst::VectorFst<fst::StdArc> *graph = RandDecodingGraph(*trans_model);
+  int32 num_frames = RandInt(5, 30);
+  Matrix<BaseFloat> loglikes(num_frames, trans_model->NumPdfs());
+  loglikes.SetRandn();
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes, 1.0);
+
+  LatticeFasterDecoderConfig config;
+  if (prune) {
+    config.beam = 8.0;
+    config.lattice_beam = 4.0;
+    config.prune_interval = RandInt(1, 10);
+  } else {
+    config.beam = 1000.0;
+    config.lattice_beam = 1000.0;
+  }
+  IncrementalDeterminizeConfig incremental_config;
+  incremental_config.determinize_period = RandInt(1, 8);
+  incremental_config.determinize_delay = RandInt(0, 8);
+
+  LatticeFasterOnlineDecoder decoder(*graph, config);
+  decoder.InitDecoding();
+  while (decoder.NumFramesDecoded() < num_frames) {
+    decoder.AdvanceDecoding(&decodable, RandInt(1, 8));
+    bool finalized = (decoder.NumFramesDecoded() == num_frames &&
+                      RandInt(0, 1) == 0);
+    if (finalized)
+      decoder.FinalizeDecoding();
+    bool use_final_probs = (finalized || RandInt(0, 1) == 0);
+
+    Lattice raw_lat;
+    KALDI_ASSERT(decoder.GetRawLattice(&raw_lat, use_final_probs));
+    CompactLattice full_clat;
+    DeterminizeLatticePhonePrunedWrapper(*trans_model, &raw_lat,
+                                         config.lattice_beam, &full_clat,
+                                         config.det_opts);
+    CompactLattice clat;
+    bool ans = decoder.GetLatticeIncremental(*trans_model, incremental_config,
+                                             use_final_probs, &clat);
+    KALDI_ASSERT(ans == (full_clat.Start() != fst::kNoStateId));
+    if (!ans)
+      continue;
+
+    if (!prune)
+      KALDI_ASSERT(fst::RandEquivalent(clat, full_clat, 5, 0.01, Rand(), 100));
+    std::vector<int32> words, full_words;
+    LatticeWeight weight, full_weight;
+    GetBestPath(clat, &words, &weight);
+    GetBestPath(full_clat, &full_words, &full_weight);
+    KALDI_ASSERT(words == full_words &&
+                 ApproxEqual(weight, full_weight, 0.01));
+
+    // Asking again must give the same lattice (this removes the chunk for
+    // the last frames and determinizes it again).
+    CompactLattice clat2;
+    decoder.GetLatticeIncremental(*trans_model, incremental_config,
+                                  use_final_probs, &clat2);
+    KALDI_ASSERT(fst::Equal(clat, clat2));
+    if (finalized)
+      break;
+  }
+  delete graph;
+  delete trans_model;
+  delete ctx_dep;
+}
+
+// Forwards LogLikelihood() to another decodable object but does not override
+// FrameLogLikelihoods(), so the decoders fall back to one call per arc.
+class PerArcDecodable: public DecodableInterface {
+ public:
+  explicit PerArcDecodable(DecodableInterface *decodable):
+      decodable_(decodable) { }
+  virtual BaseFloat LogLikelihood(int32 frame, int32 index) {
+    return decodable_->LogLikelihood(frame, index);
+  }
+  virtual bool IsLastFrame(int32 frame) const {
+    return decodable_->IsLastFrame(frame);
+  }
+  virtual int32 NumFramesReady() const {
+    return decodable_->NumFramesReady();
+  }
+  virtual int32 NumIndices() const { return decodable_->NumIndices(); }
+ private:
+  DecodableInterface *decodable_;
+};
+
+// This checks that FrameLogLikelihoods() agrees with LogLikelihood(), and that
+// the decoders give the same lattices whether or not the decodable object
+// supports FrameLogLikelihoods().
+void TestFrameLogLikelihoods() {
+  ContextDependency *ctx_dep = NULL;
+  TransitionModel *trans_model = GenRandTransitionModel(&ctx_dep);
+  fst::VectorFst<fst::StdArc> *graph = RandDecodingGraph(*trans_model);
+  int32 num_frames = RandInt(1, 20);
+  Matrix<BaseFloat> loglikes(num_frames, trans_model->NumPdfs());
+  loglikes.SetRandn();
+  DecodableMatrixScaledMapped decodable(*trans_model, loglikes,
+                                        RandUniform() + 0.5);
+  PerArcDecodable per_arc_decodable(&decodable);
+
+  for (int32 t = 0; t < num_frames; t++) {
+    std::vector<BaseFloat> frame_loglikes;
+    KALDI_ASSERT(decodable.FrameLogLikelihoods(t, &frame_loglikes) &&
+                 frame_loglikes.size() == decodable.NumIndices() + 1);
+    for (int32 i = 1; i <= decodable.NumIndices(); i++)
+      KALDI_ASSERT(frame_loglikes[i] == decodable.LogLikelihood(t, i));
+    KALDI_ASSERT(!per_arc_decodable.FrameLogLikelihoods(t, &frame_loglikes));
+  }
+
+  LatticeFasterDecoderConfig config;
+  config.beam = 8.0;
+  config.lattice_beam = 4.0;
+  {
+    LatticeFasterDecoder decoder1(*graph, config), decoder2(*graph, config);
+    decoder1.Decode(&decodable);
+    decoder2.Decode(&per_arc_decodable);
+    Lattice lat1, lat2;
+    bool ans1 = decoder1.GetRawLattice(&lat1),
+        ans2 = decoder2.GetRawLattice(&lat2);
+    KALDI_ASSERT(ans1 == ans2 && fst::Equal(lat1, lat2));
+  }
+  {
+    LatticeFasterOnlineDecoder decoder1(*graph, config),
+        decoder2(*graph, config);
+    decoder1.Decode(&decodable);
+    decoder2.Decode(&per_arc_decodable);
+    Lattice lat1, lat2;
+    bool ans1 = decoder1.GetRawLattice(&lat1, true),
+        ans2 = decoder2.GetRawLattice(&lat2, true);
+    KALDI_ASSERT(ans1 == ans2 && fst::Equal(lat1, lat2));
+  }
+  delete graph;
+  delete trans_model;
+  delete ctx_dep;
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++) {
+    TestGetLatticeIncremental(false);
+    TestGetLatticeIncremental(true);
+    TestFrameLogLikelihoods();
+  }
+  KALDI_LOG << "Success.";
+}
@@ -33,7 +33,9 @@ namespace kaldi {
 LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(
     const fst::Fst<fst::StdArc> &fst,
     const LatticeFasterDecoderConfig &config):
-    fst_(fst), delete_fst_(false), config_(config), num_toks_(0) {
+    fst_(fst), delete_fst_(false), fst_kind_(GetFstKind(fst)),
+    config_(config), num_toks_(0), determinized_frame_(0),
+    num_determinized_states_(0) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -41,7 +43,9 @@ LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(
 
 LatticeFasterOnlineDecoder::LatticeFasterOnlineDecoder(const LatticeFasterDecoderConfig &config,
                                                        fst::Fst<fst::StdArc> *fst):
-    fst_(*fst), delete_fst_(true), config_(config), num_toks_(0) {
+    fst_(*fst), delete_fst_(true), fst_kind_(GetFstKind(*fst)),
+    config_(config), num_toks_(0), determinized_frame_(0),
+    num_determinized_states_(0) {
   config.Check();
   toks_.SetSize(1000);  // just so on the first frame we do something reasonable.
 }
@@ -62,10 +66,16 @@ void LatticeFasterOnlineDecoder::InitDecoding() {
   num_toks_ = 0;
   decoding_finalized_ = false;
   final_costs_.clear();
+  determinized_lat_.DeleteStates();
+  determinized_frame_ = 0;
+  num_determinized_states_ = 0;
+  boundary_arcs_.clear();
+  boundary_token_labels_.clear();
+  last_chunk_joins_.clear();
   StateId start_state = fst_.Start();
   KALDI_ASSERT(start_state != fst::kNoStateId);
   active_toks_.resize(1);
-  Token *start_tok = new Token(0.0, 0.0, NULL, NULL, NULL);
+  Token *start_tok = token_pool_.New(Token(0.0, 0.0, NULL, NULL, NULL));
   active_toks_[0].toks = start_tok;
   toks_.Insert(start_state, start_tok);
   num_toks_++;
@@ -326,6 +336,391 @@ bool LatticeFasterOnlineDecoder::GetRawLatticePruned(
 }
 
 
+bool LatticeFasterOnlineDecoder::GetRawLatticeChunk(
+    int32 begin_frame, int32 end_frame, bool use_final_probs,
+    const unordered_map<Token*, BaseFloat> &backward_costs, Lattice *ofst,
+    std::vector<BaseFloat> *start_costs,
+    unordered_map<Token*, int32> *end_token_labels,
+    std::vector<BaseFloat> *end_costs) const {
+  typedef LatticeArc Arc;
+  typedef Arc::StateId StateId;
+  typedef Arc::Weight Weight;
+
+  int32 num_frames = NumFramesDecoded();
+  KALDI_ASSERT(begin_frame >= 0 && begin_frame < end_frame &&
+               end_frame <= num_frames);
+  bool is_last = (end_frame == num_frames);
+
+  unordered_map<Token*, BaseFloat> final_costs_local;
+  const unordered_map<Token*, BaseFloat> &final_costs =
+      (decoding_finalized_ ? final_costs_ : final_costs_local);
+  if (is_last && !decoding_finalized_ && use_final_probs)
+    ComputeFinalCosts(&final_costs_local, NULL, NULL);
+
+  ofst->DeleteStates();
+  start_costs->clear();
+  end_token_labels->clear();
+  end_costs->clear();
+
+  // If this is not the first chunk, state zero is a new start state with arcs
+  // to the tokens on begin_frame; otherwise, as in GetRawLattice(), it will be
+  // the state for the start token.
+  if (begin_frame > 0) {
+    ofst->AddState();
+    ofst->SetStart(0);
+  }
+  unordered_map<Token*, StateId> tok_map;
+  std::vector<Token*> token_list;
+  for (int32 f = begin_frame; f <= end_frame; f++) {
+    if (active_toks_[f].toks == NULL) {
+      KALDI_WARN << "GetRawLatticeChunk: no tokens active on frame " << f
+                 << ": not producing lattice.\n";
+      return false;
+    }
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (size_t i = 0; i < token_list.size(); i++)
+      if (token_list[i] != NULL)
+        tok_map[token_list[i]] = ofst->AddState();
+  }
+  if (begin_frame == 0)
+    ofst->SetStart(0);
+
+  if (begin_frame > 0) {
+    start_costs->resize(boundary_token_labels_.size(),
+                        std::numeric_limits<BaseFloat>::infinity());
+    for (Token *tok = active_toks_[begin_frame].toks; tok != NULL;
+         tok = tok->next) {
+      unordered_map<Token*, int32>::const_iterator iter =
+          boundary_token_labels_.find(tok);
+      KALDI_ASSERT(iter != boundary_token_labels_.end());
+      int32 label = iter->second;
+      (*start_costs)[label] = tok->tot_cost;
+      ofst->AddArc(0, Arc(0, kTokenLabelOffset + label,
+                          Weight(tok->tot_cost, 0.0), tok_map[tok]));
+    }
+  }
+
+  StateId final_state = fst::kNoStateId;
+  if (!is_last) {
+    final_state = ofst->AddState();
+    ofst->SetFinal(final_state, Weight::One());
+  }
+  int32 last_frame_with_links = (is_last ? end_frame : end_frame - 1);
+  for (int32 f = begin_frame; f <= end_frame; f++) {
+    for (Token *tok = active_toks_[f].toks; tok != NULL; tok = tok->next) {
+      StateId cur_state = tok_map[tok];
+      if (f <= last_frame_with_links) {
+        for (ForwardLink *l = tok->links; l != NULL; l = l->next) {
+          unordered_map<Token*, StateId>::const_iterator iter =
+              tok_map.find(l->next_tok);
+          KALDI_ASSERT(iter != tok_map.end());
+          BaseFloat cost_offset = 0.0;
+          if (l->ilabel != 0) {  // emitting..
+            KALDI_ASSERT(f >= 0 && f < cost_offsets_.size());
+            cost_offset = cost_offsets_[f];
+          }
+          Arc arc(l->ilabel, l->olabel,
+                  Weight(l->graph_cost, l->acoustic_cost - cost_offset),
+                  iter->second);
+          ofst->AddArc(cur_state, arc);
+        }
+      }
+      if (f == end_frame) {
+        if (!is_last) {
+          int32 label = end_costs->size();
+          unordered_map<Token*, BaseFloat>::const_iterator iter =
+              backward_costs.find(tok);
+          KALDI_ASSERT(iter != backward_costs.end());
+          BaseFloat backward_cost = iter->second;
+          (*end_token_labels)[tok] = label;
+          end_costs->push_back(backward_cost);
+          ofst->AddArc(cur_state, Arc(0, kTokenLabelOffset + label,
+                                      Weight(backward_cost, 0.0),
+                                      final_state));
+        } else if (use_final_probs && !final_costs.empty()) {
+          unordered_map<Token*, BaseFloat>::const_iterator iter =
+              final_costs.find(tok);
+          if (iter != final_costs.end())
+            ofst->SetFinal(cur_state, LatticeWeight(iter->second, 0));
+        } else {
+          ofst->SetFinal(cur_state, LatticeWeight::One());
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void LatticeFasterOnlineDecoder::ComputeBackwardCosts(
+    int32 frame, unordered_map<Token*, BaseFloat> *backward_costs) const {
+  int32 num_frames = NumFramesDecoded();
+  KALDI_ASSERT(frame >= 0 && frame <= num_frames);
+  const BaseFloat infinity = std::numeric_limits<BaseFloat>::infinity();
+  backward_costs->clear();
+  std::vector<Token*> token_list;
+  for (int32 f = num_frames; f >= frame; f--) {
+    // Going through the tokens in reverse topological order means that the
+    // tokens that epsilon links within the frame go to have been done already.
+    TopSortTokens(active_toks_[f].toks, &token_list);
+    for (size_t i = token_list.size(); i-- > 0; ) {
+      Token *tok = token_list[i];
+      if (tok == NULL) continue;
+      BaseFloat cost = infinity;
+      if (f == num_frames) {
+        if (!decoding_finalized_) {
+          cost = -tok->tot_cost;
+        } else if (final_costs_.empty()) {
+          cost = 0.0;
+        } else {
+          unordered_map<Token*, BaseFloat>::const_iterator iter =
+              final_costs_.find(tok);
+          if (iter != final_costs_.end())
+            cost = iter->second;
+        }
+      }
+      for (ForwardLink *l = tok->links; l != NULL; l = l->next) {
+        unordered_map<Token*, BaseFloat>::const_iterator iter =
+            backward_costs->find(l->next_tok);
+        KALDI_ASSERT(iter != backward_costs->end());
+        cost = std::min(cost, l->graph_cost + l->acoustic_cost + iter->second);
+      }
+      (*backward_costs)[tok] = cost;
+    }
+  }
+}
+
+// Adds "cost" to the graph part of the weight "w".
+static inline CompactLatticeWeight AddGraphCost(const CompactLatticeWeight &w,
+                                                BaseFloat cost) {
+  return CompactLatticeWeight(LatticeWeight(w.Weight().Value1() + cost,
+                                            w.Weight().Value2()),
+                              w.String());
+}
+
+bool LatticeFasterOnlineDecoder::AppendDeterminizedChunk(
+    const CompactLattice &chunk,
+    const std::vector<BaseFloat> &start_costs,
+    const std::vector<BaseFloat> &end_costs,
+    const std::vector<BoundaryArc> &boundary_arcs,
+    bool is_first, bool is_last,
+    CompactLattice *lat,
+    std::vector<BoundaryArc> *new_boundary_arcs,
+    std::vector<std::pair<CompactLatticeArc::StateId, size_t> >
+        *joined_states) {
+  typedef CompactLatticeArc Arc;
+  typedef Arc::StateId StateId;
+
+  StateId chunk_start = chunk.Start();
+  if (chunk_start == fst::kNoStateId)
+    return false;  // Nothing survived determinization.
+
+  // Work out which states of "chunk" can be reached from the states we start
+  // from: its start state if this is the first chunk, and otherwise the
+  // destinations of the arcs from its start state whose tokens have boundary
+  // arcs.  Only those are copied.  The start state itself is not copied
+  // unless this is the first chunk, because it is replaced by the joining
+  // arcs; and unless this is the last chunk, the final states are not copied
+  // either because they are only reached by arcs with token labels.
+  StateId num_states = chunk.NumStates();
+  std::vector<StateId> state_map(num_states, fst::kNoStateId);
+  std::vector<StateId> queue;
+  std::vector<StateId> joined_state(start_costs.size(), fst::kNoStateId);
+  std::vector<CompactLatticeWeight> joined_weight(start_costs.size());
+  if (is_first) {
+    queue.push_back(chunk_start);
+  } else {
+    std::vector<bool> has_boundary_arc(start_costs.size(), false);
+    for (size_t i = 0; i < boundary_arcs.size(); i++) {
+      int32 label = boundary_arcs[i].token_label;
+      KALDI_ASSERT(label >= 0 &&
+                   label < static_cast<int32>(start_costs.size()));
+      has_boundary_arc[label] = true;
+    }
+    for (fst::ArcIterator<CompactLattice> aiter(chunk, chunk_start);
+         !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      int32 label = arc.ilabel - kTokenLabelOffset;
+      KALDI_ASSERT(label >= 0 &&
+                   label < static_cast<int32>(start_costs.size()));
+      // If there is no boundary arc the token's paths were pruned in
+      // determinization of the previous chunk.
+      if (!has_boundary_arc[label])
+        continue;
+      queue.push_back(arc.nextstate);
+      joined_state[label] = arc.nextstate;
+      joined_weight[label] = AddGraphCost(arc.weight, -start_costs[label]);
+    }
+  }
+  for (size_t i = 0; i < queue.size(); i++) {
+    StateId s = queue[i];
+    if (state_map[s] != fst::kNoStateId ||
+        (!is_last && chunk.Final(s) != CompactLatticeWeight::Zero()))
+      continue;
+    state_map[s] = lat->AddState();
+    for (fst::ArcIterator<CompactLattice> aiter(chunk, s);
+         !aiter.Done(); aiter.Next())
+      queue.push_back(aiter.Value().nextstate);
+  }
+
+  if (is_first) {
+    lat->SetStart(state_map[chunk_start]);
+  } else {
+    // Join the boundary arcs to the destinations of the arcs from the start
+    // state of "chunk" that have the same token label.
+    for (size_t i = 0; i < boundary_arcs.size(); i++) {
+      const BoundaryArc &b = boundary_arcs[i];
+      StateId joined = joined_state[b.token_label];
+      // If joined_state is kNoStateId the token was pruned since the
+      // boundary arc was created, or its paths were pruned in
+      // determinization.
+      if (joined == fst::kNoStateId)
+        continue;
+      if (joined_states != NULL)
+        joined_states->push_back(std::make_pair(b.state,
+                                                lat->NumArcs(b.state)));
+      lat->AddArc(b.state, Arc(0, 0,
+                               Times(b.weight, joined_weight[b.token_label]),
+                               state_map[joined]));
+    }
+  }
+
+  if (!is_last)
+    new_boundary_arcs->clear();
+  for (StateId s = 0; s < num_states; s++) {
+    StateId lat_state = state_map[s];
+    if (lat_state == fst::kNoStateId) continue;
+    for (fst::ArcIterator<CompactLattice> aiter(chunk, s);
+         !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.ilabel >= kTokenLabelOffset) {
+        KALDI_ASSERT(!is_last);
+        BoundaryArc b;
+        b.state = lat_state;
+        b.token_label = arc.ilabel - kTokenLabelOffset;
+        KALDI_ASSERT(b.token_label < static_cast<int32>(end_costs.size()));
+        b.weight = AddGraphCost(Times(arc.weight, chunk.Final(arc.nextstate)),
+                                -end_costs[b.token_label]);
+        new_boundary_arcs->push_back(b);
+      } else {
+        KALDI_ASSERT(state_map[arc.nextstate] != fst::kNoStateId);
+        lat->AddArc(lat_state, Arc(arc.ilabel, arc.olabel, arc.weight,
+                                   state_map[arc.nextstate]));
+      }
+    }
+    if (is_last)
+      lat->SetFinal(lat_state, chunk.Final(s));
+  }
+  return true;
+}
+
+void LatticeFasterOnlineDecoder::RemoveLastChunk() {
+  typedef CompactLatticeArc::StateId StateId;
+  // Going backwards, so that if a state had more than one joining arc, the
+  // last number of arcs we restore is the one from before the first of them.
+  for (size_t i = last_chunk_joins_.size(); i-- > 0; ) {
+    StateId s = last_chunk_joins_[i].first;
+    determinized_lat_.DeleteArcs(
+        s, determinized_lat_.NumArcs(s) - last_chunk_joins_[i].second);
+  }
+  last_chunk_joins_.clear();
+  StateId num_states = determinized_lat_.NumStates();
+  if (num_determinized_states_ == 0) {
+    determinized_lat_.DeleteStates();
+  } else if (num_states > num_determinized_states_) {
+    // This keeps the numbering of the states before them.
+    std::vector<StateId> states;
+    for (StateId s = num_determinized_states_; s < num_states; s++)
+      states.push_back(s);
+    determinized_lat_.DeleteStates(states);
+  }
+}
+
+bool LatticeFasterOnlineDecoder::GetLatticeIncremental(
+    const TransitionModel &trans_model,
+    const IncrementalDeterminizeConfig &config,
+    bool use_final_probs,
+    CompactLattice *ofst) {
+  if (decoding_finalized_ && !use_final_probs)
+    KALDI_ERR << "You cannot call FinalizeDecoding() and then call "
+              << "GetLatticeIncremental() with use_final_probs == false";
+  config.Check();
+  int32 num_frames = NumFramesDecoded();
+  KALDI_ASSERT(num_frames > 0);
+
+  // If "ofst" shares its memory with determinized_lat_ (e.g. it is the output
+  // of the last call), this lets us modify determinized_lat_ without copying
+  // it.
+  *ofst = CompactLattice();
+  RemoveLastChunk();
+
+  Lattice raw_chunk;
+  CompactLattice chunk;
+  std::vector<BaseFloat> start_costs, end_costs;
+  unordered_map<Token*, int32> end_token_labels;
+  std::vector<BoundaryArc> new_boundary_arcs;
+
+  // First determinize any whole chunks that are far enough behind the most
+  // recently decoded frame; these are kept in determinized_lat_.  We always
+  // leave at least one frame for the last chunk.  The backward costs are
+  // worked out once, for all of those chunks.
+  int32 max_end_frame = std::min(num_frames - config.determinize_delay,
+                                 num_frames - 1);
+  unordered_map<Token*, BaseFloat> backward_costs;
+  if (determinized_frame_ + config.determinize_period <= max_end_frame)
+    ComputeBackwardCosts(determinized_frame_ + config.determinize_period,
+                         &backward_costs);
+  while (determinized_frame_ + config.determinize_period <= max_end_frame) {
+    if (determinized_frame_ > 0 && num_determinized_states_ == 0)
+      break;  // nothing survived; no point going on.
+    int32 end_frame = determinized_frame_ + config.determinize_period;
+    if (!GetRawLatticeChunk(determinized_frame_, end_frame, use_final_probs,
+                            backward_costs, &raw_chunk, &start_costs,
+                            &end_token_labels, &end_costs))
+      return false;
+    if (!DeterminizeLatticePhonePrunedWrapper(trans_model, &raw_chunk,
+                                              config_.lattice_beam, &chunk,
+                                              config_.det_opts))
+      KALDI_WARN << "Determinization finished earlier than the beam for "
+                 << "frames " << determinized_frame_ << " to " << end_frame;
+    if (AppendDeterminizedChunk(chunk, start_costs, end_costs, boundary_arcs_,
+                                determinized_frame_ == 0, false,
+                                &determinized_lat_, &new_boundary_arcs,
+                                NULL)) {
+      boundary_arcs_.swap(new_boundary_arcs);
+    } else {
+      determinized_lat_.DeleteStates();
+      boundary_arcs_.clear();
+    }
+    num_determinized_states_ = determinized_lat_.NumStates();
+    boundary_token_labels_.swap(end_token_labels);
+    determinized_frame_ = end_frame;
+  }
+  if (determinized_frame_ > 0 && num_determinized_states_ == 0)
+    return false;
+
+  // Now determinize the remaining frames and append them to determinized_lat_;
+  // the next call will remove them again.
+  if (!GetRawLatticeChunk(determinized_frame_, num_frames, use_final_probs,
+                          backward_costs, &raw_chunk, &start_costs,
+                          &end_token_labels, &end_costs))
+    return false;
+  if (!DeterminizeLatticePhonePrunedWrapper(trans_model, &raw_chunk,
+                                            config_.lattice_beam, &chunk,
+                                            config_.det_opts))
+    KALDI_WARN << "Determinization finished earlier than the beam for "
+               << "frames " << determinized_frame_ << " to " << num_frames;
+  if (!AppendDeterminizedChunk(chunk, start_costs, end_costs, boundary_arcs_,
+                               determinized_frame_ == 0, true,
+                               &determinized_lat_, NULL, &last_chunk_joins_))
+    return false;
+  *ofst = determinized_lat_;
+  // Once decoding is finalized the output is cleaned up (see the comment in
+  // the header).  This copies it, but only at the end of the utterance.
+  if (decoding_finalized_)
+    Connect(ofst);
+  return (ofst->NumStates() > 0);
+}
+
 void LatticeFasterOnlineDecoder::PossiblyResizeHash(size_t num_toks) {
   size_t new_sz = static_cast<size_t>(static_cast<BaseFloat>(num_toks)
                                       * config_.hash_ratio);
@@ -352,7 +747,8 @@ inline LatticeFasterOnlineDecoder::Token *LatticeFasterOnlineDecoder::FindOrAddT
     // tokens on the currently final frame have zero extra_cost
     // as any of them could end up
     // on the winning path.
-    Token *new_tok = new Token (tot_cost, extra_cost, NULL, toks, backpointer);
+    Token *new_tok = token_pool_.New(
+        Token(tot_cost, extra_cost, NULL, toks, backpointer));
     // NULL: no forward links yet
     toks = new_tok;
     num_toks_++;
@@ -426,7 +822,7 @@ void LatticeFasterOnlineDecoder::PruneForwardLinks(
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link;  // advance link but leave prev_link the same.
           *links_pruned = true;
         } else {   // keep the link and update the tok_extra_cost if needed.
@@ -513,7 +909,7 @@ void LatticeFasterOnlineDecoder::PruneForwardLinksFinal() {
           ForwardLink *next_link = link->next;
           if (prev_link != NULL) prev_link->next = next_link;
           else tok->links = next_link;
-          delete link;
+          link_pool_.Delete(link);
           link = next_link; // advance link but leave prev_link the same.
         } else { // keep the link and update the tok_extra_cost if needed.
           if (link_extra_cost < 0.0) { // this is just a precaution.
@@ -573,7 +969,7 @@ void LatticeFasterOnlineDecoder::PruneTokensForFrame(int32 frame_plus_one) {
       // excise tok from list and delete tok.
       if (prev_tok != NULL) prev_tok->next = tok->next;
       else toks = tok->next;
-      delete tok;
+      token_pool_.Delete(tok);
       num_toks_--;
     } else {  // fetch next Token
       prev_tok = tok;
@@ -885,7 +1281,19 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
 
   BaseFloat cost_offset = 0.0; // Used to keep probabilities in a good
   // dynamic range.
-  const FstType &fst = dynamic_cast<const FstType&>(fst_);
+  // fst_kind_ was checked in the constructor, so the cast is safe.
+  const FstType &fst = static_cast<const FstType&>(fst_);
+
+  // If the decodable object can give us all the log-likelihoods for this
+  // frame at once, we look them up in frame_loglikes_ below rather than making
+  // a virtual-function call for each arc.
+  const BaseFloat *frame_loglikes = NULL;
+  if (final_toks != NULL &&
+      decodable->FrameLogLikelihoods(frame, &frame_loglikes_)) {
+    KALDI_ASSERT(frame_loglikes_.size() ==
+                 static_cast<size_t>(decodable->NumIndices()) + 1);
+    frame_loglikes = &(frame_loglikes_[0]);
+  }
 
   // First process the best token to get a hopefully
   // reasonably tight bound on the next cutoff.  The only
@@ -899,8 +1307,11 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
          aiter.Next()) {
       const Arc &arc = aiter.Value();
       if (arc.ilabel != 0) {  // propagate..
-        BaseFloat new_weight = arc.weight.Value() + cost_offset - 
-            decodable->LogLikelihood(frame, arc.ilabel) + tok->tot_cost;
+        BaseFloat loglike = (frame_loglikes != NULL ?
+                             frame_loglikes[arc.ilabel] :
+                             decodable->LogLikelihood(frame, arc.ilabel));
+        BaseFloat new_weight = arc.weight.Value() + cost_offset -
+            loglike + tok->tot_cost;
         if (new_weight + adaptive_beam < next_cutoff)
           next_cutoff = new_weight + adaptive_beam;
       }
@@ -926,8 +1337,12 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
            aiter.Next()) {
         const Arc &arc = aiter.Value();
         if (arc.ilabel != 0) {  // propagate..
-          BaseFloat ac_cost = cost_offset -
-              decodable->LogLikelihood(frame, arc.ilabel),
+          KALDI_PARANOID_ASSERT(frame_loglikes == NULL ||
+                                arc.ilabel < frame_loglikes_.size());
+          BaseFloat loglike = (frame_loglikes != NULL ?
+                               frame_loglikes[arc.ilabel] :
+                               decodable->LogLikelihood(frame, arc.ilabel));
+          BaseFloat ac_cost = cost_offset - loglike,
               graph_cost = arc.weight.Value(),
               cur_cost = tok->tot_cost,
               tot_cost = cur_cost + ac_cost + graph_cost;
@@ -941,8 +1356,9 @@ BaseFloat LatticeFasterOnlineDecoder::ProcessEmitting(
           // NULL: no change indicator needed
 
           // Add ForwardLink from tok to next_tok (put on head of list tok->links)
-          tok->links = new ForwardLink(next_tok, arc.ilabel, arc.olabel,
-                                       graph_cost, ac_cost, tok->links);
+          tok->links = link_pool_.New(
+              ForwardLink(next_tok, arc.ilabel, arc.olabel,
+                          graph_cost, ac_cost, tok->links));
         }
       } // for all arcs
     }
@@ -961,15 +1377,13 @@ template BaseFloat LatticeFasterOnlineDecoder::
 
 BaseFloat LatticeFasterOnlineDecoder::ProcessEmittingWrapper(
         DecodableInterface *decodable) {
-  if (fst_.Type() == "const") {
-    return LatticeFasterOnlineDecoder::
-        ProcessEmitting<fst::ConstFst<Arc>>(decodable);
-  } else if (fst_.Type() == "vector") {
-    return LatticeFasterOnlineDecoder::
-        ProcessEmitting<fst::VectorFst<Arc>>(decodable);
-  } else {
-    return LatticeFasterOnlineDecoder::
-        ProcessEmitting<fst::Fst<Arc>>(decodable);
+  switch (fst_kind_) {
+    case kConstFst:
+      return ProcessEmitting<fst::ConstFst<Arc> >(decodable);
+    case kVectorFst:
+      return ProcessEmitting<fst::VectorFst<Arc> >(decodable);
+    default:
+      return ProcessEmitting<fst::Fst<Arc> >(decodable);
   }
 }
 
@@ -980,7 +1394,8 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
   // Note: "frame" is the time-index we just processed, or -1 if
   // we are processing the nonemitting transitions before the
   // first frame (called from InitDecoding()).
-  const FstType &fst = dynamic_cast<const FstType&>(fst_);
+  // fst_kind_ was checked in the constructor, so the cast is safe.
+  const FstType &fst = static_cast<const FstType&>(fst_);
 
   // Processes nonemitting arcs for one frame.  Propagates within toks_.
   // Note-- this queue structure is is not very optimal as
@@ -1010,7 +1425,7 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
     // because we're about to regenerate them.  This is a kind
     // of non-optimality (remember, this is the simple decoder),
     // but since most states are emitting it's not a huge issue.
-    tok->DeleteForwardLinks(); // necessary when re-visiting
+    DeleteForwardLinks(tok); // necessary when re-visiting
     tok->links = NULL;
     for (fst::ArcIterator<FstType> aiter(fst, state);
          !aiter.Done();
@@ -1025,8 +1440,8 @@ void LatticeFasterOnlineDecoder::ProcessNonemitting(BaseFloat cutoff) {
           Token *new_tok = FindOrAddToken(arc.nextstate, frame + 1, tot_cost,
                                           tok, &changed);
 
-          tok->links = new ForwardLink(new_tok, 0, arc.olabel,
-                                       graph_cost, 0, tok->links);
+          tok->links = link_pool_.New(
+              ForwardLink(new_tok, 0, arc.olabel, graph_cost, 0, tok->links));
 
           // "changed" tells us whether the new token has a different
           // cost from before, or is new [if so, add into queue].
@@ -1046,18 +1461,31 @@ template void LatticeFasterOnlineDecoder::
 
 void LatticeFasterOnlineDecoder::ProcessNonemittingWrapper(
         BaseFloat cost_cutoff) {
-  if (fst_.Type() == "const") {
-    return LatticeFasterOnlineDecoder::
-        ProcessNonemitting<fst::ConstFst<Arc>>(cost_cutoff);
-  } else if (fst_.Type() == "vector") {
-    return LatticeFasterOnlineDecoder::
-        ProcessNonemitting<fst::VectorFst<Arc>>(cost_cutoff);
-  } else {
-    return LatticeFasterOnlineDecoder::
-        ProcessNonemitting<fst::Fst<Arc>>(cost_cutoff);
+  switch (fst_kind_) {
+    case kConstFst:
+      ProcessNonemitting<fst::ConstFst<Arc> >(cost_cutoff);
+      break;
+    case kVectorFst:
+      ProcessNonemitting<fst::VectorFst<Arc> >(cost_cutoff);
+      break;
+    default:
+      ProcessNonemitting<fst::Fst<Arc> >(cost_cutoff);
   }
 }
 
+LatticeFasterOnlineDecoder::FstKind LatticeFasterOnlineDecoder::GetFstKind(
+    const fst::Fst<fst::StdArc> &fst) {
+  // We test the dynamic type rather than fst.Type(), because e.g. a
+  // ConstFst with 64-bit offsets also reports its type as "const" but
+  // cannot be iterated as fst::ConstFst<fst::StdArc>.
+  if (dynamic_cast<const fst::ConstFst<Arc>*>(&fst) != NULL)
+    return kConstFst;
+  else if (dynamic_cast<const fst::VectorFst<Arc>*>(&fst) != NULL)
+    return kVectorFst;
+  else
+    return kOtherFst;
+}
+
 void LatticeFasterOnlineDecoder::DeleteElems(Elem *list) {
   for (Elem *e = list, *e_tail; e != NULL; e = e_tail) {
     // Token::TokenDelete(e->val);
@@ -1066,20 +1494,30 @@ void LatticeFasterOnlineDecoder::DeleteElems(Elem *list) {
   }
 }
 
+void LatticeFasterOnlineDecoder::DeleteForwardLinks(Token *tok) {
+  ForwardLink *l = tok->links, *m;
+  while (l != NULL) {
+    m = l->next;
+    link_pool_.Delete(l);
+    l = m;
+  }
+  tok->links = NULL;
+}
+
 void LatticeFasterOnlineDecoder::ClearActiveTokens() { // a cleanup routine, at utt end/begin
-  for (size_t i = 0; i < active_toks_.size(); i++) {
-    // Delete all tokens alive on this frame, and any forward
-    // links they may have.
-    for (Token *tok = active_toks_[i].toks; tok != NULL; ) {
-      tok->DeleteForwardLinks();
-      Token *next_tok = tok->next;
-      delete tok;
-      num_toks_--;
-      tok = next_tok;
-    }
+  // All the tokens and forward links are reachable from active_toks_, so
+  // instead of deleting them one by one we recycle all the memory at once.
+  KALDI_ASSERT(token_pool_.NumInUse() == static_cast<size_t>(num_toks_));
+  if (token_pool_.NumAllocations() > 0) {
+    KALDI_VLOG(2) << "Tokens: " << token_pool_.Info();
+    KALDI_VLOG(2) << "Forward links: " << link_pool_.Info();
   }
+  token_pool_.DeleteAll();
+  link_pool_.DeleteAll();
+  token_pool_.ResetStats();
+  link_pool_.ResetStats();
+  num_toks_ = 0;
   active_toks_.clear();
-  KALDI_ASSERT(num_toks_ == 0);
 }
 
 // static
@@ -29,6 +29,7 @@
 
 #include "util/stl-utils.h"
 #include "util/hash-list.h"
+#include "util/slab-allocator.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -39,6 +40,37 @@
 
 namespace kaldi {
 
+/// The options for LatticeFasterOnlineDecoder::GetLatticeIncremental().  They
+/// are kept out of LatticeFasterDecoderConfig, which is used by many programs
+/// that have no use for them.
+struct IncrementalDeterminizeConfig {
+  bool incremental_determinize;  // not inspected by
+                                 // LatticeFasterOnlineDecoder... used by
+                                 // SingleUtteranceNnet3Decoder.
+  int32 determinize_period;
+  int32 determinize_delay;
+
+  IncrementalDeterminizeConfig(): incremental_determinize(false),
+                                  determinize_period(20),
+                                  determinize_delay(25) { }
+  void Register(OptionsItf *opts) {
+    opts->Register("incremental-determinize", &incremental_determinize,
+                   "If true, in online decoding, determinize the lattice "
+                   "incrementally in chunks of frames, so that getting the "
+                   "lattice partway through a long utterance only costs time "
+                   "proportional to the frames decoded since the last time.");
+    opts->Register("determinize-period", &determinize_period, "With "
+                   "--incremental-determinize=true, the number of frames in "
+                   "each chunk that is determinized.");
+    opts->Register("determinize-delay", &determinize_delay, "With "
+                   "--incremental-determinize=true, the number of frames "
+                   "behind the most recently decoded frame that a chunk must "
+                   "end before we determinize it.");
+  }
+  void Check() const {
+    KALDI_ASSERT(determinize_period > 0 && determinize_delay >= 0);
+  }
+};
 
 
 /** LatticeFasterOnlineDecoder is as LatticeFasterDecoder but also supports an
@@ -153,6 +185,36 @@ class LatticeFasterOnlineDecoder {
                            bool use_final_probs,
                            BaseFloat beam) const;
 
+  /// Outputs the lattice-determinized lattice for the frames decoded so far.
+  /// This is like calling GetRawLattice() and then
+  /// DeterminizeLatticePhonePrunedWrapper() with config_.lattice_beam and
+  /// config_.det_opts, except that frames more than config.determinize_delay
+  /// frames behind the most recently decoded frame are determinized only once,
+  /// in chunks of config.determinize_period frames, and the result is kept;
+  /// so each call only takes time proportional to the number of frames
+  /// decoded since the previous call.  "config" must be the same for all the
+  /// calls for an utterance.  Consecutive chunks are joined by epsilon arcs
+  /// through the tokens active on the frame between them, so the output is
+  /// not exactly deterministic: there may be more than one path for a word
+  /// sequence, if those paths pass through different tokens at a chunk
+  /// boundary.  A chunk is pruned as if any token active on the most recently
+  /// decoded frame might turn out to be the best (as in PruneActiveTokens()),
+  /// so it may keep some paths that determinizing the whole lattice later on
+  /// would prune.
+  ///
+  /// The output shares its memory with a lattice kept in this object, so it
+  /// is not copied unless one of them is modified (and if "ofst" is the
+  /// output of the previous call, that is not necessary either).  Before
+  /// FinalizeDecoding() is called, it may contain a few states from which
+  /// no final state can be reached, if tokens on a chunk boundary were pruned
+  /// after the chunk before it was determinized.  The meaning of
+  /// "use_final_probs" is as for GetRawLattice().  Returns true if the
+  /// result is nonempty.
+  bool GetLatticeIncremental(const TransitionModel &trans_model,
+                             const IncrementalDeterminizeConfig &config,
+                             bool use_final_probs,
+                             CompactLattice *ofst);
+
 
   /// InitDecoding initializes the decoding, and should only be used if you
   /// intend to call AdvanceDecoding().  If you call Decode(), you don't need to
@@ -241,15 +303,6 @@ class LatticeFasterOnlineDecoder {
                  Token *next, Token *backpointer):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next),
         backpointer(backpointer) { }
-    inline void DeleteForwardLinks() {
-      ForwardLink *l = links, *m;
-      while (l != NULL) {
-        m = l->next;
-        delete l;
-        l = m;
-      }
-      links = NULL;
-    }
   };
 
   // head of per-frame list of Tokens (list is in topological order),
@@ -351,6 +404,94 @@ class LatticeFasterOnlineDecoder {
 
   void ProcessNonemittingWrapper(BaseFloat cost_cutoff);
 
+  // Used in GetLatticeIncremental(): outputs to "ofst" the raw lattice for
+  // frames begin_frame through end_frame, i.e. the tokens active on those
+  // frames and the links leaving them, except that if end_frame <
+  // NumFramesDecoded(), links leaving tokens on end_frame are left for the next
+  // chunk.  If begin_frame > 0, the start state has arcs to the tokens on
+  // begin_frame, labeled (on the output side) with kTokenLabelOffset plus the
+  // label that boundary_token_labels_ gives them, and with their forward cost
+  // as the graph cost, so that pruned determinization works as it would for
+  // the whole lattice; these costs are output to "start_costs", indexed by
+  // label.  If end_frame < NumFramesDecoded(), each token on end_frame gets a
+  // similarly labeled arc to a single final state, with its backward cost
+  // from "backward_costs" (see ComputeBackwardCosts()) as the graph cost, so
+  // the tokens on end_frame must be in it; the labels are output to
+  // "end_token_labels" and the costs to "end_costs".  Otherwise the
+  // final-probs are set as in GetRawLattice().  Returns false if some frame
+  // had no active tokens.
+  bool GetRawLatticeChunk(
+      int32 begin_frame, int32 end_frame, bool use_final_probs,
+      const unordered_map<Token*, BaseFloat> &backward_costs,
+      Lattice *ofst,
+      std::vector<BaseFloat> *start_costs,
+      unordered_map<Token*, int32> *end_token_labels,
+      std::vector<BaseFloat> *end_costs) const;
+
+  // Used in GetRawLatticeChunk(): outputs, for each token active on frames
+  // "frame" through NumFramesDecoded(), the lowest cost of a path from it to
+  // the tokens on the last frame, plus a cost for the token it ends at: that
+  // token's final-cost (see ComputeFinalCosts()) if FinalizeDecoding() has
+  // been called and there were final-probs, zero if FinalizeDecoding() has
+  // been called and there were none, and minus its tot_cost otherwise.  Like
+  // the extra_cost that PruneForwardLinks() works out, this is relative to
+  // the best path through each token on the last frame, because more frames
+  // may be decoded; but unlike extra_cost, it is up to date.  The costs
+  // include cost_offsets_, like tot_cost.
+  void ComputeBackwardCosts(
+      int32 frame, unordered_map<Token*, BaseFloat> *backward_costs) const;
+
+  // An arc in determinized_lat_ that went into a token on the last frame it
+  // covers, when that frame's chunk was determinized.  "weight" includes the
+  // final-weight that followed it in the determinized chunk.
+  struct BoundaryArc {
+    CompactLatticeArc::StateId state;
+    int32 token_label;
+    CompactLatticeWeight weight;
+  };
+
+  // Used in GetLatticeIncremental(): appends the determinized chunk "chunk",
+  // output by determinizing the result of GetRawLatticeChunk(), to "lat".  If
+  // "is_first" is true, the start state of "chunk" becomes the start state of
+  // "lat"; otherwise each arc in "boundary_arcs" is joined by an epsilon arc
+  // to the destination of the arc from the start state of "chunk" with the
+  // same token label, and only the states of "chunk" that are reachable that
+  // way are copied.  The costs in "start_costs" and "end_costs" are
+  // subtracted again.  If "is_last" is false, the arcs in "chunk" with token
+  // labels are not copied but output to "new_boundary_arcs" instead;
+  // otherwise the final-probs of "chunk" are copied.  If "joined_states" is
+  // not NULL, then before each joining arc is added, its source state and the
+  // number of arcs it had are appended to it, so that the joining arcs can be
+  // removed again.  Returns false if "chunk" is empty, in which case nothing
+  // is done.
+  static bool AppendDeterminizedChunk(
+      const CompactLattice &chunk,
+      const std::vector<BaseFloat> &start_costs,
+      const std::vector<BaseFloat> &end_costs,
+      const std::vector<BoundaryArc> &boundary_arcs,
+      bool is_first, bool is_last,
+      CompactLattice *lat,
+      std::vector<BoundaryArc> *new_boundary_arcs,
+      std::vector<std::pair<CompactLatticeArc::StateId, size_t> >
+          *joined_states);
+
+  // Used in GetLatticeIncremental(): removes the chunk for the most recent
+  // frames, which the previous call appended to determinized_lat_, and the
+  // arcs that joined it to the rest.
+  void RemoveLastChunk();
+
+  // Token labels in the chunk lattices used in GetLatticeIncremental() are
+  // offset by this much so that they cannot clash with word labels.
+  static const int32 kTokenLabelOffset = 1000000000;
+
+  /// The FST types for which ProcessEmitting() and ProcessNonemitting() are
+  /// instantiated; anything else goes through the (virtual) fst::Fst interface.
+  enum FstKind { kConstFst, kVectorFst, kOtherFst };
+
+  /// Works out which specialization applies to "fst"; called once from the
+  /// constructor, so the per-frame dispatch in the wrappers is just a switch.
+  static FstKind GetFstKind(const fst::Fst<fst::StdArc> &fst);
+
   // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.  It is indexed by frame-index
@@ -360,14 +501,23 @@ class LatticeFasterOnlineDecoder {
   // the graph.
   HashList<StateId, Token*> toks_;
 
+  // Memory for the tokens and forward links is managed by these allocators,
+  // which avoid a call to new/delete for every token and link and let us
+  // recycle all of them at once in ClearActiveTokens().
+  SlabAllocator<Token> token_pool_;
+  SlabAllocator<ForwardLink> link_pool_;
+
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
   // must_prune_tokens).
   std::vector<StateId> queue_;  // temp variable used in ProcessNonemitting,
   std::vector<BaseFloat> tmp_array_;  // used in GetCutoff.
   // make it class member to avoid internal new/delete.
+  std::vector<BaseFloat> frame_loglikes_;  // used in ProcessEmitting(), if
+  // the decodable object supports FrameLogLikelihoods().
   const fst::Fst<fst::StdArc> &fst_;
   bool delete_fst_;
+  FstKind fst_kind_;  // the concrete type of fst_; see GetFstKind().
   std::vector<BaseFloat> cost_offsets_; // This contains, for each
   // frame, an offset that was added to the acoustic log-likelihoods on that
   // frame in order to keep everything in a nice dynamic range i.e.  close to
@@ -390,6 +540,24 @@ class LatticeFasterOnlineDecoder {
   BaseFloat final_relative_cost_;
   BaseFloat final_best_cost_;
 
+  /// The following variables are used by GetLatticeIncremental().  The first
+  /// num_determinized_states_ states of determinized_lat_ are the determinized
+  /// lattice for frames before determinized_frame_, not including the links
+  /// leaving tokens on that frame; the arcs that entered those tokens are in
+  /// boundary_arcs_, rather than in determinized_lat_, and
+  /// boundary_token_labels_ maps the tokens to the labels used in
+  /// boundary_arcs_.  (It may also contain pointers to tokens that have since
+  /// been pruned; we only look up tokens that are still active.)  The rest of
+  /// determinized_lat_ is the chunk for the remaining frames that the last
+  /// call appended, which the next call removes again; last_chunk_joins_ says
+  /// which arcs to remove with it (see AppendDeterminizedChunk()).
+  CompactLattice determinized_lat_;
+  int32 determinized_frame_;
+  CompactLatticeArc::StateId num_determinized_states_;
+  std::vector<BoundaryArc> boundary_arcs_;
+  unordered_map<Token*, int32> boundary_token_labels_;
+  std::vector<std::pair<CompactLatticeArc::StateId, size_t> > last_chunk_joins_;
+
   // There are various cleanup tasks... the the toks_ structure contains
   // singly linked lists of Token pointers, where Elem is the list type.
   // It also indexes them in a hash, indexed by state (this hash is only
@@ -412,6 +580,12 @@ class LatticeFasterOnlineDecoder {
   static void TopSortTokens(Token *tok_list,
                             std::vector<Token*> *topsorted_list);
 
+  // Deletes all the forward links of 'tok'.
+  inline void DeleteForwardLinks(Token *tok);
+
+  // Deletes all the tokens and forward links (a cleanup routine, at the
+  // beginning and end of the utterance), and if --verbose >= 2, prints
+  // statistics on the memory allocation for the utterance.
   void ClearActiveTokens();
 
 
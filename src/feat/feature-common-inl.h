@@ -84,16 +84,35 @@ void OfflineFeatureTpl<F>::Compute(
     return;
   }
   output->Resize(rows_out, cols_out);
+  // We compute the features in blocks of frames using the batched Compute()
+  // function of the computer, which is faster than doing them one by one;
+  // the block size limits the memory used for the windows.
+  const int32 kBlockSize = 64;
+  int32 block_size = std::min(rows_out, kBlockSize);
   Vector<BaseFloat> window;  // windowed waveform.
+  Matrix<BaseFloat> windows(block_size,
+                            computer_.GetFrameOptions().PaddedWindowSize(),
+                            kUndefined);
+  Vector<BaseFloat> raw_log_energies(block_size);
   bool use_raw_log_energy = computer_.NeedRawLogEnergy();
-  for (int32 r = 0; r < rows_out; r++) {  // r is frame index.
-    BaseFloat raw_log_energy = 0.0;
-    ExtractWindow(0, wave, r, computer_.GetFrameOptions(),
-                  feature_window_function_, &window,
-                  (use_raw_log_energy ? &raw_log_energy : NULL));
-
-    SubVector<BaseFloat> output_row(*output, r);
-    computer_.Compute(raw_log_energy, vtln_warp, &window, &output_row);
+  for (int32 start = 0; start < rows_out; start += block_size) {
+    int32 this_block_size = std::min(block_size, rows_out - start);
+    for (int32 i = 0; i < this_block_size; i++) {
+      int32 r = start + i;  // r is frame index.
+      BaseFloat raw_log_energy = 0.0;
+      ExtractWindow(0, wave, r, computer_.GetFrameOptions(),
+                    feature_window_function_, &window,
+                    (use_raw_log_energy ? &raw_log_energy : NULL));
+      windows.Row(i).CopyFromVec(window);
+      raw_log_energies(i) = raw_log_energy;
+    }
+    SubMatrix<BaseFloat> these_windows(windows, 0, this_block_size,
+                                       0, windows.NumCols()),
+        output_rows(*output, start, this_block_size, 0, cols_out);
+    SubVector<BaseFloat> these_raw_log_energies(raw_log_energies, 0,
+                                                this_block_size);
+    computer_.Compute(these_raw_log_energies, vtln_warp, &these_windows,
+                      &output_rows);
   }
 }
 
@@ -94,6 +94,22 @@ class ExampleFeatureComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /**
+     Batched version of Compute(), used in offline feature extraction.  Row r
+     of 'signal_frames' and 'features', and element r of
+     'signal_raw_log_energies', correspond to one frame, with the same
+     meanings as the arguments of the one-frame Compute() function.  Doing
+     many frames at once lets us do the FFT (and, where applicable, the
+     mel binning and the DCT) for all of them together, with SIMD loops and
+     with matrix-matrix rather than matrix-vector products, which is
+     considerably faster.  The results must be the same as
+     calling Compute() on each frame, up to roundoff.
+  */
+  void Compute(const VectorBase<BaseFloat> &signal_raw_log_energies,
+               BaseFloat vtln_warp,
+               MatrixBase<BaseFloat> *signal_frames,
+               MatrixBase<BaseFloat> *features);
+
  private:
   // disallow assignment.
   ExampleFeatureComputer &operator = (const ExampleFeatureComputer &in);
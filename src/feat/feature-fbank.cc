@@ -122,4 +122,65 @@ void FbankComputer::Compute(BaseFloat signal_log_energy,
   }
 }
 
+void FbankComputer::Compute(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                            BaseFloat vtln_warp,
+                            MatrixBase<BaseFloat> *signal_frames,
+                            MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows();
+  KALDI_ASSERT(signal_frames->NumCols() == opts_.frame_opts.PaddedWindowSize() &&
+               signal_raw_log_energies.Dim() == num_frames &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim());
+  const MelBanks &mel_banks = *(GetMelBanks(vtln_warp));
+
+  Vector<BaseFloat> signal_log_energies(signal_raw_log_energies);
+  // Compute energy after window function (not the raw one).
+  if (opts_.use_energy && !opts_.raw_energy)
+    for (int32 r = 0; r < num_frames; r++)
+      signal_log_energies(r) = Log(std::max(
+          VecVec(signal_frames->Row(r), signal_frames->Row(r)),
+          std::numeric_limits<BaseFloat>::min()));
+
+  if (srfft_ != NULL) {  // Compute FFT using split-radix algorithm.
+    srfft_->Compute(signal_frames, true);
+  } else {  // An alternative algorithm that works for non-powers-of-two.
+    for (int32 r = 0; r < num_frames; r++) {
+      SubVector<BaseFloat> signal_frame(*signal_frames, r);
+      RealFft(&signal_frame, true);
+    }
+  }
+
+  // Convert the FFTs into power spectra.
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r);
+    ComputePowerSpectrum(&signal_frame);
+  }
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames,
+                                     0, signal_frames->NumCols() / 2 + 1);
+
+  // Use magnitude instead of power if requested.
+  if (!opts_.use_power)
+    power_spectra.ApplyPow(0.5);
+
+  int32 mel_offset = ((opts_.use_energy && !opts_.htk_compat) ? 1 : 0);
+  SubMatrix<BaseFloat> mel_energies(*features, 0, num_frames,
+                                    mel_offset, opts_.mel_opts.num_bins);
+
+  // Sum with mel fiterbanks over the power spectra
+  mel_banks.Compute(power_spectra, &mel_energies);
+  if (opts_.use_log_fbank) {
+    // Avoid log of zero (which should be prevented anyway by dithering).
+    mel_energies.ApplyFloor(std::numeric_limits<BaseFloat>::epsilon());
+    mel_energies.ApplyLog();  // take the log.
+  }
+
+  // Copy energy as first value (or the last, if htk_compat == true).
+  if (opts_.use_energy) {
+    if (opts_.energy_floor > 0.0)
+      signal_log_energies.ApplyFloor(log_energy_floor_);
+    int32 energy_index = opts_.htk_compat ? opts_.mel_opts.num_bins : 0;
+    features->CopyColFromVec(signal_log_energies, energy_index);
+  }
+}
+
 }  // namespace kaldi
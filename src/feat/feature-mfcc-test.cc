@@ -653,6 +653,46 @@ void UnitTestVtln() {
   }
 }
 
+// Checks that the batched computation used in class Mfcc gives the same
+// results as computing the frames one by one.
+static void UnitTestBatched() {
+  std::cout << "=== UnitTestBatched() ===\n";
+  for (int32 i = 0; i < 10; i++) {
+    MfccOptions op;
+    op.frame_opts.dither = 0.0;
+    op.frame_opts.round_to_power_of_two = (Rand() % 2 == 0);
+    op.use_energy = (Rand() % 2 == 0);
+    op.raw_energy = (Rand() % 2 == 0);
+    op.htk_compat = (Rand() % 2 == 0);
+    op.cepstral_lifter = (Rand() % 2 == 0 ? 22.0 : 0.0);
+    op.energy_floor = (Rand() % 2 == 0 ? 1.0 : 0.0);
+    BaseFloat vtln_warp = (Rand() % 2 == 0 ? 1.0 : 0.9);
+
+    Vector<BaseFloat> wave(RandInt(0, 20000));
+    wave.SetRandn();
+    wave.Scale(1000.0);
+
+    Mfcc mfcc(op);
+    Matrix<BaseFloat> batched_feats;
+    mfcc.Compute(wave, vtln_warp, &batched_feats);
+
+    MfccComputer computer(op);
+    FeatureWindowFunction window_function(op.frame_opts);
+    int32 num_frames = NumFrames(wave.Dim(), op.frame_opts);
+    KALDI_ASSERT(batched_feats.NumRows() == num_frames);
+    Matrix<BaseFloat> feats(num_frames, computer.Dim());
+    Vector<BaseFloat> window;
+    for (int32 r = 0; r < num_frames; r++) {
+      BaseFloat raw_log_energy = 0.0;
+      ExtractWindow(0, wave, r, op.frame_opts, window_function, &window,
+                    (computer.NeedRawLogEnergy() ? &raw_log_energy : NULL));
+      SubVector<BaseFloat> feat(feats, r);
+      computer.Compute(raw_log_energy, vtln_warp, &window, &feat);
+    }
+    AssertEqual(feats, batched_feats, 0.001);
+  }
+}
+
 static void UnitTestFeat() {
   UnitTestVtln();
   UnitTestReadWave();
@@ -666,6 +706,7 @@ static void UnitTestFeat() {
   UnitTestHTKCompare4();
   UnitTestHTKCompare5();
   UnitTestHTKCompare6();
+  UnitTestBatched();
   std::cout << "Tests succeeded.\n";
 }
 
@@ -79,6 +79,78 @@ void MfccComputer::Compute(BaseFloat signal_log_energy,
   }
 }
 
+void MfccComputer::Compute(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                           BaseFloat vtln_warp,
+                           MatrixBase<BaseFloat> *signal_frames,
+                           MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows();
+  KALDI_ASSERT(signal_frames->NumCols() == opts_.frame_opts.PaddedWindowSize() &&
+               signal_raw_log_energies.Dim() == num_frames &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim());
+
+  const MelBanks &mel_banks = *(GetMelBanks(vtln_warp));
+
+  Vector<BaseFloat> signal_log_energies(signal_raw_log_energies);
+  if (opts_.use_energy && !opts_.raw_energy)
+    for (int32 r = 0; r < num_frames; r++)
+      signal_log_energies(r) = Log(std::max(
+          VecVec(signal_frames->Row(r), signal_frames->Row(r)),
+          std::numeric_limits<BaseFloat>::min()));
+
+  if (srfft_ != NULL) {  // Compute FFT using the split-radix algorithm.
+    srfft_->Compute(signal_frames, true);
+  } else {  // An alternative algorithm that works for non-powers-of-two.
+    for (int32 r = 0; r < num_frames; r++) {
+      SubVector<BaseFloat> signal_frame(*signal_frames, r);
+      RealFft(&signal_frame, true);
+    }
+  }
+
+  // Convert the FFTs into power spectra.
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r);
+    ComputePowerSpectrum(&signal_frame);
+  }
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames,
+                                     0, signal_frames->NumCols() / 2 + 1);
+
+  Matrix<BaseFloat> mel_energies(num_frames, opts_.mel_opts.num_bins,
+                                 kUndefined);
+  mel_banks.Compute(power_spectra, &mel_energies);
+
+  // avoid log of zero (which should be prevented anyway by dithering).
+  mel_energies.ApplyFloor(std::numeric_limits<BaseFloat>::epsilon());
+  mel_energies.ApplyLog();  // take the log.
+
+  features->SetZero();  // in case there were NaNs.
+  // features = mel_energies * dct_matrix_^T [the mel energies now have log]
+  features->AddMatMat(1.0, mel_energies, kNoTrans, dct_matrix_, kTrans, 0.0);
+
+  if (opts_.cepstral_lifter != 0.0)
+    features->MulColsVec(lifter_coeffs_);
+
+  if (opts_.use_energy) {
+    if (opts_.energy_floor > 0.0)
+      signal_log_energies.ApplyFloor(log_energy_floor_);
+    features->CopyColFromVec(signal_log_energies, 0);
+  }
+
+  if (opts_.htk_compat) {
+    // See the one-frame version of Compute() for an explanation.
+    Vector<BaseFloat> energy(num_frames);
+    energy.CopyColFromMat(*features, 0);
+    if (!opts_.use_energy)
+      energy.Scale(M_SQRT2);
+    int32 num_ceps = opts_.num_ceps;
+    SubMatrix<BaseFloat> dest(*features, 0, num_frames, 0, num_ceps - 1);
+    Matrix<BaseFloat> src(SubMatrix<BaseFloat>(*features, 0, num_frames,
+                                               1, num_ceps - 1));
+    dest.CopyFromMat(src);
+    features->CopyColFromVec(energy, num_ceps - 1);
+  }
+}
+
 MfccComputer::MfccComputer(const MfccOptions &opts):
     opts_(opts), srfft_(NULL),
     mel_energies_(opts.mel_opts.num_bins) {
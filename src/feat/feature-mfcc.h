@@ -121,6 +121,13 @@ class MfccComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /// Batched version of Compute(), which computes the features for a block of
+  /// frames at once; see ExampleFeatureComputer in feature-common.h.
+  void Compute(const VectorBase<BaseFloat> &signal_raw_log_energies,
+               BaseFloat vtln_warp,
+               MatrixBase<BaseFloat> *signal_frames,
+               MatrixBase<BaseFloat> *features);
+
   ~MfccComputer();
  private:
   // disallow assignment.
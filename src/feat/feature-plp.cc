@@ -116,13 +116,6 @@ void PlpComputer::Compute(BaseFloat signal_log_energy,
   KALDI_ASSERT(signal_frame->Dim() == opts_.frame_opts.PaddedWindowSize() &&
                feature->Dim() == this->Dim());
 
-  const MelBanks &mel_banks = *GetMelBanks(vtln_warp);
-  const Vector<BaseFloat> &equal_loudness = *GetEqualLoudness(vtln_warp);
-
-
-  KALDI_ASSERT(opts_.num_ceps <= opts_.lpc_order+1);  // our num-ceps includes C0.
-
-
   if (opts_.use_energy && !opts_.raw_energy)
     signal_log_energy = Log(std::max(VecVec(*signal_frame, *signal_frame),
                                      std::numeric_limits<BaseFloat>::min()));
@@ -138,6 +131,58 @@ void PlpComputer::Compute(BaseFloat signal_log_energy,
   SubVector<BaseFloat> power_spectrum(*signal_frame,
                                       0, signal_frame->Dim() / 2 + 1);
 
+  ComputeFromPowerSpectrum(signal_log_energy, vtln_warp, power_spectrum,
+                           feature);
+}
+
+void PlpComputer::Compute(const VectorBase<BaseFloat> &signal_raw_log_energies,
+                          BaseFloat vtln_warp,
+                          MatrixBase<BaseFloat> *signal_frames,
+                          MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows();
+  KALDI_ASSERT(signal_frames->NumCols() == opts_.frame_opts.PaddedWindowSize() &&
+               signal_raw_log_energies.Dim() == num_frames &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim());
+
+  Vector<BaseFloat> signal_log_energies(signal_raw_log_energies);
+  if (opts_.use_energy && !opts_.raw_energy)
+    for (int32 r = 0; r < num_frames; r++)
+      signal_log_energies(r) = Log(std::max(
+          VecVec(signal_frames->Row(r), signal_frames->Row(r)),
+          std::numeric_limits<BaseFloat>::min()));
+
+  if (srfft_ != NULL) {  // Compute FFT using split-radix algorithm.
+    srfft_->Compute(signal_frames, true);
+  } else {  // An alternative algorithm that works for non-powers-of-two.
+    for (int32 r = 0; r < num_frames; r++) {
+      SubVector<BaseFloat> signal_frame(*signal_frames, r);
+      RealFft(&signal_frame, true);
+    }
+  }
+
+  // The rest of the computation (the LPC analysis) is done frame by frame.
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r);
+    ComputePowerSpectrum(&signal_frame);
+    SubVector<BaseFloat> power_spectrum(signal_frame,
+                                        0, signal_frame.Dim() / 2 + 1),
+        feature(*features, r);
+    ComputeFromPowerSpectrum(signal_log_energies(r), vtln_warp,
+                             power_spectrum, &feature);
+  }
+}
+
+void PlpComputer::ComputeFromPowerSpectrum(
+    BaseFloat signal_log_energy,
+    BaseFloat vtln_warp,
+    const VectorBase<BaseFloat> &power_spectrum,
+    VectorBase<BaseFloat> *feature) {
+  const MelBanks &mel_banks = *GetMelBanks(vtln_warp);
+  const Vector<BaseFloat> &equal_loudness = *GetEqualLoudness(vtln_warp);
+
+  KALDI_ASSERT(opts_.num_ceps <= opts_.lpc_order+1);  // our num-ceps includes C0.
+
   int32 num_mel_bins = opts_.mel_opts.num_bins;
 
   SubVector<BaseFloat> mel_energies(mel_energies_duplicated_, 1, num_mel_bins);
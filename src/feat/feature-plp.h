@@ -136,8 +136,22 @@ class PlpComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /// Batched version of Compute(), which computes the features for a block of
+  /// frames at once; see ExampleFeatureComputer in feature-common.h.
+  void Compute(const VectorBase<BaseFloat> &signal_raw_log_energies,
+               BaseFloat vtln_warp,
+               MatrixBase<BaseFloat> *signal_frames,
+               MatrixBase<BaseFloat> *features);
+
   ~PlpComputer();
  private:
+  // Does the part of Compute() that comes after the FFT.  'signal_log_energy'
+  // must already have been computed as described there, i.e. it is the
+  // final (not raw) energy if opts_.raw_energy is false.
+  void ComputeFromPowerSpectrum(BaseFloat signal_log_energy,
+                                BaseFloat vtln_warp,
+                                const VectorBase<BaseFloat> &power_spectrum,
+                                VectorBase<BaseFloat> *feature);
 
   const MelBanks *GetMelBanks(BaseFloat vtln_warp);
 
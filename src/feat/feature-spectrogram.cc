@@ -79,4 +79,51 @@ void SpectrogramComputer::Compute(BaseFloat signal_log_energy,
   (*feature)(0) = signal_log_energy;
 }
 
+void SpectrogramComputer::Compute(
+    const VectorBase<BaseFloat> &signal_raw_log_energies,
+    BaseFloat vtln_warp,
+    MatrixBase<BaseFloat> *signal_frames,
+    MatrixBase<BaseFloat> *features) {
+  int32 num_frames = signal_frames->NumRows();
+  KALDI_ASSERT(signal_frames->NumCols() == opts_.frame_opts.PaddedWindowSize() &&
+               signal_raw_log_energies.Dim() == num_frames &&
+               features->NumRows() == num_frames &&
+               features->NumCols() == this->Dim());
+
+  Vector<BaseFloat> signal_log_energies(signal_raw_log_energies);
+  // Compute energy after window function (not the raw one)
+  if (!opts_.raw_energy)
+    for (int32 r = 0; r < num_frames; r++)
+      signal_log_energies(r) = Log(std::max(
+          VecVec(signal_frames->Row(r), signal_frames->Row(r)),
+          std::numeric_limits<BaseFloat>::epsilon()));
+
+  if (srfft_ != NULL) {  // Compute FFT using split-radix algorithm.
+    srfft_->Compute(signal_frames, true);
+  } else {  // An alternative algorithm that works for non-powers-of-two
+    for (int32 r = 0; r < num_frames; r++) {
+      SubVector<BaseFloat> signal_frame(*signal_frames, r);
+      RealFft(&signal_frame, true);
+    }
+  }
+
+  // Convert the FFTs into power spectra.
+  for (int32 r = 0; r < num_frames; r++) {
+    SubVector<BaseFloat> signal_frame(*signal_frames, r);
+    ComputePowerSpectrum(&signal_frame);
+  }
+  SubMatrix<BaseFloat> power_spectra(*signal_frames, 0, num_frames,
+                                     0, signal_frames->NumCols() / 2 + 1);
+
+  features->CopyFromMat(power_spectra);
+  features->ApplyFloor(std::numeric_limits<BaseFloat>::epsilon());
+  features->ApplyLog();
+
+  if (opts_.energy_floor > 0.0)
+    signal_log_energies.ApplyFloor(log_energy_floor_);
+  // The zeroth spectrogram component is always set to the signal energy,
+  // instead of the square of the constant component of the signal.
+  features->CopyColFromVec(signal_log_energies, 0);
+}
+
 }  // namespace kaldi
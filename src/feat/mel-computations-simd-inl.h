@@ -0,0 +1,76 @@
+// feat/mel-computations-simd-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// This file has no include guard: it is included by mel-computations.cc once
+// for each instruction set (AVX, NEON), each time in a different namespace.
+// Don't include it anywhere else.  Before including it, mel-computations.cc
+// defines KALDI_MEL_SIMD_TARGET as the target attribute of the functions
+// (which may be empty), and, in the same namespace, the type Vec, the
+// constant kWidth (the number of floats in a Vec), and the functions Load(),
+// Store(), Set1(), Add(), Mul() and ZeroUpper(); see matrix/srfft-simd-inl.h
+// for why the functions end with ZeroUpper().
+
+
+// Does the same as the generic MelEnergies() in mel-computations.cc, with the
+// same order of operations, so the results are the same.  We do kWidth frames
+// at a time: we first copy their power spectra to 'buffer', transposed, so
+// that the powers of an FFT bin for the kWidth frames are contiguous and the
+// energies of a mel bin for all of them can be computed at once.
+KALDI_MEL_SIMD_TARGET
+static void MelEnergies(const float *spectra, MatrixIndexT spectra_stride,
+                        int32 num_frames, int32 num_bins, const int32 *offsets,
+                        const int32 *sizes, const float *const *weights,
+                        float *energies, MatrixIndexT energies_stride) {
+  int32 num_fft_bins = 0;
+  for (int32 i = 0; i < num_bins; i++)
+    num_fft_bins = std::max(num_fft_bins, offsets[i] + sizes[i]);
+  std::vector<float> buffer(num_fft_bins * kWidth);
+  int32 num_frames_simd = num_frames - num_frames % kWidth,
+      num_fft_bins_simd = num_fft_bins - num_fft_bins % kWidth;
+  for (int32 f = 0; f < num_frames_simd; f += kWidth) {
+    const float *rows = spectra + f * spectra_stride;
+    for (int32 j = 0; j < num_fft_bins_simd; j += kWidth) {
+      Vec v[kWidth];
+      for (int32 r = 0; r < kWidth; r++)
+        v[r] = Load(rows + r * spectra_stride + j);
+      Transpose(v);
+      for (int32 c = 0; c < kWidth; c++)
+        Store(&(buffer[(j + c) * kWidth]), v[c]);
+    }
+    for (int32 r = 0; r < kWidth; r++)
+      for (int32 j = num_fft_bins_simd; j < num_fft_bins; j++)
+        buffer[j * kWidth + r] = rows[r * spectra_stride + j];
+    for (int32 i = 0; i < num_bins; i++) {
+      const float *x = &(buffer[offsets[i] * kWidth]), *w = weights[i];
+      Vec e = Set1(0.0);
+      for (int32 k = 0; k < sizes[i]; k++)
+        e = Add(e, Mul(Set1(w[k]), Load(x + k * kWidth)));
+      Store(energies + i * energies_stride + f, e);
+    }
+  }
+  for (int32 f = num_frames_simd; f < num_frames; f++) {
+    const float *row = spectra + f * spectra_stride;
+    for (int32 i = 0; i < num_bins; i++) {
+      const float *x = row + offsets[i], *w = weights[i];
+      float e = 0.0;
+      for (int32 k = 0; k < sizes[i]; k++)
+        e += w[k] * x[k];
+      energies[i * energies_stride + f] = e;
+    }
+  }
+  ZeroUpper();
+}
@@ -27,8 +27,134 @@
 #include "feat/feature-window.h"
 #include "feat/mel-computations.h"
 
+// The inner loop of the batched MelBanks::Compute() has SIMD versions, in
+// mel-computations-simd-inl.h: on x86 an AVX version compiled with a target
+// attribute, which we use if the CPU supports it, and on 64-bit ARM a NEON
+// version.  This is as for the batched FFT in matrix/srfft.cc.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define KALDI_MEL_AVX 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define KALDI_MEL_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace kaldi {
 
+#ifdef KALDI_MEL_AVX
+namespace mel_avx {
+#define KALDI_MEL_SIMD_TARGET __attribute__((target("avx")))
+typedef __m256 Vec;
+static const int32 kWidth = 8;
+KALDI_MEL_SIMD_TARGET
+static inline Vec Load(const float *p) { return _mm256_loadu_ps(p); }
+KALDI_MEL_SIMD_TARGET
+static inline void Store(float *p, Vec v) { _mm256_storeu_ps(p, v); }
+KALDI_MEL_SIMD_TARGET
+static inline Vec Set1(float f) { return _mm256_set1_ps(f); }
+KALDI_MEL_SIMD_TARGET
+static inline Vec Add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+KALDI_MEL_SIMD_TARGET
+static inline Vec Mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+KALDI_MEL_SIMD_TARGET
+static inline void ZeroUpper() { _mm256_zeroupper(); }
+// This is the same as in matrix/srfft.cc.
+KALDI_MEL_SIMD_TARGET
+static inline void Transpose(Vec *v) {
+  // Transpose the 2x2 blocks of each 4x4 quarter, then the 2x2 blocks of 2x2
+  // blocks, then the 4x4 quarters.
+  Vec t0 = _mm256_unpacklo_ps(v[0], v[1]), t1 = _mm256_unpackhi_ps(v[0], v[1]),
+      t2 = _mm256_unpacklo_ps(v[2], v[3]), t3 = _mm256_unpackhi_ps(v[2], v[3]),
+      t4 = _mm256_unpacklo_ps(v[4], v[5]), t5 = _mm256_unpackhi_ps(v[4], v[5]),
+      t6 = _mm256_unpacklo_ps(v[6], v[7]), t7 = _mm256_unpackhi_ps(v[6], v[7]);
+  Vec u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+      u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+      u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+      u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)),
+      u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)),
+      u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2)),
+      u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)),
+      u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  v[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+  v[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+  v[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+  v[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+  v[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+  v[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+  v[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+  v[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+#include "feat/mel-computations-simd-inl.h"
+#undef KALDI_MEL_SIMD_TARGET
+}  // namespace mel_avx
+#endif
+
+#ifdef KALDI_MEL_NEON
+namespace mel_neon {
+#define KALDI_MEL_SIMD_TARGET
+typedef float32x4_t Vec;
+static const int32 kWidth = 4;
+static inline Vec Load(const float *p) { return vld1q_f32(p); }
+static inline void Store(float *p, Vec v) { vst1q_f32(p, v); }
+static inline Vec Set1(float f) { return vdupq_n_f32(f); }
+static inline Vec Add(Vec a, Vec b) { return vaddq_f32(a, b); }
+static inline Vec Mul(Vec a, Vec b) { return vmulq_f32(a, b); }
+static inline void ZeroUpper() { }
+static inline void Transpose(Vec *v) {
+  float32x4x2_t t01 = vtrnq_f32(v[0], v[1]), t23 = vtrnq_f32(v[2], v[3]);
+  v[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+  v[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+  v[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+  v[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#include "feat/mel-computations-simd-inl.h"
+#undef KALDI_MEL_SIMD_TARGET
+}  // namespace mel_neon
+#endif
+
+// Sets energies[i * energies_stride + f] to the energy of mel bin i in frame
+// f, for the num_frames frames whose power spectra are the rows of 'spectra':
+// that is, the sum over k < sizes[i] of weights[i][k] times the power of FFT
+// bin offsets[i] + k.  This is the generic version; for float we use the SIMD
+// versions if we can.
+template<typename Real>
+static void MelEnergies(const Real *spectra, MatrixIndexT spectra_stride,
+                        int32 num_frames, int32 num_bins, const int32 *offsets,
+                        const int32 *sizes, const Real *const *weights,
+                        Real *energies, MatrixIndexT energies_stride) {
+  for (int32 f = 0; f < num_frames; f++) {
+    const Real *row = spectra + f * spectra_stride;
+    for (int32 i = 0; i < num_bins; i++) {
+      const Real *x = row + offsets[i], *w = weights[i];
+      Real e = 0.0;
+      for (int32 k = 0; k < sizes[i]; k++)
+        e += w[k] * x[k];
+      energies[i * energies_stride + f] = e;
+    }
+  }
+}
+
+static void MelEnergies(const float *spectra, MatrixIndexT spectra_stride,
+                        int32 num_frames, int32 num_bins, const int32 *offsets,
+                        const int32 *sizes, const float *const *weights,
+                        float *energies, MatrixIndexT energies_stride) {
+#if defined(KALDI_MEL_AVX)
+  static const bool use_avx = (__builtin_cpu_init(),
+                               __builtin_cpu_supports("avx") != 0);
+  if (use_avx) {
+    mel_avx::MelEnergies(spectra, spectra_stride, num_frames, num_bins,
+                         offsets, sizes, weights, energies, energies_stride);
+    return;
+  }
+#elif defined(KALDI_MEL_NEON)
+  mel_neon::MelEnergies(spectra, spectra_stride, num_frames, num_bins,
+                        offsets, sizes, weights, energies, energies_stride);
+  return;
+#endif
+  MelEnergies<float>(spectra, spectra_stride, num_frames, num_bins, offsets,
+                     sizes, weights, energies, energies_stride);
+}
 
 MelBanks::MelBanks(const MelBanksOptions &opts,
                    const FrameExtractionOptions &frame_opts,
@@ -250,6 +376,50 @@ void MelBanks::Compute(const VectorBase<BaseFloat> &power_spectrum,
   }
 }
 
+void MelBanks::Compute(const MatrixBase<BaseFloat> &power_spectra,
+                       MatrixBase<BaseFloat> *mel_energies_out) const {
+  int32 num_bins = bins_.size(), num_frames = power_spectra.NumRows();
+  KALDI_ASSERT(mel_energies_out->NumRows() == num_frames &&
+               mel_energies_out->NumCols() == num_bins);
+  if (num_frames == 0)
+    return;
+
+  // The weights of each bin are nonzero only on a contiguous range of FFT
+  // bins, so the full weight matrix is very sparse; MelEnergies() multiplies
+  // just that range of each row of the power spectra by the weights of each
+  // bin.  It works on several frames at once with SIMD instructions, so it
+  // produces the transpose of the output.
+  std::vector<int32> offsets(num_bins), sizes(num_bins);
+  std::vector<const BaseFloat*> weights(num_bins);
+  for (int32 i = 0; i < num_bins; i++) {
+    offsets[i] = bins_[i].first;
+    sizes[i] = bins_[i].second.Dim();
+    weights[i] = bins_[i].second.Data();
+  }
+  Matrix<BaseFloat> mel_energies_trans(num_bins, num_frames, kUndefined);
+  MelEnergies(power_spectra.Data(), power_spectra.Stride(), num_frames,
+              num_bins, &(offsets[0]), &(sizes[0]), &(weights[0]),
+              mel_energies_trans.Data(), mel_energies_trans.Stride());
+  mel_energies_out->CopyFromMat(mel_energies_trans, kTrans);
+
+  // HTK-like flooring- for testing purposes (we prefer dither)
+  if (htk_mode_)
+    mel_energies_out->ApplyFloor(1.0);
+
+  // See the comment in the one-vector version about this assert; the energies
+  // are non-negative so any NaN will show up in the sum.
+  KALDI_ASSERT(!KALDI_ISNAN(mel_energies_out->Sum()));
+
+  if (debug_) {
+    for (int32 r = 0; r < num_frames; r++) {
+      fprintf(stderr, "MEL BANKS:\n");
+      for (int32 i = 0; i < num_bins; i++)
+        fprintf(stderr, " %f", (*mel_energies_out)(r, i));
+      fprintf(stderr, "\n");
+    }
+  }
+}
+
 void ComputeLifterCoeffs(BaseFloat Q, VectorBase<BaseFloat> *coeffs) {
   // Compute liftering coefficients (scaling on cepstral coeffs)
   // coeffs are numbered slightly differently from HTK: the zeroth
@@ -111,6 +111,13 @@ class MelBanks {
   void Compute(const VectorBase<BaseFloat> &fft_energies,
                VectorBase<BaseFloat> *mel_energies_out) const;
 
+  /// Batched version of Compute(): row r of "mel_energies_out" is set to the
+  /// mel energies for the FFT energies in row r of "fft_energies".  This
+  /// treats the weights as a sparse matrix, and is more efficient than
+  /// calling Compute() for each row.
+  void Compute(const MatrixBase<BaseFloat> &fft_energies,
+               MatrixBase<BaseFloat> *mel_energies_out) const;
+
   int32 NumBins() const { return bins_.size(); }
 
   // returns vector of central freq of each bin; needed by plp code.
@@ -23,6 +23,7 @@
 #include "feat/wave-reader.h"
 #include "matrix/kaldi-matrix.h"
 #include "transform/transform-common.h"
+#include "transform/cmvn.h"
 
 namespace kaldi {
 
@@ -53,6 +54,30 @@ void GetOutput(OnlineFeatureInterface *a,
   cache.ClearCache();
 }
 
+// Like GetOutput(), but gets the frames using GetFrames(), in blocks of random
+// size with the frames of each block in random order.  All the frames of 'a'
+// must be ready.
+void GetOutputInBlocks(OnlineFeatureInterface *a,
+                       Matrix<BaseFloat> *output) {
+  int32 dim = a->Dim(), num_frames = a->NumFramesReady();
+  KALDI_ASSERT(num_frames > 0 && a->IsLastFrame(num_frames - 1));
+  output->Resize(num_frames, dim);
+  int32 start = 0;
+  while (start < num_frames) {
+    int32 block_size = std::min(1 + rand() % 20, num_frames - start);
+    std::vector<int32> frames(block_size);
+    for (int32 i = 0; i < block_size; i++)
+      frames[i] = start + i;
+    for (int32 i = block_size - 1; i > 0; i--)
+      std::swap(frames[i], frames[rand() % (i + 1)]);
+    Matrix<BaseFloat> block(block_size, dim);
+    a->GetFrames(frames, &block);
+    for (int32 i = 0; i < block_size; i++)
+      output->Row(frames[i]).CopyFromVec(block.Row(i));
+    start += block_size;
+  }
+}
+
 // Only generate random length for each piece
 bool RandomSplit(int32 wav_dim,
                  std::vector<int32> *piece_dim,
@@ -92,6 +117,13 @@ void TestOnlineMatrixCacheFeature() {
   Matrix<BaseFloat> output_feats;
   GetOutput(&matrix_feats, &output_feats);
   AssertEqual(input_feats, output_feats);
+
+  OnlineCacheFeature cache_feats(&matrix_feats);
+  GetOutputInBlocks(&cache_feats, &output_feats);
+  AssertEqual(input_feats, output_feats);
+  // now with some of the frames cached.
+  GetOutputInBlocks(&cache_feats, &output_feats);
+  AssertEqual(input_feats, output_feats);
 }
 
 void TestOnlineDeltaFeature() {
@@ -116,6 +148,10 @@ void TestOnlineDeltaFeature() {
   ComputeDeltas(opts, input_feats, &output_feats2);
 
   KALDI_ASSERT(output_feats1.ApproxEqual(output_feats2));
+
+  Matrix<BaseFloat> output_feats3;
+  GetOutputInBlocks(&delta_feats, &output_feats3);
+  KALDI_ASSERT(output_feats1.ApproxEqual(output_feats3));
 }
 
 void TestOnlineSpliceFrames() {
@@ -141,6 +177,35 @@ void TestOnlineSpliceFrames() {
     &output_feats2);
 
   KALDI_ASSERT(output_feats1.ApproxEqual(output_feats2));
+
+  Matrix<BaseFloat> output_feats3;
+  GetOutputInBlocks(&splice_frame, &output_feats3);
+  KALDI_ASSERT(output_feats1.ApproxEqual(output_feats3));
+}
+
+void TestOnlineCmvn() {
+  int32 dim = 2 + rand() % 5;  // dimension of features.
+  int32 num_frames = 100 + rand() % 200;
+
+  Matrix<BaseFloat> input_feats(num_frames, dim);
+  input_feats.SetRandn();
+  Matrix<double> global_stats(2, dim + 1);
+  AccCmvnStats(input_feats, NULL, &global_stats);
+
+  OnlineCmvnOptions opts;
+  opts.cmn_window = 10 + rand() % 100;
+  opts.normalize_variance = (rand() % 2 == 0);
+  OnlineCmvnState cmvn_state(global_stats);
+  OnlineMatrixFeature matrix_feats(input_feats);
+  // two separate objects, as the stats they cache depend on the order in
+  // which frames are requested.
+  OnlineCmvn cmvn1(opts, cmvn_state, &matrix_feats),
+      cmvn2(opts, cmvn_state, &matrix_feats);
+
+  Matrix<BaseFloat> output_feats1, output_feats2;
+  GetOutput(&cmvn1, &output_feats1);
+  GetOutputInBlocks(&cmvn2, &output_feats2);
+  KALDI_ASSERT(output_feats1.ApproxEqual(output_feats2));
 }
 
 void TestOnlineMfcc() {
@@ -277,6 +342,10 @@ void TestOnlineTransform() {
   Matrix<BaseFloat> trans_feats;
   GetOutput(&online_trans, &trans_feats);
 
+  Matrix<BaseFloat> trans_feats2;
+  GetOutputInBlocks(&online_trans, &trans_feats2);
+  KALDI_ASSERT(trans_feats.ApproxEqual(trans_feats2));
+
   Matrix<BaseFloat> output_feats(mfcc_feats.NumRows(), mfcc_feats.NumCols());
   for (int32 i = 0; i < mfcc_feats.NumRows(); i++) {
     Vector<BaseFloat> vec_tmp(mfcc_feats.Row(i));
@@ -353,6 +422,10 @@ void TestOnlineAppendFeature() {
     Matrix<BaseFloat> online_mfcc_plp_feats;
     GetOutput(&online_mfcc_plp, &online_mfcc_plp_feats);
 
+    Matrix<BaseFloat> online_mfcc_plp_feats2;
+    GetOutputInBlocks(&online_mfcc_plp, &online_mfcc_plp_feats2);
+    AssertEqual(online_mfcc_plp_feats, online_mfcc_plp_feats2);
+
     // compare mfcc_feats & plp_features with online_mfcc_plp_feats
     KALDI_ASSERT(mfcc_feats.NumRows() == online_mfcc_plp_feats.NumRows()
       && plp_feats.NumRows() == online_mfcc_plp_feats.NumRows()
@@ -383,6 +456,7 @@ int main() {
     TestOnlineMatrixCacheFeature();
     TestOnlineDeltaFeature();
     TestOnlineSpliceFrames();
+    TestOnlineCmvn();
     TestOnlineMfcc();
     TestOnlinePlp();
     TestOnlineTransform();
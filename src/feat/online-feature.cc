@@ -31,6 +31,14 @@ void OnlineGenericBaseFeature<C>::GetFrame(int32 frame,
   feat->CopyFromVec(*(features_.at(frame)));
 };
 
+template<class C>
+void OnlineGenericBaseFeature<C>::GetFrames(const std::vector<int32> &frames,
+                                            MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+  for (size_t i = 0; i < frames.size(); i++)
+    feats->Row(i).CopyFromVec(*(features_.at(frames[i])));
+}
+
 template<class C>
 OnlineGenericBaseFeature<C>::OnlineGenericBaseFeature(
     const typename C::Options &opts):
@@ -242,27 +250,42 @@ void OnlineCmvn::ComputeStatsForFrame(int32 frame,
   Matrix<double> stats(2, dim + 1);
   GetMostRecentCachedFrame(frame, &cur_frame, &stats);
 
-  Vector<BaseFloat> feats(dim);
-  Vector<double> feats_dbl(dim);
-  while (cur_frame < frame) {
-    cur_frame++;
-    src_->GetFrame(cur_frame, &feats);
-    feats_dbl.CopyFromVec(feats);
-    stats.Row(0).Range(0, dim).AddVec(1.0, feats_dbl);
-    stats.Row(1).Range(0, dim).AddVec2(1.0, feats_dbl);
-    stats(0, dim) += 1.0;
-    // it's a sliding buffer; a frame at the back may be
-    // leaving the buffer so we have to subtract that.
-    int32 prev_frame = cur_frame - opts_.cmn_window;
-    if (prev_frame >= 0) {
-      // we need to subtract frame prev_f from the stats.
-      src_->GetFrame(prev_frame, &feats);
-      feats_dbl.CopyFromVec(feats);
-      stats.Row(0).Range(0, dim).AddVec(-1.0, feats_dbl);
-      stats.Row(1).Range(0, dim).AddVec2(-1.0, feats_dbl);
-      stats(0, dim) -= 1.0;
+  if (cur_frame < frame) {
+    // Get all the frames entering the window, and those leaving it, with one
+    // call to GetFrames(); row i of 'feats' is frame cur_frame + 1 + i, and
+    // row num_new + j is the frame that leaves the window when frame
+    // first_leaving_frame + j enters it.
+    int32 num_new = frame - cur_frame,
+        first_leaving_frame = std::max(cur_frame + 1,
+                                       opts_.cmn_window),
+        num_leaving = std::max(0, frame + 1 - first_leaving_frame);
+    std::vector<int32> frames(num_new + num_leaving);
+    for (int32 i = 0; i < num_new; i++)
+      frames[i] = cur_frame + 1 + i;
+    for (int32 j = 0; j < num_leaving; j++)
+      frames[num_new + j] = first_leaving_frame + j - opts_.cmn_window;
+    Matrix<BaseFloat> feats(frames.size(), dim, kUndefined);
+    src_->GetFrames(frames, &feats);
+    Vector<double> feats_dbl(dim);
+    while (cur_frame < frame) {
+      cur_frame++;
+      feats_dbl.CopyFromVec(feats.Row(cur_frame - frames[0]));
+      stats.Row(0).Range(0, dim).AddVec(1.0, feats_dbl);
+      stats.Row(1).Range(0, dim).AddVec2(1.0, feats_dbl);
+      stats(0, dim) += 1.0;
+      // it's a sliding buffer; a frame at the back may be
+      // leaving the buffer so we have to subtract that.
+      int32 prev_frame = cur_frame - opts_.cmn_window;
+      if (prev_frame >= 0) {
+        // we need to subtract frame prev_f from the stats.
+        feats_dbl.CopyFromVec(
+            feats.Row(num_new + cur_frame - first_leaving_frame));
+        stats.Row(0).Range(0, dim).AddVec(-1.0, feats_dbl);
+        stats.Row(1).Range(0, dim).AddVec2(-1.0, feats_dbl);
+        stats(0, dim) -= 1.0;
+      }
+      CacheFrame(cur_frame, stats);
     }
-    CacheFrame(cur_frame, stats);
   }
   stats_out->CopyFromMat(stats);
 }
@@ -306,26 +329,31 @@ void OnlineCmvn::SmoothOnlineCmvnStats(const MatrixBase<double> &speaker_stats,
   }
 }
 
-void OnlineCmvn::GetFrame(int32 frame,
-                          VectorBase<BaseFloat> *feat) {
-  src_->GetFrame(frame, feat);
-  KALDI_ASSERT(feat->Dim() == this->Dim());
-  int32 dim = feat->Dim();
-  Matrix<double> stats(2, dim + 1);
+void OnlineCmvn::GetNormalizationStats(int32 frame,
+                                       MatrixBase<double> *stats) {
   if (frozen_state_.NumRows() != 0) {  // the CMVN state has been frozen.
-    stats.CopyFromMat(frozen_state_);
+    stats->CopyFromMat(frozen_state_);
   } else {
     // first get the raw CMVN stats (this involves caching..)
-    this->ComputeStatsForFrame(frame, &stats);
+    this->ComputeStatsForFrame(frame, stats);
     // now smooth them.
     SmoothOnlineCmvnStats(orig_state_.speaker_cmvn_stats,
                           orig_state_.global_cmvn_stats,
                           opts_,
-                          &stats);
+                          stats);
   }
 
   if (!skip_dims_.empty())
-    FakeStatsForSomeDims(skip_dims_, &stats);
+    FakeStatsForSomeDims(skip_dims_, stats);
+}
+
+void OnlineCmvn::GetFrame(int32 frame,
+                          VectorBase<BaseFloat> *feat) {
+  src_->GetFrame(frame, feat);
+  KALDI_ASSERT(feat->Dim() == this->Dim());
+  int32 dim = feat->Dim();
+  Matrix<double> stats(2, dim + 1);
+  GetNormalizationStats(frame, &stats);
 
   // call the function ApplyCmvn declared in ../transform/cmvn.h, which
   // requires a matrix.
@@ -339,6 +367,23 @@ void OnlineCmvn::GetFrame(int32 frame,
   feat->CopyFromVec(feat_mat.Row(0));
 }
 
+void OnlineCmvn::GetFrames(const std::vector<int32> &frames,
+                           MatrixBase<BaseFloat> *feats) {
+  src_->GetFrames(frames, feats);
+  KALDI_ASSERT(feats->NumCols() == this->Dim());
+  if (!opts_.normalize_mean) {
+    KALDI_ASSERT(!opts_.normalize_variance);
+    return;
+  }
+  int32 dim = feats->NumCols();
+  Matrix<double> stats(2, dim + 1);
+  for (size_t i = 0; i < frames.size(); i++) {
+    GetNormalizationStats(frames[i], &stats);
+    SubMatrix<BaseFloat> feat(*feats, i, 1, 0, dim);
+    ApplyCmvn(stats, opts_.normalize_variance, &feat);
+  }
+}
+
 void OnlineCmvn::Freeze(int32 cur_frame) {
   int32 dim = this->Dim();
   Matrix<double> stats(2, dim + 1);
@@ -406,6 +451,40 @@ void OnlineSpliceFrames::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   }
 }
 
+void OnlineSpliceFrames::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(left_context_ >= 0 && right_context_ >= 0);
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+  if (frames.empty())
+    return;
+  int32 dim_in = src_->Dim(), context = 1 + left_context_ + right_context_,
+      T = src_->NumFramesReady(), num_frames_ready = NumFramesReady();
+  KALDI_ASSERT(feats->NumCols() == dim_in * context);
+  // Work out the distinct source frames we need, and get them all at once.
+  std::vector<int32> src_frames;
+  src_frames.reserve(frames.size() * context);
+  for (size_t i = 0; i < frames.size(); i++) {
+    int32 frame = frames[i];
+    KALDI_ASSERT(frame >= 0 && frame < num_frames_ready);
+    for (int32 t2 = frame - left_context_; t2 <= frame + right_context_; t2++)
+      src_frames.push_back(std::min(std::max(t2, 0), T - 1));
+  }
+  SortAndUniq(&src_frames);
+  Matrix<BaseFloat> src_feats(src_frames.size(), dim_in, kUndefined);
+  src_->GetFrames(src_frames, &src_feats);
+  for (size_t i = 0; i < frames.size(); i++) {
+    int32 frame = frames[i];
+    for (int32 t2 = frame - left_context_; t2 <= frame + right_context_; t2++) {
+      int32 t2_limited = std::min(std::max(t2, 0), T - 1),
+          n = t2 - (frame - left_context_),
+          src_row = std::lower_bound(src_frames.begin(), src_frames.end(),
+                                     t2_limited) - src_frames.begin();
+      SubVector<BaseFloat> part(feats->Row(i), n * dim_in, dim_in);
+      part.CopyFromVec(src_feats.Row(src_row));
+    }
+  }
+}
+
 OnlineTransform::OnlineTransform(const MatrixBase<BaseFloat> &transform,
                                  OnlineFeatureInterface *src):
     src_(src) {
@@ -430,6 +509,16 @@ void OnlineTransform::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   feat->AddMatVec(1.0, linear_term_, kNoTrans, input_feat, 1.0);
 }
 
+void OnlineTransform::GetFrames(const std::vector<int32> &frames,
+                                MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+  Matrix<BaseFloat> input_feats(frames.size(), linear_term_.NumCols(),
+                                kUndefined);
+  src_->GetFrames(frames, &input_feats);
+  feats->CopyRowsFromVec(offset_);
+  feats->AddMatMat(1.0, input_feats, kNoTrans, linear_term_, kTrans, 1.0);
+}
+
 
 int32 OnlineDeltaFeature::Dim() const {
   int32 src_dim = src_->Dim();
@@ -473,6 +562,45 @@ void OnlineDeltaFeature::GetFrame(int32 frame,
   delta_features_.Process(temp_src, temp_t, feat);
 }
 
+void OnlineDeltaFeature::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows() &&
+               feats->NumCols() == Dim());
+  if (frames.empty())
+    return;
+  int32 context = opts_.order * opts_.window,
+      src_frames_ready = src_->NumFramesReady(),
+      num_frames_ready = NumFramesReady();
+  int32 first_frame = frames[0], last_frame = frames[0];
+  for (size_t i = 0; i < frames.size(); i++) {
+    KALDI_ASSERT(frames[i] >= 0 && frames[i] < num_frames_ready);
+    first_frame = std::min(first_frame, frames[i]);
+    last_frame = std::max(last_frame, frames[i]);
+  }
+  int32 left_frame = std::max(0, first_frame - context),
+      right_frame = std::min(src_frames_ready - 1, last_frame + context),
+      temp_num_frames = right_frame + 1 - left_frame;
+  if (temp_num_frames > static_cast<int32>(frames.size()) * (2 * context + 1)) {
+    // The frames are too spread out for it to be worth getting all the
+    // source frames in between; do them one by one.
+    OnlineFeatureInterface::GetFrames(frames, feats);
+    return;
+  }
+  // The source features for the whole block; computing the deltas on this
+  // gives the same result as GetFrame(), since the deltas for each frame only
+  // look at the frames within 'context' of it, and the block is truncated
+  // only at the edges of the available source features.
+  std::vector<int32> src_frames(temp_num_frames);
+  for (int32 t = 0; t < temp_num_frames; t++)
+    src_frames[t] = left_frame + t;
+  Matrix<BaseFloat> temp_src(temp_num_frames, src_->Dim(), kUndefined);
+  src_->GetFrames(src_frames, &temp_src);
+  for (size_t i = 0; i < frames.size(); i++) {
+    SubVector<BaseFloat> feat(*feats, i);
+    delta_features_.Process(temp_src, frames[i] - left_frame, &feat);
+  }
+}
+
 
 OnlineDeltaFeature::OnlineDeltaFeature(const DeltaFeaturesOptions &opts,
                                        OnlineFeatureInterface *src):
@@ -493,6 +621,36 @@ void OnlineCacheFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   }
 }
 
+void OnlineCacheFeature::GetFrames(const std::vector<int32> &frames,
+                                   MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+  std::vector<int32> frames_out;
+  std::vector<int32> uncached_frames;
+  for (size_t i = 0; i < frames.size(); i++) {
+    int32 frame = frames[i];
+    KALDI_ASSERT(frame >= 0);
+    if (static_cast<size_t>(frame) < cache_.size() && cache_[frame] != NULL) {
+      feats->Row(i).CopyFromVec(*(cache_[frame]));
+    } else {
+      uncached_frames.push_back(frame);
+      frames_out.push_back(i);
+    }
+  }
+  if (uncached_frames.empty())
+    return;
+  Matrix<BaseFloat> uncached_feats(uncached_frames.size(), Dim(), kUndefined);
+  // The following call will crash if any of the frames are not ready.
+  src_->GetFrames(uncached_frames, &uncached_feats);
+  for (size_t i = 0; i < uncached_frames.size(); i++) {
+    int32 frame = uncached_frames[i];
+    if (static_cast<size_t>(frame) >= cache_.size())
+      cache_.resize(frame + 1, NULL);
+    if (cache_[frame] == NULL)  // the same frame may be requested twice.
+      cache_[frame] = new Vector<BaseFloat>(uncached_feats.Row(i));
+    feats->Row(frames_out[i]).CopyFromVec(uncached_feats.Row(i));
+  }
+}
+
 void OnlineCacheFeature::ClearCache() {
   for (size_t i = 0; i < cache_.size(); i++)
     delete cache_[i];
@@ -510,5 +668,16 @@ void OnlineAppendFeature::GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
   src2_->GetFrame(frame, &feat2);
 };
 
+void OnlineAppendFeature::GetFrames(const std::vector<int32> &frames,
+                                    MatrixBase<BaseFloat> *feats) {
+  KALDI_ASSERT(feats->NumCols() == Dim());
+  int32 num_frames = feats->NumRows(), dim1 = src1_->Dim(),
+      dim2 = src2_->Dim();
+  SubMatrix<BaseFloat> feats1(*feats, 0, num_frames, 0, dim1),
+      feats2(*feats, 0, num_frames, dim1, dim2);
+  src1_->GetFrames(frames, &feats1);
+  src2_->GetFrames(frames, &feats2);
+}
+
 
 }  // namespace kaldi
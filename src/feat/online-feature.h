@@ -65,6 +65,9 @@ class OnlineGenericBaseFeature: public OnlineBaseFeature {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   // Next, functions that are not in the interface.
 
 
@@ -153,6 +156,13 @@ class OnlineMatrixFeature: public OnlineFeatureInterface {
     feat->CopyFromVec(mat_.Row(frame));
   }
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats) {
+    KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+    if (!frames.empty())
+      feats->CopyRows(mat_, &(frames[0]));
+  }
+
   virtual bool IsLastFrame(int32 frame) const {
     return (frame + 1 == mat_.NumRows());
   }
@@ -308,6 +318,9 @@ class OnlineCmvn: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -385,6 +398,11 @@ class OnlineCmvn: public OnlineFeatureInterface {
   void ComputeStatsForFrame(int32 frame,
                             MatrixBase<double> *stats);
 
+  /// Gets the stats that are used to normalize this frame: the frozen stats if
+  /// Freeze() was called, else the smoothed output of ComputeStatsForFrame(),
+  /// in either case with fake stats for the dimensions in skip_dims_.
+  void GetNormalizationStats(int32 frame, MatrixBase<double> *stats);
+
 
   OnlineCmvnOptions opts_;
   std::vector<int32> skip_dims_; // Skip CMVN for these dimensions.  Derived from opts_.
@@ -439,6 +457,9 @@ class OnlineSpliceFrames: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -472,6 +493,10 @@ class OnlineTransform: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  // Does the transform for all the frames in one matrix multiplication.
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -506,6 +531,9 @@ class OnlineDeltaFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   //
   // Next, functions that are not in the interface.
   //
@@ -537,6 +565,11 @@ class OnlineCacheFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  // Gets any frames that are not already cached from the source in a single
+  // call to its GetFrames().
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   virtual ~OnlineCacheFeature() { ClearCache(); }
 
   // Things that are not in the shared interface:
@@ -574,6 +607,9 @@ class OnlineAppendFeature: public OnlineFeatureInterface {
 
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat);
 
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats);
+
   virtual ~OnlineAppendFeature() {  }
 
   OnlineAppendFeature(OnlineFeatureInterface *src1,
@@ -504,6 +504,87 @@ void ComposeDeterministicOnDemandInverse(const Fst<Arc> &right,
 
 
 
+template<class Arc>
+void PushLookaheadWeights(DeterministicOnDemandFst<Arc> *lm,
+                          MutableFst<Arc> *fst) {
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Label Label;
+  typedef typename Arc::Weight Weight;
+  typedef typename Weight::ValueType Value;
+  const Value inf = std::numeric_limits<Value>::infinity();
+  StateId num_states = fst->NumStates(), start = fst->Start();
+  if (start == kNoStateId)
+    return;
+  StateId lm_start = lm->Start();
+  // The cost of each word label, from the start state of 'lm'.
+  std::unordered_map<Label, Value> word_costs;
+  // phi[s] starts as the lowest cost of the word labels on the arcs leaving s;
+  // preds[t] lists the states s that have an arc to t without a word label.
+  std::vector<Value> phi(num_states, inf);
+  std::vector<std::vector<StateId> > preds(num_states);
+  for (StateId s = 0; s < num_states; s++) {
+    for (ArcIterator<MutableFst<Arc> > aiter(*fst, s); !aiter.Done();
+         aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.olabel == 0) {
+        if (arc.nextstate != s)
+          preds[arc.nextstate].push_back(s);
+        continue;
+      }
+      typename std::unordered_map<Label, Value>::iterator iter =
+          word_costs.find(arc.olabel);
+      if (iter == word_costs.end()) {
+        Arc lm_arc;
+        Value cost = (lm->GetArc(lm_start, arc.olabel, &lm_arc) ?
+                      lm_arc.weight.Value() : inf);
+        iter = word_costs.insert(std::make_pair(arc.olabel, cost)).first;
+      }
+      phi[s] = std::min(phi[s], iter->second);
+    }
+  }
+  // Now propagate the costs back over the arcs without word labels, cheapest
+  // first (this is Dijkstra's algorithm with zero-cost edges).
+  typedef std::pair<Value, StateId> QueueElem;
+  std::priority_queue<QueueElem, std::vector<QueueElem>,
+                      std::greater<QueueElem> > queue;
+  for (StateId s = 0; s < num_states; s++)
+    if (phi[s] != inf)
+      queue.push(QueueElem(phi[s], s));
+  while (!queue.empty()) {
+    QueueElem elem = queue.top();
+    queue.pop();
+    if (elem.first > phi[elem.second])
+      continue;  // we already processed this state with a lower cost.
+    const std::vector<StateId> &this_preds = preds[elem.second];
+    for (size_t i = 0; i < this_preds.size(); i++) {
+      StateId p = this_preds[i];
+      if (elem.first < phi[p]) {
+        phi[p] = elem.first;
+        queue.push(QueueElem(elem.first, p));
+      }
+    }
+  }
+  for (StateId s = 0; s < num_states; s++)
+    if (phi[s] == inf)
+      phi[s] = 0.0;
+  Value offset = phi[start];
+  for (StateId s = 0; s < num_states; s++)
+    phi[s] -= offset;
+
+  for (StateId s = 0; s < num_states; s++) {
+    for (MutableArcIterator<MutableFst<Arc> > aiter(fst, s); !aiter.Done();
+         aiter.Next()) {
+      Arc arc = aiter.Value();
+      arc.weight = Times(arc.weight, Weight(phi[arc.nextstate] - phi[s]));
+      aiter.SetValue(arc);
+    }
+    Weight final = fst->Final(s);
+    if (final != Weight::Zero())
+      fst->SetFinal(s, Times(final, Weight(-phi[s])));
+  }
+}
+
+
 } // end namespace fst
 
 
@@ -218,6 +218,50 @@ void TestCompose() {
   }
 }
 
+// Checks that PushLookaheadWeights() does not change the weights of complete
+// paths, by following random paths through the FST before and after.
+void TestPushLookaheadWeights() {
+  RandFstOptions opts;
+  opts.acyclic = true;
+  opts.allow_empty = false;
+  StdVectorFst *fst = RandFst<StdArc>(opts);
+  // A unigram language model with random costs for the words.
+  StdVectorFst lm_fst;
+  lm_fst.AddState();
+  lm_fst.SetStart(0);
+  lm_fst.SetFinal(0, Weight::One());
+  for (Label word = 1; word < static_cast<Label>(opts.n_syms); word++)
+    lm_fst.AddArc(0, StdArc(word, word, 0.5 * kaldi::RandInt(0, 10), 0));
+  BackoffDeterministicOnDemandFst<StdArc> lm(lm_fst);
+
+  StdVectorFst pushed_fst(*fst);
+  PushLookaheadWeights(&lm, &pushed_fst);
+  KALDI_ASSERT(pushed_fst.NumStates() == fst->NumStates());
+  for (int32 i = 0; i < 10; i++) {
+    StateId s = fst->Start();
+    Weight weight = Weight::One(), pushed_weight = Weight::One();
+    while (true) {
+      int32 num_arcs = fst->NumArcs(s);
+      if (num_arcs == 0 || (fst->Final(s) != Weight::Zero() &&
+                            kaldi::Rand() % 2 == 0)) {
+        weight = Times(weight, fst->Final(s));
+        pushed_weight = Times(pushed_weight, pushed_fst.Final(s));
+        break;
+      }
+      int32 n = kaldi::Rand() % num_arcs;
+      ArcIterator<StdVectorFst> aiter(*fst, s), pushed_aiter(pushed_fst, s);
+      aiter.Seek(n);
+      pushed_aiter.Seek(n);
+      KALDI_ASSERT(aiter.Value().nextstate == pushed_aiter.Value().nextstate);
+      weight = Times(weight, aiter.Value().weight);
+      pushed_weight = Times(pushed_weight, pushed_aiter.Value().weight);
+      s = aiter.Value().nextstate;
+    }
+    KALDI_ASSERT(ApproxEqual(weight, pushed_weight));
+  }
+  delete fst;
+}
+
 }
 
 
@@ -225,5 +269,7 @@ int main() {
   using namespace fst;
   TestBackoffAndCache();
   TestCompose();
+  for (int32 i = 0; i < 10; i++)
+    TestPushLookaheadWeights();
 }
   
@@ -49,7 +49,11 @@
 */
 
 #include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -324,6 +328,26 @@ void ComposeDeterministicOnDemandInverse(const Fst<Arc> &fst1,
                                          MutableFst<Arc> *fst_composed);
 
 
+/**
+   This function prepares 'fst', whose output labels are words (e.g. HCL, the
+   decoding graph without the language model), for being composed on the fly
+   with the language model 'lm', as LatticeBiglmFasterDecoder does.  Without
+   the language model, there is nothing in the scores to tell the decoder
+   which words are likely until it reaches their word labels, which makes
+   pruning ineffective.  So we add "label-lookahead" weights: each state s
+   gets a potential phi(s), the lowest cost under 'lm' of the words whose
+   labels can be reached from s without crossing another word label, and we
+   add phi(t) - phi(s) to the weight of each arc from s to t and -phi(s) to
+   the final-weight of s.  The weights of complete paths are unchanged (we
+   subtract phi(start) from all the potentials, so phi(start) = 0).  For the
+   cost of a word we use its cost from the start state of 'lm', which is
+   cheap to get; states that can't reach any word label get a potential of
+   zero.  'fst' must be expanded (e.g. a VectorFst), and its weights must be
+   of a type such as TropicalWeight that has Value().
+*/
+template<class Arc>
+void PushLookaheadWeights(DeterministicOnDemandFst<Arc> *lm,
+                          MutableFst<Arc> *fst);
 
 
 /// @}
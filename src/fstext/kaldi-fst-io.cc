@@ -73,6 +73,16 @@ Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename, bool throw_on_err) {
   FstReadOptions ropts("<unspecified>", &hdr);
   Fst<StdArc> *fst = NULL;
   if (hdr.FstType() == "const") {
+    if ((hdr.GetFlags() & FstHeader::IS_ALIGNED) &&
+        kaldi::ClassifyRxfilename(rxfilename) == kaldi::kFileInput) {
+      // The FST was written with alignment (e.g. fstconvert --fst_align), so
+      // OpenFst can memory-map its states and arcs straight from the file
+      // instead of reading them into memory.  The pages are then loaded on
+      // demand and shared between all processes that map the same file.
+      ropts.mode = FstReadOptions::MAP;
+      ropts.source = rxfilename;
+      KALDI_VLOG(1) << "Memory-mapping FST from " << rxfilename;
+    }
     fst = ConstFst<StdArc>::Read(ki.Stream(), ropts);
   } else if (hdr.FstType() == "vector") {
     fst = VectorFst<StdArc>::Read(ki.Stream(), ropts);
@@ -47,6 +47,12 @@ VectorFst<StdArc> *ReadFstKaldi(std::string rxfilename);
 // doesn't support the text-mode option that we generally like to support.
 // This version currently supports ConstFst<StdArc> or VectorFst<StdArc>
 // (const-fst can give better performance for decoding).
+// If 'rxfilename' is an ordinary file containing a ConstFst that was written
+// with alignment (fstconvert --fst_type=const --fst_align, as utils/mkgraph.sh
+// does), the FST is memory-mapped read-only rather than read into memory:
+// loading then takes almost no time, and decoders on the same machine share
+// the graph's pages.  The file must not be modified in place while it is
+// mapped (replacing it with 'mv' is fine).
 Fst<StdArc> *ReadFstKaldiGeneric(std::string rxfilename,
                                  bool throw_on_err = true);
 
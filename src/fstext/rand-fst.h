@@ -22,6 +22,7 @@
 
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <fst/fstlib.h>
 #include <fst/fst-decl.h>
@@ -155,6 +156,42 @@ template<class Arc> VectorFst<Arc>* RandPairFst(RandFstOptions opts = RandFstOpt
 }
 
 
+/// Returns a random acyclic FST shaped like the lattices we get from decoding:
+/// each of 'num_frames' frames has 'states_per_frame' states, all connected to
+/// the states of the previous frame, and some of the arcs have input-epsilons,
+/// so that the epsilon closure matters.  The result is sorted on input label.
+/// Only works if weight can be constructed from a pair of floats.
+template<class Arc> VectorFst<Arc>* RandDeepPairFst(int32 num_frames,
+                                                     int32 states_per_frame) {
+  typedef typename Arc::StateId StateId;
+  typedef typename Arc::Weight Weight;
+  VectorFst<Arc> *fst = new VectorFst<Arc>();
+  StateId start = fst->AddState();
+  fst->SetStart(start);
+  std::vector<StateId> prev(1, start);
+  for (int32 t = 0; t < num_frames; t++) {
+    std::vector<StateId> cur(states_per_frame);
+    for (int32 j = 0; j < states_per_frame; j++)
+      cur[j] = fst->AddState();
+    for (size_t j = 0; j < prev.size(); j++) {
+      for (int32 k = 0; k < states_per_frame; k++) {
+        int32 ilabel = (kaldi::Rand() % 10 == 0 ? 0 :
+                        1 + kaldi::Rand() % 5),
+            olabel = (kaldi::Rand() % 10 == 0 ? 1 + kaldi::Rand() % 100 : 0);
+        Weight weight(kaldi::RandUniform(), kaldi::RandUniform());
+        fst->AddArc(prev[j], Arc(ilabel, olabel, weight, cur[k]));
+      }
+    }
+    prev = cur;
+  }
+  for (size_t j = 0; j < prev.size(); j++)
+    fst->SetFinal(prev[j], Weight::One());
+  ILabelCompare<Arc> ilabel_comp;
+  ArcSort(fst, ilabel_comp);
+  return fst;
+}
+
+
 } // end namespace fst.
 
 
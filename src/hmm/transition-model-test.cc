@@ -46,11 +46,28 @@ void TestTransitionModel() {
   delete trans_model;
 }
 
+void TestMapPdfLogLikelihoods() {
+  TransitionModel *trans_model = GenRandTransitionModel(NULL);
+  Vector<BaseFloat> pdf_loglikes(trans_model->NumPdfs());
+  pdf_loglikes.SetRandn();
+  BaseFloat scale = RandUniform();
+  std::vector<BaseFloat> loglikes;
+  trans_model->MapPdfLogLikelihoods(pdf_loglikes.Data(), scale, &loglikes);
+  KALDI_ASSERT(loglikes.size() == trans_model->NumTransitionIds() + 1 &&
+               loglikes[0] == 0.0);
+  for (int32 tid = 1; tid <= trans_model->NumTransitionIds(); tid++)
+    KALDI_ASSERT(loglikes[tid] ==
+                 scale * pdf_loglikes(trans_model->TransitionIdToPdf(tid)));
+  delete trans_model;
+}
+
 }
 
 int main() {
-  for (int i = 0; i < 2; i++)
+  for (int i = 0; i < 2; i++) {
     kaldi::TestTransitionModel();
+    kaldi::TestMapPdfLogLikelihoods();
+  }
   KALDI_LOG << "Test OK.\n";
 }
 
@@ -771,6 +771,16 @@ void TransitionModel::MapUpdateShared(const Vector<double> &stats,
 }
 
 
+void TransitionModel::MapPdfLogLikelihoods(
+    const BaseFloat *pdf_loglikes, BaseFloat scale,
+    std::vector<BaseFloat> *loglikes) const {
+  int32 num_tids = id2pdf_id_.size();
+  loglikes->resize(num_tids);
+  (*loglikes)[0] = 0.0;
+  for (int32 tid = 1; tid < num_tids; tid++)
+    (*loglikes)[tid] = scale * pdf_loglikes[id2pdf_id_[tid]];
+}
+
 int32 TransitionModel::TransitionIdToPhone(int32 trans_id) const {
   KALDI_ASSERT(trans_id != 0 && static_cast<size_t>(trans_id) < id2state_.size());
   int32 trans_state = id2state_[trans_id];
@@ -156,6 +156,13 @@ class TransitionModel {
   // this state doesn't have a self-loop.
 
   inline int32 TransitionIdToPdf(int32 trans_id) const;
+  /// Maps a row of log-likelihoods indexed by pdf-id, "pdf_loglikes", to one
+  /// indexed by transition-id, as DecodableInterface::FrameLogLikelihoods()
+  /// outputs it: "loglikes" is resized to NumTransitionIds() + 1, and
+  /// (*loglikes)[tid] = scale * pdf_loglikes[TransitionIdToPdf(tid)] for
+  /// tid > 0; element zero is set to zero.
+  void MapPdfLogLikelihoods(const BaseFloat *pdf_loglikes, BaseFloat scale,
+                            std::vector<BaseFloat> *loglikes) const;
   int32 TransitionIdToPhone(int32 trans_id) const;
   int32 TransitionIdToPdfClass(int32 trans_id) const;
   int32 TransitionIdToHmmState(int32 trans_id) const;
@@ -21,6 +21,7 @@
 
 #ifndef KALDI_ITF_DECODABLE_ITF_H_
 #define KALDI_ITF_DECODABLE_ITF_H_ 1
+#include <vector>
 #include "base/kaldi-common.h"
 
 namespace kaldi {
@@ -87,6 +88,21 @@ class DecodableInterface {
   /// returns false before calling this.
   virtual BaseFloat LogLikelihood(int32 frame, int32 index) = 0;
 
+  /// If the log-likelihoods of all the indices on frame "frame" are cheap to
+  /// get at once (e.g. because the acoustic model produces them as a row of a
+  /// matrix), outputs them to "loglikes" and returns true; "loglikes" is
+  /// resized to NumIndices() + 1, so that (*loglikes)[index] ==
+  /// LogLikelihood(frame, index) for 1 <= index <= NumIndices(), and element
+  /// zero is unused.  Otherwise (e.g. for GMMs, where likelihoods are computed
+  /// on demand) returns false without doing anything, and the caller should use
+  /// LogLikelihood() instead.  Decoders use this to avoid a
+  /// virtual-function call for each arc they traverse.  The default
+  /// implementation returns false.
+  virtual bool FrameLogLikelihoods(int32 frame,
+                                   std::vector<BaseFloat> *loglikes) {
+    return false;
+  }
+
   /// Returns true if this is the last frame.  Frames are zero-based, so the
   /// first frame is zero.  IsLastFrame(-1) will return false, unless the file
   /// is empty (which is a case that I'm not sure all the code will handle, so
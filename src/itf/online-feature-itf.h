@@ -74,6 +74,22 @@ class OnlineFeatureInterface {
   /// the class.
   virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) = 0;
 
+  /// This is like GetFrame() but for a collection of frames: row i of 'feats'
+  /// is set to the feature vector for frame frames[i].  The frames need not
+  /// be consecutive or in order, but they must all be ready.  There is a
+  /// default implementation that gets the frames one by one, but child
+  /// classes should override it where it is more efficient to process a
+  /// block of frames at once (e.g. one matrix multiplication for a whole
+  /// block instead of one per frame).
+  virtual void GetFrames(const std::vector<int32> &frames,
+                         MatrixBase<BaseFloat> *feats) {
+    KALDI_ASSERT(static_cast<int32>(frames.size()) == feats->NumRows());
+    for (size_t i = 0; i < frames.size(); i++) {
+      SubVector<BaseFloat> feat(*feats, i);
+      GetFrame(frames[i], &feat);
+    }
+  }
+
   // Returns frame shift in seconds.  Helps to estimate duration from frame
   // counts.
   virtual BaseFloat FrameShiftInSeconds() const = 0;
@@ -0,0 +1,59 @@
+// lat/determinize-lattice-pruned-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lat/determinize-lattice-pruned.h"
+#include "lat/kaldi-lattice.h"
+#include "fstext/rand-fst.h"
+#include "base/timer.h"
+
+namespace fst {
+
+// Times determinization of long, "deep" lattices, like those we get from long
+// utterances, with input-epsilon arcs so that the epsilon closure matters.
+// With a small max-mem, this also times the freeing of memory during
+// determinization.
+void TestDeterminizeLatticePrunedSpeed() {
+  using kaldi::LatticeArc;
+  using kaldi::LatticeWeight;
+  for (int32 i = 0; i < 2; i++) {
+    int32 num_frames = 1000 * (i + 1);
+    VectorFst<LatticeArc> *fst = RandDeepPairFst<LatticeArc>(num_frames, 3);
+
+    for (int32 j = 0; j < 2; j++) {
+      DeterminizeLatticePrunedOptions lat_opts;
+      if (j == 1)
+        lat_opts.max_mem = 1000000;
+      kaldi::Timer timer;
+      VectorFst<LatticeArc> det_fst;
+      bool ans = DeterminizeLatticePruned<LatticeWeight>(*fst, 4.0, &det_fst,
+                                                         lat_opts);
+      KALDI_LOG << "Determinizing lattice with " << num_frames << " frames "
+                << "and max-mem=" << lat_opts.max_mem << " took "
+                << timer.Elapsed() << " seconds; output has "
+                << det_fst.NumStates() << " states, success = " << ans;
+    }
+    delete fst;
+  }
+}
+
+} // end namespace fst
+
+int main() {
+  using namespace fst;
+  TestDeterminizeLatticePrunedSpeed();
+  std::cout << "Tests succeeded\n";
+}
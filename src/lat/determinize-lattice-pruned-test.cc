@@ -137,11 +137,40 @@ template<class Arc> void TestDeterminizeLatticePruned2() {
 }
 
 
+// Checks that a small max-mem, which makes the determinizer free its caches
+// and rebuild its string repository while it runs, does not change the output
+// when determinization succeeds.
+void TestDeterminizeLatticePrunedMaxMem() {
+  using kaldi::LatticeArc;
+  using kaldi::LatticeWeight;
+  for (int32 i = 0; i < 20; i++) {
+    VectorFst<LatticeArc> *fst = RandDeepPairFst<LatticeArc>(
+        kaldi::RandInt(5, 40), kaldi::RandInt(1, 4));
+    DeterminizeLatticePrunedOptions lat_opts, lat_opts_small_mem;
+    lat_opts_small_mem.max_mem = kaldi::RandInt(2000, 200000);
+    VectorFst<LatticeArc> det_fst, det_fst_small_mem;
+    bool ans = DeterminizeLatticePruned<LatticeWeight>(*fst, 4.0, &det_fst,
+                                                       lat_opts),
+        ans_small_mem = DeterminizeLatticePruned<LatticeWeight>(
+            *fst, 4.0, &det_fst_small_mem, lat_opts_small_mem);
+    KALDI_ASSERT(ans && det_fst.NumStates() > 0 &&
+                 (det_fst.Properties(kIDeterministic, true) &
+                  kIDeterministic));
+    KALDI_LOG << "With max-mem=" << lat_opts_small_mem.max_mem
+              << ", determinization "
+              << (ans_small_mem ? "succeeded" : "failed");
+    if (ans_small_mem)
+      KALDI_ASSERT(Equal(det_fst, det_fst_small_mem));
+    delete fst;
+  }
+}
+
 } // end namespace fst
 
 int main() {
   using namespace fst;
   TestDeterminizeLatticePruned<kaldi::LatticeArc>();
   TestDeterminizeLatticePruned2<kaldi::LatticeArc>();
+  TestDeterminizeLatticePrunedMaxMem();
   std::cout << "Tests succeeded\n";
 }
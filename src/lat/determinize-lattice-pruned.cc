@@ -19,6 +19,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <vector>
 #include <climits>
 #include "fstext/determinize-lattice.h" // for LatticeStringRepository
@@ -215,15 +216,15 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       empty_subset.swap(output_states_[i]->minimal_subset);
     }
 
-    for (typename InitialSubsetHash::iterator iter = initial_hash_.begin();
-         iter != initial_hash_.end(); ++iter)
-      delete iter->first;
-    { InitialSubsetHash tmp; tmp.swap(initial_hash_); }
+    ClearInitialHash();
     for (size_t i = 0; i < output_states_.size(); i++) {
       vector<Element> tmp;
       tmp.swap(output_states_[i]->minimal_subset);
     }
     { vector<char> tmp;  tmp.swap(isymbol_or_final_); }
+    { vector<int32> tmp;  tmp.swap(closure_index_); }
+    { vector<Element> tmp;  tmp.swap(closure_elems_); }
+    { vector<Element> tmp;  tmp.swap(closure_queue_); }
     { // Free up the queue.  I'm not sure how to make sure all
       // the memory is really freed (no swap() function)... doesn't really
       // matter much though.
@@ -242,6 +243,18 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // rest is deleted by destructors.
   }
 
+  // Frees the memory in initial_hash_.  This is only a cache that lets us skip
+  // the epsilon closure for initial subsets we have seen before, so we can
+  // clear it at any time; this is what we do first when we run low on memory.
+  void ClearInitialHash() {
+    for (typename InitialSubsetHash::iterator iter = initial_hash_.begin();
+         iter != initial_hash_.end(); ++iter) {
+      num_elems_ -= iter->first->size();
+      delete iter->first;
+    }
+    { InitialSubsetHash tmp(3, hasher_, equal_); tmp.swap(initial_hash_); }
+  }
+
   void RebuildRepository() { // rebuild the string repository,
     // freeing stuff we don't need.. we call this when memory usage
     // passes a supplied threshold.  We need to accumulate all the
@@ -286,21 +299,27 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
   }
 
   bool CheckMemoryUsage() {
-    int32 repo_size = repository_.MemSize(),
+    int64 repo_size = repository_.MemSize(),
         arcs_size = num_arcs_ * sizeof(TempArc),
         elems_size = num_elems_ * sizeof(Element),
         total_size = repo_size + arcs_size + elems_size;
     if (opts_.max_mem > 0 && total_size > opts_.max_mem) { // We passed the memory threshold.
-      // This is usually due to the repository getting large, so we
-      // clean this out.
+      // This is usually due to the repository getting large, so we clean this
+      // out.  We first clear initial_hash_, which is only a cache, as it
+      // refers to many strings that would otherwise have to be kept.
+      ClearInitialHash();
       RebuildRepository();
-      int32 new_repo_size = repository_.MemSize(),
-          new_total_size = new_repo_size + arcs_size + elems_size;
+      int64 new_repo_size = repository_.MemSize(),
+          new_elems_size = num_elems_ * sizeof(Element),
+          new_total_size = new_repo_size + arcs_size + new_elems_size;
 
-      KALDI_VLOG(2) << "Rebuilt repository in determinize-lattice: repository shrank from "
-                    << repo_size << " to " << new_repo_size << " bytes (approximately)";
+      KALDI_VLOG(2) << "Rebuilt repository in determinize-lattice: "
+                    << "repository shrank from " << repo_size << " to "
+                    << new_repo_size << " bytes, and elements from "
+                    << elems_size << " to " << new_elems_size
+                    << " bytes (approximately)";
 
-      if (new_total_size > static_cast<int32>(opts_.max_mem * 0.8)) {
+      if (new_total_size > static_cast<int64>(opts_.max_mem * 0.8)) {
         // Rebuilding didn't help enough-- we need a margin to stop
         // having to rebuild too often.  We'll just return to the user at
         // this point, with a partial lattice that's pruned tighter than
@@ -317,7 +336,8 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
                    << "size exceeds maximum " << opts_.max_mem
                    << " bytes; (repo,arcs,elems) = (" << repo_size << ","
                    << arcs_size << "," << elems_size
-                   << "), after rebuilding, repo size was " << new_repo_size
+                   << "), after rebuilding, (repo,elems) size was ("
+                   << new_repo_size << "," << new_elems_size << ")"
                    << ", effective beam was " << effective_beam
                    << " vs. requested beam " << beam_;
         return false;
@@ -635,14 +655,23 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     // be so at output].  This function follows input-epsilons, and augments the
     // subset accordingly.
 
-    std::priority_queue<Element, vector<Element>, greater<Element> > queue;
-    unordered_map<InputStateId, Element> cur_subset;
-    typedef typename unordered_map<InputStateId, Element>::iterator MapIter;
+    // "cur_subset" is closure_elems_, and closure_index_ maps each input state
+    // to its position there (or -1); these are class members, indexed by
+    // input state, to avoid a hash lookup and memory allocation per arc.  The
+    // "queue" is a heap in closure_queue_, ordered on the state.
+    vector<Element> &cur_subset = closure_elems_, &queue = closure_queue_;
+    vector<int32> &index = closure_index_;
+    if (index.size() < static_cast<size_t>(ifst_->NumStates()))
+      index.resize(ifst_->NumStates(), -1);
+    greater<Element> queue_compare;
     typedef typename vector<Element>::const_iterator VecIter;
+    KALDI_ASSERT(cur_subset.empty() && queue.empty());
 
     for (VecIter iter = subset->begin(); iter != subset->end(); ++iter) {
-      queue.push(*iter);
-      cur_subset[iter->state] = *iter;
+      queue.push_back(*iter);
+      std::push_heap(queue.begin(), queue.end(), queue_compare);
+      index[iter->state] = cur_subset.size();
+      cur_subset.push_back(*iter);
     }
 
     // find whether input fst is known to be sorted on input label.
@@ -651,8 +680,9 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
     int counter = 0; // stops infinite loops here for non-lattice-determinizable input
     // (e.g. input with negative-cost epsilon loops); useful in testing.
     while (queue.size() != 0) {
-      Element elem = queue.top();
-      queue.pop();
+      std::pop_heap(queue.begin(), queue.end(), queue_compare);
+      Element elem = queue.back();
+      queue.pop_back();
 
       // The next if-statement is a kind of optimization.  It's to prevent us
       // unnecessarily repeating the processing of a state.  "cur_subset" always
@@ -661,9 +691,13 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       // both the new (optimal) and old (less-optimal) Element will still be in
       // "queue".  The next if-statement stops us from wasting compute by
       // processing the old Element.
-      if (replaced_elems && cur_subset[elem.state] != elem)
+      if (replaced_elems && cur_subset[index[elem.state]] != elem)
         continue;
       if (opts_.max_loop > 0 && counter++ > opts_.max_loop) {
+        for (VecIter iter = cur_subset.begin(); iter != cur_subset.end(); ++iter)
+          index[iter->state] = -1;
+        cur_subset.clear();
+        queue.clear();
         KALDI_ERR << "Lattice determinization aborted since looped more than "
                   << opts_.max_loop << " times during epsilon closure.\n";
         throw std::runtime_error("looped more than max-arcs times in lattice determinization");
@@ -680,32 +714,36 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
           // next_elem.string is not set up yet... create it only
           // when we know we need it (this is an optimization)
 
-          MapIter iter = cur_subset.find(next_elem.state);
-          if (iter == cur_subset.end()) {
+          int32 next_index = index[next_elem.state];
+          if (next_index == -1) {
             // was no such StateId: insert and add to queue.
             next_elem.string = (arc.olabel == 0 ? elem.string :
                                 repository_.Successor(elem.string, arc.olabel));
-            cur_subset[next_elem.state] = next_elem;
-            queue.push(next_elem);
+            index[next_elem.state] = cur_subset.size();
+            cur_subset.push_back(next_elem);
+            queue.push_back(next_elem);
+            std::push_heap(queue.begin(), queue.end(), queue_compare);
           } else {
             // was not inserted because one already there.  In normal
             // determinization we'd add the weights.  Here, we find which one
             // has the better weight, and keep its corresponding string.
-            int comp = fst::Compare(next_elem.weight, iter->second.weight);
+            Element &cur_elem = cur_subset[next_index];
+            int comp = fst::Compare(next_elem.weight, cur_elem.weight);
             if (comp == 0) { // A tie on weights.  This should be a rare case;
                              // we don't optimize for it.
               next_elem.string = (arc.olabel == 0 ? elem.string :
                                   repository_.Successor(elem.string,
                                                         arc.olabel));
               comp = Compare(next_elem.weight, next_elem.string,
-                             iter->second.weight, iter->second.string);
+                             cur_elem.weight, cur_elem.string);
             }
             if(comp == 1) { // next_elem is better, so use its (weight, string)
               next_elem.string = (arc.olabel == 0 ? elem.string :
                                   repository_.Successor(elem.string, arc.olabel));
-              iter->second.string = next_elem.string;
-              iter->second.weight = next_elem.weight;
-              queue.push(next_elem);
+              cur_elem.string = next_elem.string;
+              cur_elem.weight = next_elem.weight;
+              queue.push_back(next_elem);
+              std::push_heap(queue.begin(), queue.end(), queue_compare);
               replaced_elems = true;
             }
             // else it is the same or worse, so use original one.
@@ -714,11 +752,11 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
       }
     }
 
-    { // copy cur_subset to subset.
-      subset->clear();
-      subset->reserve(cur_subset.size());
-      MapIter iter = cur_subset.begin(), end = cur_subset.end();
-      for (; iter != end; ++iter) subset->push_back(iter->second);
+    { // copy cur_subset to subset, and reset the index for next time.
+      subset->assign(cur_subset.begin(), cur_subset.end());
+      for (VecIter iter = cur_subset.begin(); iter != cur_subset.end(); ++iter)
+        index[iter->state] = -1;
+      cur_subset.clear();
       // sort by state ID, because the subset hash function is order-dependent(see SubsetKey)
       std::sort(subset->begin(), subset->end());
     }
@@ -1169,6 +1207,12 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 
   enum IsymbolOrFinal { OSF_UNKNOWN = 0, OSF_NO = 1, OSF_YES = 2 };
 
+  // Temporaries used in EpsilonClosure(); closure_index_ is indexed by input
+  // state and is -1 for states not in the current subset.
+  vector<int32> closure_index_;
+  vector<Element> closure_elems_;
+  vector<Element> closure_queue_;
+
   vector<char> isymbol_or_final_; // A kind of cache; it says whether
   // each state is (emitting or final) where emitting means it has at least one
   // non-epsilon output arc.  Only accessed by IsIsymbolOrFinal()
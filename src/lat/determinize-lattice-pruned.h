@@ -112,7 +112,8 @@ namespace fst {
 struct DeterminizeLatticePrunedOptions {
   float delta; // A small offset used to measure equality of weights.
   int max_mem; // If >0, determinization will fail and return false
-  // when the algorithm's (approximate) memory consumption crosses this threshold.
+  // when the algorithm's (approximate) memory consumption crosses this threshold
+  // and freeing its caches and unused strings does not bring it well below it.
   int max_loop; // If >0, can be used to detect non-determinizable input
   // (a case that wouldn't be caught by max_mem).
   int max_states;
@@ -24,6 +24,7 @@
 #include "lat/lattice-functions.h"
 #include "lm/const-arpa-lm.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -36,7 +37,8 @@ int main(int argc, char *argv[]) {
         "will be wrapped into the DeterministicOnDemandFst interface and the\n"
         "rescoring is done by composing with the wrapped LM using a special\n"
         "type of composition algorithm. Determinization will be applied on\n"
-        "the composed lattice.\n"
+        "the composed lattice.  With --num-threads, lattices are rescored in\n"
+        "parallel; the output is the same, and in the same order.\n"
         "\n"
         "Usage: lattice-lmrescore-const-arpa [options] lattice-rspecifier \\\n"
         "                                   const-arpa-in lattice-wspecifier\n"
@@ -45,9 +47,11 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -62,56 +66,70 @@ int main(int argc, char *argv[]) {
 
     // Reads the language model in ConstArpaLm format.
     ConstArpaLm const_arpa;
-    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    const_arpa.ReadMapped(lm_rxfilename);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
     CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
 
     int32 n_done = 0, n_fail = 0;
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
-
-      if (lm_scale != 0.0) {
-        // Before composing with the LM FST, we scale the lattice weights
-        // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
-        // We do it this way so we can determinize and it will give the
-        // right effect (taking the "best path" through the LM) regardless
-        // of the sign of lm_scale.
-        fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale), &clat);
-        ArcSort(&clat, fst::OLabelCompare<CompactLatticeArc>());
-
-        // Wraps the ConstArpaLm format language model into FST. We re-create it
-        // for each lattice to prevent memory usage increasing with time.
-        ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
-
-        // Composes lattice with language model.
-        CompactLattice composed_clat;
-        ComposeCompactLatticeDeterministic(clat,
-                                           &const_arpa_fst, &composed_clat);
-
-        // Determinizes the composed lattice.
-        Lattice composed_lat;
-        ConvertLattice(composed_clat, &composed_lat);
-        Invert(&composed_lat);
-        CompactLattice determinized_clat;
-        DeterminizeLattice(composed_lat, &determinized_clat);
-        fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), &determinized_clat);
-        if (determinized_clat.Start() == fst::kNoStateId) {
-          KALDI_WARN << "Empty lattice for utterance " << key
-              << " (incompatible LM?)";
-          n_fail++;
-        } else {
-          compact_lattice_writer.Write(key, determinized_clat);
-          n_done++;
-        }
-      } else {
+
+    // This is run in parallel for different lattices.  It only reads
+    // const_arpa, which is safe.
+    auto rescore = [&const_arpa, lm_scale](const std::string &key,
+                                           CompactLattice *clat,
+                                           CompactLattice *determinized_clat) {
+      if (lm_scale == 0.0) {
         // Zero scale so nothing to do.
+        *determinized_clat = *clat;
+        return;
+      }
+      // Before composing with the LM FST, we scale the lattice weights
+      // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
+      // We do it this way so we can determinize and it will give the
+      // right effect (taking the "best path" through the LM) regardless
+      // of the sign of lm_scale.
+      fst::ScaleLattice(fst::GraphLatticeScale(1.0/lm_scale), clat);
+      ArcSort(clat, fst::OLabelCompare<CompactLatticeArc>());
+
+      // Wraps the ConstArpaLm format language model into FST. We re-create it
+      // for each lattice to prevent memory usage increasing with time.
+      ConstArpaLmDeterministicFst const_arpa_fst(const_arpa);
+
+      // Composes lattice with language model.
+      CompactLattice composed_clat;
+      ComposeCompactLatticeDeterministic(*clat,
+                                         &const_arpa_fst, &composed_clat);
+
+      // Determinizes the composed lattice.
+      Lattice composed_lat;
+      ConvertLattice(composed_clat, &composed_lat);
+      Invert(&composed_lat);
+      DeterminizeLattice(composed_lat, determinized_clat);
+      fst::ScaleLattice(fst::GraphLatticeScale(lm_scale), determinized_clat);
+    };
+    // This is called for each lattice in order.
+    auto write = [&](const std::string &key,
+                     CompactLattice *determinized_clat) {
+      if (lm_scale != 0.0 && determinized_clat->Start() == fst::kNoStateId) {
+        KALDI_WARN << "Empty lattice for utterance " << key
+            << " (incompatible LM?)";
+        n_fail++;
+      } else {
+        compact_lattice_writer.Write(key, *determinized_clat);
         n_done++;
-        compact_lattice_writer.Write(key, clat);
       }
+    };
+
+    {
+      OrderedParallelMap<CompactLattice, CompactLattice> parallel_map(
+          sequencer_config, rescore, write);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        parallel_map.Run(compact_lattice_reader.Key(),
+                         compact_lattice_reader.Value());
+        compact_lattice_reader.FreeCurrent();
+      }
+      parallel_map.Wait();
     }
 
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
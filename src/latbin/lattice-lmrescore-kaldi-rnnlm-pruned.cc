@@ -28,6 +28,7 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -43,6 +44,8 @@ int main(int argc, char *argv[]) {
         "Rescores lattice with kaldi-rnnlm. This script is called from \n"
         "scripts/rnnlm/lmrescore_pruned.sh. An example for rescoring \n"
         "lattices is at egs/swbd/s5c/local/rnnlm/run_lstm.sh \n"
+        "With --num-threads, lattices are rescored in parallel; the output\n"
+        "is the same, and in the same order.\n"
         "\n"
         "Usage: lattice-lmrescore-kaldi-rnnlm-pruned [options] \\\n"
         "             <old-lm-rxfilename> <embedding-file> \\\n"
@@ -65,6 +68,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 0.5;
     BaseFloat acoustic_scale = 0.1;
     bool use_carpa = false;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -80,6 +84,7 @@ int main(int argc, char *argv[]) {
 
     opts.Register(&po);
     compose_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -91,6 +96,8 @@ int main(int argc, char *argv[]) {
     if (opts.bos_index == -1 || opts.eos_index == -1) {
       KALDI_ERR << "must set --bos-symbol and --eos-symbol options";
     }
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
 
     std::string lm_to_subtract_rxfilename, lats_rspecifier,
                 word_embedding_rxfilename, rnnlm_rxfilename, lats_wspecifier;
@@ -101,23 +108,19 @@ int main(int argc, char *argv[]) {
     lats_rspecifier = po.GetArg(4);
     lats_wspecifier = po.GetArg(5);
 
-    // for G.fst
+    // for G.fst.  These don't keep any state, so they can be shared between
+    // threads.
     fst::ScaleDeterministicOnDemandFst *lm_to_subtract_det_scale = NULL;
     fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_subtract_det_backoff = NULL;
     VectorFst<StdArc> *lm_to_subtract_fst = NULL;
 
     // for G.carpa
     ConstArpaLm* const_arpa = NULL;
-    fst::DeterministicOnDemandFst<StdArc> *carpa_lm_to_subtract_fst = NULL;
 
     KALDI_LOG << "Reading old LMs...";
     if (use_carpa) {
       const_arpa = new ConstArpaLm();
       ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
-      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
-      lm_to_subtract_det_scale
-        = new fst::ScaleDeterministicOnDemandFst(-lm_scale,
-                                                 carpa_lm_to_subtract_fst);
     } else {
       lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
           lm_to_subtract_rxfilename);
@@ -136,6 +139,7 @@ int main(int argc, char *argv[]) {
     CuMatrix<BaseFloat> word_embedding_mat;
     ReadKaldiObject(word_embedding_rxfilename, &word_embedding_mat);
 
+    // This is only read from, so it is shared between threads.
     const rnnlm::RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
 
     // Reads and writes as compact lattice.
@@ -144,16 +148,21 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    rnnlm::KaldiRnnlmDeterministicFst* lm_to_add_orig = 
-         new rnnlm::KaldiRnnlmDeterministicFst(max_ngram_order, info);
-
-    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
-      fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
-         new fst::ScaleDeterministicOnDemandFst(lm_scale, lm_to_add_orig);
-
-      std::string key = compact_lattice_reader.Key();
-      CompactLattice clat = compact_lattice_reader.Value();
-      compact_lattice_reader.FreeCurrent();
+    // This is run in parallel for different lattices.
+    auto rescore = [&](const std::string &key, CompactLattice *clat,
+                       CompactLattice *composed_clat) {
+      // The RNNLM FST and the const-arpa FST cache the LM states they have
+      // seen, so we create them for each lattice.
+      rnnlm::KaldiRnnlmDeterministicFst lm_to_add_orig(max_ngram_order, info);
+      fst::ScaleDeterministicOnDemandFst lm_to_add(lm_scale, &lm_to_add_orig);
+      ConstArpaLmDeterministicFst *carpa_lm_to_subtract_fst = NULL;
+      fst::ScaleDeterministicOnDemandFst *carpa_lm_to_subtract_det_scale = NULL;
+      if (use_carpa) {
+        carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
+        carpa_lm_to_subtract_det_scale =
+            new fst::ScaleDeterministicOnDemandFst(-lm_scale,
+                                                   carpa_lm_to_subtract_fst);
+      }
 
       // Before composing with the LM FST, we scale the lattice weights
       // by the inverse of "lm_scale".  We'll later scale by "lm_scale".
@@ -161,43 +170,52 @@ int main(int argc, char *argv[]) {
       // right effect (taking the "best path" through the LM) regardless
       // of the sign of lm_scale.
       if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
+        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), clat);
       }
-      TopSortCompactLatticeIfNeeded(&clat);
+      TopSortCompactLatticeIfNeeded(clat);
 
       fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
-          lm_to_subtract_det_scale, lm_to_add);
+          (use_carpa ? carpa_lm_to_subtract_det_scale :
+           lm_to_subtract_det_scale), &lm_to_add);
 
       // Composes lattice with language model.
-      CompactLattice composed_clat;
-      ComposeCompactLatticePruned(compose_opts, clat,
-                                  &combined_lms, &composed_clat);
-
-      lm_to_add_orig->Clear();
-
-      if (composed_clat.NumStates() == 0) {
+      ComposeCompactLatticePruned(compose_opts, *clat,
+                                  &combined_lms, composed_clat);
+      delete carpa_lm_to_subtract_det_scale;
+      delete carpa_lm_to_subtract_fst;
+
+      if (composed_clat->NumStates() != 0 && acoustic_scale != 1.0) {
+        fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
+                          composed_clat);
+      }
+    };
+    // This is called for each lattice in order.
+    auto write = [&](const std::string &key, CompactLattice *composed_clat) {
+      if (composed_clat->NumStates() == 0) {
         // Something went wrong.  A warning will already have been printed.
         num_err++;
       } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
+        compact_lattice_writer.Write(key, *composed_clat);
         num_done++;
       }
-      delete lm_to_add;
+    };
+
+    {
+      OrderedParallelMap<CompactLattice, CompactLattice> parallel_map(
+          sequencer_config, rescore, write);
+      for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+        parallel_map.Run(compact_lattice_reader.Key(),
+                         compact_lattice_reader.Value());
+        compact_lattice_reader.FreeCurrent();
+      }
+      parallel_map.Wait();
     }
 
     delete lm_to_subtract_fst;
-    delete lm_to_add_orig;
     delete lm_to_subtract_det_backoff;
     delete lm_to_subtract_det_scale;
 
     delete const_arpa;
-    delete carpa_lm_to_subtract_fst;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
@@ -26,6 +26,7 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
 
 int main(int argc, char *argv[]) {
   try {
@@ -38,18 +39,23 @@ int main(int argc, char *argv[]) {
     using fst::ReadFstKaldi;
 
     const char *usage =
-        "This program can be used to subtract scores from one language model and\n"
-        "add scores from another one.  It uses an efficient rescoring algorithm that\n"
-        "avoids exploring the entire composed lattice.  The first (negative-weight)\n"
-        "language model is expected to be an FST, e.g. G.fst; the second one can\n"
-        "either be in FST or const-arpa format.  Any FST-format language models will\n"
-        "be projected on their output by this program, making it unnecessary for the\n"
-        "caller to remove disambiguation symbols.\n"
+        "This program can be used to subtract scores from one language\n"
+        "model and add scores from another one.  It uses an efficient\n"
+        "rescoring algorithm that avoids exploring the entire composed\n"
+        "lattice.  The first (negative-weight) language model is expected to\n"
+        "be an FST, e.g. G.fst; the second one can either be in FST or\n"
+        "const-arpa format.  Any FST-format language models will be projected\n"
+        "on their output by this program, making it unnecessary for the\n"
+        "caller to remove disambiguation symbols.  With --num-threads,\n"
+        "lattices are rescored in parallel; the output is the same, and in\n"
+        "the same order.\n"
         "\n"
-        "Usage: lattice-lmrescore-pruned [options] <lm-to-subtract> <lm-to-add> <lattice-rspecifier> <lattice-wspecifier>\n"
+        "Usage: lattice-lmrescore-pruned [options] <lm-to-subtract> \\\n"
+        "           <lm-to-add> <lattice-rspecifier> <lattice-wspecifier>\n"
         " e.g.: lattice-lmrescore-pruned --acoustic-scale=0.1 \\\n"
         "      data/lang/G.fst data/lang_fg/G.fst ark:in.lats ark:out.lats\n"
-        " or: lattice-lmrescore-pruned --acoustic-scale=0.1 --add-const-arpa=true\\\n"
+        " or: lattice-lmrescore-pruned --acoustic-scale=0.1 \\\n"
+        "      --add-const-arpa=true \\\n"
         "      data/lang/G.fst data/lang_fg/G.carpa ark:in.lats ark:out.lats\n";
 
     ParseOptions po(usage);
@@ -60,6 +66,7 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 1.0;
     BaseFloat acoustic_scale = 1.0;
     bool add_const_arpa = false;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -69,7 +76,7 @@ int main(int argc, char *argv[]) {
     po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected"
                 "to be in const-arpa format; if false it's expected to be in FST"
                 "format.");
-
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -77,6 +84,8 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
 
     std::string lm_to_subtract_rxfilename = po.GetArg(1),
         lm_to_add_rxfilename = po.GetArg(2),
@@ -89,29 +98,18 @@ int main(int argc, char *argv[]) {
     VectorFst<StdArc> *lm_to_add_fst = NULL;
     ConstArpaLm const_arpa;
     if (add_const_arpa) {
-      ReadKaldiObject(lm_to_add_rxfilename, &const_arpa);
+      const_arpa.ReadMapped(lm_to_add_rxfilename);
     } else {
       lm_to_add_fst = fst::ReadAndPrepareLmFst(lm_to_add_rxfilename);
     }
+    // These two don't keep any state, so they can be shared between threads.
     fst::BackoffDeterministicOnDemandFst<StdArc> lm_to_subtract_det_backoff(
         *lm_to_subtract_fst);
     fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
         -lm_scale, &lm_to_subtract_det_backoff);
-
-
-    fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig = NULL,
-        *lm_to_add = NULL;
-    if (add_const_arpa) {
-      lm_to_add = new ConstArpaLmDeterministicFst(const_arpa);
-    } else {
-      lm_to_add = new fst::BackoffDeterministicOnDemandFst<StdArc>(
-          *lm_to_add_fst);
-    }
-    if (lm_scale != 1.0) {
-      lm_to_add_orig = lm_to_add;
-      lm_to_add = new fst::ScaleDeterministicOnDemandFst(lm_scale,
-                                                         lm_to_add_orig);
-    }
+    fst::BackoffDeterministicOnDemandFst<StdArc> *lm_to_add_det_backoff =
+        (add_const_arpa ? NULL :
+         new fst::BackoffDeterministicOnDemandFst<StdArc>(*lm_to_add_fst));
 
     KALDI_LOG << "Done.";
 
@@ -123,14 +121,27 @@ int main(int argc, char *argv[]) {
 
     int32 num_done = 0, num_err = 0;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice &clat = clat_reader.Value();
-
+    // This is run in parallel for different lattices.
+    auto rescore = [&](const std::string &key, CompactLattice *clat,
+                       CompactLattice *composed_clat) {
       if (acoustic_scale != 1.0) {
-        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), &clat);
+        fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale), clat);
       }
-      TopSortCompactLatticeIfNeeded(&clat);
+      TopSortCompactLatticeIfNeeded(clat);
+
+      // ConstArpaLmDeterministicFst caches the LM states it has seen, so we
+      // create one for each lattice; this also avoids memory gradually
+      // increasing with time.
+      ConstArpaLmDeterministicFst *lm_to_add_carpa =
+          (add_const_arpa ? new ConstArpaLmDeterministicFst(const_arpa) :
+           NULL);
+      fst::DeterministicOnDemandFst<StdArc> *lm_to_add =
+          (add_const_arpa ?
+           static_cast<fst::DeterministicOnDemandFst<StdArc>*>(
+               lm_to_add_carpa) : lm_to_add_det_backoff);
+      fst::ScaleDeterministicOnDemandFst lm_to_add_scale(lm_scale, lm_to_add);
+      if (lm_scale != 1.0)
+        lm_to_add = &lm_to_add_scale;
 
       // To avoid memory gradually increasing with time, we reconstruct the
       // composed-LM FST for each lattice we process.
@@ -140,30 +151,40 @@ int main(int argc, char *argv[]) {
       fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
           &lm_to_subtract_det_scale, lm_to_add);
 
-      CompactLattice composed_clat;
       ComposeCompactLatticePruned(compose_opts,
-                                  clat,
+                                  *clat,
                                   &combined_lms,
-                                  &composed_clat);
+                                  composed_clat);
+      delete lm_to_add_carpa;
 
-      if (composed_clat.NumStates() == 0) {
+      if (composed_clat->NumStates() != 0 && acoustic_scale != 1.0) {
+        fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
+                          composed_clat);
+      }
+    };
+    // This is called for each lattice in order.
+    auto write = [&](const std::string &key, CompactLattice *composed_clat) {
+      if (composed_clat->NumStates() == 0) {
         // Something went wrong.  A warning will already have been printed.
         num_err++;
       } else {
-        if (acoustic_scale != 1.0) {
-          if (acoustic_scale == 0.0)
-            KALDI_ERR << "Acoustic scale cannot be zero.";
-          fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale),
-                            &composed_clat);
-        }
-        compact_lattice_writer.Write(key, composed_clat);
+        compact_lattice_writer.Write(key, *composed_clat);
         num_done++;
       }
+    };
+
+    {
+      OrderedParallelMap<CompactLattice, CompactLattice> parallel_map(
+          sequencer_config, rescore, write);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        parallel_map.Run(clat_reader.Key(), clat_reader.Value());
+        clat_reader.FreeCurrent();
+      }
+      parallel_map.Wait();
     }
     delete lm_to_subtract_fst;
     delete lm_to_add_fst;
-    delete lm_to_add_orig;
-    delete lm_to_add;
+    delete lm_to_add_det_backoff;
 
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
@@ -20,9 +20,31 @@
 
 #include "util/common-utils.h"
 #include "util/kaldi-table.h"
+#include "util/kaldi-thread.h"
 #include "lat/sausages.h"
 #include <numeric>
 
+namespace kaldi {
+
+// The input to the MBR computation for one utterance; 'one_best' and 'times'
+// are empty if not supplied.
+struct CtmConfInput {
+  CompactLattice clat;
+  std::vector<int32> one_best;
+  std::vector<std::pair<BaseFloat, BaseFloat> > times;
+};
+
+// The output of the MBR computation for one utterance.
+struct CtmConfOutput {
+  std::vector<int32> words;
+  std::vector<BaseFloat> conf;
+  std::vector<std::pair<BaseFloat, BaseFloat> > times;
+  BaseFloat bayes_risk;
+  CtmConfOutput(): bayes_risk(0.0) { }
+};
+
+}  // namespace kaldi
+
 int main(int argc, char *argv[]) {
   try {
     using namespace kaldi;
@@ -42,7 +64,8 @@ int main(int argc, char *argv[]) {
         "utils/convert_ctm.pl.  The times produced by this program will only\n"
         "be meaningful if you do lattice-align-words on the input.  The\n"
         "<1-best-rspecifier> could be the output of utils/int2sym.pl or\n"
-        "nbest-to-linear.\n"
+        "nbest-to-linear.  With --num-threads, lattices are processed in\n"
+        "parallel; the output is the same, and in the same order.\n"
         "\n"
         "Usage: lattice-to-ctm-conf [options]  <lattice-rspecifier> \\\n"
         "                                          <ctm-wxfilename>\n"
@@ -58,6 +81,7 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 1.0, inv_acoustic_scale = 1.0, lm_scale = 1.0;
     BaseFloat frame_shift = 0.01;
     int32 confidence_digits = 2;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
 
     std::string word_syms_filename;
     po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for "
@@ -72,6 +96,7 @@ int main(int argc, char *argv[]) {
 
     MinimumBayesRiskOptions mbr_opts;
     mbr_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -126,42 +151,35 @@ int main(int argc, char *argv[]) {
     int32 n_done = 0, n_words = 0;
     BaseFloat tot_bayes_risk = 0.0;
 
-    for (; !clat_reader.Done(); clat_reader.Next()) {
-      std::string key = clat_reader.Key();
-      CompactLattice clat = clat_reader.Value();
-      clat_reader.FreeCurrent();
+    // This is run in parallel for different lattices.
+    auto decode = [&](const std::string &key, CtmConfInput *input,
+                      CtmConfOutput *output) {
+      CompactLattice &clat = input->clat;
       fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
 
       MinimumBayesRisk *mbr = NULL;
-
       if (one_best_rspecifier == "") {
         mbr = new MinimumBayesRisk(clat, mbr_opts);
+      } else if (times_rspecifier == "") {
+        // no 'times',
+        mbr = new MinimumBayesRisk(clat, input->one_best, mbr_opts);
       } else {
-        // check,
-        if (!one_best_reader.HasKey(key)) {
-          KALDI_WARN << "No 1-best present for utterance " << key;
-          continue;
-        }
-        if (times_rspecifier != "" && !times_reader.HasKey(key)) {
-          KALDI_WARN << "No 'times' present for utterance " << key;
-          continue;
-        }
-        // get the 'mbr' decoding object,
-        if (times_rspecifier == "") {
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, mbr_opts); // no 'times',
-        } else {
-          // with initial 'times' of the bins,
-          const std::vector<int32> &one_best = one_best_reader.Value(key);
-          const std::vector<std::pair<BaseFloat,BaseFloat> > &times = times_reader.Value(key);
-          mbr = new MinimumBayesRisk(clat, one_best, times, mbr_opts);
-        }
+        // with initial 'times' of the bins,
+        mbr = new MinimumBayesRisk(clat, input->one_best, input->times,
+                                   mbr_opts);
       }
-
-      const std::vector<BaseFloat> &conf = mbr->GetOneBestConfidences();
-      const std::vector<int32> &words = mbr->GetOneBest();
+      output->conf = mbr->GetOneBestConfidences();
+      output->words = mbr->GetOneBest();
+      output->times = mbr->GetOneBestTimes();
+      output->bayes_risk = mbr->GetBayesRisk();
+      delete mbr;
+    };
+    // This is called for each lattice in order.
+    auto write = [&](const std::string &key, CtmConfOutput *output) {
+      const std::vector<BaseFloat> &conf = output->conf;
+      const std::vector<int32> &words = output->words;
       const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
-          mbr->GetOneBestTimes();
+          output->times;
       KALDI_ASSERT(conf.size() == words.size() && words.size() == times.size());
       for (size_t i = 0; i < words.size(); i++) {
         KALDI_ASSERT(words[i] != 0 || mbr_opts.print_silence); // Should not have epsilons.
@@ -170,12 +188,40 @@ int main(int argc, char *argv[]) {
                     << words[i] << ' ' << conf[i] << '\n';
       }
       KALDI_LOG << "For utterance " << key << ", Bayes Risk "
-                << mbr->GetBayesRisk() << ", avg. confidence per-word "
+                << output->bayes_risk << ", avg. confidence per-word "
                 << std::accumulate(conf.begin(),conf.end(),0.0) / words.size();
       n_done++;
-      n_words += mbr->GetOneBest().size();
-      tot_bayes_risk += mbr->GetBayesRisk();
-      delete mbr;
+      n_words += words.size();
+      tot_bayes_risk += output->bayes_risk;
+    };
+
+    {
+      OrderedParallelMap<CtmConfInput, CtmConfOutput> parallel_map(
+          sequencer_config, decode, write);
+      for (; !clat_reader.Done(); clat_reader.Next()) {
+        std::string key = clat_reader.Key();
+        CtmConfInput input;
+        if (one_best_rspecifier != "") {
+          // check,
+          if (!one_best_reader.HasKey(key)) {
+            KALDI_WARN << "No 1-best present for utterance " << key;
+            continue;
+          }
+          if (times_rspecifier != "" && !times_reader.HasKey(key)) {
+            KALDI_WARN << "No 'times' present for utterance " << key;
+            continue;
+          }
+          // The random-access readers are not thread-safe, so we look up the
+          // 1-best and 'times' here.
+          input.one_best = one_best_reader.Value(key);
+          if (times_rspecifier != "")
+            input.times = times_reader.Value(key);
+        }
+        input.clat = clat_reader.Value();
+        clat_reader.FreeCurrent();
+        parallel_map.Run(key, std::move(input));
+      }
+      parallel_map.Wait();
     }
 
     KALDI_LOG << "Done " << n_done << " lattices.";
@@ -0,0 +1,126 @@
+// lm/const-arpa-lm-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <set>
+#include <unistd.h>
+
+#include "lm/const-arpa-lm.h"
+
+namespace kaldi {
+
+// Writes a random trigram language model in ARPA format, with integer words,
+// to "filename".  Words 1, 2 and 3 are <s>, </s> and <unk>.
+static void WriteRandomArpa(int32 num_words, const std::string &filename) {
+  typedef std::pair<int32, int32> Bigram;
+  std::set<Bigram> bigrams;
+  int32 num_bigrams = RandInt(1, 10 * num_words);
+  for (int32 i = 0; i < num_bigrams; i++) {
+    // the history can't be </s> and the predicted word can't be <s>.
+    int32 w1 = RandInt(1, num_words), w2 = RandInt(2, num_words);
+    if (w1 != 2) bigrams.insert(Bigram(w1, w2));
+  }
+  // For a trigram (w1, w2, w3) we need the bigrams (w1, w2) and (w2, w3).
+  std::vector<std::vector<int32> > trigrams;
+  for (std::set<Bigram>::const_iterator iter = bigrams.begin();
+       iter != bigrams.end(); ++iter) {
+    if (iter->second == 2 || RandInt(0, 1) == 0) continue;
+    std::set<Bigram>::const_iterator next =
+        bigrams.lower_bound(Bigram(iter->second, 0));
+    for (; next != bigrams.end() && next->first == iter->second; ++next) {
+      if (RandInt(0, 2) != 0) continue;
+      std::vector<int32> trigram(3);
+      trigram[0] = iter->first;
+      trigram[1] = iter->second;
+      trigram[2] = next->second;
+      trigrams.push_back(trigram);
+    }
+  }
+
+  Output ko(filename, false);
+  std::ostream &os = ko.Stream();
+  os << "\\data\\\n"
+     << "ngram 1=" << num_words << "\n"
+     << "ngram 2=" << bigrams.size() << "\n"
+     << "ngram 3=" << trigrams.size() << "\n\n"
+     << "\\1-grams:\n";
+  for (int32 w = 1; w <= num_words; w++) {
+    os << (w == 1 ? -99.0 : -5.0 * RandUniform()) << '\t' << w;
+    if (w != 2) os << '\t' << -RandUniform();
+    os << '\n';
+  }
+  os << "\n\\2-grams:\n";
+  for (std::set<Bigram>::const_iterator iter = bigrams.begin();
+       iter != bigrams.end(); ++iter) {
+    os << -3.0 * RandUniform() << '\t' << iter->first << ' ' << iter->second;
+    if (iter->second != 2) os << '\t' << -RandUniform();
+    os << '\n';
+  }
+  os << "\n\\3-grams:\n";
+  for (size_t i = 0; i < trigrams.size(); i++)
+    os << -2.0 * RandUniform() << '\t' << trigrams[i][0] << ' '
+       << trigrams[i][1] << ' ' << trigrams[i][2] << '\n';
+  os << "\n\\end\\\n";
+}
+
+// Checks that a page-aligned file read with ReadMapped() gives the same
+// probabilities as an ordinary file read with Read(), and that both layouts
+// can be read either way.
+void UnitTestConstArpaLmReadMapped() {
+  int32 num_words = RandInt(4, 500);
+  WriteRandomArpa(num_words, "tmp.arpa");
+  ArpaParseOptions options;
+  options.bos_symbol = 1;
+  options.eos_symbol = 2;
+  options.unk_symbol = 3;
+  BuildConstArpaLm(options, "tmp.arpa", "tmp.carpa", false);
+  BuildConstArpaLm(options, "tmp.arpa", "tmp_aligned.carpa", true);
+
+  ConstArpaLm lm, lm_aligned, lm_mapped, lm_not_mapped;
+  ReadKaldiObject("tmp.carpa", &lm);
+  ReadKaldiObject("tmp_aligned.carpa", &lm_aligned);
+  lm_mapped.ReadMapped("tmp_aligned.carpa");
+  lm_not_mapped.ReadMapped("tmp.carpa");  // falls back to an ordinary read.
+
+  for (int32 i = 0; i < 1000; i++) {
+    std::vector<int32> hist;
+    int32 hist_length = RandInt(0, 2);
+    for (int32 j = 0; j < hist_length; j++)
+      hist.push_back(j == 0 && RandInt(0, 1) == 0 ? 1 : RandInt(3, num_words));
+    // Also try some words that are out of the vocabulary.
+    int32 word = RandInt(2, num_words + 2);
+    BaseFloat logprob = lm.GetNgramLogprob(word, hist);
+    KALDI_ASSERT(lm_aligned.GetNgramLogprob(word, hist) == logprob &&
+                 lm_mapped.GetNgramLogprob(word, hist) == logprob &&
+                 lm_not_mapped.GetNgramLogprob(word, hist) == logprob);
+    bool exists = lm.HistoryStateExists(hist);
+    KALDI_ASSERT(lm_aligned.HistoryStateExists(hist) == exists &&
+                 lm_mapped.HistoryStateExists(hist) == exists &&
+                 lm_not_mapped.HistoryStateExists(hist) == exists);
+  }
+  unlink("tmp.arpa");
+  unlink("tmp.carpa");
+  unlink("tmp_aligned.carpa");
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    UnitTestConstArpaLmReadMapped();
+  KALDI_LOG << "Tests succeeded.";
+}
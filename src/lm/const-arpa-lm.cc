@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <sstream>
 #include <utility>
@@ -25,9 +26,17 @@
 #include "base/kaldi-math.h"
 #include "lm/arpa-file-parser.h"
 #include "lm/const-arpa-lm.h"
+#include "util/kaldi-io.h"
 #include "util/stl-utils.h"
 #include "util/text-utils.h"
 
+#ifndef _MSC_VER
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 
 namespace kaldi {
 
@@ -184,6 +193,7 @@ class ConstArpaLmBuilder : public ArpaFileParser {
     lm_states_size_ = 0;
     max_address_offset_ = pow(2, 30) - 1;
     is_built_ = false;
+    page_aligned_ = false;
     lm_states_ = NULL;
     unigram_states_ = NULL;
     overflow_buffer_ = NULL;
@@ -205,6 +215,9 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   // Writes ConstArpaLm.
   void Write(std::ostream &os, bool binary) const;
 
+  // If true, Write() uses the page-aligned layout; see ConstArpaLm::Write().
+  void SetPageAligned(bool page_aligned) { page_aligned_ = page_aligned; }
+
   void SetMaxAddressOffset(const int32 max_address_offset) {
     KALDI_WARN << "You are changing <max_address_offset_>; the default should "
         << "not be changed unless you are in testing mode.";
@@ -230,6 +243,9 @@ class ConstArpaLmBuilder : public ArpaFileParser {
   // Indicating if ConstArpaLm has been built or not.
   bool is_built_;
 
+  // Whether to write the page-aligned layout.
+  bool page_aligned_;
+
   // Maximum relative address for the child. We put it here just for testing.
   // The default value is 30-bits and should not be changed except for testing.
   int32 max_address_offset_;
@@ -480,6 +496,11 @@ void ConstArpaLmBuilder::ReadComplete() {
   is_built_ = true;
 }
 
+// The page-aligned layout pads the file so that <lm_states_> starts at a
+// multiple of this many bytes, which is a multiple of the page size on all the
+// platforms we know of (including those with 64k pages).
+static const int32 kConstArpaLmPageAlignment = 65536;
+
 void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
   if (!binary) {
     KALDI_ERR << "text-mode writing is not implemented for ConstArpaLmBuilder.";
@@ -491,10 +512,24 @@ void ConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
       Options().bos_symbol, Options().eos_symbol, Options().unk_symbol,
       ngram_order_, num_words_, overflow_buffer_size_, lm_states_size_,
       unigram_states_, overflow_buffer_, lm_states_);
-  const_arpa_lm.Write(os, binary);
+  const_arpa_lm.Write(os, binary, page_aligned_);
+}
+
+ConstArpaLm::~ConstArpaLm() {
+  if (memory_assigned_) {
+    if (mapped_region_ == NULL)
+      delete[] lm_states_;
+    delete[] unigram_states_;
+    delete[] overflow_buffer_;
+  }
+#ifndef _MSC_VER
+  if (mapped_region_ != NULL)
+    munmap(mapped_region_, mapped_size_);
+#endif
 }
 
-void ConstArpaLm::Write(std::ostream &os, bool binary) const {
+void ConstArpaLm::Write(std::ostream &os, bool binary,
+                        bool page_aligned) const {
   KALDI_ASSERT(initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode writing is not implemented for ConstArpaLm.";
@@ -511,8 +546,33 @@ void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   WriteToken(os, binary, "</LmInfo>");
 
   // LmStates section.
-  WriteToken(os, binary, "<LmStates>");
-  WriteBasicType(os, binary, lm_states_size_);
+  if (page_aligned) {
+    // In the page-aligned layout, the size is followed by the number of bytes
+    // of padding that precede the array.
+    WriteToken(os, binary, "<LmStatesPageAligned>");
+    WriteBasicType(os, binary, lm_states_size_);
+    int64 pos = static_cast<int64>(os.tellp());
+    int32 num_padding = 0;
+    if (pos < 0) {
+      KALDI_WARN << "Cannot align ConstArpaLm as the output is not seekable; "
+                 << "it will not be possible to memory-map it.";
+    } else {
+      // WriteBasicType() writes an int32 as a size byte plus 4 bytes.
+      int64 data_begin = pos + 1 + sizeof(int32);
+      num_padding = (kConstArpaLmPageAlignment -
+                     data_begin % kConstArpaLmPageAlignment) %
+          kConstArpaLmPageAlignment;
+    }
+    WriteBasicType(os, binary, num_padding);
+    std::vector<char> padding(num_padding, '\0');
+    if (num_padding > 0)
+      os.write(&(padding[0]), num_padding);
+    KALDI_ASSERT(pos < 0 || static_cast<int64>(os.tellp()) %
+                 kConstArpaLmPageAlignment == 0);
+  } else {
+    WriteToken(os, binary, "<LmStates>");
+    WriteBasicType(os, binary, lm_states_size_);
+  }
   os.write(reinterpret_cast<char *>(lm_states_),
            sizeof(int32) * lm_states_size_);
   if (!os.good()) {
@@ -580,11 +640,71 @@ void ConstArpaLm::Read(std::istream &is, bool binary) {
   if (first_char == 4) {  // Old on-disk format starts with length of int32.
     ReadInternalOldFormat(is, binary);
   } else {                // New on-disk format starts with token <ConstArpaLm>.
-    ReadInternal(is, binary);
+    ReadInternal(is, binary, "");
   }
 }
 
-void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
+void ConstArpaLm::ReadMapped(const std::string &rxfilename) {
+  KALDI_ASSERT(!initialized_);
+  bool binary;
+  Input ki(rxfilename, &binary);
+  if (!binary) {
+    KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
+  }
+  std::istream &is = ki.Stream();
+  int first_char = is.peek();
+  if (first_char == 4) {  // Old on-disk format; it cannot be mapped.
+    ReadInternalOldFormat(is, binary);
+  } else {
+    // We can only map ordinary files, not pipes, standard input or
+    // files with offsets (e.g. in archives).
+    std::string map_filename =
+        (ClassifyRxfilename(rxfilename) == kFileInput ? rxfilename : "");
+    ReadInternal(is, binary, map_filename);
+  }
+}
+
+bool ConstArpaLm::MapLmStates(const std::string &filename, int64 offset) {
+#ifdef _MSC_VER
+  return false;
+#else
+  if (offset < 0 || offset % sizeof(int32) != 0)
+    return false;
+  int64 page_size = sysconf(_SC_PAGESIZE);
+  if (page_size <= 0)
+    return false;
+  // mmap() requires the offset to be a multiple of the page size, so we map
+  // from the start of the page containing <offset>.
+  int64 region_begin = offset - offset % page_size;
+  size_t region_size = static_cast<size_t>(
+      offset - region_begin + sizeof(int32) * lm_states_size_);
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    KALDI_WARN << "Could not open " << filename << " to map ConstArpaLm: "
+               << strerror(errno);
+    return false;
+  }
+  void *region = mmap(NULL, region_size, PROT_READ, MAP_SHARED, fd,
+                      static_cast<off_t>(region_begin));
+  close(fd);  // the mapping stays valid after closing the file.
+  if (region == MAP_FAILED) {
+    KALDI_WARN << "Could not map ConstArpaLm from " << filename << ": "
+               << strerror(errno);
+    return false;
+  }
+  // LM lookups go to essentially random places in the array, so read-ahead
+  // would mostly fetch pages we do not need.
+  madvise(region, region_size, MADV_RANDOM);
+  mapped_region_ = region;
+  mapped_size_ = region_size;
+  lm_states_ = reinterpret_cast<int32*>(static_cast<char*>(region) +
+                                        (offset - region_begin));
+  return true;
+#endif
+}
+
+void ConstArpaLm::ReadInternal(std::istream &is, bool binary,
+                               const std::string &map_filename) {
   KALDI_ASSERT(!initialized_);
   if (!binary) {
     KALDI_ERR << "text-mode reading is not implemented for ConstArpaLm.";
@@ -601,11 +721,34 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
   ExpectToken(is, binary, "</LmInfo>");
 
   // LmStates section.
-  ExpectToken(is, binary, "<LmStates>");
-  ReadBasicType(is, binary, &lm_states_size_);
-  lm_states_ = new int32[lm_states_size_];
-  is.read(reinterpret_cast<char *>(lm_states_),
-          sizeof(int32) * lm_states_size_);
+  std::string token;
+  ReadToken(is, binary, &token);
+  bool mapped = false;
+  if (token == "<LmStates>") {
+    ReadBasicType(is, binary, &lm_states_size_);
+  } else if (token == "<LmStatesPageAligned>") {
+    ReadBasicType(is, binary, &lm_states_size_);
+    int32 num_padding;
+    ReadBasicType(is, binary, &num_padding);
+    is.ignore(num_padding);
+    if (!map_filename.empty()) {
+      int64 offset = static_cast<int64>(is.tellg());
+      if (MapLmStates(map_filename, offset)) {
+        KALDI_VLOG(1) << "Memory-mapped " << lm_states_size_
+                      << " LM states from " << map_filename;
+        is.seekg(sizeof(int32) * lm_states_size_, std::ios_base::cur);
+        mapped = true;
+      }
+    }
+  } else {
+    KALDI_ERR << "Expected <LmStates> or <LmStatesPageAligned>, got "
+              << token;
+  }
+  if (!mapped) {
+    lm_states_ = new int32[lm_states_size_];
+    is.read(reinterpret_cast<char *>(lm_states_),
+            sizeof(int32) * lm_states_size_);
+  }
   if (!is.good()) {
     KALDI_ERR << "ConstArpaLm <LmStates> section reading failed.";
   }
@@ -1073,8 +1216,10 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
 
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename) {
+                      const std::string& const_arpa_wxfilename,
+                      bool page_aligned) {
   ConstArpaLmBuilder lm_builder(options);
+  lm_builder.SetPageAligned(page_aligned);
   KALDI_LOG << "Reading " << arpa_rxfilename;
   Input ki(arpa_rxfilename);
   lm_builder.Read(ki.Stream());
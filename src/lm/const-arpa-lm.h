@@ -218,6 +218,8 @@ class ConstArpaLm {
     unigram_states_ = NULL;
     overflow_buffer_ = NULL;
     memory_assigned_ = false;
+    mapped_region_ = NULL;
+    mapped_size_ = 0;
     initialized_ = false;
   }
 
@@ -243,23 +245,35 @@ class ConstArpaLm {
                  (unk_symbol_ > 0 || unk_symbol_ == -1));
     lm_states_end_ = lm_states_ + lm_states_size_ - 1;
     memory_assigned_ = false;
+    mapped_region_ = NULL;
+    mapped_size_ = 0;
     initialized_ = true;
   }
 
-  ~ConstArpaLm() {
-    if (memory_assigned_) {
-      delete[] lm_states_;
-      delete[] unigram_states_;
-      delete[] overflow_buffer_;
-    }
-  }
+  ~ConstArpaLm();
 
   // Reads the ConstArpaLm format language model. It calls ReadInternal() or
   // ReadInternalOldFormat() to do the actual reading.
   void Read(std::istream &is, bool binary);
 
+  // Reads the ConstArpaLm format language model from <rxfilename>. If it is an
+  // ordinary file that was written with page_aligned == true (see Write()),
+  // the <lm_states_> array is memory-mapped read-only instead of being read
+  // into memory: the pages are faulted in lazily as they are used, and are
+  // shared between all the processes that map the same file.  Otherwise this
+  // is the same as ReadKaldiObject(rxfilename, this).  The file must not be
+  // modified while it is mapped (replacing it with 'mv' is fine).
+  void ReadMapped(const std::string &rxfilename);
+
   // Writes the language model in ConstArpaLm format.
-  void Write(std::ostream &os, bool binary) const;
+  void Write(std::ostream &os, bool binary) const { Write(os, binary, false); }
+
+  // Writes the language model in ConstArpaLm format; if <page_aligned> is true
+  // it pads the output so that, if <os> is a file, the <lm_states_> array
+  // starts at an offset that is a multiple of the page size, which allows
+  // ReadMapped() to map it.  Files written this way cannot be read by
+  // versions of this code from before the page-aligned format was added.
+  void Write(std::ostream &os, bool binary, bool page_aligned) const;
 
   // Creates Arpa format language model from ConstArpaLm format, and writes it
   // to output stream. This will be useful in testing.
@@ -279,8 +293,17 @@ class ConstArpaLm {
   int32 NgramOrder() const { return ngram_order_; }
 
  private:
-  // Function that loads data from stream to the class.
-  void ReadInternal(std::istream &is, bool binary);
+  // Function that loads data from stream to the class.  If <map_filename> is
+  // nonempty it is the name of the file that <is> reads from, and
+  // <lm_states_> will be memory-mapped from it if the file has the
+  // page-aligned layout.
+  void ReadInternal(std::istream &is, bool binary,
+                    const std::string &map_filename);
+
+  // Maps <lm_states_size_> int32's of file <filename>, starting at byte
+  // <offset>, into <lm_states_>.  Returns false (and does nothing) if this is
+  // not possible, e.g. on Windows or if the data is not int32-aligned.
+  bool MapLmStates(const std::string &filename, int64 offset);
 
   // Function that loads data from stream to the class. This is a deprecated one
   // that handles the old on-disk format. We keep this for back-compatibility
@@ -325,6 +348,12 @@ class ConstArpaLm {
   // the destructor.
   bool memory_assigned_;
 
+  // If <lm_states_> was memory-mapped by ReadMapped(), the start and size of
+  // the mapped region (which may start a little before <lm_states_>); else
+  // NULL and 0.
+  void *mapped_region_;
+  size_t mapped_size_;
+
   // Makes sure that the language model has been loaded before using it.
   bool initialized_;
 
@@ -419,9 +448,12 @@ class ConstArpaLmDeterministicFst
 // Reads in an Arpa format language model and converts it into ConstArpaLm
 // format. We assume that the words in the input Arpa format language model have
 // been converted into integers.
+// If <page_aligned> is true, the output is written in the page-aligned layout
+// that ConstArpaLm::ReadMapped() can memory-map.
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
-                      const std::string& const_arpa_wxfilename);
+                      const std::string& const_arpa_wxfilename,
+                      bool page_aligned = false);
 
 }  // namespace kaldi
 
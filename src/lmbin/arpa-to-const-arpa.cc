@@ -59,6 +59,13 @@ int main(int argc, char *argv[]) {
     po.Register("eos-symbol", &options.eos_symbol,
                 "Integer corresponds to </s>. You must set this to your actual "
                 "EOS integer.");
+    bool page_aligned = false;
+    po.Register("page-aligned", &page_aligned,
+                "If true, write the output so that the bulk of it can be "
+                "memory-mapped by the rescoring programs, which lets several "
+                "processes on the same machine share one copy of it.  The "
+                "output will be slightly larger and cannot be read by older "
+                "versions of Kaldi.");
 
     po.Read(argc, argv);
 
@@ -76,7 +83,7 @@ int main(int argc, char *argv[]) {
         const_arpa_wxfilename = po.GetOptArg(2);
 
     bool ans = BuildConstArpaLm(options, arpa_rxfilename,
-                                const_arpa_wxfilename);
+                                const_arpa_wxfilename, page_aligned);
     if (ans)
       return 0;
     else
@@ -0,0 +1,108 @@
+// matrix/compressed-matrix-simd-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// This file has no include guard: it is included by compressed-matrix.cc once
+// for each instruction set (AVX2, NEON), each time in a different namespace,
+// to compile the decompression loops with SIMD instructions.  Don't include
+// it anywhere else.  Before including it, compressed-matrix.cc defines
+// KALDI_COMPRESSED_SIMD_TARGET as the target attribute of the functions
+// (which may be empty), and, in the same namespace, the type Vec, the
+// constant kWidth (the number of floats in a Vec), and the functions Load(),
+// Store(), LoadBytes() and LoadUint16s() (which convert kWidth integers to
+// float), Set1(), Add(), Sub(), Mul(), Min(), Max(), Transpose() and
+// ZeroUpper(); see matrix/srfft-simd-inl.h for what the last two do.
+//
+// Each function does the same as the generic function of the same name in
+// compressed-matrix.cc, with the same order of operations, so the results
+// are the same.
+
+
+KALDI_COMPRESSED_SIMD_TARGET
+static void DecodeBytes(const uint8 *data, int32 n, float min_value,
+                        float increment, float *out) {
+  int32 n_simd = n - n % kWidth;
+  Vec vmin = Set1(min_value), vinc = Set1(increment);
+  for (int32 j = 0; j < n_simd; j += kWidth)
+    Store(out + j, Add(vmin, Mul(vinc, LoadBytes(data + j))));
+  for (int32 j = n_simd; j < n; j++)
+    out[j] = min_value + increment * data[j];
+  ZeroUpper();
+}
+
+KALDI_COMPRESSED_SIMD_TARGET
+static void DecodeUint16s(const uint16 *data, int32 n, float min_value,
+                          float increment, float *out) {
+  int32 n_simd = n - n % kWidth;
+  Vec vmin = Set1(min_value), vinc = Set1(increment);
+  for (int32 j = 0; j < n_simd; j += kWidth)
+    Store(out + j, Add(vmin, Mul(vinc, LoadUint16s(data + j))));
+  for (int32 j = n_simd; j < n; j++)
+    out[j] = min_value + increment * data[j];
+  ZeroUpper();
+}
+
+KALDI_COMPRESSED_SIMD_TARGET
+static void DecodeColumn(const uint8 *data, int32 n, float p0, float p25,
+                         float p75, float p100, float *out) {
+  float c1 = (p25 - p0) * (1.0f / 64.0f), c2 = (p75 - p25) * (1.0f / 128.0f),
+      c3 = (p100 - p75) * (1.0f / 63.0f);
+  int32 n_simd = n - n % kWidth;
+  Vec vp0 = Set1(p0), vc1 = Set1(c1), vc2 = Set1(c2), vc3 = Set1(c3),
+      zero = Set1(0.0f), k64 = Set1(64.0f), k128 = Set1(128.0f),
+      k192 = Set1(192.0f);
+  for (int32 j = 0; j < n_simd; j += kWidth) {
+    Vec v = LoadBytes(data + j),
+        v1 = Min(v, k64),
+        v2 = Min(Max(Sub(v, k64), zero), k128),
+        v3 = Max(Sub(v, k192), zero);
+    Store(out + j, Add(Add(Add(vp0, Mul(vc1, v1)), Mul(vc2, v2)),
+                       Mul(vc3, v3)));
+  }
+  for (int32 j = n_simd; j < n; j++) {
+    float v = data[j],
+        v1 = std::min(v, 64.0f),
+        v2 = std::min(std::max(v - 64.0f, 0.0f), 128.0f),
+        v3 = std::max(v - 192.0f, 0.0f);
+    out[j] = p0 + c1 * v1 + c2 * v2 + c3 * v3;
+  }
+  ZeroUpper();
+}
+
+KALDI_COMPRESSED_SIMD_TARGET
+static void CopyTransposed(const float *src, int32 src_stride,
+                           int32 num_rows, int32 num_cols,
+                           float *dest, MatrixIndexT dest_stride) {
+  int32 num_rows_simd = num_rows - num_rows % kWidth,
+      num_cols_simd = num_cols - num_cols % kWidth;
+  for (int32 r = 0; r < num_rows_simd; r += kWidth) {
+    for (int32 c = 0; c < num_cols_simd; c += kWidth) {
+      Vec v[kWidth];
+      for (int32 i = 0; i < kWidth; i++)
+        v[i] = Load(src + (c + i) * src_stride + r);
+      Transpose(v);
+      for (int32 i = 0; i < kWidth; i++)
+        Store(dest + (r + i) * dest_stride + c, v[i]);
+    }
+    for (int32 i = 0; i < kWidth; i++)
+      for (int32 c = num_cols_simd; c < num_cols; c++)
+        dest[(r + i) * dest_stride + c] = src[c * src_stride + r + i];
+  }
+  for (int32 r = num_rows_simd; r < num_rows; r++)
+    for (int32 c = 0; c < num_cols; c++)
+      dest[r * dest_stride + c] = src[c * src_stride + r];
+  ZeroUpper();
+}
@@ -21,9 +21,220 @@
 
 #include "matrix/compressed-matrix.h"
 #include <algorithm>
+#include <vector>
+
+// The loops that decompress into float have SIMD versions, in
+// compressed-matrix-simd-inl.h: on x86 an AVX2 version compiled with a target
+// attribute, which we use if the CPU supports it, and on 64-bit ARM a NEON
+// version.  This is as for the batched FFT in srfft.cc.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define KALDI_COMPRESSED_AVX2 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define KALDI_COMPRESSED_NEON 1
+#include <arm_neon.h>
+#include <string.h>
+#endif
 
 namespace kaldi {
 
+#ifdef KALDI_COMPRESSED_AVX2
+namespace compressed_avx2 {
+#define KALDI_COMPRESSED_SIMD_TARGET __attribute__((target("avx2")))
+typedef __m256 Vec;
+static const int32 kWidth = 8;
+KALDI_COMPRESSED_SIMD_TARGET
+static inline Vec Load(const float *p) { return _mm256_loadu_ps(p); }
+KALDI_COMPRESSED_SIMD_TARGET
+static inline void Store(float *p, Vec v) { _mm256_storeu_ps(p, v); }
+KALDI_COMPRESSED_SIMD_TARGET
+static inline Vec LoadBytes(const uint8 *p) {
+  return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+}
+KALDI_COMPRESSED_SIMD_TARGET
+static inline Vec LoadUint16s(const uint16 *p) {
+  return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+}
+KALDI_COMPRESSED_SIMD_TARGET
+static inline Vec Set1(float f) { return _mm256_set1_ps(f); }
+KALDI_COMPRESSED_SIMD_TARGET
+static inline Vec Add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+KALDI_COMPRESSED_SIMD_TARGET
+static inline Vec Sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+KALDI_COMPRESSED_SIMD_TARGET
+static inline Vec Mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+KALDI_COMPRESSED_SIMD_TARGET
+static inline Vec Min(Vec a, Vec b) { return _mm256_min_ps(a, b); }
+KALDI_COMPRESSED_SIMD_TARGET
+static inline Vec Max(Vec a, Vec b) { return _mm256_max_ps(a, b); }
+KALDI_COMPRESSED_SIMD_TARGET
+static inline void ZeroUpper() { _mm256_zeroupper(); }
+// This is the same as in srfft.cc.
+KALDI_COMPRESSED_SIMD_TARGET
+static inline void Transpose(Vec *v) {
+  // Transpose the 2x2 blocks of each 4x4 quarter, then the 2x2 blocks of 2x2
+  // blocks, then the 4x4 quarters.
+  Vec t0 = _mm256_unpacklo_ps(v[0], v[1]), t1 = _mm256_unpackhi_ps(v[0], v[1]),
+      t2 = _mm256_unpacklo_ps(v[2], v[3]), t3 = _mm256_unpackhi_ps(v[2], v[3]),
+      t4 = _mm256_unpacklo_ps(v[4], v[5]), t5 = _mm256_unpackhi_ps(v[4], v[5]),
+      t6 = _mm256_unpacklo_ps(v[6], v[7]), t7 = _mm256_unpackhi_ps(v[6], v[7]);
+  Vec u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+      u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+      u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+      u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)),
+      u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)),
+      u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2)),
+      u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)),
+      u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  v[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+  v[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+  v[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+  v[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+  v[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+  v[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+  v[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+  v[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+#include "matrix/compressed-matrix-simd-inl.h"
+#undef KALDI_COMPRESSED_SIMD_TARGET
+}  // namespace compressed_avx2
+#endif
+
+#ifdef KALDI_COMPRESSED_NEON
+namespace compressed_neon {
+#define KALDI_COMPRESSED_SIMD_TARGET
+typedef float32x4_t Vec;
+static const int32 kWidth = 4;
+static inline Vec Load(const float *p) { return vld1q_f32(p); }
+static inline void Store(float *p, Vec v) { vst1q_f32(p, v); }
+static inline Vec LoadBytes(const uint8 *p) {
+  uint32_t bytes;
+  memcpy(&bytes, p, 4);
+  uint16x8_t v = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bytes)));
+  return vcvtq_f32_u32(vmovl_u16(vget_low_u16(v)));
+}
+static inline Vec LoadUint16s(const uint16 *p) {
+  return vcvtq_f32_u32(vmovl_u16(vld1_u16(p)));
+}
+static inline Vec Set1(float f) { return vdupq_n_f32(f); }
+static inline Vec Add(Vec a, Vec b) { return vaddq_f32(a, b); }
+static inline Vec Sub(Vec a, Vec b) { return vsubq_f32(a, b); }
+static inline Vec Mul(Vec a, Vec b) { return vmulq_f32(a, b); }
+static inline Vec Min(Vec a, Vec b) { return vminq_f32(a, b); }
+static inline Vec Max(Vec a, Vec b) { return vmaxq_f32(a, b); }
+static inline void ZeroUpper() { }
+// This is the same as in srfft.cc.
+static inline void Transpose(Vec *v) {
+  float32x4x2_t t01 = vtrnq_f32(v[0], v[1]), t23 = vtrnq_f32(v[2], v[3]);
+  v[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+  v[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+  v[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+  v[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#include "matrix/compressed-matrix-simd-inl.h"
+#undef KALDI_COMPRESSED_SIMD_TARGET
+}  // namespace compressed_neon
+#endif
+
+// The generic versions of the decompression loops, for double (and for float
+// if we have no SIMD version).
+
+// Sets out[j] = min_value + increment * data[j], for j < n.
+template<typename Real>
+static void DecodeBytes(const uint8 *data, int32 n, float min_value,
+                        float increment, Real *out) {
+  for (int32 j = 0; j < n; j++)
+    out[j] = min_value + increment * data[j];
+}
+
+// As DecodeBytes(), for the two-byte format.
+template<typename Real>
+static void DecodeUint16s(const uint16 *data, int32 n, float min_value,
+                          float increment, Real *out) {
+  for (int32 j = 0; j < n; j++)
+    out[j] = min_value + increment * data[j];
+}
+
+// Sets out[j] to the value of byte data[j] of a column of the
+// kOneByteWithColHeaders format with the given percentiles, for j < n; this
+// computes the same as CompressedMatrix::CharToFloat().
+template<typename Real>
+static void DecodeColumn(const uint8 *data, int32 n, float p0, float p25,
+                         float p75, float p100, Real *out) {
+  float c1 = (p25 - p0) * (1.0f / 64.0f), c2 = (p75 - p25) * (1.0f / 128.0f),
+      c3 = (p100 - p75) * (1.0f / 63.0f);
+  for (int32 j = 0; j < n; j++) {
+    float v = data[j],
+        v1 = std::min(v, 64.0f),
+        v2 = std::min(std::max(v - 64.0f, 0.0f), 128.0f),
+        v3 = std::max(v - 192.0f, 0.0f);
+    out[j] = p0 + c1 * v1 + c2 * v2 + c3 * v3;
+  }
+}
+
+// Sets dest[r * dest_stride + c] = src[c * src_stride + r], for r < num_rows
+// and c < num_cols.
+template<typename Real>
+static void CopyTransposed(const float *src, int32 src_stride,
+                           int32 num_rows, int32 num_cols,
+                           Real *dest, MatrixIndexT dest_stride) {
+  for (int32 r = 0; r < num_rows; r++)
+    for (int32 c = 0; c < num_cols; c++)
+      dest[r * dest_stride + c] = src[c * src_stride + r];
+}
+
+// The float versions use the SIMD versions if we can.  On x86, whether the CPU
+// supports AVX2 is checked the first time.
+#ifdef KALDI_COMPRESSED_AVX2
+static bool CompressedMatrixUseAvx2() {
+  static const bool ans = (__builtin_cpu_init(),
+                           __builtin_cpu_supports("avx2") != 0);
+  return ans;
+}
+#define KALDI_COMPRESSED_SIMD_CALL(func, args)                          \
+  if (CompressedMatrixUseAvx2()) { compressed_avx2::func args; return; }
+#elif defined(KALDI_COMPRESSED_NEON)
+#define KALDI_COMPRESSED_SIMD_CALL(func, args)  \
+  { compressed_neon::func args; return; }
+#else
+#define KALDI_COMPRESSED_SIMD_CALL(func, args)
+#endif
+
+static void DecodeBytes(const uint8 *data, int32 n, float min_value,
+                        float increment, float *out) {
+  KALDI_COMPRESSED_SIMD_CALL(DecodeBytes,
+                             (data, n, min_value, increment, out));
+  DecodeBytes<float>(data, n, min_value, increment, out);
+}
+
+static void DecodeUint16s(const uint16 *data, int32 n, float min_value,
+                          float increment, float *out) {
+  KALDI_COMPRESSED_SIMD_CALL(DecodeUint16s,
+                             (data, n, min_value, increment, out));
+  DecodeUint16s<float>(data, n, min_value, increment, out);
+}
+
+static void DecodeColumn(const uint8 *data, int32 n, float p0, float p25,
+                         float p75, float p100, float *out) {
+  KALDI_COMPRESSED_SIMD_CALL(DecodeColumn,
+                             (data, n, p0, p25, p75, p100, out));
+  DecodeColumn<float>(data, n, p0, p25, p75, p100, out);
+}
+
+static void CopyTransposed(const float *src, int32 src_stride,
+                           int32 num_rows, int32 num_cols,
+                           float *dest, MatrixIndexT dest_stride) {
+  KALDI_COMPRESSED_SIMD_CALL(CopyTransposed, (src, src_stride, num_rows,
+                                              num_cols, dest, dest_stride));
+  CopyTransposed<float>(src, src_stride, num_rows, num_cols, dest,
+                        dest_stride);
+}
+
+#undef KALDI_COMPRESSED_SIMD_CALL
+
 //static
 MatrixIndexT CompressedMatrix::DataSize(const GlobalHeader &header) {
   // Returns size in bytes of the data.
@@ -34,6 +245,9 @@ MatrixIndexT CompressedMatrix::DataSize(const GlobalHeader &header) {
   } else if (format == kTwoByte) {
     return sizeof(GlobalHeader) +
         2 * header.num_rows * header.num_cols;
+  } else if (format == kOneByteWithRowHeaders) {
+    return sizeof(GlobalHeader) +
+        header.num_rows * (sizeof(PerRowHeader) + header.num_cols);
   } else {
     KALDI_ASSERT(format == kOneByte);
     return sizeof(GlobalHeader) +
@@ -50,6 +264,13 @@ void CompressedMatrix::Scale(float alpha) {
     // and leave all integers the same.
     h->min_value *= alpha;
     h->range *= alpha;
+    if (static_cast<DataFormat>(h->format) == kOneByteWithRowHeaders) {
+      PerRowHeader *row_header = reinterpret_cast<PerRowHeader*>(h + 1);
+      for (int32 r = 0; r < h->num_rows; r++, row_header++) {
+        row_header->min_value *= alpha;
+        row_header->range *= alpha;
+      }
+    }
   }
 }
 
@@ -72,6 +293,9 @@ void CompressedMatrix::ComputeGlobalHeader(
     case kOneByteAuto: case kOneByteUnsignedInteger: case kOneByteZeroOne:
       header->format = static_cast<int32>(kOneByte);  // 3.
       break;
+    case kOneBytePerRow:
+      header->format = static_cast<int32>(kOneByteWithRowHeaders);  // 4.
+      break;
     default:
       KALDI_ERR << "Invalid compression type: "
                 << static_cast<int32>(method);
@@ -82,7 +306,10 @@ void CompressedMatrix::ComputeGlobalHeader(
 
   // Now compute 'min_value' and 'range'.
   switch (method) {
-    case kSpeechFeature: case kTwoByteAuto: case kOneByteAuto: {
+    case kSpeechFeature: case kTwoByteAuto: case kOneByteAuto:
+    case kOneBytePerRow: {
+      // For kOneBytePerRow the global min_value and range are not used for
+      // the data, but we set them anyway and check for NaN's and Inf's.
       float min_value = mat.Min(), max_value = mat.Max();
       // ensure that max_value is strictly greater than min_value, even if matrix is
       // constant; this avoids crashes in ComputeColHeader when compressing speech
@@ -128,19 +355,23 @@ void CompressedMatrix::ComputeGlobalHeader(
 template<typename Real>
 void CompressedMatrix::CopyFromMat(
     const MatrixBase<Real> &mat, CompressionMethod method) {
-  if (data_ != NULL) {
-    delete [] static_cast<float*>(data_);  // call delete [] because was allocated with new float[]
-    data_ = NULL;
+  if (mat.NumRows() == 0) {  // Zero-size matrix stored as zero pointer.
+    Clear();
+    return;
   }
-  if (mat.NumRows() == 0) { return; }  // Zero-size matrix stored as zero pointer.
-
 
   GlobalHeader global_header;
   ComputeGlobalHeader(mat, method, &global_header);
 
   int32 data_size = DataSize(global_header);
 
-  data_ = AllocateData(data_size);
+  // Reuse the existing memory if it is the right size, which saves an
+  // allocation when the same object is used repeatedly.
+  if (data_ == NULL ||
+      DataSize(*reinterpret_cast<GlobalHeader*>(data_)) != data_size) {
+    Clear();
+    data_ = AllocateData(data_size);
+  }
 
   *(reinterpret_cast<GlobalHeader*>(data_)) = global_header;
 
@@ -172,6 +403,17 @@ void CompressedMatrix::CopyFromMat(
         data[c] = FloatToUint16(global_header, row_data[c]);
       data += num_cols;
     }
+  } else if (format == kOneByteWithRowHeaders) {
+    PerRowHeader *header_data =
+        reinterpret_cast<PerRowHeader*>(static_cast<char*>(data_) +
+                                        sizeof(GlobalHeader));
+    int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
+    uint8 *byte_data = reinterpret_cast<uint8*>(header_data + num_rows);
+    for (int32 r = 0; r < num_rows; r++) {
+      CompressRow(mat.RowData(r), num_cols, header_data, byte_data);
+      header_data++;
+      byte_data += num_cols;
+    }
   } else {
     KALDI_ASSERT(format == kOneByte);
     uint8 *data = reinterpret_cast<uint8*>(static_cast<char*>(data_) +
@@ -297,6 +539,26 @@ CompressedMatrix::CompressedMatrix(
       memcpy(new_row_data, old_row_data, sizeof(uint16) * num_cols);
       new_row_data += num_cols;
     }
+  } else if (format == kOneByteWithRowHeaders) {
+    const PerRowHeader *old_row_header =
+        reinterpret_cast<const PerRowHeader*>(old_global_header + 1);
+    const uint8 *old_data =
+        reinterpret_cast<const uint8*>(old_row_header + old_num_rows);
+    PerRowHeader *new_row_header =
+        reinterpret_cast<PerRowHeader*>(
+            reinterpret_cast<GlobalHeader*>(data_) + 1);
+    uint8 *new_row_data = reinterpret_cast<uint8*>(new_row_header + num_rows);
+
+    for (int32 row = 0; row < num_rows; row++) {
+      int32 old_row = row + row_offset;
+      // The next two lines are only relevant if padding_is_used.
+      if (old_row < 0) old_row = 0;
+      else if (old_row >= old_num_rows) old_row = old_num_rows - 1;
+      new_row_header[row] = old_row_header[old_row];
+      memcpy(new_row_data, old_data + col_offset + (old_num_cols * old_row),
+             num_cols);
+      new_row_data += num_cols;
+    }
   } else {
     KALDI_ASSERT(format == kOneByte);
     const uint8 *old_data =
@@ -490,13 +752,18 @@ inline uint8 CompressedMatrix::FloatToChar(
 inline float CompressedMatrix::CharToFloat(
     float p0, float p25, float p75, float p100,
     uint8 value) {
-  if (value <= 64) {
-    return p0 + (p25 - p0) * value * (1/64.0);
-  } else if (value <= 192) {
-    return p25 + (p75 - p25) * (value - 64) * (1/128.0);
-  } else {
-    return p75 + (p100 - p75) * (value - 192) * (1/63.0);
-  }
+  // Characters 0 .. 64 cover the range [ p0, p25 ], 64 .. 192 cover
+  // [ p25, p75 ] and 192 .. 255 cover [ p75, p100 ].  We add up the
+  // contributions from the three ranges rather than working out which range
+  // we're in, which avoids branches (the clamping is done in float so that
+  // loops over this function can be vectorized).
+  float v = value,
+      v1 = std::min(v, 64.0f),
+      v2 = std::min(std::max(v - 64.0f, 0.0f), 128.0f),
+      v3 = std::max(v - 192.0f, 0.0f);
+  return p0 + (p25 - p0) * (1.0f / 64.0f) * v1
+      + (p75 - p25) * (1.0f / 128.0f) * v2
+      + (p100 - p75) * (1.0f / 63.0f) * v3;
 }
 
 
@@ -520,6 +787,24 @@ void CompressedMatrix::CompressColumn(
   }
 }
 
+template<typename Real>  // static
+void CompressedMatrix::CompressRow(const Real *data, int32 num_cols,
+                                   PerRowHeader *header, uint8 *byte_data) {
+  Real min_value = data[0], max_value = data[0];
+  for (int32 c = 1; c < num_cols; c++) {
+    min_value = std::min(min_value, data[c]);
+    max_value = std::max(max_value, data[c]);
+  }
+  header->min_value = min_value;
+  header->range = max_value - min_value;
+  // a constant row has range zero; all its bytes will be zero.
+  float scale = (header->range > 0.0 ? 255.0 / header->range : 0.0);
+  for (int32 c = 0; c < num_cols; c++) {
+    int32 i = static_cast<int32>((data[c] - header->min_value) * scale + 0.5);
+    byte_data[c] = static_cast<uint8>(std::min(std::max(i, 0), 255));
+  }
+}
+
 // static
 void* CompressedMatrix::AllocateData(int32 num_bytes) {
   KALDI_ASSERT(num_bytes > 0);
@@ -539,6 +824,8 @@ void CompressedMatrix::Write(std::ostream &os, bool binary) const {
         WriteToken(os, binary, "CM2");
       } else if (format == kOneByte) {
         WriteToken(os, binary, "CM3");
+      } else if (format == kOneByteWithRowHeaders) {
+        WriteToken(os, binary, "CM4");
       }
       MatrixIndexT size = DataSize(h);  // total size of data in data_
       // We don't write out the "int32 format", hence the + 4, - 4.
@@ -577,8 +864,10 @@ void CompressedMatrix::Read(std::istream &is, bool binary) {
       if (tok == "CM") { h.format = 1; } //  kOneByteWithColHeaders
       else if (tok == "CM2") { h.format = 2; }  // kTwoByte
       else if (tok == "CM3") { h.format = 3; }  // kOneByte
+      else if (tok == "CM4") { h.format = 4; }  // kOneByteWithRowHeaders
       else {
-        KALDI_ERR << "Unexpected token " << tok << ", expecting CM, CM2 or CM3";
+        KALDI_ERR << "Unexpected token " << tok
+                  << ", expecting CM, CM2, CM3 or CM4";
       }
       // don't read the "format" -> hence + 4, - 4.
       is.read(reinterpret_cast<char*>(&h) + 4, sizeof(h) - 4);
@@ -630,43 +919,7 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
   KALDI_ASSERT(mat->NumRows() == num_rows);
   KALDI_ASSERT(mat->NumCols() == num_cols);
 
-  DataFormat format = static_cast<DataFormat>(h->format);
-  if (format == kOneByteWithColHeaders) {
-    PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
-    uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
-                                                h->num_cols);
-    for (int32 i = 0; i < num_cols; i++, per_col_header++) {
-      float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
-          p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
-          p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
-          p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < num_rows; j++, byte_data++) {
-        float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-        (*mat)(j, i) = f;
-      }
-    }
-  } else if (format == kTwoByte) {
-    const uint16 *data = reinterpret_cast<const uint16*>(h + 1);
-    float min_value = h->min_value,
-        increment = h->range * (1.0 / 65535.0);
-    for (int32 i = 0; i < num_rows; i++) {
-      Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
-        row_data[j] = min_value + data[j] * increment;
-      data += num_cols;
-    }
-  } else {
-    KALDI_ASSERT(format == kOneByte);
-    float min_value = h->min_value, increment = h->range * (1.0 / 255.0);
-
-    const uint8 *data = reinterpret_cast<const uint8*>(h + 1);
-    for (int32 i = 0; i < num_rows; i++) {
-      Real *row_data = mat->RowData(i);
-      for (int32 j = 0; j < num_cols; j++)
-        row_data[j] = min_value + data[j] * increment;
-      data += num_cols;
-    }
-  }
+  CopyToMat(0, 0, mat);
 }
 
 // Instantiate the template for float and double.
@@ -705,18 +958,24 @@ void CompressedMatrix::CopyRowToVec(MatrixIndexT row,
     float min_value = h->min_value,
         increment = h->range * (1.0 / 65535.0);
     const uint16 *row_data = reinterpret_cast<uint16*>(h + 1) + (num_cols * row);
-    Real *v_data = v->Data();
-    for (int32 c = 0; c < num_cols; c++)
-      v_data[c] = min_value + row_data[c] * increment;
+    DecodeUint16s(row_data, num_cols, min_value, increment, v->Data());
+  } else if (format == kOneByteWithRowHeaders) {
+    int32 num_rows = h->num_rows, num_cols = h->num_cols;
+    const PerRowHeader *row_header =
+        reinterpret_cast<const PerRowHeader*>(h + 1);
+    const uint8 *row_data = reinterpret_cast<const uint8*>(row_header +
+                                                           num_rows) +
+        (num_cols * row);
+    float min_value = row_header[row].min_value,
+        increment = row_header[row].range * (1.0 / 255.0);
+    DecodeBytes(row_data, num_cols, min_value, increment, v->Data());
   } else {
     KALDI_ASSERT(format == kOneByte);
     int32 num_cols = h->num_cols;
     float min_value = h->min_value,
         increment = h->range * (1.0 / 255.0);
     const uint8 *row_data = reinterpret_cast<uint8*>(h + 1) + (num_cols * row);
-    Real *v_data = v->Data();
-    for (int32 c = 0; c < num_cols; c++)
-      v_data[c] = min_value + row_data[c] * increment;
+    DecodeBytes(row_data, num_cols, min_value, increment, v->Data());
   }
 }
 
@@ -752,6 +1011,16 @@ void CompressedMatrix::CopyColToVec(MatrixIndexT col,
     Real *v_data = v->Data();
     for (int32 r = 0; r < num_rows; r++)
       v_data[r] = min_value + increment * col_data[r * num_cols];
+  } else if (format == kOneByteWithRowHeaders) {
+    int32 num_rows = h->num_rows, num_cols = h->num_cols;
+    const PerRowHeader *row_header =
+        reinterpret_cast<const PerRowHeader*>(h + 1);
+    const uint8 *col_data = reinterpret_cast<const uint8*>(row_header +
+                                                           num_rows) + col;
+    Real *v_data = v->Data();
+    for (int32 r = 0; r < num_rows; r++)
+      v_data[r] = row_header[r].min_value + row_header[r].range *
+          (1.0 / 255.0) * col_data[r * num_cols];
   } else {
     KALDI_ASSERT(format == kOneByte);
     int32 num_rows = h->num_rows, num_cols = h->num_cols;
@@ -791,28 +1060,18 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
 
   DataFormat format = static_cast<DataFormat>(h->format);
   if (format == kOneByteWithColHeaders) {
-    PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
-    uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
-                                                h->num_cols);
-
-    uint8 *start_of_subcol = byte_data+row_offset;  // skip appropriate
-    // number of columns
-    start_of_subcol += col_offset*num_rows;  // skip appropriate number of rows
-
-    per_col_header += col_offset;  // skip the appropriate number of headers
-
-    for (int32 i = 0;
-         i < tgt_cols;
-         i++, per_col_header++, start_of_subcol+=num_rows) {
-      byte_data = start_of_subcol;
-      float p0 = Uint16ToFloat(*h, per_col_header->percentile_0),
-          p25 = Uint16ToFloat(*h, per_col_header->percentile_25),
-          p75 = Uint16ToFloat(*h, per_col_header->percentile_75),
-          p100 = Uint16ToFloat(*h, per_col_header->percentile_100);
-      for (int32 j = 0; j < tgt_rows; j++, byte_data++) {
-        float f = CharToFloat(p0, p25, p75, p100, *byte_data);
-        (*dest)(j, i) = f;
-      }
+    CopyToMatColHeaders(row_offset, col_offset, dest);
+  } else if (format == kOneByteWithRowHeaders) {
+    const PerRowHeader *row_header =
+        reinterpret_cast<const PerRowHeader*>(h + 1) + row_offset;
+    const uint8 *data = reinterpret_cast<const uint8*>(
+        reinterpret_cast<const PerRowHeader*>(h + 1) + num_rows) +
+        col_offset + (num_cols * row_offset);
+    for (int32 row = 0; row < tgt_rows; row++, row_header++) {
+      float min_value = row_header->min_value,
+          increment = row_header->range * (1.0 / 255.0);
+      DecodeBytes(data, tgt_cols, min_value, increment, dest->RowData(row));
+      data += num_cols;
     }
   } else if (format == kTwoByte) {
     const uint16 *data = reinterpret_cast<const uint16*>(h+1) + col_offset +
@@ -821,9 +1080,7 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
         increment = h->range * (1.0 / 65535.0);
 
     for (int32 row = 0; row < tgt_rows; row++) {
-      Real *dest_row = dest->RowData(row);
-      for (int32 col = 0; col < tgt_cols; col++)
-        dest_row[col] = min_value + increment * data[col];
+      DecodeUint16s(data, tgt_cols, min_value, increment, dest->RowData(row));
       data += num_cols;
     }
   } else {
@@ -833,9 +1090,7 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
     float min_value = h->min_value,
         increment = h->range * (1.0 / 255.0);
     for (int32 row = 0; row < tgt_rows; row++) {
-      Real *dest_row = dest->RowData(row);
-      for (int32 col = 0; col < tgt_cols; col++)
-        dest_row[col] = min_value + increment * data[col];
+      DecodeBytes(data, tgt_cols, min_value, increment, dest->RowData(row));
       data += num_cols;
     }
   }
@@ -849,6 +1104,41 @@ template void CompressedMatrix::CopyToMat(int32,
                                           int32,
                                           MatrixBase<double> *dest) const;
 
+template<typename Real>
+void CompressedMatrix::CopyToMatColHeaders(int32 row_offset,
+                                           int32 col_offset,
+                                           MatrixBase<Real> *dest) const {
+  // the number of rows we uncompress at a time; the buffer holds
+  // kBlockRows * tgt_cols floats.
+  const int32 kBlockRows = 32;
+  const GlobalHeader *h = reinterpret_cast<const GlobalHeader*>(data_);
+  int32 num_rows = h->num_rows,
+      tgt_rows = dest->NumRows(), tgt_cols = dest->NumCols();
+  const PerColHeader *per_col_header =
+      reinterpret_cast<const PerColHeader*>(h + 1);
+  const uint8 *byte_data =
+      reinterpret_cast<const uint8*>(per_col_header + h->num_cols) +
+      row_offset + (col_offset * num_rows);
+  per_col_header += col_offset;
+
+  std::vector<float> buffer(kBlockRows * tgt_cols);
+  for (int32 block_start = 0; block_start < tgt_rows;
+       block_start += kBlockRows) {
+    int32 block_rows = std::min(kBlockRows, tgt_rows - block_start);
+    for (int32 c = 0; c < tgt_cols; c++) {
+      float p0 = Uint16ToFloat(*h, per_col_header[c].percentile_0),
+          p25 = Uint16ToFloat(*h, per_col_header[c].percentile_25),
+          p75 = Uint16ToFloat(*h, per_col_header[c].percentile_75),
+          p100 = Uint16ToFloat(*h, per_col_header[c].percentile_100);
+      const uint8 *col_data = byte_data + (c * num_rows) + block_start;
+      DecodeColumn(col_data, block_rows, p0, p25, p75, p100,
+                   &(buffer[c * kBlockRows]));
+    }
+    CopyTransposed(&(buffer[0]), kBlockRows, block_rows, tgt_cols,
+                   dest->RowData(block_start), dest->Stride());
+  }
+}
+
 void CompressedMatrix::Clear() {
   if (data_ != NULL) {
     delete [] static_cast<float*>(data_);
@@ -856,6 +1146,97 @@ void CompressedMatrix::Clear() {
   }
 }
 
+bool CompressedMatrix::AppendCompressedMatrixRows(
+    const std::vector<const CompressedMatrix*> &inputs) {
+  // First check that the inputs can be appended without decompressing them.
+  // This requires that they have the same format, and, for the formats whose
+  // mapping to floats is given by the global header, the same mapping.
+  const GlobalHeader *first_header = NULL;
+  int32 num_rows = 0;
+  float min_value = 0.0, max_value = 0.0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    KALDI_ASSERT(inputs[i] != this);
+    if (inputs[i]->data_ == NULL)
+      continue;
+    const GlobalHeader *h =
+        reinterpret_cast<const GlobalHeader*>(inputs[i]->data_);
+    DataFormat format = static_cast<DataFormat>(h->format);
+    if (format == kOneByteWithColHeaders)
+      return false;
+    if (first_header == NULL) {
+      first_header = h;
+      min_value = h->min_value;
+      max_value = h->min_value + h->range;
+    } else {
+      if (h->format != first_header->format ||
+          h->num_cols != first_header->num_cols)
+        return false;
+      if (format != kOneByteWithRowHeaders &&
+          (h->min_value != first_header->min_value ||
+           h->range != first_header->range))
+        return false;
+      min_value = std::min(min_value, h->min_value);
+      max_value = std::max(max_value, h->min_value + h->range);
+    }
+    num_rows += h->num_rows;
+  }
+  if (first_header == NULL) {
+    Clear();
+    return true;
+  }
+  GlobalHeader global_header = *first_header;
+  global_header.num_rows = num_rows;
+  // For kOneByteWithRowHeaders the global range is only informational.
+  global_header.min_value = min_value;
+  global_header.range = max_value - min_value;
+
+  int32 data_size = DataSize(global_header);
+  if (data_ == NULL ||
+      DataSize(*reinterpret_cast<GlobalHeader*>(data_)) != data_size) {
+    Clear();
+    data_ = AllocateData(data_size);
+  }
+  *(reinterpret_cast<GlobalHeader*>(data_)) = global_header;
+
+  int32 num_cols = global_header.num_cols;
+  if (static_cast<DataFormat>(global_header.format) ==
+      kOneByteWithRowHeaders) {
+    PerRowHeader *row_header = reinterpret_cast<PerRowHeader*>(
+        reinterpret_cast<GlobalHeader*>(data_) + 1);
+    uint8 *row_data = reinterpret_cast<uint8*>(row_header + num_rows);
+    for (size_t i = 0; i < inputs.size(); i++) {
+      if (inputs[i]->data_ == NULL)
+        continue;
+      const GlobalHeader *h =
+          reinterpret_cast<const GlobalHeader*>(inputs[i]->data_);
+      const PerRowHeader *src_row_header =
+          reinterpret_cast<const PerRowHeader*>(h + 1);
+      const uint8 *src_row_data =
+          reinterpret_cast<const uint8*>(src_row_header + h->num_rows);
+      memcpy(row_header, src_row_header, sizeof(PerRowHeader) * h->num_rows);
+      memcpy(row_data, src_row_data, static_cast<size_t>(h->num_rows) *
+             num_cols);
+      row_header += h->num_rows;
+      row_data += static_cast<size_t>(h->num_rows) * num_cols;
+    }
+  } else {
+    // kOneByte or kTwoByte: the data is in row-major order after the
+    // global header.
+    char *dest = reinterpret_cast<char*>(
+        reinterpret_cast<GlobalHeader*>(data_) + 1);
+    for (size_t i = 0; i < inputs.size(); i++) {
+      if (inputs[i]->data_ == NULL)
+        continue;
+      const GlobalHeader *h =
+          reinterpret_cast<const GlobalHeader*>(inputs[i]->data_);
+      size_t num_bytes = DataSize(*h) - sizeof(GlobalHeader);
+      memcpy(dest, h + 1, num_bytes);
+      dest += num_bytes;
+    }
+  }
+  return true;
+}
+
 CompressedMatrix::CompressedMatrix(const CompressedMatrix &mat): data_(NULL) {
   *this = mat; // use assignment operator.
 }
@@ -21,6 +21,7 @@
 #ifndef KALDI_MATRIX_COMPRESSED_MATRIX_H_
 #define KALDI_MATRIX_COMPRESSED_MATRIX_H_ 1
 
+#include <vector>
 #include "matrix/kaldi-matrix.h"
 
 namespace kaldi {
@@ -67,6 +68,15 @@ namespace kaldi {
                         one byte as a uint8, with the representable range of
                         values equal to [0.0, 1.0].  Suitable for image data
                         that has previously been compressed as int8.
+    kOneBytePerRow = 8  Each element is stored in one byte as a uint8, with
+                        the representable range of values chosen separately
+                        for each row from the minimum and maximum elements of
+                        that row, and stored in an 8-byte header per row.
+                        Unlike with kSpeechFeature, the data is stored row by
+                        row, so extracting a range of rows (e.g. the frames
+                        needed for a neural-net training example) is just a
+                        copy; but it is less accurate than kSpeechFeature for
+                        features whose dimensions have very different ranges.
 
     // We can add new methods here as needed: if they just imply different ways
     // of selecting the min_value and range, and a num-bytes = 1 or 2, they will
@@ -79,7 +89,8 @@ enum CompressionMethod {
   kTwoByteSignedInteger = 4,
   kOneByteAuto = 5,
   kOneByteUnsignedInteger = 6,
-  kOneByteZeroOne = 7
+  kOneByteZeroOne = 7,
+  kOneBytePerRow = 8
 };
 
 
@@ -120,7 +131,8 @@ class CompressedMatrix {
 
   void *Data() const { return this->data_; }
 
-  /// This will resize *this and copy the contents of mat to *this.
+  /// This will resize *this and copy the contents of mat to *this.  The
+  /// existing memory is reused if it is the right size.
   template<typename Real>
   void CopyFromMat(const MatrixBase<Real> &mat,
                    CompressionMethod method = kAutomaticMethod);
@@ -172,6 +184,17 @@ class CompressedMatrix {
 
   void Clear();
 
+  /// Sets *this to the rows of the matrices in 'inputs' appended together,
+  /// copying the compressed data directly without decompressing it, and
+  /// returns true.  This is only possible if the inputs are in the same data
+  /// format and it is not the one used by kSpeechFeature; for the formats with
+  /// a global header (e.g. kTwoByteAuto), they must also have the same range.
+  /// If they are not, returns false and leaves *this unchanged.  Empty inputs
+  /// are ignored.  The existing memory of *this is reused if it is the right
+  /// size.
+  bool AppendCompressedMatrixRows(
+      const std::vector<const CompressedMatrix*> &inputs);
+
   /// scales all elements of matrix by alpha.
   /// It scales the floating point values in GlobalHeader by alpha.
   void Scale(float alpha);
@@ -198,10 +221,16 @@ class CompressedMatrix {
   //    order and is decompressed as:
   //       uint8 i;  GlobalHeader g;
   //       float f = g.min_value + i * (g.range / 255.0)
+  //  kOneByteWithRowHeaders means there is a global header and each
+  //    row has a PerRowHeader; the data is stored in one byte per
+  //    element in row-major order and is decompressed as:
+  //       uint8 i;  PerRowHeader r;
+  //       float f = r.min_value + i * (r.range / 255.0)
   enum DataFormat {
     kOneByteWithColHeaders = 1,
     kTwoByte = 2,
-    kOneByte = 3
+    kOneByte = 3,
+    kOneByteWithRowHeaders = 4
   };
 
 
@@ -238,6 +267,12 @@ class CompressedMatrix {
     uint16 percentile_100;
   };
 
+  // This struct is only used in format kOneByteWithRowHeaders.
+  struct PerRowHeader {
+    float min_value;
+    float range;
+  };
+
   template<typename Real>
   static void CompressColumn(const GlobalHeader &global_header,
                              const Real *data, MatrixIndexT stride,
@@ -264,13 +299,31 @@ class CompressedMatrix {
                                           float value);
 
   // this is used only in the kOneByteWithColHeaders compression format.
+  // It is written without branches so that loops that call it can be
+  // vectorized.
   static inline float CharToFloat(float p0, float p25,
                                   float p75, float p100,
                                   uint8 value);
 
+  // this is used only in the kOneByteWithRowHeaders compression format.
+  template<typename Real>
+  static void CompressRow(const Real *data, int32 num_cols,
+                          PerRowHeader *header, uint8 *byte_data);
+
+  // Copies the submatrix starting at (row_offset, col_offset) with the
+  // dimensions of 'dest' to 'dest', for the kOneByteWithColHeaders format.
+  // Since the data is stored by column, it uncompresses blocks of rows into a
+  // temporary buffer column by column and then copies them to 'dest' row by
+  // row, which is much more cache-friendly than writing 'dest' by column.
+  template<typename Real>
+  void CopyToMatColHeaders(int32 row_offset, int32 col_offset,
+                           MatrixBase<Real> *dest) const;
+
   void *data_; // first GlobalHeader, then PerColHeader (repeated), then
   // the byte data for each column (repeated).  Note: don't intersperse
   // the byte data with the PerColHeaders, because of alignment issues.
+  // In the kOneByteWithRowHeaders format, it is the GlobalHeader, then the
+  // PerRowHeaders, then the byte data for each row.
 
 };
 
@@ -3669,6 +3669,31 @@ template<typename Real> static void UnitTestSplitRadixRealFft() {
 
 
 
+template<typename Real> static void UnitTestSplitRadixRealFftBatched() {
+  for (MatrixIndexT p = 0; p < 10; p++) {
+    MatrixIndexT logn = 2 + Rand() % 9,
+        N = 1 << logn, num_rows = Rand() % 100;
+    SplitRadixRealFft<Real> srfft(N);
+    std::vector<Real> temp_buffer;
+    Matrix<Real> M(num_rows, N), M2(num_rows, N);
+    M.SetRandn();
+    M2.CopyFromMat(M);
+    for (MatrixIndexT r = 0; r < num_rows; r++)
+      srfft.Compute(M2.RowData(r), true);
+    Matrix<Real> M3(M);
+    if (Rand() % 2 == 0)
+      srfft.Compute(&M3, true);
+    else
+      srfft.Compute(&M3, true, &temp_buffer);
+    AssertEqual(M2, M3, 0.001);
+    // check the inverse.
+    srfft.Compute(&M3, false);
+    M3.Scale(1.0 / N);
+    AssertEqual(M, M3, 0.001);
+  }
+}
+
+
 template<typename Real> static void UnitTestRealFftSpeed() {
 
   // First, test RealFftInefficient.
@@ -4090,10 +4115,11 @@ template<typename Real> static void UnitTestCompressedMatrix() {
 
 
     CompressionMethod method;
-    switch(RandInt(0, 3)) {
+    switch(RandInt(0, 4)) {
       case 0: method = kAutomaticMethod; break;
       case 1: method = kSpeechFeature; break;
       case 2: method = kTwoByteAuto; break;
+      case 3: method = kOneBytePerRow; break;
       default: method = kOneByteAuto; break;
     }
 
@@ -4218,7 +4244,8 @@ template<typename Real> static void UnitTestCompressedMatrix() {
           num_cols = 10 + Rand() % 50;
         Matrix<Real> M(num_rows, num_cols);
         M.SetRandn();
-        CompressedMatrix cmat(M);
+        CompressedMatrix cmat(M, t % 2 == 0 ? kAutomaticMethod :
+                              kOneBytePerRow);
         Matrix<Real> scaled_comp_mat(num_rows, num_cols),
           scaled_mat(M);
         scaled_mat.Scale(alpha);
@@ -4459,6 +4486,58 @@ static void UnitTestExtractCompressedMatrix() {
   }
 }
 
+template<typename Real>
+static void UnitTestAppendCompressedMatrixRows() {
+  for (int32 i = 0; i < 30; i++) {
+    // kSpeechFeature can't be appended; kTwoByteSignedInteger can, since the
+    // range is fixed.
+    CompressionMethod methods[] = { kOneBytePerRow, kTwoByteSignedInteger,
+                                    kSpeechFeature },
+        method = methods[i % 3];
+    MatrixIndexT num_cols = 1 + Rand() % 30, num_inputs = 1 + Rand() % 4,
+        tot_rows = 0;
+    std::vector<CompressedMatrix> cmats(num_inputs);
+    std::vector<const CompressedMatrix*> inputs(num_inputs);
+    for (int32 j = 0; j < num_inputs; j++) {
+      MatrixIndexT num_rows = Rand() % 5;
+      Matrix<Real> mat;
+      if (num_rows != 0)  // some of the inputs are empty.
+        mat.Resize(num_rows, num_cols);
+      mat.SetRandn();
+      cmats[j].CopyFromMat(mat, method);
+      inputs[j] = &(cmats[j]);
+      tot_rows += mat.NumRows();
+    }
+    CompressedMatrix appended;
+    bool ans = appended.AppendCompressedMatrixRows(inputs);
+    if (method == kSpeechFeature && tot_rows != 0) {
+      KALDI_ASSERT(!ans);
+      continue;
+    }
+    KALDI_ASSERT(ans && appended.NumRows() == tot_rows);
+    if (tot_rows == 0)
+      continue;
+    KALDI_ASSERT(appended.NumCols() == num_cols);
+    Matrix<Real> mat(tot_rows, num_cols);
+    appended.CopyToMat(&mat);
+    MatrixIndexT row_offset = 0;
+    for (int32 j = 0; j < num_inputs; j++) {
+      MatrixIndexT num_rows = cmats[j].NumRows();
+      if (num_rows == 0) continue;
+      Matrix<Real> mat2(num_rows, num_cols);
+      cmats[j].CopyToMat(&mat2);
+      // the compressed data is copied, so the result should be exact.
+      SubMatrix<Real> sub_mat(mat, row_offset, num_rows, 0, num_cols);
+      KALDI_ASSERT(sub_mat.ApproxEqual(mat2, 0.0));
+      row_offset += num_rows;
+    }
+    // Appending again reuses the memory.
+    void *data = appended.Data();
+    KALDI_ASSERT(appended.AppendCompressedMatrixRows(inputs) &&
+                 appended.Data() == data);
+  }
+}
+
 
 template<typename Real>
 static void UnitTestTridiag() {
@@ -4599,6 +4678,7 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestCompressedMatrix<Real>();
   UnitTestCompressedMatrix2<Real>();
   UnitTestExtractCompressedMatrix<Real>();
+  UnitTestAppendCompressedMatrixRows<Real>();
   UnitTestResize<Real>();
   UnitTestResizeCopyDataDifferentStrideType<Real>();
   UnitTestNonsymmetricPower<Real>();
@@ -4620,6 +4700,7 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestRealFft<Real>();
   KALDI_LOG << " Point C";
   UnitTestSplitRadixRealFft<Real>();
+  UnitTestSplitRadixRealFftBatched<Real>();
   UnitTestSvd<Real>();
   UnitTestSvdNodestroy<Real>();
   UnitTestSvdJustvec<Real>();
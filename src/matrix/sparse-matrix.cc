@@ -917,6 +917,10 @@ void GeneralMatrix::Read(std::istream &is, bool binary) {
 
 void AppendGeneralMatrixRows(const std::vector<const GeneralMatrix *> &src,
                              GeneralMatrix *mat) {
+  // If 'mat' holds a full matrix, keep it so its memory can be reused.
+  Matrix<BaseFloat> appended_mat;
+  if (mat->Type() == kFullMatrix)
+    mat->SwapFullMatrix(&appended_mat);
   mat->Clear();
   int32 size = src.size();
   if (size == 0)
@@ -948,7 +952,7 @@ void AppendGeneralMatrixRows(const std::vector<const GeneralMatrix *> &src,
                     << num_cols << " vs. " << src_cols;
       }
     }
-    Matrix<BaseFloat> appended_mat(tot_rows, num_cols, kUndefined);
+    appended_mat.Resize(tot_rows, num_cols, kUndefined);
     int32 row_offset = 0;
     for (int32 i = 0; i < size; i++) {
       const GeneralMatrix &src_mat = *(src[i]);
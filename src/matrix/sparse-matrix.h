@@ -381,7 +381,8 @@ class GeneralMatrix {
 /// Appends all the matrix rows of a list of GeneralMatrixes, to get a single
 /// GeneralMatrix.  Preserves sparsity if all inputs were sparse (or empty).
 /// Does not preserve compression, if inputs were compressed; you have to
-/// re-compress manually, if that's what you need.
+/// re-compress manually, if that's what you need.  If 'mat' already holds a
+/// full matrix of the right size, its memory is reused.
 void AppendGeneralMatrixRows(const std::vector<const GeneralMatrix *> &src,
                              GeneralMatrix *mat);
 
@@ -0,0 +1,307 @@
+// matrix/srfft-simd-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// This file has no include guard: it is included by srfft.cc once for each
+// instruction set (AVX, NEON), each time in a different namespace, to compile
+// the loops of the batched FFT with SIMD instructions.  Don't include it
+// anywhere else.  Before including it, srfft.cc defines
+// KALDI_SRFFT_SIMD_TARGET as the target attribute of the functions (which may
+// be empty), and, in the same namespace, the type Vec, the constant kWidth
+// (the number of floats in a Vec), and the functions Load(), Store(), Set1(),
+// Add(), Sub(), Mul(), Transpose() (which transposes the kWidth by kWidth
+// matrix whose rows are v[0] ... v[kWidth - 1]) and ZeroUpper().  The
+// functions that srfft.cc calls end with ZeroUpper(), which for AVX clears the
+// upper halves of the registers so that the SSE code that runs afterwards
+// does not pay a penalty for mixing the two; GCC only does this itself with
+// -O2 or higher, and Kaldi is compiled with -O1.
+//
+// Each function does the same as the generic function in srfft.cc whose name
+// is the same with "Batch" prepended, in the same order of operations, so the
+// results are the same.  The loops are over the 'n' elements of a batch (the
+// FFTs), of which all but the last n % kWidth are done kWidth at a time.
+
+
+// Sets (x1, x2) to (x1 + x2, x1 - x2).
+KALDI_SRFFT_SIMD_TARGET
+static void AddSub(float *x1, float *x2, MatrixIndexT n) {
+  MatrixIndexT n_simd = n - n % kWidth;
+  for (MatrixIndexT j = 0; j < n_simd; j += kWidth) {
+    Vec a = Load(x1 + j), b = Load(x2 + j);
+    Store(x1 + j, Add(a, b));
+    Store(x2 + j, Sub(a, b));
+  }
+  for (MatrixIndexT j = n_simd; j < n; j++) {
+    float tmp = x1[j] + x2[j];
+    x2[j] = x1[j] - x2[j];
+    x1[j] = tmp;
+  }
+  ZeroUpper();
+}
+
+// Step 2 of the split-radix butterfly.
+KALDI_SRFFT_SIMD_TARGET
+static void Step2(float *xr1, float *xr2, float *xi1, float *xi2,
+                  MatrixIndexT n) {
+  MatrixIndexT n_simd = n - n % kWidth;
+  for (MatrixIndexT j = 0; j < n_simd; j += kWidth) {
+    Vec r1 = Load(xr1 + j), r2 = Load(xr2 + j),
+        i1 = Load(xi1 + j), i2 = Load(xi2 + j);
+    Store(xr1 + j, Add(r1, i2));
+    Store(xi2 + j, Add(i1, r2));
+    Store(xi1 + j, Sub(i1, r2));
+    Store(xr2 + j, Sub(r1, i2));
+  }
+  for (MatrixIndexT j = n_simd; j < n; j++) {
+    float tmp1 = xr1[j] + xi2[j],
+        tmp2 = xi1[j] + xr2[j];
+    xi1[j] = xi1[j] - xr2[j];
+    xr2[j] = xr1[j] - xi2[j];
+    xr1[j] = tmp1;
+    xi2[j] = tmp2;
+  }
+  ZeroUpper();
+}
+
+// Multiplies (xr, xi) by a twiddle factor, given as c, c + s and c - s.
+KALDI_SRFFT_SIMD_TARGET
+static inline void Twiddle(float *xr, float *xi, float c, float spc,
+                           float smc, MatrixIndexT n) {
+  MatrixIndexT n_simd = n - n % kWidth;
+  Vec vc = Set1(c), vspc = Set1(spc), vsmc = Set1(smc);
+  for (MatrixIndexT j = 0; j < n_simd; j += kWidth) {
+    Vec r = Load(xr + j), i = Load(xi + j),
+        tmp2 = Mul(vc, Add(r, i));
+    Store(xr + j, Add(Mul(vsmc, i), tmp2));
+    Store(xi + j, Add(Mul(vspc, r), tmp2));
+  }
+  for (MatrixIndexT j = n_simd; j < n; j++) {
+    float tmp2 = c * (xr[j] + xi[j]);
+    float tmp1 = spc * xr[j] + tmp2;
+    xr[j] = smc * xi[j] + tmp2;
+    xi[j] = tmp1;
+  }
+}
+
+// The twiddle factors for the index m/8, where c = s = sqrt(1/2).
+KALDI_SRFFT_SIMD_TARGET
+static inline void TwiddleEighth(float *xr1, float *xi1, float *xr2,
+                                 float *xi2, float sqhalf, MatrixIndexT n) {
+  MatrixIndexT n_simd = n - n % kWidth;
+  Vec s = Set1(sqhalf), minus_s = Set1(-sqhalf);
+  for (MatrixIndexT j = 0; j < n_simd; j += kWidth) {
+    Vec r1 = Load(xr1 + j), i1 = Load(xi1 + j),
+        r2 = Load(xr2 + j), i2 = Load(xi2 + j);
+    Store(xr1 + j, Mul(s, Add(r1, i1)));
+    Store(xi1 + j, Mul(s, Sub(i1, r1)));
+    Store(xr2 + j, Mul(s, Sub(i2, r2)));
+    Store(xi2 + j, Mul(minus_s, Add(r2, i2)));
+  }
+  for (MatrixIndexT j = n_simd; j < n; j++) {
+    float tmp1 = sqhalf * (xr1[j] + xi1[j]);
+    xi1[j] = sqhalf * (xi1[j] - xr1[j]);
+    xr1[j] = tmp1;
+    float tmp2 = sqhalf * (xi2[j] - xr2[j]);
+    xi2[j] = -sqhalf * (xr2[j] + xi2[j]);
+    xr2[j] = tmp2;
+  }
+}
+
+// Steps 3 and 4 of the split-radix butterfly for an FFT of length m = 4 * m4,
+// where m4 >= 2; 'tab' is the table of butterfly coefficients, which is NULL
+// if m4 == 2.
+KALDI_SRFFT_SIMD_TARGET
+static void Steps34(float *xr, float *xi, MatrixIndexT m4, const float *tab,
+                    MatrixIndexT n) {
+  const float sqhalf = M_SQRT1_2;
+  MatrixIndexT m2 = 2 * m4, m8 = m4 / 2, nel = m4 - 2;
+  const float *cn = tab, *spcn = cn + nel, *smcn = spcn + nel,
+      *c3n = smcn + nel, *spc3n = c3n + nel, *smc3n = spc3n + nel;
+  for (MatrixIndexT k = 1; k < m4; k++) {
+    float *xr1 = xr + (m2 + k) * n, *xr2 = xr1 + m4 * n,
+        *xi1 = xi + (m2 + k) * n, *xi2 = xi1 + m4 * n;
+    if (k == m8) {
+      TwiddleEighth(xr1, xi1, xr2, xi2, sqhalf, n);
+    } else {
+      Twiddle(xr1, xi1, *cn++, *spcn++, *smcn++, n);
+      Twiddle(xr2, xi2, *c3n++, *spc3n++, *smc3n++, n);
+    }
+  }
+  ZeroUpper();
+}
+
+// The FFT of length 4; element k of the batch is at xr + k * n.
+KALDI_SRFFT_SIMD_TARGET
+static void Radix4(float *xr, float *xi, MatrixIndexT n) {
+  MatrixIndexT n_simd = n - n % kWidth;
+  for (MatrixIndexT j = 0; j < n_simd; j += kWidth) {
+    Vec r0 = Load(xr + j), r1 = Load(xr + n + j), r2 = Load(xr + 2 * n + j),
+        r3 = Load(xr + 3 * n + j),
+        i0 = Load(xi + j), i1 = Load(xi + n + j), i2 = Load(xi + 2 * n + j),
+        i3 = Load(xi + 3 * n + j);
+    Vec s0 = Add(r0, r2), s2 = Sub(r0, r2), s1 = Add(r1, r3),
+        s3 = Sub(r1, r3), t0 = Add(i0, i2), t2 = Sub(i0, i2),
+        t1 = Add(i1, i3), t3 = Sub(i1, i3);
+    Store(xr + j, Add(s0, s1));
+    Store(xr + n + j, Sub(s0, s1));
+    Store(xi + j, Add(t0, t1));
+    Store(xi + n + j, Sub(t0, t1));
+    Store(xr + 2 * n + j, Add(s2, t3));
+    Store(xi + 3 * n + j, Add(t2, s3));
+    Store(xi + 2 * n + j, Sub(t2, s3));
+    Store(xr + 3 * n + j, Sub(s2, t3));
+  }
+  for (MatrixIndexT j = n_simd; j < n; j++) {
+    float r0 = xr[j], r1 = xr[n + j], r2 = xr[2 * n + j], r3 = xr[3 * n + j],
+        i0 = xi[j], i1 = xi[n + j], i2 = xi[2 * n + j], i3 = xi[3 * n + j];
+    float s0 = r0 + r2, s2 = r0 - r2, s1 = r1 + r3, s3 = r1 - r3,
+        t0 = i0 + i2, t2 = i0 - i2, t1 = i1 + i3, t3 = i1 - i3;
+    xr[j] = s0 + s1;
+    xr[n + j] = s0 - s1;
+    xi[j] = t0 + t1;
+    xi[n + j] = t0 - t1;
+    xr[2 * n + j] = s2 + t3;
+    xi[3 * n + j] = t2 + s3;
+    xi[2 * n + j] = t2 - s3;
+    xr[3 * n + j] = s2 - t3;
+  }
+  ZeroUpper();
+}
+
+// The step of the real FFT that combines elements k and N/2 - k of the
+// complex FFT of length N2 = N/2, for k = 1 ... N2/2; see
+// SplitRadixRealFft::ComputeBlock().  (rootN_re, rootN_im) is the twiddle
+// factor for k = 1, and (kN_re, kN_im) the initial value of the factor, which
+// we multiply by it for each k.
+KALDI_SRFFT_SIMD_TARGET
+static void RealFftSteps(float *xr, float *xi, MatrixIndexT N2,
+                         float rootN_re, float rootN_im,
+                         float kN_re, float kN_im, MatrixIndexT n) {
+  MatrixIndexT n_simd = n - n % kWidth;
+  Vec half = Set1(0.5), minus_half = Set1(-0.5);
+  for (MatrixIndexT k = 1; 2 * k <= N2; k++) {
+    ComplexMul(rootN_re, rootN_im, &kN_re, &kN_im);
+    MatrixIndexT kdash = N2 - k;
+    float *re_k = xr + k * n, *im_k = xi + k * n,
+        *re_kdash = xr + kdash * n, *im_kdash = xi + kdash * n;
+    Vec vkN_re = Set1(kN_re), vkN_im = Set1(kN_im),
+        minus_kN_re = Set1(-kN_re);
+    for (MatrixIndexT j = 0; j < n_simd; j += kWidth) {
+      Vec rk = Load(re_k + j), ik = Load(im_k + j),
+          rkd = Load(re_kdash + j), ikd = Load(im_kdash + j);
+      Vec Ck_re = Mul(half, Add(rk, rkd)),
+          Ck_im = Mul(half, Sub(ik, ikd)),
+          Dk_re = Mul(half, Add(ik, ikd)),
+          Dk_im = Mul(minus_half, Sub(rk, rkd));
+      Store(re_k + j,
+            Add(Ck_re, Sub(Mul(vkN_re, Dk_re), Mul(vkN_im, Dk_im))));
+      Store(im_k + j,
+            Add(Ck_im, Add(Mul(vkN_re, Dk_im), Mul(vkN_im, Dk_re))));
+      if (kdash != k) {
+        Store(re_kdash + j,
+              Add(Ck_re, Add(Mul(minus_kN_re, Dk_re), Mul(vkN_im, Dk_im))));
+        Store(im_kdash + j,
+              Sub(Add(Mul(vkN_re, Dk_im), Mul(vkN_im, Dk_re)), Ck_im));
+      }
+    }
+    for (MatrixIndexT j = n_simd; j < n; j++) {
+      float Ck_re = 0.5 * (re_k[j] + re_kdash[j]),
+          Ck_im = 0.5 * (im_k[j] - im_kdash[j]),
+          Dk_re = 0.5 * (im_k[j] + im_kdash[j]),
+          Dk_im = -0.5 * (re_k[j] - re_kdash[j]);
+      re_k[j] = Ck_re + (kN_re * Dk_re - kN_im * Dk_im);
+      im_k[j] = Ck_im + (kN_re * Dk_im + kN_im * Dk_re);
+      if (kdash != k) {
+        re_kdash[j] = Ck_re + (-kN_re * Dk_re + kN_im * Dk_im);
+        im_kdash[j] = -Ck_im + (kN_re * Dk_im + kN_im * Dk_re);
+      }
+    }
+  }
+  ZeroUpper();
+}
+
+// Copies n rows of length 2 * N2, the first at 'data' and each 'stride' after
+// the previous one, to the batch layout: element 2k of row b goes to
+// xr[k * n + b] and element 2k + 1 to xi[k * n + b].
+KALDI_SRFFT_SIMD_TARGET
+static void CopyIn(const float *data, MatrixIndexT stride, MatrixIndexT N2,
+                   float *xr, float *xi, MatrixIndexT n) {
+  MatrixIndexT n_simd = n - n % kWidth, N = 2 * N2, N_simd = N - N % kWidth;
+  for (MatrixIndexT b = 0; b < n_simd; b += kWidth) {
+    for (MatrixIndexT j = 0; j < N_simd; j += kWidth) {
+      Vec v[kWidth];
+      for (MatrixIndexT i = 0; i < kWidth; i++)
+        v[i] = Load(data + (b + i) * stride + j);
+      Transpose(v);
+      // kWidth and j are even, so v[i] is a real part if i is even.
+      for (MatrixIndexT i = 0; i < kWidth; i += 2) {
+        Store(xr + ((j + i) / 2) * n + b, v[i]);
+        Store(xi + ((j + i) / 2) * n + b, v[i + 1]);
+      }
+    }
+    for (MatrixIndexT i = 0; i < kWidth; i++) {
+      const float *row = data + (b + i) * stride;
+      for (MatrixIndexT k = N_simd / 2; k < N2; k++) {
+        xr[k * n + b + i] = row[2 * k];
+        xi[k * n + b + i] = row[2 * k + 1];
+      }
+    }
+  }
+  for (MatrixIndexT b = n_simd; b < n; b++) {
+    const float *row = data + b * stride;
+    for (MatrixIndexT k = 0; k < N2; k++) {
+      xr[k * n + b] = row[2 * k];
+      xi[k * n + b] = row[2 * k + 1];
+    }
+  }
+  ZeroUpper();
+}
+
+// The reverse of CopyIn(), except that it also multiplies by 'scale'.
+KALDI_SRFFT_SIMD_TARGET
+static void CopyOut(const float *xr, const float *xi, MatrixIndexT N2,
+                    float scale, float *data, MatrixIndexT stride,
+                    MatrixIndexT n) {
+  MatrixIndexT n_simd = n - n % kWidth, N = 2 * N2, N_simd = N - N % kWidth;
+  Vec vscale = Set1(scale);
+  for (MatrixIndexT b = 0; b < n_simd; b += kWidth) {
+    for (MatrixIndexT j = 0; j < N_simd; j += kWidth) {
+      Vec v[kWidth];
+      for (MatrixIndexT i = 0; i < kWidth; i += 2) {
+        v[i] = Load(xr + ((j + i) / 2) * n + b);
+        v[i + 1] = Load(xi + ((j + i) / 2) * n + b);
+      }
+      Transpose(v);
+      for (MatrixIndexT i = 0; i < kWidth; i++)
+        Store(data + (b + i) * stride + j, Mul(vscale, v[i]));
+    }
+    for (MatrixIndexT i = 0; i < kWidth; i++) {
+      float *row = data + (b + i) * stride;
+      for (MatrixIndexT k = N_simd / 2; k < N2; k++) {
+        row[2 * k] = scale * xr[k * n + b + i];
+        row[2 * k + 1] = scale * xi[k * n + b + i];
+      }
+    }
+  }
+  for (MatrixIndexT b = n_simd; b < n; b++) {
+    float *row = data + b * stride;
+    for (MatrixIndexT k = 0; k < N2; k++) {
+      row[2 * k] = scale * xr[k * n + b];
+      row[2 * k + 1] = scale * xi[k * n + b];
+    }
+  }
+  ZeroUpper();
+}
@@ -28,8 +28,287 @@
 #include "matrix/srfft.h"
 #include "matrix/matrix-functions.h"
 
+// The loops of the batched FFT (see SplitRadixComplexFft::ComputeBatched())
+// have SIMD versions for float, in srfft-simd-inl.h: on x86 we compile an AVX
+// version with a target attribute, which we use if the CPU supports it, and
+// on 64-bit ARM a NEON version, which is always supported.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define KALDI_SRFFT_AVX 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define KALDI_SRFFT_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace kaldi {
 
+#ifdef KALDI_SRFFT_AVX
+namespace srfft_avx {
+#define KALDI_SRFFT_SIMD_TARGET __attribute__((target("avx")))
+typedef __m256 Vec;
+static const MatrixIndexT kWidth = 8;
+KALDI_SRFFT_SIMD_TARGET
+static inline Vec Load(const float *p) { return _mm256_loadu_ps(p); }
+KALDI_SRFFT_SIMD_TARGET
+static inline void Store(float *p, Vec v) { _mm256_storeu_ps(p, v); }
+KALDI_SRFFT_SIMD_TARGET
+static inline Vec Set1(float f) { return _mm256_set1_ps(f); }
+KALDI_SRFFT_SIMD_TARGET
+static inline Vec Add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+KALDI_SRFFT_SIMD_TARGET
+static inline Vec Sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+KALDI_SRFFT_SIMD_TARGET
+static inline Vec Mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+KALDI_SRFFT_SIMD_TARGET
+static inline void ZeroUpper() { _mm256_zeroupper(); }
+KALDI_SRFFT_SIMD_TARGET
+static inline void Transpose(Vec *v) {
+  // Transpose the 2x2 blocks of each 4x4 quarter, then the 2x2 blocks of 2x2
+  // blocks, then the 4x4 quarters.
+  Vec t0 = _mm256_unpacklo_ps(v[0], v[1]), t1 = _mm256_unpackhi_ps(v[0], v[1]),
+      t2 = _mm256_unpacklo_ps(v[2], v[3]), t3 = _mm256_unpackhi_ps(v[2], v[3]),
+      t4 = _mm256_unpacklo_ps(v[4], v[5]), t5 = _mm256_unpackhi_ps(v[4], v[5]),
+      t6 = _mm256_unpacklo_ps(v[6], v[7]), t7 = _mm256_unpackhi_ps(v[6], v[7]);
+  Vec u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+      u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+      u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+      u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)),
+      u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)),
+      u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2)),
+      u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)),
+      u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  v[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+  v[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+  v[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+  v[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+  v[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+  v[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+  v[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+  v[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+}
+#include "matrix/srfft-simd-inl.h"
+#undef KALDI_SRFFT_SIMD_TARGET
+}  // namespace srfft_avx
+#endif
+
+#ifdef KALDI_SRFFT_NEON
+namespace srfft_neon {
+#define KALDI_SRFFT_SIMD_TARGET
+typedef float32x4_t Vec;
+static const MatrixIndexT kWidth = 4;
+static inline Vec Load(const float *p) { return vld1q_f32(p); }
+static inline void Store(float *p, Vec v) { vst1q_f32(p, v); }
+static inline Vec Set1(float f) { return vdupq_n_f32(f); }
+static inline Vec Add(Vec a, Vec b) { return vaddq_f32(a, b); }
+static inline Vec Sub(Vec a, Vec b) { return vsubq_f32(a, b); }
+static inline Vec Mul(Vec a, Vec b) { return vmulq_f32(a, b); }
+static inline void ZeroUpper() { }
+static inline void Transpose(Vec *v) {
+  float32x4x2_t t01 = vtrnq_f32(v[0], v[1]), t23 = vtrnq_f32(v[2], v[3]);
+  v[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+  v[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+  v[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+  v[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#include "matrix/srfft-simd-inl.h"
+#undef KALDI_SRFFT_SIMD_TARGET
+}  // namespace srfft_neon
+#endif
+
+// The generic versions of the loops of the batched FFT, for float (if we have
+// no SIMD version) and double; see srfft-simd-inl.h for what they do.
+template<typename Real>
+static void BatchAddSub(Real *x1, Real *x2, MatrixIndexT n) {
+  for (MatrixIndexT j = 0; j < n; j++) {
+    Real tmp = x1[j] + x2[j];
+    x2[j] = x1[j] - x2[j];
+    x1[j] = tmp;
+  }
+}
+
+template<typename Real>
+static void BatchStep2(Real *xr1, Real *xr2, Real *xi1, Real *xi2,
+                       MatrixIndexT n) {
+  for (MatrixIndexT j = 0; j < n; j++) {
+    Real tmp1 = xr1[j] + xi2[j],
+        tmp2 = xi1[j] + xr2[j];
+    xi1[j] = xi1[j] - xr2[j];
+    xr2[j] = xr1[j] - xi2[j];
+    xr1[j] = tmp1;
+    xi2[j] = tmp2;
+  }
+}
+
+template<typename Real>
+static void BatchSteps34(Real *xr, Real *xi, MatrixIndexT m4, const Real *tab,
+                         MatrixIndexT n) {
+  const Real sqhalf = M_SQRT1_2;
+  MatrixIndexT m2 = 2 * m4, m8 = m4 / 2, nel = m4 - 2;
+  const Real *cn = tab, *spcn = cn + nel, *smcn = spcn + nel,
+      *c3n = smcn + nel, *spc3n = c3n + nel, *smc3n = spc3n + nel;
+  for (MatrixIndexT k = 1; k < m4; k++) {
+    Real *xr1 = xr + (m2 + k) * n, *xr2 = xr1 + m4 * n,
+        *xi1 = xi + (m2 + k) * n, *xi2 = xi1 + m4 * n;
+    if (k == m8) {
+      for (MatrixIndexT j = 0; j < n; j++) {
+        Real tmp1 = sqhalf * (xr1[j] + xi1[j]);
+        xi1[j] = sqhalf * (xi1[j] - xr1[j]);
+        xr1[j] = tmp1;
+        Real tmp2 = sqhalf * (xi2[j] - xr2[j]);
+        xi2[j] = -sqhalf * (xr2[j] + xi2[j]);
+        xr2[j] = tmp2;
+      }
+    } else {
+      Real c = *cn++, spc = *spcn++, smc = *smcn++,
+          c3 = *c3n++, spc3 = *spc3n++, smc3 = *smc3n++;
+      for (MatrixIndexT j = 0; j < n; j++) {
+        Real tmp2 = c * (xr1[j] + xi1[j]);
+        Real tmp1 = spc * xr1[j] + tmp2;
+        xr1[j] = smc * xi1[j] + tmp2;
+        xi1[j] = tmp1;
+      }
+      for (MatrixIndexT j = 0; j < n; j++) {
+        Real tmp2 = c3 * (xr2[j] + xi2[j]);
+        Real tmp1 = spc3 * xr2[j] + tmp2;
+        xr2[j] = smc3 * xi2[j] + tmp2;
+        xi2[j] = tmp1;
+      }
+    }
+  }
+}
+
+template<typename Real>
+static void BatchRadix4(Real *xr, Real *xi, MatrixIndexT n) {
+  for (MatrixIndexT j = 0; j < n; j++) {
+    Real r0 = xr[j], r1 = xr[n + j], r2 = xr[2 * n + j], r3 = xr[3 * n + j],
+        i0 = xi[j], i1 = xi[n + j], i2 = xi[2 * n + j], i3 = xi[3 * n + j];
+    Real s0 = r0 + r2, s2 = r0 - r2, s1 = r1 + r3, s3 = r1 - r3,
+        t0 = i0 + i2, t2 = i0 - i2, t1 = i1 + i3, t3 = i1 - i3;
+    xr[j] = s0 + s1;
+    xr[n + j] = s0 - s1;
+    xi[j] = t0 + t1;
+    xi[n + j] = t0 - t1;
+    xr[2 * n + j] = s2 + t3;
+    xi[3 * n + j] = t2 + s3;
+    xi[2 * n + j] = t2 - s3;
+    xr[3 * n + j] = s2 - t3;
+  }
+}
+
+template<typename Real>
+static void BatchRealFftSteps(Real *xr, Real *xi, MatrixIndexT N2,
+                              Real rootN_re, Real rootN_im,
+                              Real kN_re, Real kN_im, MatrixIndexT n) {
+  for (MatrixIndexT k = 1; 2 * k <= N2; k++) {
+    ComplexMul(rootN_re, rootN_im, &kN_re, &kN_im);
+    MatrixIndexT kdash = N2 - k;
+    Real *re_k = xr + k * n, *im_k = xi + k * n,
+        *re_kdash = xr + kdash * n, *im_kdash = xi + kdash * n;
+    for (MatrixIndexT j = 0; j < n; j++) {
+      Real Ck_re = 0.5 * (re_k[j] + re_kdash[j]),
+          Ck_im = 0.5 * (im_k[j] - im_kdash[j]),
+          Dk_re = 0.5 * (im_k[j] + im_kdash[j]),
+          Dk_im = -0.5 * (re_k[j] - re_kdash[j]);
+      re_k[j] = Ck_re + (kN_re * Dk_re - kN_im * Dk_im);
+      im_k[j] = Ck_im + (kN_re * Dk_im + kN_im * Dk_re);
+      if (kdash != k) {
+        re_kdash[j] = Ck_re + (-kN_re * Dk_re + kN_im * Dk_im);
+        im_kdash[j] = -Ck_im + (kN_re * Dk_im + kN_im * Dk_re);
+      }
+    }
+  }
+}
+
+template<typename Real>
+static void BatchCopyIn(const Real *data, MatrixIndexT stride, MatrixIndexT N2,
+                        Real *xr, Real *xi, MatrixIndexT n) {
+  for (MatrixIndexT b = 0; b < n; b++) {
+    const Real *row = data + b * stride;
+    for (MatrixIndexT k = 0; k < N2; k++) {
+      xr[k * n + b] = row[2 * k];
+      xi[k * n + b] = row[2 * k + 1];
+    }
+  }
+}
+
+template<typename Real>
+static void BatchCopyOut(const Real *xr, const Real *xi, MatrixIndexT N2,
+                         Real scale, Real *data, MatrixIndexT stride,
+                         MatrixIndexT n) {
+  for (MatrixIndexT b = 0; b < n; b++) {
+    Real *row = data + b * stride;
+    for (MatrixIndexT k = 0; k < N2; k++) {
+      row[2 * k] = scale * xr[k * n + b];
+      row[2 * k + 1] = scale * xi[k * n + b];
+    }
+  }
+}
+
+// The float versions of the loops use the SIMD versions if we can.  On x86,
+// whether the CPU supports AVX is checked the first time.
+#ifdef KALDI_SRFFT_AVX
+static bool SrfftUseAvx() {
+  static const bool ans = (__builtin_cpu_init(),
+                           __builtin_cpu_supports("avx") != 0);
+  return ans;
+}
+#define KALDI_SRFFT_SIMD_CALL(func, args)               \
+  if (SrfftUseAvx()) { srfft_avx::func args; return; }
+#elif defined(KALDI_SRFFT_NEON)
+#define KALDI_SRFFT_SIMD_CALL(func, args)       \
+  { srfft_neon::func args; return; }
+#else
+#define KALDI_SRFFT_SIMD_CALL(func, args)
+#endif
+
+static void BatchAddSub(float *x1, float *x2, MatrixIndexT n) {
+  KALDI_SRFFT_SIMD_CALL(AddSub, (x1, x2, n));
+  BatchAddSub<float>(x1, x2, n);
+}
+
+static void BatchStep2(float *xr1, float *xr2, float *xi1, float *xi2,
+                       MatrixIndexT n) {
+  KALDI_SRFFT_SIMD_CALL(Step2, (xr1, xr2, xi1, xi2, n));
+  BatchStep2<float>(xr1, xr2, xi1, xi2, n);
+}
+
+static void BatchSteps34(float *xr, float *xi, MatrixIndexT m4,
+                         const float *tab, MatrixIndexT n) {
+  KALDI_SRFFT_SIMD_CALL(Steps34, (xr, xi, m4, tab, n));
+  BatchSteps34<float>(xr, xi, m4, tab, n);
+}
+
+static void BatchRadix4(float *xr, float *xi, MatrixIndexT n) {
+  KALDI_SRFFT_SIMD_CALL(Radix4, (xr, xi, n));
+  BatchRadix4<float>(xr, xi, n);
+}
+
+static void BatchRealFftSteps(float *xr, float *xi, MatrixIndexT N2,
+                              float rootN_re, float rootN_im,
+                              float kN_re, float kN_im, MatrixIndexT n) {
+  KALDI_SRFFT_SIMD_CALL(RealFftSteps,
+                        (xr, xi, N2, rootN_re, rootN_im, kN_re, kN_im, n));
+  BatchRealFftSteps<float>(xr, xi, N2, rootN_re, rootN_im, kN_re, kN_im, n);
+}
+
+static void BatchCopyIn(const float *data, MatrixIndexT stride,
+                        MatrixIndexT N2, float *xr, float *xi,
+                        MatrixIndexT n) {
+  KALDI_SRFFT_SIMD_CALL(CopyIn, (data, stride, N2, xr, xi, n));
+  BatchCopyIn<float>(data, stride, N2, xr, xi, n);
+}
+
+static void BatchCopyOut(const float *xr, const float *xi, MatrixIndexT N2,
+                         float scale, float *data, MatrixIndexT stride,
+                         MatrixIndexT n) {
+  KALDI_SRFFT_SIMD_CALL(CopyOut, (xr, xi, N2, scale, data, stride, n));
+  BatchCopyOut<float>(xr, xi, N2, scale, data, stride, n);
+}
+
+#undef KALDI_SRFFT_SIMD_CALL
+
+
 
 template<typename Real>
 SplitRadixComplexFft<Real>::SplitRadixComplexFft(MatrixIndexT N) {
@@ -351,6 +630,83 @@ void SplitRadixComplexFft<Real>::ComputeRecursive(Real *xr, Real *xi, MatrixInde
 }
 
 
+template<typename Real>
+void SplitRadixComplexFft<Real>::ComputeBatched(Real *xr, Real *xi,
+                                                bool forward,
+                                                MatrixIndexT batch_size) const {
+  if (!forward) {  // reverse real and imaginary parts for complex FFT.
+    Real *tmp = xr;
+    xr = xi;
+    xi = tmp;
+  }
+  ComputeRecursiveBatched(xr, xi, logn_, batch_size);
+  if (logn_ > 1) {
+    BitReversePermuteBatched(xr, logn_, batch_size);
+    BitReversePermuteBatched(xi, logn_, batch_size);
+  }
+}
+
+template<typename Real>
+void SplitRadixComplexFft<Real>::BitReversePermuteBatched(
+    Real *x, MatrixIndexT logn, MatrixIndexT batch_size) const {
+  // This is as BitReversePermute(), but it swaps blocks of batch_size
+  // elements.
+  MatrixIndexT B = batch_size;
+  MatrixIndexT lg2 = logn >> 1, n = 1 << lg2;
+  for (MatrixIndexT off = 1; off < n; off++) {
+    MatrixIndexT fj = n * brseed_[off], i = off;
+    std::swap_ranges(x + i * B, x + (i + 1) * B, x + fj * B);
+    const MatrixIndexT *brp = &(brseed_[1]);
+    for (MatrixIndexT gno = 1; gno < brseed_[off]; gno++) {
+      i += n;
+      MatrixIndexT j = fj + *brp++;
+      std::swap_ranges(x + i * B, x + (i + 1) * B, x + j * B);
+    }
+  }
+}
+
+template<typename Real>
+void SplitRadixComplexFft<Real>::ComputeRecursiveBatched(
+    Real *xr, Real *xi, MatrixIndexT logn, MatrixIndexT batch_size) const {
+  // This mirrors ComputeRecursive(), but each element is replaced by a block
+  // of batch_size elements, one per FFT, and each operation by a loop over
+  // the block.
+  const MatrixIndexT B = batch_size;
+
+  if (logn < 0)
+    KALDI_ERR << "Error: logn is out of bounds in SRFFT";
+
+  if (logn == 0) {  /* length m = 1 */
+    return;
+  } else if (logn == 1) {  /* length m = 2 */
+    BatchAddSub(xr, xr + B, B);
+    BatchAddSub(xi, xi + B, B);
+    return;
+  } else if (logn == 2) {  /* length m = 4 */
+    BatchRadix4(xr, xi, B);
+    return;
+  }
+
+  /* Compute a few constants */
+  MatrixIndexT m = 1 << logn, m2 = m / 2, m4 = m2 / 2;
+
+  /* Step 1 */
+  BatchAddSub(xr, xr + m2 * B, m2 * B);
+  BatchAddSub(xi, xi + m2 * B, m2 * B);
+
+  /* Step 2 */
+  BatchStep2(xr + m2 * B, xr + (m2 + m4) * B, xi + m2 * B,
+             xi + (m2 + m4) * B, m4 * B);
+
+  /* Steps 3 & 4 */
+  BatchSteps34(xr, xi, m4, (logn >= 4 ? tab_[logn-4] : NULL), B);
+
+  ComputeRecursiveBatched(xr, xi, logn - 1, B);
+  ComputeRecursiveBatched(xr + m2 * B, xi + m2 * B, logn - 2, B);
+  ComputeRecursiveBatched(xr + 3 * m4 * B, xi + 3 * m4 * B, logn - 2, B);
+}
+
+
 template<typename Real>
 void SplitRadixRealFft<Real>::Compute(Real *data, bool forward) {
   Compute(data, forward, &this->temp_buffer_);
@@ -430,6 +786,71 @@ void SplitRadixRealFft<Real>::Compute(Real *data, bool forward,
   }
 }
 
+template<typename Real>
+void SplitRadixRealFft<Real>::Compute(MatrixBase<Real> *data, bool forward) {
+  Compute(data, forward, &this->temp_buffer_);
+}
+
+template<typename Real>
+void SplitRadixRealFft<Real>::Compute(MatrixBase<Real> *data, bool forward,
+                                      std::vector<Real> *temp_buffer) const {
+  KALDI_ASSERT(data->NumCols() == N_ && temp_buffer != NULL);
+  // The number of rows we transform at once.  The temporary storage is
+  // N * kBlockSize elements, so this should not be too large or the block
+  // will not fit in cache.
+  const MatrixIndexT kBlockSize = 32;
+  MatrixIndexT num_rows = data->NumRows();
+  if (num_rows == 0)
+    return;
+  MatrixIndexT block_size = std::min(num_rows, kBlockSize);
+  if (temp_buffer->size() < static_cast<size_t>(N_ * block_size))
+    temp_buffer->resize(N_ * block_size);
+  for (MatrixIndexT r = 0; r < num_rows; r += block_size) {
+    MatrixIndexT this_block_size = std::min(block_size, num_rows - r);
+    SubMatrix<Real> rows(*data, r, this_block_size, 0, N_);
+    Real *xr = &((*temp_buffer)[0]), *xi = xr + (N_ / 2) * this_block_size;
+    ComputeBlock(&rows, forward, xr, xi);
+  }
+}
+
+// This is the same as the one-vector Compute() function, except that it works
+// on a block of vectors at once, in the layout described for
+// SplitRadixComplexFft::ComputeBatched(), and keeps the real and imaginary
+// parts in separate arrays.
+template<typename Real>
+void SplitRadixRealFft<Real>::ComputeBlock(MatrixBase<Real> *rows,
+                                           bool forward,
+                                           Real *xr, Real *xi) const {
+  MatrixIndexT N = N_, N2 = N/2, B = rows->NumRows();
+  BatchCopyIn(rows->Data(), rows->Stride(), N2, xr, xi, B);
+  if (forward)
+    SplitRadixComplexFft<Real>::ComputeBatched(xr, xi, true, B);
+
+  Real rootN_re, rootN_im;  // exp(-2pi/N), forward; exp(2pi/N), backward
+  int forward_sign = forward ? -1 : 1;
+  ComplexImExp(static_cast<Real>(M_2PI/N *forward_sign), &rootN_re, &rootN_im);
+  Real kN_re = -forward_sign, kN_im = 0.0;
+  BatchRealFftSteps(xr, xi, N2, rootN_re, rootN_im, kN_re, kN_im, B);
+
+  for (MatrixIndexT b = 0; b < B; b++) {  // Now handle k = 0.
+    Real zeroth = xr[b] + xi[b],
+        n2th = xr[b] - xi[b];
+    xr[b] = zeroth;
+    xi[b] = n2th;
+    if (!forward) {
+      xr[b] /= 2;
+      xi[b] /= 2;
+    }
+  }
+
+  Real scale = 1.0;
+  if (!forward) {
+    SplitRadixComplexFft<Real>::ComputeBatched(xr, xi, false, B);
+    scale = 2.0;  // See the comment in the one-vector version.
+  }
+  BatchCopyOut(xr, xi, N2, scale, rows->Data(), rows->Stride(), B);
+}
+
 template class SplitRadixComplexFft<float>;
 template class SplitRadixComplexFft<double>;
 template class SplitRadixRealFft<float>;
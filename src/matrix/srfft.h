@@ -83,10 +83,24 @@ class SplitRadixComplexFft {
   // temp_buffer_ is allocated only if someone calls Compute with only one Real*
   // argument and we need a temporary buffer while creating interleaved data.
   std::vector<Real> temp_buffer_;
+
+  // This does 'batch_size' FFTs at once.  xr and xi are arrays of size
+  // N * batch_size in which element n of FFT b is at index n * batch_size + b;
+  // otherwise this is like Compute(xr, xi, forward).  Since all the FFTs in
+  // the batch do the same operations on adjacent elements, the inner loops
+  // are over the batch; for float they use AVX (if the CPU supports it) or
+  // NEON instructions, see srfft-simd-inl.h.
+  void ComputeBatched(Real *xr, Real *xi, bool forward,
+                      Integer batch_size) const;
  private:
   void ComputeTables();
   void ComputeRecursive(Real *xr, Real *xi, Integer logn) const;
   void BitReversePermute(Real *x, Integer logn) const;
+  // Batched versions of the above; see ComputeBatched().
+  void ComputeRecursiveBatched(Real *xr, Real *xi, Integer logn,
+                               Integer batch_size) const;
+  void BitReversePermuteBatched(Real *x, Integer logn,
+                                Integer batch_size) const;
 
   Integer N_;
   Integer logn_;  // log(N)
@@ -125,7 +139,25 @@ class SplitRadixRealFft: private SplitRadixComplexFft<Real> {
   /// uses a user-supplied buffer.
   void Compute(Real *x, bool forward, std::vector<Real> *temp_buffer) const;
 
+  /// This does the same as calling Compute(data->RowData(r), forward) for each
+  /// row r of 'data', which must have N columns, but it is faster when there
+  /// are many rows (e.g. all the frames of an utterance) because it transforms
+  /// blocks of rows at once, with the inner loops over the rows of the block,
+  /// which for float use AVX or NEON instructions where available.  The
+  /// results are the same as doing the rows one by one, up to roundoff.
+  void Compute(MatrixBase<Real> *data, bool forward);
+
+  /// This is as the other batched Compute() function, but it is a const
+  /// version that uses a user-supplied buffer.
+  void Compute(MatrixBase<Real> *data, bool forward,
+               std::vector<Real> *temp_buffer) const;
+
  private:
+  // Does the batched transform for 'batch_size' rows; 'xr' and 'xi' point to
+  // arrays of size N/2 * batch_size, laid out as for ComputeBatched().
+  void ComputeBlock(MatrixBase<Real> *rows, bool forward,
+                    Real *xr, Real *xi) const;
+
   // Disallow assignment.
   SplitRadixRealFft &operator =(const SplitRadixRealFft<Real> &other);
   int N_;
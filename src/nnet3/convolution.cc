@@ -440,15 +440,41 @@ void ConvolutionComputation::Check() const {
 }
 
 
+// Does *output += input * P^T, where P is the sub-matrix of the columns
+// [params_start_col, params_start_col + input.NumCols()) of 'params'.  This
+// is overloaded for the quantized parameters so that ConvolveForwardInternal()
+// can be templated on the type of the parameters.
+static void AddInputParamsProduct(const CuMatrixBase<BaseFloat> &input,
+                                  const CuMatrixBase<BaseFloat> &params,
+                                  int32 params_start_col,
+                                  CuMatrixBase<BaseFloat> *output) {
+  CuSubMatrix<BaseFloat> params_part(params,
+                                     0, params.NumRows(),
+                                     params_start_col,
+                                     input.NumCols());
+  output->AddMatMat(1.0, input, kNoTrans, params_part, kTrans, 1.0);
+}
+
+static void AddInputParamsProduct(
+    const CuMatrixBase<BaseFloat> &input,
+    const quantization::QuantizedMatrix &params,
+    int32 params_start_col,
+    CuMatrixBase<BaseFloat> *output) {
+  quantization::AddMatQuantizedMat(input.Mat(), params,
+                                          params_start_col, &(output->Mat()));
+}
+
+
 // Internal function called inside ConvolveForward.
 // Note: the number of time steps covered may be different
 // from that implied by cc.num_t_in and cc.num_t_out
 // if the matrices are very large and we've broken the
 // computation up into pieces to save memoiry.
+template <typename ParamsType>
 static void ConvolveForwardInternal(
     const ConvolutionComputation &cc,
     const CuMatrixBase<BaseFloat> &input,
-    const CuMatrixBase<BaseFloat> &params,
+    const ParamsType &params,
     CuMatrixBase<BaseFloat> *temp_mat,
     CuMatrixBase<BaseFloat> *output) {
   KALDI_ASSERT(temp_mat->Stride() == temp_mat->NumCols());
@@ -471,12 +497,7 @@ static void ConvolveForwardInternal(
     CuSubMatrix<BaseFloat> input_part(input,
                                       input_row_start, output_rows,
                                       0, input.NumCols());
-    int32 temp_num_cols = step.columns.Dim(),
-        param_cols = temp_num_cols / cc.height_out;
-    CuSubMatrix<BaseFloat> params_part(params,
-                                       0, params.NumRows(),
-                                       step.params_start_col,
-                                       param_cols);
+    int32 temp_num_cols = step.columns.Dim();
     CuSubMatrix<BaseFloat> output_reshaped(
         output->Data(), output_rows * cc.height_out,
         cc.num_filters_out, cc.num_filters_out);
@@ -507,24 +528,25 @@ static void ConvolveForwardInternal(
           temp_mat_part.Data(), temp_mat_part.NumRows() * cc.height_out,
           temp_num_cols / cc.height_out, temp_num_cols / cc.height_out);
 
-      output_reshaped.AddMatMat(1.0, temp_mat_part_reshaped, kNoTrans,
-                                params_part, kTrans, 1.0);
+      AddInputParamsProduct(temp_mat_part_reshaped, params,
+                            step.params_start_col, &output_reshaped);
     } else {
       CuSubMatrix<BaseFloat> input_reshaped(
           input_part.Data(), input_part.NumRows() * cc.height_out,
           input_part.NumCols() / cc.height_out,
           input_part.NumCols() / cc.height_out);
 
-      output_reshaped.AddMatMat(1.0, input_reshaped, kNoTrans,
-                                params_part, kTrans, 1.0);
+      AddInputParamsProduct(input_reshaped, params,
+                            step.params_start_col, &output_reshaped);
     }
   }
 }
 
-void ConvolveForward(
+template <typename ParamsType>
+static void ConvolveForwardTpl(
     const ConvolutionComputation &cc,
     const CuMatrixBase<BaseFloat> &input,
-    const CuMatrixBase<BaseFloat> &params,
+    const ParamsType &params,
     CuMatrixBase<BaseFloat> *output) {
   KALDI_ASSERT(input.NumCols() == input.Stride() &&
                output->NumCols() == output->Stride());
@@ -551,7 +573,7 @@ void ConvolveForward(
         new_stride = new_num_cols;
     CuSubMatrix<BaseFloat> input_reshaped(
         input.Data(), required_input_rows, new_num_cols, new_stride);
-    ConvolveForward(cc, input_reshaped, params, output);
+    ConvolveForwardTpl(cc, input_reshaped, params, output);
     return;
   }
 
@@ -592,6 +614,22 @@ void ConvolveForward(
   ConvolveForwardInternal(cc, input, params, &temp_mat, output);
 }
 
+void ConvolveForward(
+    const ConvolutionComputation &cc,
+    const CuMatrixBase<BaseFloat> &input,
+    const CuMatrixBase<BaseFloat> &params,
+    CuMatrixBase<BaseFloat> *output) {
+  ConvolveForwardTpl(cc, input, params, output);
+}
+
+void ConvolveForward(
+    const ConvolutionComputation &cc,
+    const CuMatrixBase<BaseFloat> &input,
+    const quantization::QuantizedMatrix &params,
+    CuMatrixBase<BaseFloat> *output) {
+  ConvolveForwardTpl(cc, input, params, output);
+}
+
 
 // Internal function called inside ConvolveBackwardData.
 // Note: the number of time steps covered may be different
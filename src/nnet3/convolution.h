@@ -26,6 +26,7 @@
 #include "matrix/matrix-lib.h"
 #include "cudamatrix/cu-matrix-lib.h"
 #include "nnet3/nnet-common.h"
+#include "nnet3/quantization.h"
 
 #include <iostream>
 
@@ -480,6 +481,18 @@ void ConvolveForward(
     const CuMatrixBase<BaseFloat> &params,
     CuMatrixBase<BaseFloat> *output);
 
+/**
+   This version of ConvolveForward() is as the one above, except that the
+   parameters are quantized to 8 bits (see quantization.h), and the input is
+   quantized to 7 bits on the fly.  It is only used if
+   quantization::QuantizedKernelsAvailable(); it is for CPU only.
+ */
+void ConvolveForward(
+    const ConvolutionComputation &conv_comp,
+    const CuMatrixBase<BaseFloat> &input,
+    const quantization::QuantizedMatrix &params,
+    CuMatrixBase<BaseFloat> *output);
+
 
 /**
    \brief This does the part of the backward derivative computation
@@ -32,8 +32,10 @@ DecodableNnetLoopedOnlineBase::DecodableNnetLoopedOnlineBase(
     info_(info),
     input_features_(input_features),
     ivector_features_(ivector_features),
-    computer_(info_.opts.compute_config, info_.computation,
-              info_.nnet, NULL) {   // NULL is 'nnet_to_update'
+    computer_(new NnetComputer(info_.opts.compute_config, info_.computation,
+                               info_.nnet, NULL)),  // NULL is 'nnet_to_update'
+    multi_computer_(NULL),
+    stream_id_(-1) {
   // Check that feature dimensions match.
   KALDI_ASSERT(input_features_ != NULL);
   int32 nnet_input_dim = info_.nnet.InputDim("input"),
@@ -51,6 +53,28 @@ DecodableNnetLoopedOnlineBase::DecodableNnetLoopedOnlineBase(
   }
 }
 
+DecodableNnetLoopedOnlineBase::DecodableNnetLoopedOnlineBase(
+    NnetMultiStreamLoopedComputer *computer,
+    OnlineFeatureInterface *input_features,
+    OnlineFeatureInterface *ivector_features):
+    num_chunks_computed_(0),
+    current_log_post_subsampled_offset_(-1),
+    info_(computer->Info()),
+    input_features_(input_features),
+    ivector_features_(ivector_features),
+    computer_(NULL),
+    multi_computer_(computer),
+    stream_id_(-1) {
+  // AddStream() checks the feature dimensions.
+  stream_id_ = multi_computer_->AddStream(input_features, ivector_features);
+}
+
+DecodableNnetLoopedOnlineBase::~DecodableNnetLoopedOnlineBase() {
+  if (multi_computer_ != NULL)
+    multi_computer_->RemoveStream(stream_id_);
+  delete computer_;
+}
+
 
 int32 DecodableNnetLoopedOnlineBase::NumFramesReady() const {
   // note: the ivector_features_ may have 2 or 3 fewer frames ready than
@@ -110,6 +134,21 @@ bool DecodableNnetLoopedOnlineBase::IsLastFrame(
 
 
 void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
+  if (multi_computer_ != NULL) {
+    // The shared computer may already have computed this chunk as part of a
+    // batch; if not, we make it do a step (which also advances any other
+    // streams that are ready).
+    while (!multi_computer_->GetNextChunk(stream_id_, &current_log_post_)) {
+      if (multi_computer_->Compute() == 0)
+        KALDI_ERR << "Attempt to access frame past the end of the available "
+                  << "input";
+    }
+    num_chunks_computed_++;
+    current_log_post_subsampled_offset_ =
+        (num_chunks_computed_ - 1) *
+        (info_.frames_per_chunk / info_.opts.frame_subsampling_factor);
+    return;
+  }
   // Prepare the input data for the next chunk of features.
   // note: 'end' means one past the last.
   int32 begin_input_frame, end_input_frame;
@@ -147,18 +186,20 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
   CuMatrix<BaseFloat> feats_chunk;
   { // this block sets 'feats_chunk'.
     Matrix<BaseFloat> this_feats(end_input_frame - begin_input_frame,
-                                 input_features_->Dim());
+                                 input_features_->Dim(), kUndefined);
+    std::vector<int32> input_frames;
+    input_frames.reserve(end_input_frame - begin_input_frame);
     for (int32 i = begin_input_frame; i < end_input_frame; i++) {
-      SubVector<BaseFloat> this_row(this_feats, i - begin_input_frame);
       int32 input_frame = i;
       if (input_frame < 0) input_frame = 0;
       if (input_frame >= num_feature_frames_ready)
         input_frame = num_feature_frames_ready - 1;
-      input_features_->GetFrame(input_frame, &this_row);
+      input_frames.push_back(input_frame);
     }
+    input_features_->GetFrames(input_frames, &this_feats);
     feats_chunk.Swap(&this_feats);
   }
-  computer_.AcceptInput("input", &feats_chunk);
+  computer_->AcceptInput("input", &feats_chunk);
 
   if (info_.has_ivectors) {
     KALDI_ASSERT(ivector_features_ != NULL);
@@ -196,9 +237,9 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
     ivectors.CopyRowsFromVec(ivector);
     CuMatrix<BaseFloat> cu_ivectors;
     cu_ivectors.Swap(&ivectors);
-    computer_.AcceptInput("ivector", &cu_ivectors);
+    computer_->AcceptInput("ivector", &cu_ivectors);
   }
-  computer_.Run();
+  computer_->Run();
 
   {
     // Note: it's possible in theory that if you had weird recurrence that went
@@ -207,7 +248,7 @@ void DecodableNnetLoopedOnlineBase::AdvanceChunk() {
     // instead of GetOutputDestructive().  But we don't anticipate this will
     // happen in practice.
     CuMatrix<BaseFloat> output;
-    computer_.GetOutputDestructive("output", &output);
+    computer_->GetOutputDestructive("output", &output);
 
     if (info_.log_priors.Dim() != 0) {
       // subtract log-prior (divide by prior)
@@ -238,6 +279,18 @@ BaseFloat DecodableNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
       index - 1);
 }
 
+bool DecodableNnetLoopedOnline::FrameLogLikelihoods(
+    int32 subsampled_frame, std::vector<BaseFloat> *loglikes) {
+  EnsureFrameIsComputed(subsampled_frame);
+  const BaseFloat *row = current_log_post_.RowData(
+      subsampled_frame - current_log_post_subsampled_offset_);
+  int32 dim = current_log_post_.NumCols();
+  loglikes->resize(dim + 1);
+  (*loglikes)[0] = 0.0;
+  std::copy(row, row + dim, loglikes->begin() + 1);
+  return true;
+}
+
 
 BaseFloat DecodableAmNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
                                                     int32 index) {
@@ -247,6 +300,15 @@ BaseFloat DecodableAmNnetLoopedOnline::LogLikelihood(int32 subsampled_frame,
       trans_model_.TransitionIdToPdf(index));
 }
 
+bool DecodableAmNnetLoopedOnline::FrameLogLikelihoods(
+    int32 subsampled_frame, std::vector<BaseFloat> *loglikes) {
+  EnsureFrameIsComputed(subsampled_frame);
+  const BaseFloat *pdf_loglikes = current_log_post_.RowData(
+      subsampled_frame - current_log_post_subsampled_offset_);
+  trans_model_.MapPdfLogLikelihoods(pdf_loglikes, 1.0, loglikes);
+  return true;
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
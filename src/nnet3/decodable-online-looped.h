@@ -28,6 +28,7 @@
 #include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/decodable-simple-looped.h"
+#include "nnet3/nnet-multi-stream-looped.h"
 #include "hmm/transition-model.h"
 
 namespace kaldi {
@@ -62,6 +63,16 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
                                  OnlineFeatureInterface *input_features,
                                  OnlineFeatureInterface *ivector_features);
 
+  // Constructor for when the neural net computation is shared with other
+  // streams via class NnetMultiStreamLoopedComputer (which must outlive this
+  // object); this registers the features as a new stream of 'computer', and
+  // the destructor removes it.  The info is taken from computer->Info().
+  DecodableNnetLoopedOnlineBase(NnetMultiStreamLoopedComputer *computer,
+                                OnlineFeatureInterface *input_features,
+                                OnlineFeatureInterface *ivector_features);
+
+  virtual ~DecodableNnetLoopedOnlineBase();
+
   // note: the LogLikelihood function is not overridden; the child
   // class needs to do this.
   //virtual BaseFloat LogLikelihood(int32 subsampled_frame, int32 index);
@@ -121,7 +132,13 @@ class DecodableNnetLoopedOnlineBase: public DecodableInterface {
   OnlineFeatureInterface *input_features_;
   OnlineFeatureInterface *ivector_features_;
 
-  NnetComputer computer_;
+  // Owned here; NULL if multi_computer_ is non-NULL.
+  NnetComputer *computer_;
+
+  // If non-NULL, the computation is done by this shared object rather than
+  // by computer_, and stream_id_ is our stream in it.
+  NnetMultiStreamLoopedComputer *multi_computer_;
+  int32 stream_id_;
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetLoopedOnlineBase);
 };
@@ -142,6 +159,12 @@ class DecodableNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
       OnlineFeatureInterface *ivector_features):
       DecodableNnetLoopedOnlineBase(info, input_features, ivector_features) { }
 
+  DecodableNnetLoopedOnline(
+      NnetMultiStreamLoopedComputer *computer,
+      OnlineFeatureInterface *input_features,
+      OnlineFeatureInterface *ivector_features):
+      DecodableNnetLoopedOnlineBase(computer, input_features,
+                                    ivector_features) { }
 
   // returns the output-dim of the neural net.
   virtual int32 NumIndices() const { return info_.output_dim; }
@@ -151,6 +174,9 @@ class DecodableNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
   // represents the pdf-id (or other output of the network) PLUS ONE.
   virtual BaseFloat LogLikelihood(int32 subsampled_frame, int32 index);
 
+  virtual bool FrameLogLikelihoods(int32 subsampled_frame,
+                                   std::vector<BaseFloat> *loglikes);
+
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetLoopedOnline);
 
@@ -174,6 +200,15 @@ class DecodableAmNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
       DecodableNnetLoopedOnlineBase(info, input_features, ivector_features),
       trans_model_(trans_model) { }
 
+  DecodableAmNnetLoopedOnline(
+      const TransitionModel &trans_model,
+      NnetMultiStreamLoopedComputer *computer,
+      OnlineFeatureInterface *input_features,
+      OnlineFeatureInterface *ivector_features):
+      DecodableNnetLoopedOnlineBase(computer, input_features,
+                                    ivector_features),
+      trans_model_(trans_model) { }
+
 
   // returns the output-dim of the neural net.
   virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
@@ -183,6 +218,9 @@ class DecodableAmNnetLoopedOnline: public DecodableNnetLoopedOnlineBase {
   virtual BaseFloat LogLikelihood(int32 subsampled_frame,
                                   int32 transition_id);
 
+  virtual bool FrameLogLikelihoods(int32 subsampled_frame,
+                                   std::vector<BaseFloat> *loglikes);
+
  private:
   const TransitionModel &trans_model_;
 
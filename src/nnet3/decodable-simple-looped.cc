@@ -83,8 +83,13 @@ void DecodableNnetSimpleLoopedInfo::Init(
                                  num_sequences,
                                  &request1, &request2, &request3);
 
-  CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
-                &computation);
+  if (opts.computation_cache.empty() ||
+      !ReadCachedComputation(opts, *nnet)) {
+    CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
+                  &computation);
+    if (!opts.computation_cache.empty())
+      WriteCachedComputation(opts, *nnet);
+  }
   computation.ComputeCudaIndexes();
   if (GetVerboseLevel() >= 3) {
     KALDI_VLOG(3) << "Computation is:";
@@ -93,6 +98,59 @@ void DecodableNnetSimpleLoopedInfo::Init(
 }
 
 
+bool DecodableNnetSimpleLoopedInfo::ReadCachedComputation(
+    const NnetSimpleLoopedComputationOptions &opts,
+    const Nnet &nnet) {
+  std::string contents;
+  try {
+    if (!ReadComputationCacheFile(opts.computation_cache, NnetHash(nnet),
+                                  &contents))
+      return false;
+    std::istringstream is(contents);
+    bool binary = true;
+    NnetOptimizeOptions optimize_config_cached;
+    optimize_config_cached.Read(is, binary);
+    ComputationRequest request1_cached, request2_cached, request3_cached;
+    request1_cached.Read(is, binary);
+    request2_cached.Read(is, binary);
+    request3_cached.Read(is, binary);
+    // The requests depend on options such as --frames-per-chunk.
+    if (!(optimize_config_cached == opts.optimize_config &&
+          request1_cached == request1 && request2_cached == request2 &&
+          request3_cached == request3)) {
+      KALDI_LOG << "Not using computation cache from "
+                << PrintableRxfilename(opts.computation_cache)
+                << " because the options have changed.";
+      return false;
+    }
+    NnetComputation computation_cached;
+    computation_cached.Read(is, binary);
+    computation = computation_cached;
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error reading computation cache from "
+               << PrintableRxfilename(opts.computation_cache)
+               << ", ignoring it.";
+    return false;
+  }
+  KALDI_LOG << "Read computation cache from "
+            << PrintableRxfilename(opts.computation_cache);
+  return true;
+}
+
+void DecodableNnetSimpleLoopedInfo::WriteCachedComputation(
+    const NnetSimpleLoopedComputationOptions &opts,
+    const Nnet &nnet) const {
+  std::ostringstream os;
+  bool binary = true;
+  opts.optimize_config.Write(os, binary);
+  request1.Write(os, binary);
+  request2.Write(os, binary);
+  request3.Write(os, binary);
+  computation.Write(os, binary);
+  WriteComputationCacheFile(opts.computation_cache, NnetHash(nnet), os.str());
+}
+
+
 DecodableNnetSimpleLooped::DecodableNnetSimpleLooped(
     const DecodableNnetSimpleLoopedInfo &info,
     const MatrixBase<BaseFloat> &feats,
@@ -261,6 +319,13 @@ BaseFloat DecodableAmNnetSimpleLooped::LogLikelihood(int32 frame,
   return decodable_nnet_.GetOutput(frame, pdf_id);
 }
 
+bool DecodableAmNnetSimpleLooped::FrameLogLikelihoods(
+    int32 frame, std::vector<BaseFloat> *loglikes) {
+  const BaseFloat *pdf_loglikes = decodable_nnet_.GetOutputRowData(frame);
+  trans_model_.MapPdfLogLikelihoods(pdf_loglikes, 1.0, loglikes);
+  return true;
+}
+
 
 
 } // namespace nnet3
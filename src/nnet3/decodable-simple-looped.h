@@ -51,6 +51,9 @@ struct NnetSimpleLoopedComputationOptions {
   bool debug_computation;
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
+  // If nonempty, a file in which the compiled computations are cached
+  // between runs of the program.
+  std::string computation_cache;
   NnetSimpleLoopedComputationOptions():
       extra_left_context_initial(0),
       frame_subsampling_factor(1),
@@ -83,6 +86,11 @@ struct NnetSimpleLoopedComputationOptions {
                    "if needed.");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("computation-cache", &computation_cache, "If set, a file "
+                   "in which the compiled neural net computations are cached, "
+                   "so that later jobs with the same model can skip compilation "
+                   "(the cache is ignored if the model or the optimization "
+                   "options change).");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -151,6 +159,17 @@ class DecodableNnetSimpleLoopedInfo  {
 
   // The compiled, 'looped' computation.
   NnetComputation computation;
+
+ private:
+  // Sets 'computation' from the file given by opts.computation_cache, and
+  // returns true, if it was compiled for this model with the same options
+  // and computation requests.
+  bool ReadCachedComputation(const NnetSimpleLoopedComputationOptions &opts,
+                             const Nnet &nnet);
+
+  // Writes 'computation' to the file given by opts.computation_cache.
+  void WriteCachedComputation(const NnetSimpleLoopedComputationOptions &opts,
+                              const Nnet &nnet) const;
 };
 
 /*
@@ -215,6 +234,20 @@ class DecodableNnetSimpleLooped {
                              current_log_post_subsampled_offset_,
                              pdf_id);
   }
+
+  // Returns a pointer to the output for a particular frame (of dimension
+  // OutputDim()); the same ordering requirements apply as for GetOutput().
+  // It is only valid until the next call to any of the Get* functions of this
+  // object.
+  inline const BaseFloat *GetOutputRowData(int32 subsampled_frame) {
+    KALDI_ASSERT(subsampled_frame >= current_log_post_subsampled_offset_ &&
+                 "Frames must be accessed in order.");
+    while (subsampled_frame >= current_log_post_subsampled_offset_ +
+                            current_log_post_.NumRows())
+      AdvanceChunk();
+    return current_log_post_.RowData(subsampled_frame -
+                                     current_log_post_subsampled_offset_);
+  }
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimpleLooped);
 
@@ -304,6 +337,9 @@ class DecodableAmNnetSimpleLooped: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual bool FrameLogLikelihoods(int32 frame,
+                                   std::vector<BaseFloat> *loglikes);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_.NumFrames();
   }
@@ -81,6 +81,13 @@ BaseFloat DecodableAmNnetSimple::LogLikelihood(int32 frame,
   return decodable_nnet_.GetOutput(frame, pdf_id);
 }
 
+bool DecodableAmNnetSimple::FrameLogLikelihoods(
+    int32 frame, std::vector<BaseFloat> *loglikes) {
+  const BaseFloat *pdf_loglikes = decodable_nnet_.GetOutputRowData(frame);
+  trans_model_.MapPdfLogLikelihoods(pdf_loglikes, 1.0, loglikes);
+  return true;
+}
+
 int32 DecodableNnetSimple::GetIvectorDim() const {
   if (ivector_ != NULL)
     return ivector_->Dim();
@@ -317,7 +324,8 @@ DecodableAmNnetSimpleParallel::DecodableAmNnetSimpleParallel(
     const MatrixBase<BaseFloat> &feats,
     const VectorBase<BaseFloat> *ivector,
     const MatrixBase<BaseFloat> *online_ivectors,
-    int32 online_ivector_period):
+    int32 online_ivector_period,
+    CachingOptimizingCompiler *compiler):
     compiler_(am_nnet.GetNnet(), opts.optimize_config, opts.compiler_config),
     trans_model_(trans_model),
     feats_copy_(NULL),
@@ -332,7 +340,8 @@ DecodableAmNnetSimpleParallel::DecodableAmNnetSimpleParallel(
       online_ivectors_copy_ = new Matrix<BaseFloat>(*online_ivectors);
     decodable_nnet_ = new DecodableNnetSimple(opts, am_nnet.GetNnet(),
                                               am_nnet.Priors(), *feats_copy_,
-                                              &compiler_, ivector_copy_,
+                                              (compiler != NULL ? compiler :
+                                               &compiler_), ivector_copy_,
                                               online_ivectors_copy_,
                                               online_ivector_period);
 
@@ -361,6 +370,13 @@ BaseFloat DecodableAmNnetSimpleParallel::LogLikelihood(int32 frame,
   return decodable_nnet_->GetOutput(frame, pdf_id);
 }
 
+bool DecodableAmNnetSimpleParallel::FrameLogLikelihoods(
+    int32 frame, std::vector<BaseFloat> *loglikes) {
+  const BaseFloat *pdf_loglikes = decodable_nnet_->GetOutputRowData(frame);
+  trans_model_.MapPdfLogLikelihoods(pdf_loglikes, 1.0, loglikes);
+  return true;
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
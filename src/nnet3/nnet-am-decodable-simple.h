@@ -52,6 +52,9 @@ struct NnetSimpleComputationOptions {
   NnetOptimizeOptions optimize_config;
   NnetComputeOptions compute_config;
   CachingOptimizingCompilerOptions compiler_config;
+  // If nonempty, a file in which the compiled computations are cached
+  // between runs of the program.
+  std::string computation_cache;
 
   NnetSimpleComputationOptions():
       extra_left_context(0),
@@ -94,6 +97,11 @@ struct NnetSimpleComputationOptions {
                    "input frames");
     opts->Register("debug-computation", &debug_computation, "If true, turn on "
                    "debug for the actual computation (very verbose!)");
+    opts->Register("computation-cache", &computation_cache, "If set, a file "
+                   "in which the compiled neural net computations are cached, "
+                   "so that later jobs with the same model can skip compilation "
+                   "(the cache is ignored if the model or the optimization "
+                   "options change).");
 
     // register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -178,6 +186,18 @@ class DecodableNnetSimple {
                              current_log_post_subsampled_offset_,
                              pdf_id);
   }
+
+  // Returns a pointer to the output for a particular frame (of dimension
+  // OutputDim()), with 0 <= subsampled_frame < NumFrames().  It is only valid
+  // until the next call to any of the Get* functions of this object.
+  inline const BaseFloat *GetOutputRowData(int32 subsampled_frame) {
+    if (subsampled_frame < current_log_post_subsampled_offset_ ||
+        subsampled_frame >= current_log_post_subsampled_offset_ +
+                            current_log_post_.NumRows())
+      EnsureFrameIsComputed(subsampled_frame);
+    return current_log_post_.RowData(subsampled_frame -
+                                     current_log_post_subsampled_offset_);
+  }
  private:
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableNnetSimple);
 
@@ -294,6 +314,9 @@ class DecodableAmNnetSimple: public DecodableInterface {
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual bool FrameLogLikelihoods(int32 frame,
+                                   std::vector<BaseFloat> *loglikes);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_.NumFrames();
   }
@@ -323,11 +346,12 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
         (1) It doesn't keep around pointers to the features and iVectors;
             instead, it creates copies of them (so the caller can
             delete the originals).
-        (2) It doesn't support the user passing in a pointer to the
-            CachingOptimizingCompiler-- because making that thread safe
-            would be quite complicated, and in any case multi-threaded
-            decoding probably makes the most sense when using CPU, and
-            in that case we don't expect the compilation phase to dominate.
+        (2) The CachingOptimizingCompiler is optional; if you don't
+            supply one, it uses its own.  Supplying one that is shared
+            between the decoding threads (its Compile() function is
+            thread-safe) avoids compiling the same computation for each
+            utterance, and allows it to be read from and written to the
+            --computation-cache file.
 
      This constructor takes features as input, and you can either supply a
      single iVector input, estimated in batch-mode ('ivector'), or 'online'
@@ -352,6 +376,9 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
      @param [in] online_ivector_period If you are using iVectors estimated 'online'
                         (i.e. if online_ivectors != NULL) gives the periodicity
                         (in frames) with which the iVectors are estimated.
+     @param [in] compiler  If non-NULL, the compiler to use (it must have been
+                        created for am_nnet.GetNnet() and must outlive this
+                        object); may be shared between threads.
   */
   DecodableAmNnetSimpleParallel(
       const NnetSimpleComputationOptions &opts,
@@ -360,11 +387,15 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
       const MatrixBase<BaseFloat> &feats,
       const VectorBase<BaseFloat> *ivector = NULL,
       const MatrixBase<BaseFloat> *online_ivectors = NULL,
-      int32 online_ivector_period = 1);
+      int32 online_ivector_period = 1,
+      CachingOptimizingCompiler *compiler = NULL);
 
 
   virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
 
+  virtual bool FrameLogLikelihoods(int32 frame,
+                                   std::vector<BaseFloat> *loglikes);
+
   virtual inline int32 NumFramesReady() const {
     return decodable_nnet_->NumFrames();
   }
@@ -381,6 +412,7 @@ class DecodableAmNnetSimpleParallel: public DecodableInterface {
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetSimpleParallel);
   void DeletePointers();
 
+  // Only used if no compiler was passed to the constructor.
   CachingOptimizingCompiler compiler_;
   const TransitionModel &trans_model_;
 
@@ -857,6 +857,22 @@ void ComputationChecker::CheckComputationIndexes() const {
           memo_to_command[c.arg5] = command_index;
         }
         KALDI_ASSERT(c.arg6 == 0 || c.arg6 == 1);
+        if (c.arg7 > 0) {  // fused with the following commands.
+          if (command_index + c.arg7 >= num_commands)
+            KALDI_ERR << "Fused commands extend past the end of the "
+                "computation";
+          // The fused commands are executed with NULL indexes.
+          if (!(properties & kSimpleComponent) || c.arg2 != 0 || c.arg5 > 0)
+            KALDI_ERR << "Invalid fused propagate command";
+          for (int32 i = 1; i <= c.arg7; i++) {
+            const NnetComputation::Command &next_c =
+                computation_.commands[command_index + i];
+            if (next_c.command_type != kPropagate ||
+                next_c.arg2 != 0 || next_c.arg3 != c.arg4 ||
+                next_c.arg4 != c.arg4 || next_c.arg5 > 0 || next_c.arg7 > 0)
+              KALDI_ERR << "Invalid command fused with propagate command";
+          }
+        }
         break;
       }
       case kBackprop:
@@ -1482,5 +1498,111 @@ int64 GetMaxMemoryUse(const NnetComputation &computation) {
   return max_memory_use;
 }
 
+void ComputeCommandDependencies(
+    const Nnet &nnet,
+    const NnetComputation &computation,
+    std::vector<std::vector<int32> > *dependencies) {
+  ComputationVariables variables;
+  variables.Init(computation);
+  std::vector<CommandAttributes> attributes;
+  ComputeCommandAttributes(nnet, computation, variables, &attributes);
+
+  const std::vector<NnetComputation::Command> &commands = computation.commands;
+  int32 num_commands = commands.size(),
+      num_variables = variables.NumVariables(),
+      num_components = nnet.NumComponents(),
+      max_memo_index = 0;
+  for (int32 c = 0; c < num_commands; c++) {
+    if (commands[c].command_type == kPropagate)
+      max_memo_index = std::max(max_memo_index, commands[c].arg5);
+  }
+  // We treat components and memos like variables; we call all of them
+  // 'resources'.  Resource r < num_variables is variable r; then come the
+  // components and then the memos.
+  int32 component_offset = num_variables,
+      memo_offset = num_variables + num_components,
+      num_resources = memo_offset + max_memo_index + 1;
+  // last_writer[r] is the last command that wrote to resource r, or -1;
+  // readers[r] is the list of commands that have read it since then.
+  std::vector<int32> last_writer(num_resources, -1);
+  std::vector<std::vector<int32> > readers(num_resources);
+  // the last command that changes the flow of control or does I/O, or -1.
+  int32 last_barrier = -1;
+
+  dependencies->clear();
+  dependencies->resize(num_commands);
+  std::vector<int32> resources_read, resources_written;
+  for (int32 c = 0; c < num_commands; c++) {
+    const NnetComputation::Command &command = commands[c];
+    std::vector<int32> &this_dependencies = (*dependencies)[c];
+    switch (command.command_type) {
+      case kAcceptInput: case kProvideOutput: case kNoOperationMarker:
+      case kNoOperationLabel: case kGotoLabel:
+        for (int32 c2 = std::max(last_barrier, 0); c2 < c; c2++)
+          this_dependencies.push_back(c2);
+        last_barrier = c;
+        continue;
+      default:
+        break;
+    }
+    if (last_barrier >= 0)
+      this_dependencies.push_back(last_barrier);
+    const CommandAttributes &attr = attributes[c];
+    resources_read = attr.variables_read;
+    resources_written = attr.variables_written;
+    switch (command.command_type) {
+      case kAllocMatrix: case kDeallocMatrix:
+        variables.AppendVariablesForMatrix(
+            computation.submatrices[command.arg1].matrix_index,
+            &resources_written);
+        break;
+      case kSwapMatrix:
+        variables.AppendVariablesForMatrix(
+            computation.submatrices[command.arg1].matrix_index,
+            &resources_written);
+        variables.AppendVariablesForMatrix(
+            computation.submatrices[command.arg2].matrix_index,
+            &resources_written);
+        break;
+      case kPropagate:
+        resources_written.push_back(component_offset + command.arg1);
+        if (command.arg5 > 0)
+          resources_written.push_back(memo_offset + command.arg5);
+        break;
+      case kBackprop: case kBackpropNoModelUpdate:
+        resources_written.push_back(component_offset + command.arg1);
+        if (command.arg7 > 0) {
+          KALDI_ASSERT(command.arg7 <= max_memo_index);
+          resources_written.push_back(memo_offset + command.arg7);
+        }
+        break;
+      default:
+        break;
+    }
+    for (size_t i = 0; i < resources_read.size(); i++) {
+      int32 r = resources_read[i];
+      if (last_writer[r] >= 0)
+        this_dependencies.push_back(last_writer[r]);
+    }
+    for (size_t i = 0; i < resources_written.size(); i++) {
+      int32 r = resources_written[i];
+      if (last_writer[r] >= 0)
+        this_dependencies.push_back(last_writer[r]);
+      this_dependencies.insert(this_dependencies.end(),
+                               readers[r].begin(), readers[r].end());
+    }
+    SortAndUniq(&this_dependencies);
+    // Variables that are both read and written (e.g. by += operations) appear
+    // in both lists; they count as written.
+    for (size_t i = 0; i < resources_read.size(); i++)
+      readers[resources_read[i]].push_back(c);
+    for (size_t i = 0; i < resources_written.size(); i++) {
+      int32 r = resources_written[i];
+      last_writer[r] = c;
+      readers[r].clear();
+    }
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
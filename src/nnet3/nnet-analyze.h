@@ -388,6 +388,31 @@ void ComputeCommandAttributes(
     std::vector<CommandAttributes> *attributes);
 
 
+/**
+   This function works out the order in which the commands of the computation
+   really have to be executed; it is used when executing a computation with
+   more than one thread (see NnetComputeOptions::num_threads).  On output,
+   (*dependencies)[c] is a sorted list of earlier commands that must have
+   finished before command c can start.
+
+   Command c depends on an earlier command if they access a common variable and
+   at least one of them writes to it (kAllocMatrix, kDeallocMatrix and
+   kSwapMatrix count as writing all of the matrix); if they use the same memo;
+   or if they both propagate or backprop through the same component, as
+   components may have state that is not safe to use from two threads at once,
+   such as random number generators and stats.  The commands that interact with
+   the user or change the flow of control (kAcceptInput, kProvideOutput,
+   kNoOperationMarker, kNoOperationLabel and kGotoLabel) depend on all the
+   commands since the previous such command, and all later commands depend on
+   them.  Dependencies that are implied by other dependencies may or may not be
+   listed.
+*/
+void ComputeCommandDependencies(
+    const Nnet &nnet,
+    const NnetComputation &computation,
+    std::vector<std::vector<int32> > *dependencies);
+
+
 struct CheckComputationOptions {
   // do the check_rewrite check only for a non-optimized computation, it may
   // legitimately fail after optimization.  see code for details.
@@ -0,0 +1,421 @@
+// nnet3/nnet-batch-compute.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+NnetBatchComputer::NnetBatchComputer(
+    const NnetBatchComputerOptions &opts,
+    const Nnet &nnet,
+    const VectorBase<BaseFloat> &priors):
+    opts_(opts),
+    nnet_(nnet),
+    output_dim_(nnet.OutputDim("output")),
+    log_priors_(priors),
+    compiler_(nnet, opts.optimize_config, opts.compiler_config),
+    num_pending_tasks_(0),
+    num_computations_(0),
+    num_tasks_computed_(0) {
+  KALDI_ASSERT(IsSimpleNnet(nnet));
+  ComputeSimpleNnetContext(nnet, &nnet_left_context_, &nnet_right_context_);
+  log_priors_.ApplyLog();
+  CheckAndFixConfigs();
+  if (!opts_.computation_cache.empty())
+    compiler_.ReadCacheFile(opts_.computation_cache);
+}
+
+NnetBatchComputer::~NnetBatchComputer() {
+  if (!opts_.computation_cache.empty())
+    compiler_.WriteCacheFile(opts_.computation_cache);
+  if (num_pending_tasks_ != 0)
+    KALDI_WARN << "Destroying NnetBatchComputer with " << num_pending_tasks_
+               << " tasks not computed.";
+  if (num_computations_ != 0)
+    KALDI_VLOG(1) << "Did " << num_computations_ << " batched computations "
+                  << "for " << num_tasks_computed_ << " chunks, average "
+                  << "minibatch size was "
+                  << (num_tasks_computed_ * 1.0 / num_computations_)
+                  << " (--minibatch-size=" << opts_.minibatch_size << ")";
+}
+
+void NnetBatchComputer::CheckAndFixConfigs() {
+  static bool warned_frames_per_chunk = false;
+  if (opts_.frame_subsampling_factor < 1 ||
+      opts_.frames_per_chunk < 1)
+    KALDI_ERR << "--frame-subsampling-factor and --frames-per-chunk must be > 0";
+  if (opts_.minibatch_size < 1)
+    KALDI_ERR << "--minibatch-size must be > 0";
+  KALDI_ASSERT(opts_.extra_left_context >= 0 && opts_.extra_right_context >= 0);
+  int32 nnet_modulus = nnet_.Modulus();
+  KALDI_ASSERT(nnet_modulus > 0);
+  int32 n = Lcm(opts_.frame_subsampling_factor, nnet_modulus);
+  if (opts_.frames_per_chunk % n != 0) {
+    // round up to the nearest multiple of n.
+    int32 frames_per_chunk = n * ((opts_.frames_per_chunk + n - 1) / n);
+    if (!warned_frames_per_chunk) {
+      warned_frames_per_chunk = true;
+      KALDI_LOG << "Increasing --frames-per-chunk from "
+                << opts_.frames_per_chunk << " to "
+                << frames_per_chunk << " due to "
+                << "--frame-subsampling-factor="
+                << opts_.frame_subsampling_factor << " and "
+                << "nnet shift-invariance modulus = " << nnet_modulus;
+    }
+    opts_.frames_per_chunk = frames_per_chunk;
+  }
+}
+
+void NnetBatchComputer::GetCurrentIvector(
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period,
+    int32 output_t_start, int32 num_output_frames,
+    Vector<BaseFloat> *ivector_out) const {
+  if (ivector != NULL) {
+    *ivector_out = *ivector;
+    return;
+  } else if (online_ivectors == NULL) {
+    ivector_out->Resize(0);
+    return;
+  }
+  KALDI_ASSERT(online_ivector_period > 0);
+  // as in DecodableNnetSimple, we use the iVector from near the middle of the
+  // chunk.
+  int32 frame_to_search = output_t_start + num_output_frames / 2;
+  int32 ivector_frame = frame_to_search / online_ivector_period;
+  KALDI_ASSERT(ivector_frame >= 0);
+  if (ivector_frame >= online_ivectors->NumRows()) {
+    int32 margin = ivector_frame - (online_ivectors->NumRows() - 1);
+    if (margin * online_ivector_period > 50) {
+      // Half a second seems like too long to be explainable as edge effects.
+      KALDI_ERR << "Could not get iVector for frame " << frame_to_search
+                << ", only available till frame "
+                << online_ivectors->NumRows()
+                << " * ivector-period=" << online_ivector_period
+                << " (mismatched --ivector-period?)";
+    }
+    ivector_frame = online_ivectors->NumRows() - 1;
+  }
+  *ivector_out = online_ivectors->Row(ivector_frame);
+}
+
+void NnetBatchComputer::SplitUtteranceIntoTasks(
+    const MatrixBase<BaseFloat> &input,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period,
+    std::vector<NnetInferenceTask> *tasks) const {
+  KALDI_ASSERT(!(ivector != NULL && online_ivectors != NULL));
+  KALDI_ASSERT(!(online_ivectors != NULL && online_ivector_period <= 0 &&
+                 "You need to set the --online-ivector-period option!"));
+  int32 feature_dim = input.NumCols(),
+      ivector_dim = (ivector != NULL ? ivector->Dim() :
+                     (online_ivectors != NULL ?
+                      online_ivectors->NumCols() : 0)),
+      nnet_input_dim = nnet_.InputDim("input"),
+      nnet_ivector_dim = std::max<int32>(0, nnet_.InputDim("ivector"));
+  if (feature_dim != nnet_input_dim)
+    KALDI_ERR << "Neural net expects 'input' features with dimension "
+              << nnet_input_dim << " but you provided "
+              << feature_dim;
+  if (ivector_dim != nnet_ivector_dim)
+    KALDI_ERR << "Neural net expects 'ivector' features with dimension "
+              << nnet_ivector_dim << " but you provided " << ivector_dim;
+
+  int32 num_input_frames = input.NumRows(),
+      subsampling_factor = opts_.frame_subsampling_factor,
+      num_subsampled_frames = (num_input_frames + subsampling_factor - 1) /
+                              subsampling_factor,
+      subsampled_frames_per_chunk = opts_.frames_per_chunk /
+                                    subsampling_factor,
+      chunk_size = std::min<int32>(subsampled_frames_per_chunk,
+                                   num_subsampled_frames),
+      num_chunks = (num_subsampled_frames + chunk_size - 1) / chunk_size;
+  KALDI_ASSERT(num_input_frames > 0);
+
+  tasks->clear();
+  tasks->resize(num_chunks);
+  for (int32 c = 0; c < num_chunks; c++) {
+    NnetInferenceTask &task = (*tasks)[c];
+    // the last chunk is shifted left so it has the same size as the others;
+    // we discard the output frames it shares with the previous chunk.
+    int32 first_used_subsampled_frame = c * chunk_size,
+        start_subsampled_frame = std::min<int32>(
+            first_used_subsampled_frame, num_subsampled_frames - chunk_size),
+        last_subsampled_frame = start_subsampled_frame + chunk_size - 1;
+    task.num_output_frames = chunk_size;
+    task.num_initial_unused_output_frames =
+        first_used_subsampled_frame - start_subsampled_frame;
+    task.first_used_output_frame_index = first_used_subsampled_frame;
+
+    int32 first_output_frame = start_subsampled_frame * subsampling_factor,
+        last_output_frame = last_subsampled_frame * subsampling_factor;
+    int32 extra_left_context = opts_.extra_left_context,
+        extra_right_context = opts_.extra_right_context;
+    if (first_output_frame == 0 && opts_.extra_left_context_initial >= 0)
+      extra_left_context = opts_.extra_left_context_initial;
+    if (last_subsampled_frame == num_subsampled_frames - 1 &&
+        opts_.extra_right_context_final >= 0)
+      extra_right_context = opts_.extra_right_context_final;
+    int32 left_context = nnet_left_context_ + extra_left_context,
+        right_context = nnet_right_context_ + extra_right_context;
+    int32 first_input_frame = first_output_frame - left_context,
+        last_input_frame = last_output_frame + right_context,
+        num_chunk_input_frames = last_input_frame + 1 - first_input_frame;
+    task.left_context = left_context;
+
+    task.input.Resize(num_chunk_input_frames, feature_dim, kUndefined);
+    for (int32 i = 0; i < num_chunk_input_frames; i++) {
+      int32 t = i + first_input_frame;
+      if (t < 0) t = 0;
+      if (t >= num_input_frames) t = num_input_frames - 1;
+      task.input.Row(i).CopyFromVec(input.Row(t));
+    }
+    GetCurrentIvector(ivector, online_ivectors, online_ivector_period,
+                      first_output_frame,
+                      last_output_frame - first_output_frame,
+                      &task.ivector);
+  }
+}
+
+bool NnetBatchComputer::ComputationShape::operator < (
+    const ComputationShape &other) const {
+  if (left_context != other.left_context)
+    return left_context < other.left_context;
+  if (num_input_frames != other.num_input_frames)
+    return num_input_frames < other.num_input_frames;
+  if (num_output_frames != other.num_output_frames)
+    return num_output_frames < other.num_output_frames;
+  return has_ivector < other.has_ivector;
+}
+
+NnetBatchComputer::ComputationShape NnetBatchComputer::GetShape(
+    const NnetInferenceTask &task) {
+  ComputationShape shape;
+  shape.left_context = task.left_context;
+  shape.num_input_frames = task.input.NumRows();
+  shape.num_output_frames = task.num_output_frames;
+  shape.has_ivector = (task.ivector.Dim() != 0);
+  return shape;
+}
+
+void NnetBatchComputer::AcceptTask(NnetInferenceTask *task) {
+  KALDI_ASSERT(!task->is_done && task->num_output_frames > 0);
+  tasks_[GetShape(*task)].push_back(task);
+  num_pending_tasks_++;
+}
+
+void NnetBatchComputer::GetComputationRequest(
+    const ComputationShape &shape,
+    int32 num_tasks,
+    ComputationRequest *request) const {
+  request->need_model_derivative = false;
+  request->store_component_stats = false;
+  request->inputs.clear();
+  request->inputs.resize(shape.has_ivector ? 2 : 1);
+  request->outputs.clear();
+  request->outputs.resize(1);
+
+  // We shift the time so that the first output frame of each chunk has t = 0,
+  // as DecodableNnetSimple does, so the compiler's cache is effective.
+  IoSpecification &input = request->inputs[0];
+  input.name = "input";
+  input.has_deriv = false;
+  input.indexes.resize(num_tasks * shape.num_input_frames);
+  int32 first_input_t = -shape.left_context;
+  for (int32 n = 0, i = 0; n < num_tasks; n++)
+    for (int32 t = 0; t < shape.num_input_frames; t++, i++)
+      input.indexes[i] = Index(n, first_input_t + t);
+
+  if (shape.has_ivector) {
+    IoSpecification &ivector = request->inputs[1];
+    ivector.name = "ivector";
+    ivector.has_deriv = false;
+    ivector.indexes.resize(num_tasks);
+    for (int32 n = 0; n < num_tasks; n++)
+      ivector.indexes[n] = Index(n, 0);
+  }
+
+  IoSpecification &output = request->outputs[0];
+  output.name = "output";
+  output.has_deriv = false;
+  output.indexes.resize(num_tasks * shape.num_output_frames);
+  int32 subsample = opts_.frame_subsampling_factor;
+  for (int32 n = 0, i = 0; n < num_tasks; n++)
+    for (int32 t = 0; t < shape.num_output_frames; t++, i++)
+      output.indexes[i] = Index(n, t * subsample);
+}
+
+bool NnetBatchComputer::Compute(bool allow_partial_minibatch) {
+  typedef std::map<ComputationShape,
+                   std::list<NnetInferenceTask*> >::iterator IterType;
+  IterType best_iter = tasks_.end();
+  size_t best_size = 0;
+  for (IterType iter = tasks_.begin(); iter != tasks_.end(); ++iter) {
+    if (iter->second.size() > best_size) {
+      best_size = iter->second.size();
+      best_iter = iter;
+    }
+  }
+  size_t minibatch_size = opts_.minibatch_size;
+  if (best_size == 0 ||
+      (!allow_partial_minibatch && best_size < minibatch_size))
+    return false;
+
+  const ComputationShape shape = best_iter->first;
+  int32 num_tasks = std::min(best_size, minibatch_size);
+  std::vector<NnetInferenceTask*> tasks(num_tasks);
+  std::list<NnetInferenceTask*> &queue = best_iter->second;
+  for (int32 n = 0; n < num_tasks; n++) {
+    tasks[n] = queue.front();
+    queue.pop_front();
+  }
+  if (queue.empty())
+    tasks_.erase(best_iter);
+  num_pending_tasks_ -= num_tasks;
+
+  ComputationRequest request;
+  GetComputationRequest(shape, num_tasks, &request);
+  std::shared_ptr<const NnetComputation> computation =
+      compiler_.Compile(request);
+  Nnet *nnet_to_update = NULL;  // we're not doing any update.
+  NnetComputer computer(opts_.compute_config, *computation,
+                        nnet_, nnet_to_update);
+
+  int32 num_input_frames = shape.num_input_frames,
+      num_output_frames = shape.num_output_frames;
+  CuMatrix<BaseFloat> input(num_tasks * num_input_frames,
+                            tasks[0]->input.NumCols(), kUndefined);
+  for (int32 n = 0; n < num_tasks; n++)
+    input.RowRange(n * num_input_frames,
+                   num_input_frames).CopyFromMat(tasks[n]->input);
+  computer.AcceptInput("input", &input);
+  if (shape.has_ivector) {
+    CuMatrix<BaseFloat> ivectors(num_tasks, tasks[0]->ivector.Dim(),
+                                 kUndefined);
+    for (int32 n = 0; n < num_tasks; n++)
+      ivectors.Row(n).CopyFromVec(tasks[n]->ivector);
+    computer.AcceptInput("ivector", &ivectors);
+  }
+  computer.Run();
+  CuMatrix<BaseFloat> output;
+  computer.GetOutputDestructive("output", &output);
+  // subtract log-prior (divide by prior)
+  if (log_priors_.Dim() != 0)
+    output.AddVecToRows(-1.0, log_priors_);
+  // apply the acoustic scale
+  output.Scale(opts_.acoustic_scale);
+
+  for (int32 n = 0; n < num_tasks; n++) {
+    NnetInferenceTask *task = tasks[n];
+    task->output.Resize(num_output_frames, output.NumCols(), kUndefined);
+    output.RowRange(n * num_output_frames,
+                    num_output_frames).CopyToMat(&(task->output));
+    task->is_done = true;
+  }
+  num_computations_++;
+  num_tasks_computed_ += num_tasks;
+  return true;
+}
+
+void NnetBatchComputer::MergeTaskOutput(
+    const std::vector<NnetInferenceTask> &tasks,
+    Matrix<BaseFloat> *output) {
+  KALDI_ASSERT(!tasks.empty());
+  const NnetInferenceTask &last_task = tasks.back();
+  int32 num_output_frames = last_task.first_used_output_frame_index +
+      last_task.num_output_frames - last_task.num_initial_unused_output_frames,
+      output_dim = last_task.output.NumCols();
+  output->Resize(num_output_frames, output_dim, kUndefined);
+  for (size_t i = 0; i < tasks.size(); i++) {
+    const NnetInferenceTask &task = tasks[i];
+    KALDI_ASSERT(task.is_done && task.output.NumCols() == output_dim);
+    int32 num_used = task.num_output_frames -
+        task.num_initial_unused_output_frames;
+    output->RowRange(task.first_used_output_frame_index,
+                     num_used).CopyFromMat(
+                         task.output.RowRange(
+                             task.num_initial_unused_output_frames,
+                             num_used));
+  }
+}
+
+
+NnetBatchInference::NnetBatchInference(
+    const NnetBatchComputerOptions &opts,
+    const Nnet &nnet,
+    const VectorBase<BaseFloat> &priors):
+    computer_(opts, nnet, priors) { }
+
+NnetBatchInference::~NnetBatchInference() {
+  if (!utts_.empty())
+    KALDI_WARN << "Destroying NnetBatchInference with " << utts_.size()
+               << " utterances whose output was not retrieved.";
+  for (std::list<UtteranceInfo*>::iterator iter = utts_.begin();
+       iter != utts_.end(); ++iter)
+    delete *iter;
+}
+
+void NnetBatchInference::AcceptInput(
+    const std::string &utterance_id,
+    const MatrixBase<BaseFloat> &input,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period) {
+  UtteranceInfo *info = new UtteranceInfo();
+  info->utterance_id = utterance_id;
+  computer_.SplitUtteranceIntoTasks(input, ivector, online_ivectors,
+                                    online_ivector_period, &(info->tasks));
+  for (size_t i = 0; i < info->tasks.size(); i++)
+    computer_.AcceptTask(&(info->tasks[i]));
+  utts_.push_back(info);
+
+  while (computer_.Compute(false));  // do all full minibatches.
+  // Tasks with unusual shapes (e.g. from short utterances) may never make a
+  // full minibatch; to bound the latency and memory use, once too many tasks
+  // are waiting we compute partial minibatches, largest first.
+  int32 max_pending_tasks = 2 * computer_.GetOptions().minibatch_size;
+  while (computer_.NumPendingTasks() > max_pending_tasks)
+    computer_.Compute(true);
+}
+
+void NnetBatchInference::Finished() {
+  while (computer_.Compute(true));
+}
+
+bool NnetBatchInference::GetOutput(std::string *utterance_id,
+                                   Matrix<BaseFloat> *output) {
+  if (utts_.empty())
+    return false;
+  UtteranceInfo *info = utts_.front();
+  for (size_t i = 0; i < info->tasks.size(); i++)
+    if (!info->tasks[i].is_done)
+      return false;
+  NnetBatchComputer::MergeTaskOutput(info->tasks, output);
+  *utterance_id = info->utterance_id;
+  delete info;
+  utts_.pop_front();
+  return true;
+}
+
+
+}  // namespace nnet3
+}  // namespace kaldi
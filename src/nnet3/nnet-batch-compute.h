@@ -0,0 +1,287 @@
+// nnet3/nnet-batch-compute.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+#define KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+/**
+   Options for NnetBatchComputer.  These are the options for
+   DecodableNnetSimple (which this class mirrors, so that the output is the
+   same for non-recurrent models), plus the minibatch size.
+*/
+struct NnetBatchComputerOptions: public NnetSimpleComputationOptions {
+  int32 minibatch_size;
+
+  NnetBatchComputerOptions(): minibatch_size(32) { }
+
+  void Register(OptionsItf *opts) {
+    NnetSimpleComputationOptions::Register(opts);
+    opts->Register("minibatch-size", &minibatch_size, "Number of chunks "
+                   "(possibly from different utterances) that are stacked "
+                   "together into a single neural net computation.  Larger "
+                   "values make the matrix multiplications more efficient, "
+                   "at the cost of latency and memory.");
+  }
+};
+
+
+/**
+   A chunk of an utterance to be evaluated by class NnetBatchComputer.  Each
+   task contains its own copy of the input features (with the left and right
+   context already attached) so it does not depend on the lifetime of the
+   utterance's feature matrix.
+ */
+struct NnetInferenceTask {
+  // The input features for this chunk, including left and right context.
+  // The first row corresponds to output frame 0 minus 'left_context'.
+  Matrix<BaseFloat> input;
+
+  // The iVector for this chunk, if the model takes iVectors; else empty.
+  Vector<BaseFloat> ivector;
+
+  // The left-context (in input frames) that 'input' contains before the
+  // first output frame.  Together with input.NumRows(), num_output_frames
+  // and the presence of an iVector, this determines the shape of the
+  // computation, and only tasks of identical shape are batched together.
+  int32 left_context;
+
+  // The number of (subsampled) output frames that will be computed.
+  int32 num_output_frames;
+
+  // The number of initial output frames that are to be discarded because
+  // they were already computed by the previous chunk.  This is nonzero only
+  // for the last chunk of an utterance, which is shifted to the left so that
+  // it has the same shape as the other chunks.
+  int32 num_initial_unused_output_frames;
+
+  // The subsampled frame index, within the utterance, of the first used
+  // output frame.
+  int32 first_used_output_frame_index;
+
+  // Set to true by NnetBatchComputer once 'output' has been computed.
+  bool is_done;
+
+  // The output of the computation, of dimension num_output_frames by the
+  // output dimension; it has had the log-priors subtracted and the acoustic
+  // scale applied.
+  Matrix<BaseFloat> output;
+
+  NnetInferenceTask(): left_context(0), num_output_frames(0),
+                       num_initial_unused_output_frames(0),
+                       first_used_output_frame_index(0), is_done(false) { }
+};
+
+
+/**
+   NnetBatchComputer evaluates chunks of utterances (NnetInferenceTask) for a
+   'simple' neural net (see IsSimpleNnet()), stacking chunks of identical shape
+   into a single NnetComputation using the 'n' index, which gives much larger
+   and more efficient matrix multiplications than evaluating one chunk at a
+   time as DecodableNnetSimple does.  The chunks may come from different
+   utterances.
+
+   For models without recurrence or 'optional' context the output is the same
+   as that of DecodableNnetSimple with the same options.
+
+   This class is not thread-safe; the caller is expected to do the neural net
+   computation from a single thread (possibly handing the output to other
+   threads, as nnet3-latgen-faster-parallel does).
+ */
+class NnetBatchComputer {
+ public:
+  /**
+     Constructor.
+       @param [in] opts  Options.  frames_per_chunk may be increased to make it
+                         a multiple of the frame-subsampling-factor and the
+                         model's modulus.
+       @param [in] nnet  The neural net; must satisfy IsSimpleNnet(nnet).
+                         Must outlive this object.
+       @param [in] priors  Vector of priors-- if supplied and nonempty, we
+                         subtract the log of these priors from the nnet output.
+   */
+  NnetBatchComputer(const NnetBatchComputerOptions &opts,
+                    const Nnet &nnet,
+                    const VectorBase<BaseFloat> &priors);
+
+  /**
+     Splits an utterance into tasks, each covering 'frames_per_chunk' input
+     frames (or the whole utterance, if it is shorter).  The last chunk is
+     shifted left to share its shape with the other chunks.  The arguments
+     'ivector', 'online_ivectors' and 'online_ivector_period' are as for
+     DecodableNnetSimple.  'tasks' is output.
+   */
+  void SplitUtteranceIntoTasks(const MatrixBase<BaseFloat> &input,
+                               const VectorBase<BaseFloat> *ivector,
+                               const MatrixBase<BaseFloat> *online_ivectors,
+                               int32 online_ivector_period,
+                               std::vector<NnetInferenceTask> *tasks) const;
+
+  /// Adds a task to the queue of tasks waiting to be computed.  It will be
+  /// computed (and task->is_done set) by a later call to Compute().  The
+  /// pointer must remain valid until then.
+  void AcceptTask(NnetInferenceTask *task);
+
+  /// Returns the total number of tasks waiting to be computed.
+  int32 NumPendingTasks() const { return num_pending_tasks_; }
+
+  /// Does one minibatch of computation, taken from the largest group of
+  /// same-shaped pending tasks.  If allow_partial_minibatch is false, it only
+  /// does the computation if that group has at least minibatch_size tasks.
+  /// Returns true if it did any computation.
+  bool Compute(bool allow_partial_minibatch);
+
+  /// Merges the outputs of the tasks from one utterance (as produced by
+  /// SplitUtteranceIntoTasks(), in that order, and all done) into a matrix
+  /// with one row per subsampled output frame.
+  static void MergeTaskOutput(const std::vector<NnetInferenceTask> &tasks,
+                              Matrix<BaseFloat> *output);
+
+  int32 OutputDim() const { return output_dim_; }
+
+  const NnetBatchComputerOptions &GetOptions() const { return opts_; }
+
+  ~NnetBatchComputer();
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetBatchComputer);
+
+  // Tasks are batched together only if their ComputationShape is the same.
+  struct ComputationShape {
+    int32 left_context;
+    int32 num_input_frames;
+    int32 num_output_frames;
+    bool has_ivector;
+    bool operator < (const ComputationShape &other) const;
+  };
+
+  static ComputationShape GetShape(const NnetInferenceTask &task);
+
+  // Creates the computation request for 'num_tasks' tasks of shape 'shape';
+  // the indexes have 'n' varying slowest, so the rows of the stacked input
+  // and output matrices are the tasks' rows concatenated.
+  void GetComputationRequest(const ComputationShape &shape,
+                             int32 num_tasks,
+                             ComputationRequest *request) const;
+
+  // Rounds frames_per_chunk up as needed (c.f. DecodableNnetSimple).
+  void CheckAndFixConfigs();
+
+  // Gets the iVector for the chunk with the given output frames; this is as
+  // DecodableNnetSimple::GetCurrentIvector().
+  void GetCurrentIvector(const VectorBase<BaseFloat> *ivector,
+                         const MatrixBase<BaseFloat> *online_ivectors,
+                         int32 online_ivector_period,
+                         int32 output_t_start, int32 num_output_frames,
+                         Vector<BaseFloat> *ivector_out) const;
+
+  NnetBatchComputerOptions opts_;
+  const Nnet &nnet_;
+  int32 output_dim_;
+  CuVector<BaseFloat> log_priors_;
+  int32 nnet_left_context_;
+  int32 nnet_right_context_;
+  CachingOptimizingCompiler compiler_;
+
+  // Pending tasks, grouped by shape.
+  std::map<ComputationShape, std::list<NnetInferenceTask*> > tasks_;
+  int32 num_pending_tasks_;
+
+  // Statistics, printed in the destructor.
+  int64 num_computations_;
+  int64 num_tasks_computed_;
+};
+
+
+/**
+   This class does offline neural net inference for a sequence of utterances,
+   e.g. as read from a SequentialTableReader, batching chunks from different
+   utterances together via class NnetBatchComputer.  It returns the output for
+   the utterances in the same order they were provided.  Usage is:
+
+   \code
+     NnetBatchInference inference(opts, nnet, priors);
+     for (each utterance) {
+       inference.AcceptInput(utt, feats, ivector, NULL, 0);
+       std::string utt_out;
+       Matrix<BaseFloat> output;
+       while (inference.GetOutput(&utt_out, &output)) { ... }
+     }
+     inference.Finished();
+     while (inference.GetOutput(&utt_out, &output)) { ... }
+   \endcode
+ */
+class NnetBatchInference {
+ public:
+  NnetBatchInference(const NnetBatchComputerOptions &opts,
+                     const Nnet &nnet,
+                     const VectorBase<BaseFloat> &priors);
+
+  /// Accepts the input for one utterance; the arguments are as for
+  /// DecodableNnetSimple.  The input is copied, so it does not need to
+  /// persist after this call.  This may do some neural net computation if
+  /// enough chunks have accumulated to make a full minibatch.
+  void AcceptInput(const std::string &utterance_id,
+                   const MatrixBase<BaseFloat> &input,
+                   const VectorBase<BaseFloat> *ivector,
+                   const MatrixBase<BaseFloat> *online_ivectors,
+                   int32 online_ivector_period);
+
+  /// Call this after the last call to AcceptInput(); it finishes all
+  /// remaining computation, using partial minibatches as needed.
+  void Finished();
+
+  /// If the output for the earliest utterance not yet returned is ready,
+  /// outputs it and returns true; else returns false.  After Finished() has
+  /// been called, keep calling it until it returns false to get all output.
+  bool GetOutput(std::string *utterance_id,
+                 Matrix<BaseFloat> *output);
+
+  int32 OutputDim() const { return computer_.OutputDim(); }
+
+  ~NnetBatchInference();
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetBatchInference);
+
+  struct UtteranceInfo {
+    std::string utterance_id;
+    std::vector<NnetInferenceTask> tasks;
+  };
+
+  NnetBatchComputer computer_;
+  // Utterances whose output has not been returned yet, in the order they
+  // were provided.  These are pointers so that the tasks' addresses stay
+  // fixed while the computer holds pointers to them.
+  std::list<UtteranceInfo*> utts_;
+};
+
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+#endif  // KALDI_NNET3_NNET_BATCH_COMPUTE_H_
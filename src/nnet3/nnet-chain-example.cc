@@ -248,6 +248,8 @@ static void MergeSupervision(
         output->deriv_weights(t * num_inputs + n) = src_deriv_weights(t);
       }
     }
+  } else {
+    output->deriv_weights.Resize(0);
   }
   output->CheckDim();
 }
@@ -256,6 +258,14 @@ static void MergeSupervision(
 void MergeChainExamples(bool compress,
                         std::vector<NnetChainExample> *input,
                         NnetChainExample *output) {
+  GeneralMatrix temp;
+  MergeChainExamples(compress, input, output, &temp);
+}
+
+void MergeChainExamples(bool compress,
+                        std::vector<NnetChainExample> *input,
+                        NnetChainExample *output,
+                        GeneralMatrix *temp) {
   int32 num_examples = input->size();
   KALDI_ASSERT(num_examples > 0);
   // we temporarily make the input-features in 'input' look like regular NnetExamples,
@@ -263,8 +273,10 @@ void MergeChainExamples(bool compress,
   std::vector<NnetExample> eg_inputs(num_examples);
   for (int32 i = 0; i < num_examples; i++)
     eg_inputs[i].io.swap((*input)[i].inputs);
+  // start from 'output->inputs' so that MergeExamples() can reuse its memory.
   NnetExample eg_output;
-  MergeExamples(eg_inputs, compress, &eg_output);
+  eg_output.io.swap(output->inputs);
+  MergeExamples(eg_inputs, compress, &eg_output, temp);
   // swap the inputs back so that they are not really changed.
   for (int32 i = 0; i < num_examples; i++)
     eg_inputs[i].io.swap((*input)[i].inputs);
@@ -495,11 +507,12 @@ void ChainExampleMerger::WriteMinibatch(
   size_t structure_hash = eg_hasher((*egs)[0]);
   int32 minibatch_size = egs->size();
   stats_.WroteExample(eg_size, structure_hash, minibatch_size);
-  NnetChainExample merged_eg;
-  MergeChainExamples(config_.compress, egs, &merged_eg);
+  MergedExamplePool<NnetChainExample>::Buffer *buffer =
+      pool_.GetBuffer(structure_hash, minibatch_size);
+  MergeChainExamples(config_.compress, egs, &(buffer->eg), &(buffer->temp));
   std::ostringstream key;
   key << "merged-" << (num_egs_written_++) << "-" << minibatch_size;
-  writer_->Write(key.str(), merged_eg);
+  writer_->Write(key.str(), buffer->eg);
 }
 
 void ChainExampleMerger::Finish() {
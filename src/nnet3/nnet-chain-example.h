@@ -173,6 +173,14 @@ void MergeChainExamples(bool compress,
                         std::vector<NnetChainExample> *input,
                         NnetChainExample *output);
 
+/// This version of MergeChainExamples() reuses the memory already held in the
+/// input features of 'output' and in 'temp'; see the version of
+/// MergeExamples() with the same arguments.
+void MergeChainExamples(bool compress,
+                        std::vector<NnetChainExample> *input,
+                        NnetChainExample *output,
+                        GeneralMatrix *temp);
+
 
 
 /** Shifts the time-index t of everything in the input of "eg" by adding
@@ -264,6 +272,7 @@ class ChainExampleMerger {
   const ExampleMergingConfig &config_;
   NnetChainExampleWriter *writer_;
   ExampleMergingStats stats_;
+  MergedExamplePool<NnetChainExample> pool_;
 
   // Note: the "key" into the egs is the first element of the vector.
   typedef unordered_map<NnetChainExample*,
@@ -122,6 +122,8 @@ Component* Component::NewComponentOfType(const std::string &component_type) {
     ans = new SumGroupComponent();
   } else if (component_type == "FixedAffineComponent") {
     ans = new FixedAffineComponent();
+  } else if (component_type == "QuantizedAffineComponent") {
+    ans = new QuantizedAffineComponent();
   } else if (component_type == "FixedScaleComponent") {
     ans = new FixedScaleComponent();
   } else if (component_type == "FixedBiasComponent") {
@@ -170,6 +172,8 @@ Component* Component::NewComponentOfType(const std::string &component_type) {
     ans = new BatchNormComponent();
   } else if (component_type == "TimeHeightConvolutionComponent") {
     ans = new TimeHeightConvolutionComponent();
+  } else if (component_type == "QuantizedTimeHeightConvolutionComponent") {
+    ans = new QuantizedTimeHeightConvolutionComponent();
   } else if (component_type == "RestrictedAttentionComponent") {
     ans = new RestrictedAttentionComponent();
   } else if (component_type == "SumBlockComponent") {
@@ -472,6 +472,54 @@ void UnitTestNnetComponent() {
   }
 }
 
+// Checks that QuantizedAffineComponent gives about the same output as the
+// AffineComponent it was converted from.
+void UnitTestQuantizedAffineComponent() {
+  for (int32 n = 0; n < 10; n++) {
+    int32 input_dim = RandInt(1, 200), output_dim = RandInt(1, 100),
+        num_rows = RandInt(1, 30);
+    std::ostringstream os;
+    os << "input-dim=" << input_dim << " output-dim=" << output_dim
+       << " bias-stddev=1.0";
+    ConfigLine cfl;
+    cfl.ParseLine(os.str());
+    AffineComponent affine;
+    affine.InitFromConfig(&cfl);
+    QuantizedAffineComponent quantized(affine);
+    TestNnetComponentIo(&quantized);
+    TestNnetComponentCopy(&quantized);
+    KALDI_LOG << quantized.Info();
+    {  // Check that writing and reading it in binary mode gives exactly the
+       // same parameters.
+      bool binary = true;
+      std::ostringstream os;
+      quantized.Write(os, binary);
+      std::istringstream is(os.str());
+      QuantizedAffineComponent quantized2;
+      quantized2.Read(is, binary);
+      KALDI_ASSERT(quantized2.LinearParams().ApproxEqual(
+          quantized.LinearParams(), 0.0));
+    }
+
+    CuMatrix<BaseFloat> input(num_rows, input_dim),
+        output(num_rows, output_dim), quantized_output(num_rows, output_dim);
+    input.SetRandn();
+    if (n == 0)
+      input.Row(0).SetZero();  // test the case where a row's scale is zero.
+    affine.Propagate(NULL, input, &output);
+    quantized.Propagate(NULL, input, &quantized_output);
+    // The error per element of the weights is at most 1/254 of the row
+    // maximum, and if the integer kernels are used the input is quantized to
+    // 7 bits, so we allow a fairly loose tolerance.
+    BaseFloat tolerance = 0.05;
+    quantized_output.AddMat(-1.0, output);
+    KALDI_LOG << "Relative error of quantized output is "
+              << quantized_output.FrobeniusNorm() / output.FrobeniusNorm();
+    KALDI_ASSERT(quantized_output.FrobeniusNorm() <=
+                 tolerance * output.FrobeniusNorm());
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -488,6 +536,7 @@ int main() {
       CuDevice::Instantiate().SelectGpuId("yes");
 #endif
     UnitTestNnetComponent();
+    UnitTestQuantizedAffineComponent();
 #if HAVE_CUDA == 1
   } // No for loop if 'HAVE_CUDA != 1',
   CuDevice::Instantiate().PrintProfile();
@@ -549,7 +549,10 @@ static void PrintCommand(std::ostream &os_out,
       if (c.arg2 == 0) os << "NULL, ";
       else os << "precomputed_indexes[" << c.arg2 << "], ";
       os << submatrix_strings[c.arg3] << ", &" << submatrix_strings[c.arg4]
-         << ")\n";
+         << ")";
+      if (c.arg7 > 0)
+        os << " [fused with next " << c.arg7 << "]";
+      os << "\n";
       break;
     case kBackprop:
     case kBackpropNoModelUpdate: {
@@ -860,6 +863,7 @@ void NnetComputation::Read(std::istream &is, bool binary) {
   ReadBasicType(is, binary, &need_model_derivative);
 
   ComputeCudaIndexes();
+  command_schedule.reset();
   ExpectToken(is, binary, "</NnetComputation>");
 }
 
@@ -1159,6 +1163,7 @@ NnetComputation& NnetComputation::operator = (const NnetComputation &other) {
   need_model_derivative = other.need_model_derivative;
   indexes_cuda = other.indexes_cuda;
   indexes_ranges_cuda = other.indexes_ranges_cuda;
+  command_schedule.reset();
 
   for (size_t i = 1; i < component_precomputed_indexes.size(); i++)
     delete component_precomputed_indexes[i].data;
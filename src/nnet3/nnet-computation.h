@@ -25,6 +25,7 @@
 #include "nnet3/nnet-nnet.h"
 
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <vector>
 #include <map>
@@ -205,6 +206,11 @@ struct ComputationRequestPtrEqual {
      - arg6 is 1 if we need to call StoreStats() after the Propagate, or 0
        if we don't.  We used to have a separate command for storing the
        stats, but that has been removed.
+     - arg7, if positive, means that this command and the arg7 commands that
+       follow it are fused (see FusePropagateCommands()): they are all
+       kPropagate commands of element-wise components, the following ones
+       being in-place on sub-matrix arg4, and they may be executed together
+       on one block of rows at a time.  It is zero or -1 otherwise.
    - kBackprop: Do the back-propagation operation, see Component::Backprop()
      - arg1 is index of component in neural net
      - arg2 is index into ComponentPrecomputedIndexes (0 if NULL; always 0
@@ -447,6 +453,19 @@ struct NnetComputation {
   // computed from "indexes_ranges" by ComputeCudaIndexes().
   std::vector<CuArray<Int32Pair> > indexes_ranges_cuda;
 
+  // This is information used by class NnetComputer to execute commands in
+  // parallel (see NnetComputeOptions::num_threads); see NnetComputer for the
+  // meaning of the members.  It is worked out from the commands by the first
+  // NnetComputer that needs it, so that it is done once per computation and
+  // not once per chunk.  It is not read, written or copied.
+  struct CommandSchedule {
+    std::vector<int32> segment_end;
+    std::vector<int32> num_dependencies;
+    std::vector<std::vector<int32> > dependents;
+    int32 num_memos;
+  };
+  mutable std::shared_ptr<const CommandSchedule> command_schedule;
+
 
   /// Convenience function used when adding new matrices.  Writes to
   /// 'this->matrices' and 'this->submatrices'; and if 'this->matrix_debug_info'
@@ -0,0 +1,134 @@
+// nnet3/nnet-compute-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/timer.h"
+#include "nnet3/nnet-nnet.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Creates a TDNN-like network in which each layer has 'num_branches'
+// branches with different splicing, whose outputs are appended.
+static void CreateMultiBranchNnet(int32 input_dim, int32 hidden_dim,
+                                  int32 num_layers, int32 num_branches,
+                                  Nnet *nnet) {
+  std::ostringstream os;
+  os << "input-node name=input dim=" << input_dim << std::endl;
+  std::string prev_layer = "input";
+  int32 prev_dim = input_dim;
+  for (int32 l = 1; l <= num_layers; l++) {
+    std::ostringstream append;
+    append << "Append(";
+    for (int32 b = 1; b <= num_branches; b++) {
+      std::ostringstream name;
+      name << "tdnn" << l << "." << b;
+      os << "component name=" << name.str() << ".affine type=AffineComponent "
+         << "input-dim=" << (2 * prev_dim) << " output-dim=" << hidden_dim
+         << std::endl;
+      os << "component name=" << name.str() << ".relu "
+         << "type=RectifiedLinearComponent dim=" << hidden_dim << std::endl;
+      os << "component-node name=" << name.str() << ".affine component="
+         << name.str() << ".affine input=Append(Offset(" << prev_layer
+         << ", -" << b << "), Offset(" << prev_layer << ", " << b << "))"
+         << std::endl;
+      os << "component-node name=" << name.str() << ".relu component="
+         << name.str() << ".relu input=" << name.str() << ".affine"
+         << std::endl;
+      append << (b > 1 ? ", " : "") << name.str() << ".relu";
+    }
+    append << ")";
+    std::ostringstream name;
+    name << "combine" << l;
+    os << "component name=" << name.str() << " type=AffineComponent "
+       << "input-dim=" << (num_branches * hidden_dim) << " output-dim="
+       << hidden_dim << std::endl;
+    os << "component-node name=" << name.str() << " component="
+       << name.str() << " input=" << append.str() << std::endl;
+    prev_layer = name.str();
+    prev_dim = hidden_dim;
+  }
+  os << "output-node name=output input=" << prev_layer << std::endl;
+  std::istringstream is(os.str());
+  nnet->ReadConfig(is);
+}
+
+static void TestNnetComputeParallelSpeed(int32 hidden_dim,
+                                         int32 num_branches) {
+  int32 input_dim = 40, num_layers = 3, num_frames = 50;
+  Nnet nnet;
+  CreateMultiBranchNnet(input_dim, hidden_dim, num_layers, num_branches,
+                        &nnet);
+  int32 left_context, right_context;
+  ComputeSimpleNnetContext(nnet, &left_context, &right_context);
+
+  ComputationRequest request;
+  request.inputs.push_back(
+      IoSpecification("input", -left_context, num_frames + right_context));
+  request.outputs.push_back(IoSpecification("output", 0, num_frames));
+  NnetOptimizeOptions opt_config;
+  CachingOptimizingCompiler compiler(nnet, opt_config);
+  std::shared_ptr<const NnetComputation> computation =
+      compiler.Compile(request);
+
+  CuMatrix<BaseFloat> input(num_frames + left_context + right_context,
+                            input_dim);
+  input.SetRandn();
+  double time_one_thread = 0.0;
+  for (int32 num_threads = 1; num_threads <= 4; num_threads *= 2) {
+    NnetComputeOptions compute_opts;
+    compute_opts.num_threads = num_threads;
+    BaseFloat time_in_secs = 0.5;
+    Timer tim;
+    int32 iter = 0;
+    for (; tim.Elapsed() < time_in_secs; iter++) {
+      NnetComputer computer(compute_opts, *computation, nnet, NULL);
+      CuMatrix<BaseFloat> input_copy(input);
+      computer.AcceptInput("input", &input_copy);
+      computer.Run();
+    }
+    double time_per_chunk = tim.Elapsed() / iter;
+    if (num_threads == 1)
+      time_one_thread = time_per_chunk;
+    KALDI_LOG << "For " << num_branches << " branches of dim " << hidden_dim
+              << ", with " << num_threads << " threads, time per chunk was "
+              << (time_per_chunk * 1000.0) << " ms (speedup "
+              << (time_one_thread / time_per_chunk) << ")";
+  }
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+#if HAVE_CUDA == 1
+  // Parallel execution of commands only applies to CPU.
+  CuDevice::Instantiate().SelectGpuId("no");
+#endif
+  // Note: the speedup will be less than expected if the BLAS library is
+  // multi-threaded (e.g. try setting OPENBLAS_NUM_THREADS=1).
+  for (int32 hidden_dim = 256; hidden_dim <= 1024; hidden_dim *= 2)
+    for (int32 num_branches = 1; num_branches <= 4; num_branches *= 2)
+      TestNnetComputeParallelSpeed(hidden_dim, num_branches);
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
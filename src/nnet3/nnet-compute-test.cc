@@ -27,6 +27,8 @@
 #include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-am-decodable-simple.h"
 #include "nnet3/decodable-simple-looped.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/decodable-online-looped.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -75,6 +77,89 @@ void UnitTestComputationRequestIo(ComputationRequest *request) {
   }
 }
 
+// Online features from a matrix, whose frames become ready a few at a time;
+// used to test NnetMultiStreamLoopedComputer.
+class TestOnlineFeature: public OnlineFeatureInterface {
+ public:
+  explicit TestOnlineFeature(const MatrixBase<BaseFloat> &feats):
+      feats_(feats), num_frames_ready_(0) { }
+  virtual int32 Dim() const { return feats_.NumCols(); }
+  virtual int32 NumFramesReady() const { return num_frames_ready_; }
+  virtual bool IsLastFrame(int32 frame) const {
+    return num_frames_ready_ == feats_.NumRows() &&
+        frame == num_frames_ready_ - 1;
+  }
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+    KALDI_ASSERT(frame >= 0 && frame < num_frames_ready_);
+    feat->CopyFromVec(feats_.Row(frame));
+  }
+  virtual BaseFloat FrameShiftInSeconds() const { return 0.01; }
+  void AddFrames(int32 num_frames) {
+    num_frames_ready_ = std::min(feats_.NumRows(),
+                                 num_frames_ready_ + num_frames);
+  }
+ private:
+  const MatrixBase<BaseFloat> &feats_;
+  int32 num_frames_ready_;
+};
+
+// Decodes 'inputs' as separate streams sharing one
+// NnetMultiStreamLoopedComputer, with the features arriving a few frames at a
+// time and the streams starting at different times; outputs the
+// log-likelihoods of each stream.
+void TestNnetMultiStreamLooped(const DecodableNnetSimpleLoopedInfo &info,
+                               const std::vector<Matrix<BaseFloat> > &inputs,
+                               const Matrix<BaseFloat> &ivectors,
+                               std::vector<Matrix<BaseFloat> > *outputs) {
+  int32 num_streams = inputs.size();
+  NnetMultiStreamLoopedComputer computer(info, RandInt(num_streams,
+                                                       num_streams + 2));
+  std::vector<TestOnlineFeature*> feats(num_streams, NULL),
+      ivector_feats(num_streams, NULL);
+  std::vector<DecodableNnetLoopedOnline*> decodables(num_streams, NULL);
+  std::vector<int32> num_frames_done(num_streams, 0);
+  outputs->resize(num_streams);
+  int32 num_finished = 0;
+  for (int32 step = 0; num_finished < num_streams; step++) {
+    for (int32 s = 0; s < num_streams; s++) {
+      // stream s starts at step 2 * s, and finishes once all its output has
+      // been read, after which its stream-id can be reused.
+      if (step == 2 * s) {
+        feats[s] = new TestOnlineFeature(inputs[s]);
+        if (ivectors.NumRows() != 0) {
+          ivector_feats[s] = new TestOnlineFeature(ivectors);
+          ivector_feats[s]->AddFrames(ivectors.NumRows());
+        }
+        decodables[s] = new DecodableNnetLoopedOnline(&computer, feats[s],
+                                                      ivector_feats[s]);
+        (*outputs)[s].Resize(inputs[s].NumRows(), info.output_dim);
+      }
+      if (decodables[s] != NULL && RandInt(0, 2) != 0)
+        feats[s]->AddFrames(RandInt(1, 10));
+    }
+    if (RandInt(0, 1) == 0)
+      while (computer.Compute() != 0);
+    for (int32 s = 0; s < num_streams; s++) {
+      if (decodables[s] == NULL)
+        continue;
+      std::vector<BaseFloat> loglikes;
+      for (; num_frames_done[s] < decodables[s]->NumFramesReady();
+           num_frames_done[s]++) {
+        decodables[s]->FrameLogLikelihoods(num_frames_done[s], &loglikes);
+        SubVector<BaseFloat> row((*outputs)[s], num_frames_done[s]);
+        row.CopyFromVec(SubVector<BaseFloat>(&(loglikes[1]), info.output_dim));
+      }
+      if (num_frames_done[s] == inputs[s].NumRows()) {
+        delete decodables[s];
+        delete feats[s];
+        delete ivector_feats[s];
+        decodables[s] = NULL;
+        num_finished++;
+      }
+    }
+  }
+}
+
 // this checks that a couple of different decodable objects give the same
 // answer.
 void TestNnetDecodable(Nnet *nnet) {
@@ -98,11 +183,14 @@ void TestNnetDecodable(Nnet *nnet) {
   }
 
   Matrix<BaseFloat> output1(num_frames, output_dim),
-      output2(num_frames, output_dim);
+      output2(num_frames, output_dim), output3, output4;
+  std::vector<Matrix<BaseFloat> > multi_stream_outputs;
+  int32 multi_stream_right_context;
+  int32 frames_per_chunk = RandInt(5, 25);
 
   {
     NnetSimpleComputationOptions opts;
-    opts.frames_per_chunk = RandInt(5, 25);
+    opts.frames_per_chunk = frames_per_chunk;
     CachingOptimizingCompiler compiler(*nnet);
     DecodableNnetSimple decodable(opts, *nnet, priors, input, &compiler,
                                   (ivector_dim != 0 ? &ivector : NULL));
@@ -112,6 +200,30 @@ void TestNnetDecodable(Nnet *nnet) {
     }
   }
 
+  {
+    NnetBatchComputerOptions opts;
+    opts.frames_per_chunk = frames_per_chunk;
+    opts.minibatch_size = RandInt(1, 4);
+    NnetBatchInference inference(opts, *nnet, priors);
+    // the shorter utterance in the middle gives chunks of a different shape.
+    int32 short_frames = RandInt(1, num_frames);
+    inference.AcceptInput("a", input, (ivector_dim != 0 ? &ivector : NULL),
+                          NULL, 0);
+    inference.AcceptInput("b", input.RowRange(0, short_frames),
+                          (ivector_dim != 0 ? &ivector : NULL), NULL, 0);
+    inference.AcceptInput("c", input, (ivector_dim != 0 ? &ivector : NULL),
+                          NULL, 0);
+    inference.Finished();
+    std::string utt;
+    Matrix<BaseFloat> output;
+    KALDI_ASSERT(inference.GetOutput(&utt, &output3) && utt == "a");
+    KALDI_ASSERT(inference.GetOutput(&utt, &output) && utt == "b" &&
+                 output.NumRows() == short_frames);
+    KALDI_ASSERT(inference.GetOutput(&utt, &output4) && utt == "c");
+    KALDI_ASSERT(!inference.GetOutput(&utt, &output));
+    KALDI_ASSERT(output3.NumRows() == num_frames && output3.ApproxEqual(output4));
+  }
+
   {
     NnetSimpleLoopedComputationOptions opts;
     // caution: this may modify nnet, by changing how it consumes iVectors.
@@ -122,6 +234,13 @@ void TestNnetDecodable(Nnet *nnet) {
       SubVector<BaseFloat> row(output2, t);
       decodable.GetOutputForFrame(t, &row);
     }
+
+    std::vector<Matrix<BaseFloat> > inputs(3, input);
+    inputs[1].Resize(RandInt(1, num_frames), input_dim, kCopyData);
+    Matrix<BaseFloat> ivectors(ivector_dim != 0 ? num_frames : 0, ivector_dim);
+    ivectors.CopyRowsFromVec(ivector);
+    TestNnetMultiStreamLooped(info, inputs, ivectors, &multi_stream_outputs);
+    multi_stream_right_context = info.frames_right_context;
   }
 
 
@@ -141,6 +260,15 @@ void TestNnetDecodable(Nnet *nnet) {
           row2(output2, t);
       KALDI_ASSERT(row1.ApproxEqual(row2));
     }
+    KALDI_ASSERT(output1.ApproxEqual(output3));
+    KALDI_ASSERT(output2.ApproxEqual(multi_stream_outputs[0]) &&
+                 output2.ApproxEqual(multi_stream_outputs[2]));
+    // the shorter stream differs at the end, where it is padded.
+    int32 num_rows_same = multi_stream_outputs[1].NumRows() -
+        multi_stream_right_context;
+    if (num_rows_same > 0)
+      KALDI_ASSERT(output2.RowRange(0, num_rows_same).ApproxEqual(
+          multi_stream_outputs[1].RowRange(0, num_rows_same)));
   }
 }
 
@@ -276,6 +404,90 @@ void UnitTestNnetCompute() {
   }
 }
 
+// Checks that executing the computation with more than one thread gives the
+// same outputs, input-derivatives and model update as executing it with one.
+void UnitTestNnetComputeParallel() {
+  for (int32 n = 0; n < 10; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      KALDI_LOG << "Input config[" << j << "] is: " << configs[j];
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    ComputationRequest request;
+    std::vector<Matrix<BaseFloat> > inputs;
+    ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+
+    NnetComputation computation;
+    Compiler compiler(request, nnet);
+    CompilerOptions opts;
+    compiler.CreateComputation(opts, &computation);
+    NnetOptimizeOptions opt_config;
+    opt_config.fuse_propagate = (RandInt(0, 1) == 0);
+    Optimize(opt_config, nnet, MaxOutputTimeInRequest(request),
+             &computation);
+    computation.ComputeCudaIndexes();
+    {
+      std::ostringstream os;
+      computation.Print(os, nnet);
+      KALDI_LOG << "Optimized computation is: " << os.str();
+    }
+
+    const Matrix<BaseFloat> *output_deriv = NULL;
+    // The computation is run once with one thread and twice with several.
+    std::vector<Matrix<BaseFloat> > outputs(3), in_derivs(3);
+    std::vector<Vector<BaseFloat> > params(3);
+    const NnetComputation::CommandSchedule *schedule = NULL;
+    for (int32 i = 0; i < 3; i++) {
+      NnetComputeOptions compute_opts;
+      if (i > 0)
+        compute_opts.num_threads = RandInt(2, 4);
+      Nnet nnet_copy(nnet), nnet_to_update(nnet);
+      ResetGenerators(&nnet_copy);
+      NnetComputer computer(compute_opts, computation, nnet_copy,
+                            &nnet_to_update);
+      for (size_t j = 0; j < request.inputs.size(); j++) {
+        CuMatrix<BaseFloat> temp(inputs[j]);
+        computer.AcceptInput(request.inputs[j].name, &temp);
+      }
+      computer.Run();
+      outputs[i] = Matrix<BaseFloat>(computer.GetOutput("output"));
+      if (request.outputs[0].has_deriv) {
+        if (output_deriv == NULL) {
+          Matrix<BaseFloat> *temp = new Matrix<BaseFloat>(outputs[i].NumRows(),
+                                                          outputs[i].NumCols());
+          temp->SetRandn();
+          output_deriv = temp;
+        }
+        CuMatrix<BaseFloat> temp(*output_deriv);
+        computer.AcceptInput("output", &temp);
+        computer.Run();
+        if (request.inputs[0].has_deriv)
+          in_derivs[i] = Matrix<BaseFloat>(
+              computer.GetOutput(request.inputs[0].name));
+      }
+      params[i].Resize(NumParameters(nnet_to_update));
+      VectorizeNnet(nnet_to_update, &(params[i]));
+      // The dependencies between the commands are only worked out once.
+      if (i == 1)
+        schedule = computation.command_schedule.get();
+      else if (i == 2)
+        KALDI_ASSERT(computation.command_schedule.get() == schedule);
+    }
+    delete output_deriv;
+    KALDI_LOG << "Output sum (1 thread) is " << outputs[0].Sum()
+              << ", (multiple threads) is " << outputs[1].Sum();
+    for (int32 i = 1; i < 3; i++) {
+      AssertEqual(outputs[0], outputs[i]);
+      AssertEqual(in_derivs[0], in_derivs[i]);
+      AssertEqual(params[0], params[i]);
+    }
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -297,6 +509,7 @@ int main() {
 #endif
     UnitTestNnetCompute();
   }
+  UnitTestNnetComputeParallel();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
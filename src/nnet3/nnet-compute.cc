@@ -17,9 +17,15 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
 #include <iterator>
+#include <mutex>
 #include <sstream>
 #include "nnet3/nnet-compute.h"
+#include "cudamatrix/cu-cpu-allocator.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -62,6 +68,148 @@ void NnetComputer::Init() {
     KALDI_LOG << preamble;
     computation_.GetSubmatrixStrings(nnet_, &submatrix_strings_);
   }
+  if (options_.num_threads > 1 && !debug_) {
+#if HAVE_CUDA == 1
+    // On GPU the commands are queued anyway, so there would be nothing to
+    // gain.
+    if (!CuDevice::Instantiate().Enabled())
+#endif
+      InitParallel();
+  }
+}
+
+static bool IsBarrierCommand(const NnetComputation::Command &c) {
+  switch (c.command_type) {
+    case kAcceptInput: case kProvideOutput: case kNoOperationMarker:
+    case kNoOperationLabel: case kGotoLabel:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Works out the information in 'schedule' from the computation; see the
+// comment for NnetComputer::schedule_ for what it means.
+static void ComputeCommandSchedule(const Nnet &nnet,
+                                   const NnetComputation &computation,
+                                   NnetComputation::CommandSchedule *schedule) {
+  const std::vector<NnetComputation::Command> &commands = computation.commands;
+  int32 num_commands = commands.size();
+  std::vector<std::vector<int32> > dependencies;
+  ComputeCommandDependencies(nnet, computation, &dependencies);
+
+  // group[c] is the command that command c is executed with (c itself, unless
+  // it is fused with an earlier command; see NnetComputer::NumCommandsFused()).
+  std::vector<int32> group(num_commands);
+  for (int32 c = 0; c < num_commands; c++)
+    group[c] = c;
+  for (int32 c = 0; c < num_commands; c++) {
+    int32 num_fused = (commands[c].command_type == kPropagate &&
+                       commands[c].arg7 > 0 ? commands[c].arg7 : 0);
+    for (int32 i = 1; i <= num_fused; i++)
+      group[c + i] = c;
+    c += num_fused;
+  }
+
+  std::vector<int32> &segment_end = schedule->segment_end,
+      &num_dependencies = schedule->num_dependencies;
+  std::vector<std::vector<int32> > &dependents = schedule->dependents;
+  segment_end.clear();
+  segment_end.resize(num_commands, -1);
+  num_dependencies.clear();
+  num_dependencies.resize(num_commands, 0);
+  dependents.clear();
+  dependents.resize(num_commands);
+  std::vector<int32> depth(num_commands);
+  for (int32 begin = 0; begin < num_commands; ) {
+    if (IsBarrierCommand(commands[begin])) {
+      begin++;
+      continue;
+    }
+    int32 end = begin;
+    while (end < num_commands && !IsBarrierCommand(commands[end]))
+      end++;
+    int32 num_groups = 0;
+    for (int32 c = begin; c < end; c++) {
+      int32 g = group[c];
+      if (g == c) num_groups++;
+      else num_dependencies[c] = -1;
+      for (size_t i = 0; i < dependencies[c].size(); i++) {
+        int32 d = dependencies[c][i];
+        // Dependencies outside [begin, end) are finished before we start.
+        if (d >= begin && group[d] != g)
+          dependents[group[d]].push_back(g);
+      }
+    }
+    // If the longest chain of dependencies covers all the commands, they
+    // can't be executed in parallel.
+    int32 max_depth = 0;
+    for (int32 c = begin; c < end; c++)
+      depth[c] = 1;
+    for (int32 c = begin; c < end; c++) {
+      if (group[c] != c)
+        continue;
+      SortAndUniq(&(dependents[c]));
+      for (size_t i = 0; i < dependents[c].size(); i++) {
+        int32 d = dependents[c][i];
+        num_dependencies[d]++;
+        depth[d] = std::max(depth[d], depth[c] + 1);
+      }
+      max_depth = std::max(max_depth, depth[c]);
+    }
+    if (max_depth < num_groups)
+      segment_end[begin] = end;
+    begin = end;
+  }
+  int32 max_memo_index = 0;
+  for (int32 c = 0; c < num_commands; c++)
+    if (commands[c].command_type == kPropagate)
+      max_memo_index = std::max(max_memo_index, commands[c].arg5);
+  schedule->num_memos = max_memo_index + 1;
+}
+
+// Returns a thread pool with num_threads threads.  There is one per calling
+// thread, which is kept until the thread exits (or until a different number of
+// threads is asked for), so that we don't start new threads for each
+// NnetComputer.  Pools replaced by one of a different size are deleted when
+// the last NnetComputer using them is.
+static std::shared_ptr<ThreadPool> GetThreadPool(int32 num_threads) {
+  static thread_local std::shared_ptr<ThreadPool> pool;
+  if (pool == NULL || pool->NumThreads() != num_threads)
+    pool.reset(new ThreadPool(num_threads));
+  return pool;
+}
+
+void NnetComputer::InitParallel() {
+  {
+    // The schedule is computed by the first NnetComputer that needs it.
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (computation_.command_schedule == NULL) {
+      NnetComputation::CommandSchedule *schedule =
+          new NnetComputation::CommandSchedule();
+      ComputeCommandSchedule(nnet_, computation_, schedule);
+      computation_.command_schedule.reset(schedule);
+    }
+    schedule_ = computation_.command_schedule;
+  }
+  if (std::count(schedule_->segment_end.begin(), schedule_->segment_end.end(),
+                 -1) == static_cast<std::ptrdiff_t>(
+                     schedule_->segment_end.size())) {
+    schedule_.reset();  // there is nothing to execute in parallel.
+    return;
+  }
+  pool_ = GetThreadPool(options_.num_threads - 1);
+  // Make sure that SaveMemo() won't have to resize memos_ while other threads
+  // are accessing it.
+  memos_.resize(schedule_->num_memos, NULL);
+}
+
+int32 NnetComputer::NumCommandsFused(int32 command) const {
+  const NnetComputation::Command &c = computation_.commands[command];
+  // In debug mode we execute the fused commands one by one, which gives the
+  // same result.
+  return (c.command_type == kPropagate && c.arg7 > 0 && !debug_ ? c.arg7 : 0);
 }
 
 //static
@@ -199,16 +347,21 @@ NnetComputer::NnetComputer(const NnetComputer &other):
     submatrix_strings_(other.submatrix_strings_),
     command_strings_(other.command_strings_),
     matrices_(other.matrices_),
-    memos_(other.memos_) {
-  // Note: this is the same as the default copy constructor, except for the check below.
-  if (!memos_.empty()) {
+    memos_(other.memos_),
+    schedule_(other.schedule_),
+    pool_(other.pool_) {
+  // Note: this is the same as the default copy constructor, except for the
+  // check below (memos_ may have been resized in advance by InitParallel()).
+  if (static_cast<size_t>(std::count(memos_.begin(), memos_.end(),
+                                     static_cast<void*>(NULL))) !=
+      memos_.size()) {
     KALDI_ERR << "You cannot use the copy constructor of NnetComputer if "
         "memos are used.";
   }
 }
 
-void NnetComputer::ExecuteCommand() {
-  const NnetComputation::Command &c = computation_.commands[program_counter_];
+void NnetComputer::ExecuteCommand(int32 command) {
+  const NnetComputation::Command &c = computation_.commands[command];
   int32 m1, m2;
   try {
     switch (c.command_type) {
@@ -235,6 +388,10 @@ void NnetComputer::ExecuteCommand() {
         break;
       }
       case kPropagate: {
+        if (NumCommandsFused(command) > 0) {
+          ExecuteFusedPropagate(command);
+          break;
+        }
         const Component *component = nnet_.GetComponent(c.arg1);
         ComponentPrecomputedIndexes *indexes =
             computation_.component_precomputed_indexes[c.arg2].data;
@@ -430,17 +587,154 @@ void NnetComputer::ExecuteCommand() {
         KALDI_ERR << "Invalid command in computation";
     }
   } catch (...) {
+    // If commands are executed in parallel, more than one may fail at once;
+    // we don't want to interleave their output.
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> command_strings;
     if (!debug_) {
       std::string preamble;
-      computation_.GetCommandStrings(nnet_, &preamble, &command_strings_);
+      computation_.GetCommandStrings(nnet_, &preamble, &command_strings);
       KALDI_WARN << "Printing some background info since error was detected";
       KALDI_LOG << preamble;
-      for (int32 prev_c = 0; prev_c < program_counter_; prev_c++)
-        KALDI_LOG << command_strings_[prev_c];
+      for (int32 prev_c = 0; prev_c < command; prev_c++)
+        KALDI_LOG << command_strings[prev_c];
     }
     // the following will re-throw the error, but now we've printed more info
     // about what went wrong.
-    KALDI_ERR << "Error running command " << command_strings_[program_counter_];
+    KALDI_ERR << "Error running command "
+              << (debug_ ? command_strings_ : command_strings)[command];
+  }
+}
+
+void NnetComputer::ExecuteFusedPropagate(int32 command) {
+  const std::vector<NnetComputation::Command> &commands = computation_.commands;
+  const NnetComputation::Command &first_command = commands[command];
+  int32 num_fused = first_command.arg7 + 1;
+  KALDI_ASSERT(command + num_fused <= static_cast<int32>(commands.size()));
+  const CuSubMatrix<BaseFloat> input(GetSubMatrix(first_command.arg3));
+  CuSubMatrix<BaseFloat> output(GetSubMatrix(first_command.arg4));
+  int32 num_rows = output.NumRows();
+
+  bool use_gpu = false;
+#if HAVE_CUDA == 1
+  use_gpu = CuDevice::Instantiate().Enabled();
+#endif
+  // Blocks of about 64KB stay in the L1 or L2 cache while all the components
+  // are applied to them.  On GPU there is nothing to be gained from splitting
+  // up the matrix.
+  int32 block_size = (use_gpu ? num_rows :
+                      std::max<int32>(1, 16384 / output.NumCols()));
+  for (int32 row_offset = 0; row_offset < num_rows; row_offset += block_size) {
+    int32 this_block_size = std::min(block_size, num_rows - row_offset);
+    CuSubMatrix<BaseFloat> output_block(output.RowRange(row_offset,
+                                                        this_block_size));
+    for (int32 i = 0; i < num_fused; i++) {
+      const NnetComputation::Command &c = commands[command + i];
+      const Component *component = nnet_.GetComponent(c.arg1);
+      void *memo;
+      if (i == 0) {
+        const CuSubMatrix<BaseFloat> input_block(
+            input.RowRange(row_offset, this_block_size));
+        memo = component->Propagate(NULL, input_block, &output_block);
+      } else {
+        memo = component->Propagate(NULL, output_block, &output_block);
+      }
+      KALDI_ASSERT(memo == NULL);
+    }
+  }
+}
+
+struct NnetComputer::ParallelState {
+  int32 begin;
+  std::mutex mutex;
+  // Notified when commands are added to 'ready', when num_remaining reaches
+  // zero, and when there is an error.
+  std::condition_variable cond;
+  // For each command from 'begin', the number of commands it is still
+  // waiting for.
+  std::vector<int32> num_waiting;
+  // Commands that are not waiting for anything and have not been started.
+  std::deque<int32> ready;
+  // The number of commands that have not finished (not counting those that
+  // are fused with earlier commands).
+  int32 num_remaining;
+  // The first exception thrown by a command, if any.
+  std::exception_ptr error;
+};
+
+void NnetComputer::ExecuteCommandsParallel(int32 begin, int32 end) {
+  ParallelState state;
+  state.begin = begin;
+  state.num_waiting.assign(schedule_->num_dependencies.begin() + begin,
+                           schedule_->num_dependencies.begin() + end);
+  state.num_remaining = 0;
+  for (int32 c = begin; c < end; c++) {
+    if (state.num_waiting[c - begin] == 0)
+      state.ready.push_back(c);
+    if (state.num_waiting[c - begin] != -1)
+      state.num_remaining++;
+  }
+  // The threads of pool_ and the calling thread make up the num_threads.
+  int32 num_workers = pool_->NumThreads();
+  std::vector<std::future<void> > workers(num_workers);
+  for (int32 i = 0; i < num_workers; i++)
+    workers[i] = pool_->Submit([this, &state]() {
+        ExecuteReadyCommands(&state);
+      });
+  ExecuteReadyCommands(&state);
+  // 'state' must outlive the workers.  The pool may be busy with the commands
+  // of another NnetComputer that uses it in another thread; Wait() runs any
+  // of our workers that have not been started in this thread, where they
+  // return at once since all the commands are finished.
+  for (int32 i = 0; i < num_workers; i++)
+    pool_->Wait(workers[i]);
+  if (state.error)
+    std::rethrow_exception(state.error);
+}
+
+void NnetComputer::ExecuteReadyCommands(ParallelState *state) {
+  const std::vector<std::vector<int32> > &dependents = schedule_->dependents;
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (true) {
+    state->cond.wait(lock, [state]() {
+        return !state->ready.empty() || state->num_remaining == 0 ||
+            state->error;
+      });
+    // After an error, we just let the commands that are running finish.
+    if (state->num_remaining == 0 || state->error)
+      return;
+    int32 command = state->ready.front();
+    state->ready.pop_front();
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      ExecuteCommand(command);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    if (error) {
+      if (!state->error)
+        state->error = error;
+      state->cond.notify_all();
+      return;
+    }
+    int32 num_new_ready = 0;
+    for (size_t i = 0; i < dependents[command].size(); i++) {
+      int32 d = dependents[command][i];
+      if (--(state->num_waiting[d - state->begin]) == 0) {
+        state->ready.push_back(d);
+        num_new_ready++;
+      }
+    }
+    if (--(state->num_remaining) == 0) {
+      state->cond.notify_all();
+    } else {
+      // This thread will take one of the new commands itself.
+      for (int32 i = 1; i < num_new_ready; i++)
+        state->cond.notify_one();
+    }
   }
 }
 
@@ -519,6 +813,10 @@ void NnetComputer::Run() {
   CommandDebugInfo info;
   Timer timer;
   double total_elapsed_previous = 0.0;
+  // These are only used if debug_ == true.
+  int32 num_allocations = 0;
+  int64 num_system_allocations =
+      (debug_ ? CpuMemoryAllocator::Instantiate().NumSystemAllocations() : 0);
 
   for (; program_counter_ < num_commands; program_counter_++) {
     if (c[program_counter_].command_type == kAcceptInput ||
@@ -527,15 +825,42 @@ void NnetComputer::Run() {
       // interaction, e.g. the end of the forward or backward phase.
       break;
     }
-    if (debug_)
+    if (schedule_ != NULL &&
+        schedule_->segment_end[program_counter_] != -1) {
+      int32 end = schedule_->segment_end[program_counter_];
+      ExecuteCommandsParallel(program_counter_, end);
+      program_counter_ = end - 1;
+      continue;
+    }
+    if (debug_) {
       DebugBeforeExecute(program_counter_, &info);
-    ExecuteCommand();
+      if (c[program_counter_].command_type == kAllocMatrix)
+        num_allocations++;
+    }
+    ExecuteCommand(program_counter_);
     if (debug_) {
       double total_elapsed_now = timer.Elapsed();
       DebugAfterExecute(program_counter_, info,
                         total_elapsed_now - total_elapsed_previous);
       total_elapsed_previous = total_elapsed_now;
     }
+    program_counter_ += NumCommandsFused(program_counter_);
+  }
+  if (debug_) {
+    std::ostringstream os;
+    os << "Allocated " << num_allocations << " matrices";
+#if HAVE_CUDA == 1
+    if (!CuDevice::Instantiate().Enabled())
+#endif
+    {
+      // Note: if other threads are allocating, this will include their
+      // allocations.
+      os << ", of which "
+         << (CpuMemoryAllocator::Instantiate().NumSystemAllocations() -
+             num_system_allocations)
+         << " could not use cached memory";
+    }
+    KALDI_LOG << os.str();
   }
 }
 
@@ -25,8 +25,10 @@
 #include "nnet3/nnet-computation.h"
 #include "nnet3/nnet-analyze.h"
 #include "nnet3/nnet-example.h"
+#include "util/kaldi-thread.h"
 
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <vector>
 #include <map>
@@ -38,11 +40,18 @@ namespace nnet3 {
 
 struct NnetComputeOptions {
   bool debug;
-  NnetComputeOptions(): debug(false) { }
+  int32 num_threads;
+  NnetComputeOptions(): debug(false), num_threads(1) { }
   void Register(OptionsItf *opts) {
     opts->Register("debug", &debug, "If true, turn on "
                    "debug for the neural net computation (very verbose!) "
                    "Will be turned on regardless if --verbose >= 5");
+    opts->Register("num-threads", &num_threads, "If >1, commands of the "
+                   "computation that do not depend on each other (e.g. in "
+                   "different branches of the network) are executed in "
+                   "parallel using this many threads.  Only applies when not "
+                   "using a GPU and not in debug mode.  You will probably want "
+                   "to use a single-threaded BLAS with this.");
   }
 
 };
@@ -124,11 +133,22 @@ class NnetComputer {
   void GetOutputDestructive(const std::string &output_name,
                             CuMatrix<BaseFloat> *output);
 
-
   ~NnetComputer();
  private:
+  // NnetMultiStreamLoopedComputer uses GetMatrix() to swap the persistent state
+  // of looped computations in and out between calls to Run().
+  friend class NnetMultiStreamLoopedComputer;
+
   void Init(); // called from constructors.
 
+  // Gives direct access to matrix 'matrix_index' of the computation (as
+  // indexed in computation.matrices); it will be empty if it is not currently
+  // allocated.
+  CuMatrix<BaseFloat> &GetMatrix(int32 matrix_index) {
+    KALDI_ASSERT(static_cast<size_t>(matrix_index) < matrices_.size());
+    return matrices_[matrix_index];
+  }
+
   const NnetComputeOptions &options_;
   const NnetComputation &computation_;
   const Nnet &nnet_;
@@ -153,7 +173,7 @@ class NnetComputer {
   std::vector<CommandAttributes> command_attributes_;
   // submatrix_strings_ is only used if debug_=true.
   std::vector<std::string> submatrix_strings_;
-  // command_strings_ is only used if debug_=true, or in case of error.
+  // command_strings_ is only used if debug_=true.
   std::vector<std::string> command_strings_;
 
   // The matrices used in the computation.
@@ -173,8 +193,61 @@ class NnetComputer {
   std::vector<CuCompressedMatrixBase*> compressed_matrices_;
 
 
-  // executes the command in computation_.commands[program_counter_].
-  void ExecuteCommand();
+  // The following are only set up, by InitParallel(), if
+  // options_.num_threads > 1 and we are not in debug mode or using a GPU.
+  //
+  // schedule_ is computation_.command_schedule (see ComputeCommandSchedule()
+  // in nnet-compute.cc).  If command c starts a sequence of commands with no
+  // I/O or control flow commands in it (i.e. none of kAcceptInput,
+  // kProvideOutput, kNoOperationMarker, kNoOperationLabel or kGotoLabel), and
+  // some of the commands in the sequence may be executed in parallel, then
+  // schedule_->segment_end[c] is the end of the sequence; otherwise it is -1.
+  // For the commands in those sequences, schedule_->num_dependencies[c] is
+  // the number of other commands in the sequence that c has to wait for (see
+  // ComputeCommandDependencies()), and schedule_->dependents[c] lists the
+  // commands that wait for it.  The commands that are fused with an earlier
+  // kPropagate command (see ExecuteFusedPropagate()) are executed with it and
+  // have num_dependencies[c] == -1.
+  std::shared_ptr<const NnetComputation::CommandSchedule> schedule_;
+  // The threads that execute commands, with the thread that calls Run(); it
+  // has options_.num_threads - 1 threads.  It is shared by all the
+  // NnetComputer objects that are created in the same thread (and their
+  // copies), so that e.g. a decodable object that creates one NnetComputer
+  // per chunk doesn't start new threads each time; see GetThreadPool() in
+  // nnet-compute.cc.
+  std::shared_ptr<ThreadPool> pool_;
+
+  // This is called from Init() if we will be executing commands in parallel.
+  void InitParallel();
+
+  // The state of a call to ExecuteCommandsParallel(), which is shared by the
+  // threads executing the commands.
+  struct ParallelState;
+
+  // Executes the commands from 'begin' to end-1 (where end ==
+  // schedule_->segment_end[begin]) in parallel, as far as their dependencies
+  // allow.
+  void ExecuteCommandsParallel(int32 begin, int32 end);
+
+  // This is run by the calling thread and the threads of pool_ during
+  // ExecuteCommandsParallel(): it executes commands whose dependencies are
+  // finished, until all the commands are finished or one of them fails.
+  void ExecuteReadyCommands(ParallelState *state);
+
+  // Executes the command computation_.commands[command].  The only command that
+  // changes program_counter_ is kGotoLabel.  Note: if the command is a
+  // kPropagate that is fused with later commands, they are executed too (see
+  // NumCommandsFused()).
+  void ExecuteCommand(int32 command);
+
+  // Returns the number of commands after command 'command' that are executed
+  // by ExecuteCommand(command) because they are fused with it.
+  int32 NumCommandsFused(int32 command) const;
+
+  // Called from ExecuteCommand() for a kPropagate command that is fused with
+  // the arg7 commands after it (see FusePropagateCommands()).  It executes all
+  // of them, one block of rows at a time.
+  void ExecuteFusedPropagate(int32 command);
 
   // Returns the matrix index where the input (if is_output==false) or output
   // matrix index for "node_name" is stored.  This looks at the next command (at
@@ -644,6 +644,98 @@ void TimeHeightConvolutionComponent::FreezeNaturalGradient(bool freeze) {
   preconditioner_out_.Freeze(freeze);
 }
 
+QuantizedTimeHeightConvolutionComponent::
+QuantizedTimeHeightConvolutionComponent(
+    const TimeHeightConvolutionComponent &c):
+    TimeHeightConvolutionComponent(c) {
+  quantized_params_.Init(Matrix<BaseFloat>(linear_params_));
+  Dequantize();
+}
+
+void QuantizedTimeHeightConvolutionComponent::Dequantize() {
+  Matrix<BaseFloat> params(quantized_params_.NumRows(),
+                           quantized_params_.NumCols(), kUndefined);
+  quantized_params_.CopyToMat(&params);
+  linear_params_.Swap(&params);
+}
+
+void QuantizedTimeHeightConvolutionComponent::InitFromConfig(ConfigLine *cfl) {
+  KALDI_ERR << "QuantizedTimeHeightConvolutionComponent cannot be "
+            << "initialized from a config line; use nnet3-am-quantize.";
+}
+
+std::string QuantizedTimeHeightConvolutionComponent::Info() const {
+  std::ostringstream stream;
+  stream << Type() << ", " << model_.Info();
+  PrintParameterStats(stream, "filter-params", linear_params_);
+  PrintParameterStats(stream, "bias-params", bias_params_, true);
+  stream << ", max-memory-mb=" << max_memory_mb_;
+  return stream.str();
+}
+
+void* QuantizedTimeHeightConvolutionComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes_in,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  if (!quantization::QuantizedKernelsAvailable())
+    return TimeHeightConvolutionComponent::Propagate(indexes_in, in, out);
+  const PrecomputedIndexes *indexes =
+      dynamic_cast<const PrecomputedIndexes*>(indexes_in);
+  KALDI_ASSERT(indexes != NULL);
+  { // this block handles the bias term.
+    KALDI_ASSERT(out->Stride() == out->NumCols() &&
+                 out->NumCols() == model_.height_out * model_.num_filters_out);
+    CuSubMatrix<BaseFloat> out_reshaped(
+        out->Data(), out->NumRows() * model_.height_out,
+        model_.num_filters_out, model_.num_filters_out);
+    out_reshaped.CopyRowsFromVec(bias_params_);
+  }
+  ConvolveForward(indexes->computation, in, quantized_params_, out);
+  return NULL;
+}
+
+void QuantizedTimeHeightConvolutionComponent::Write(std::ostream &os,
+                                                    bool binary) const {
+  WriteToken(os, binary, "<QuantizedTimeHeightConvolutionComponent>");
+  WriteToken(os, binary, "<Model>");
+  model_.Write(os, binary);
+  WriteToken(os, binary, "<LinearParams>");
+  WriteIntegerVector(os, binary, quantized_params_.Data());
+  WriteToken(os, binary, "<RowScales>");
+  quantized_params_.RowScales().Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "<MaxMemoryMb>");
+  WriteBasicType(os, binary, max_memory_mb_);
+  WriteToken(os, binary, "</QuantizedTimeHeightConvolutionComponent>");
+}
+
+void QuantizedTimeHeightConvolutionComponent::Read(std::istream &is,
+                                                   bool binary) {
+  std::vector<int8> quantized;
+  Vector<BaseFloat> row_scales;
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedTimeHeightConvolutionComponent>",
+                       "<Model>");
+  model_.Read(is, binary);
+  ExpectToken(is, binary, "<LinearParams>");
+  ReadIntegerVector(is, binary, &quantized);
+  ExpectToken(is, binary, "<RowScales>");
+  row_scales.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "<MaxMemoryMb>");
+  ReadBasicType(is, binary, &max_memory_mb_);
+  ExpectToken(is, binary, "</QuantizedTimeHeightConvolutionComponent>");
+  if (row_scales.Dim() != model_.ParamRows() ||
+      quantized.size() != static_cast<size_t>(model_.ParamRows()) *
+      model_.ParamCols())
+    KALDI_ERR << "Invalid QuantizedTimeHeightConvolutionComponent.";
+  quantized_params_.Init(model_.ParamCols(), row_scales, &quantized);
+  Dequantize();
+  ComputeDerived();
+  Check();
+}
+
 TimeHeightConvolutionComponent::PrecomputedIndexes*
 TimeHeightConvolutionComponent::PrecomputedIndexes::Copy() const {
   return new PrecomputedIndexes(*this);
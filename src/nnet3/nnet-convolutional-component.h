@@ -300,7 +300,7 @@ class TimeHeightConvolutionComponent: public UpdatableComponent {
   };
 
   void ScaleLinearParams(BaseFloat alpha) { linear_params_.Scale(alpha); }
- private:
+ protected:
 
   void Check() const;
 
@@ -371,6 +371,50 @@ class TimeHeightConvolutionComponent: public UpdatableComponent {
 };
 
 
+/**
+   QuantizedTimeHeightConvolutionComponent is a TimeHeightConvolutionComponent
+   whose linear parameters are stored as 8-bit integers with a floating-point
+   scale for each filter, like QuantizedAffineComponent (see its comment in
+   nnet-simple-component.h).  It is intended for inference, and is not
+   trainable; you get it by converting a TimeHeightConvolutionComponent in a
+   trained model, see QuantizeNnet() in nnet-utils.h.
+
+   If quantization::QuantizedKernelsAvailable(), Propagate() does the
+   convolution in integer arithmetic; otherwise, and in Backprop(), it uses the
+   dequantized parameters in linear_params_.
+*/
+class QuantizedTimeHeightConvolutionComponent:
+      public TimeHeightConvolutionComponent {
+ public:
+  QuantizedTimeHeightConvolutionComponent() { }
+  explicit QuantizedTimeHeightConvolutionComponent(
+      const TimeHeightConvolutionComponent &c);
+
+  virtual std::string Info() const;
+  // This component cannot be initialized from a config line.
+  virtual void InitFromConfig(ConfigLine *cfl);
+  virtual std::string Type() const {
+    return "QuantizedTimeHeightConvolutionComponent";
+  }
+  virtual int32 Properties() const {
+    return TimeHeightConvolutionComponent::Properties() & ~kUpdatableComponent;
+  }
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+  virtual Component* Copy() const {
+    return new QuantizedTimeHeightConvolutionComponent(*this);
+  }
+ private:
+  // Sets linear_params_ from quantized_params_.
+  void Dequantize();
+
+  quantization::QuantizedMatrix quantized_params_;
+};
+
+
 
 
 } // namespace nnet3
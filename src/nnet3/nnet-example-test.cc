@@ -95,6 +95,35 @@ void UnitTestNnetMergeExamples() {
   }
 }
 
+// Checks that merging into a buffer from MergedExamplePool, which reuses the
+// memory of the previous merged example, gives the same result as merging
+// into a new example, even if the shapes change between calls.
+void UnitTestNnetMergeExamplesPooled() {
+  MergedExamplePool<NnetExample> pool;
+  MergedExamplePool<NnetExample>::Buffer *buffer = pool.GetBuffer(0, 1);
+  KALDI_ASSERT(pool.GetBuffer(0, 1) == buffer &&
+               pool.GetBuffer(0, 2) != buffer);
+  for (int32 n = 0; n < 20; n++) {
+    int32 num_supervised_frames = RandInt(1, 10),
+                   left_context = RandInt(0, 5),
+                  right_context = RandInt(0, 5),
+                      input_dim = RandInt(1, 10),
+                     output_dim = RandInt(5, 10),
+                    ivector_dim = RandInt(-1, 2);
+    int32 num_egs = RandInt(1, 4);
+    std::vector<NnetExample> egs_to_be_merged(num_egs);
+    for (int32 i = 0; i < num_egs; i++)
+      GenerateSimpleNnetTrainingExample(num_supervised_frames, left_context,
+                                        right_context, input_dim, output_dim,
+                                        ivector_dim, &(egs_to_be_merged[i]));
+    bool compress = (RandInt(0, 1) == 0);
+    MergeExamples(egs_to_be_merged, compress, &(buffer->eg), &(buffer->temp));
+    NnetExample eg_merged;
+    MergeExamples(egs_to_be_merged, compress, &eg_merged);
+    KALDI_ASSERT(buffer->eg == eg_merged);
+  }
+}
+
 
 
 } // namespace nnet3
@@ -106,6 +135,7 @@ int main() {
 
   UnitTestNnetExample();
   UnitTestNnetMergeExamples();
+  UnitTestNnetMergeExamplesPooled();
 
   KALDI_LOG << "Nnet-example tests succeeded.";
 
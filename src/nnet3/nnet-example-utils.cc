@@ -83,13 +83,57 @@ static void GetIoSizes(const std::vector<NnetExample> &src,
 
 
 
+// Appends the rows of the features in 'src' and writes them to 'dest',
+// compressing if 'compress' is true.  The memory already held in 'dest' and
+// 'temp' is reused where possible.
+static void MergeFeatures(const std::vector<const GeneralMatrix*> &src,
+                          bool compress,
+                          GeneralMatrix *dest,
+                          GeneralMatrix *temp) {
+  if (compress) {
+    bool all_compressed = true;
+    for (size_t i = 0; i < src.size(); i++)
+      if (src[i]->Type() != kCompressedMatrix)
+        all_compressed = false;
+    // Take the compressed matrix out of 'dest' so we can reuse its memory.
+    CompressedMatrix cmat;
+    if (dest->Type() == kCompressedMatrix)
+      dest->SwapCompressedMatrix(&cmat);
+    if (all_compressed) {
+      // If the rows of the inputs can be appended without decompressing them,
+      // do that.
+      std::vector<const CompressedMatrix*> src_cmats(src.size());
+      for (size_t i = 0; i < src.size(); i++)
+        src_cmats[i] = &(src[i]->GetCompressedMatrix());
+      if (cmat.AppendCompressedMatrixRows(src_cmats)) {
+        dest->Clear();
+        dest->SwapCompressedMatrix(&cmat);
+        return;
+      }
+    }
+    AppendGeneralMatrixRows(src, temp);
+    if (temp->Type() == kFullMatrix) {
+      cmat.CopyFromMat(temp->GetFullMatrix());
+      dest->Clear();
+      dest->SwapCompressedMatrix(&cmat);
+      return;
+    }
+    // the features were sparse, so we won't compress them.
+    dest->Swap(temp);
+  } else {
+    AppendGeneralMatrixRows(src, dest);
+  }
+}
+
+
 // Do the final merging of NnetIo, once we have obtained the names, dims and
 // sizes for each feature/supervision type.
 static void MergeIo(const std::vector<NnetExample> &src,
                     const std::vector<std::string> &names,
                     const std::vector<int32> &sizes,
                     bool compress,
-                    NnetExample *merged_eg) {
+                    NnetExample *merged_eg,
+                    GeneralMatrix *temp) {
   // The total number of Indexes we have across all examples.
   int32 num_feats = names.size();
 
@@ -98,8 +142,8 @@ static void MergeIo(const std::vector<NnetExample> &src,
   // The features in the different NnetIo in the Indexes across all examples
   std::vector<std::vector<GeneralMatrix const*> > output_lists(num_feats);
 
-  // Initialize the merged_eg
-  merged_eg->io.clear();
+  // Initialize the merged_eg.  We don't clear it first, so that the memory
+  // it holds can be reused.
   merged_eg->io.resize(num_feats);
   for (int32 f = 0; f < num_feats; f++) {
     NnetIo &io = merged_eg->io[f];
@@ -147,14 +191,9 @@ static void MergeIo(const std::vector<NnetExample> &src,
     }
   }
   KALDI_ASSERT(cur_size == sizes);
-  for (int32 f = 0; f < num_feats; f++) {
-    AppendGeneralMatrixRows(output_lists[f],
-                            &(merged_eg->io[f].features));
-    if (compress) {
-      // the following won't do anything if the features were sparse.
-      merged_eg->io[f].features.Compress();
-    }
-  }
+  for (int32 f = 0; f < num_feats; f++)
+    MergeFeatures(output_lists[f], compress, &(merged_eg->io[f].features),
+                  temp);
 }
 
 
@@ -162,13 +201,21 @@ static void MergeIo(const std::vector<NnetExample> &src,
 void MergeExamples(const std::vector<NnetExample> &src,
                    bool compress,
                    NnetExample *merged_eg) {
+  GeneralMatrix temp;
+  MergeExamples(src, compress, merged_eg, &temp);
+}
+
+void MergeExamples(const std::vector<NnetExample> &src,
+                   bool compress,
+                   NnetExample *merged_eg,
+                   GeneralMatrix *temp) {
   KALDI_ASSERT(!src.empty());
   std::vector<std::string> io_names;
   GetIoNames(src, &io_names);
   // the sizes are the total number of Indexes we have across all examples.
   std::vector<int32> io_sizes;
   GetIoSizes(src, io_names, &io_sizes);
-  MergeIo(src, io_names, io_sizes, compress, merged_eg);
+  MergeIo(src, io_names, io_sizes, compress, merged_eg, temp);
 }
 
 void ShiftExampleTimes(int32 t_offset,
@@ -1229,11 +1276,12 @@ void ExampleMerger::WriteMinibatch(const std::vector<NnetExample> &egs) {
   size_t structure_hash = eg_hasher(egs[0]);
   int32 minibatch_size = egs.size();
   stats_.WroteExample(eg_size, structure_hash, minibatch_size);
-  NnetExample merged_eg;
-  MergeExamples(egs, config_.compress, &merged_eg);
+  MergedExamplePool<NnetExample>::Buffer *buffer =
+      pool_.GetBuffer(structure_hash, minibatch_size);
+  MergeExamples(egs, config_.compress, &(buffer->eg), &(buffer->temp));
   std::ostringstream key;
   key << "merged-" << (num_egs_written_++) << "-" << minibatch_size;
-  writer_->Write(key.str(), merged_eg);
+  writer_->Write(key.str(), buffer->eg);
 }
 
 void ExampleMerger::Finish() {
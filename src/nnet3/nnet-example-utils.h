@@ -38,6 +38,19 @@ void MergeExamples(const std::vector<NnetExample> &src,
                    bool compress,
                    NnetExample *dest);
 
+/** This version of MergeExamples() reuses the memory already held in "dest"
+    (e.g. from merging an earlier minibatch with the same structure) and in
+    "temp", which is used as a temporary when compressing.  See also class
+    MergedExamplePool.  If "compress" is true and the input features were
+    compressed in a format whose rows can be appended directly (see
+    CompressedMatrix::AppendCompressedMatrixRows()), they are appended without
+    being decompressed, and keep their format.
+ */
+void MergeExamples(const std::vector<NnetExample> &src,
+                   bool compress,
+                   NnetExample *dest,
+                   GeneralMatrix *temp);
+
 
 /** Shifts the time-index t of everything in the "eg" by adding "t_offset" to
     all "t" values.  This might be useful in things like clockwork RNNs that are
@@ -474,6 +487,44 @@ class ExampleMergingStats {
 };
 
 
+/// This class is used by ExampleMerger and ChainExampleMerger to keep the
+/// merged examples from one minibatch to the next so that their memory can be
+/// reused.  There is one buffer for each combination of example structure (as
+/// given by the structure hash) and minibatch size, so once all of them have
+/// been seen, merging examples does not allocate memory for the features.
+template<class Example> class MergedExamplePool {
+ public:
+  struct Buffer {
+    Example eg;  // The merged example.
+    GeneralMatrix temp;  // A temporary used when compressing.
+  };
+
+  MergedExamplePool() { }
+
+  /// Returns the buffer for this structure hash and minibatch size, creating
+  /// it if needed.  It remains owned by this class.
+  Buffer *GetBuffer(size_t structure_hash, int32 minibatch_size) {
+    Buffer *&buffer = buffers_[std::pair<size_t, int32>(structure_hash,
+                                                        minibatch_size)];
+    if (buffer == NULL)
+      buffer = new Buffer();
+    return buffer;
+  }
+
+  ~MergedExamplePool() {
+    typename MapType::iterator iter = buffers_.begin(), end = buffers_.end();
+    for (; iter != end; ++iter)
+      delete iter->second;
+  }
+ private:
+  typedef unordered_map<std::pair<size_t, int32>, Buffer*,
+                        PairHasher<size_t, int32> > MapType;
+  MapType buffers_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MergedExamplePool);
+};
+
+
 /// This class is responsible for arranging examples in groups
 /// that have the same strucure (i.e. the same input and output
 /// indexes), and outputting them in suitable minibatches
@@ -509,6 +560,7 @@ class ExampleMerger {
   const ExampleMergingConfig &config_;
   NnetExampleWriter *writer_;
   ExampleMergingStats stats_;
+  MergedExamplePool<NnetExample> pool_;
 
   // Note: the "key" into the egs is the first element of the vector.
   typedef unordered_map<NnetExample*, std::vector<NnetExample*>,
@@ -0,0 +1,489 @@
+// nnet3/nnet-multi-stream-looped.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include "nnet3/nnet-multi-stream-looped.h"
+#include "nnet3/nnet-compile-looped.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+// Sets 'rows' to the (n, t - first_t) pairs for the indexes of 'io', where
+// first_t is the smallest 't' value; if 't_divisor' > 1 the time offset is
+// divided by it.
+static void GetIoRowInfo(const IoSpecification &io,
+                         int32 t_divisor,
+                         std::vector<std::pair<int32, int32> > *rows) {
+  KALDI_ASSERT(!io.indexes.empty());
+  int32 first_t = io.indexes[0].t;
+  for (size_t i = 1; i < io.indexes.size(); i++)
+    first_t = std::min(first_t, io.indexes[i].t);
+  rows->resize(io.indexes.size());
+  for (size_t i = 0; i < io.indexes.size(); i++)
+    (*rows)[i] = std::pair<int32, int32>(
+        io.indexes[i].n, (io.indexes[i].t - first_t) / t_divisor);
+}
+
+
+NnetMultiStreamLoopedComputer::NnetMultiStreamLoopedComputer(
+    const DecodableNnetSimpleLoopedInfo &info,
+    int32 max_streams):
+    info_(info),
+    max_streams_(max_streams),
+    num_active_streams_(0),
+    computer_(NULL),
+    streams_(max_streams),
+    num_steps_(0),
+    num_stream_chunks_(0) {
+  KALDI_ASSERT(max_streams > 0);
+  int32 chunk_size = info_.frames_per_chunk;
+  num_warmup_chunks_ = (info_.frames_left_context +
+                        info_.frames_right_context + chunk_size - 1) /
+                       chunk_size;
+
+  // The nnet in 'info' has already been modified to take iVectors with a
+  // period equal to the chunk size; see DecodableNnetSimpleLoopedInfo::Init().
+  int32 ivector_period = chunk_size;
+  CreateLoopedComputationRequest(info_.nnet, chunk_size,
+                                 info_.opts.frame_subsampling_factor,
+                                 ivector_period,
+                                 info_.frames_left_context,
+                                 info_.frames_right_context,
+                                 max_streams,
+                                 &request1_, &request2_, &request3_);
+  CompileLooped(info_.nnet, info_.opts.optimize_config,
+                request1_, request2_, request3_, &computation_);
+  computation_.ComputeCudaIndexes();
+  if (GetVerboseLevel() >= 3) {
+    KALDI_VLOG(3) << "Computation is:";
+    computation_.Print(std::cerr, info_.nnet);
+  }
+
+  GetIoRowInfo(request2_.inputs[request2_.IndexForInput("input")], 1,
+               &input_rows_);
+  if (info_.has_ivectors)
+    GetIoRowInfo(request2_.inputs[request2_.IndexForInput("ivector")], 1,
+                 &ivector_rows_);
+  GetIoRowInfo(request2_.outputs[request2_.IndexForOutput("output")],
+               info_.opts.frame_subsampling_factor, &output_rows_);
+
+  int32 num_matrices = computation_.matrices.size();
+  if (static_cast<int32>(computation_.matrix_debug_info.size()) !=
+      num_matrices)
+    KALDI_ERR << "Multi-stream looped computation requires debug info.";
+  stream_rows_.resize(num_matrices);
+  for (int32 m = 1; m < num_matrices; m++) {
+    const std::vector<Cindex> &cindexes =
+        computation_.matrix_debug_info[m].cindexes;
+    KALDI_ASSERT(static_cast<int32>(cindexes.size()) ==
+                 computation_.matrices[m].num_rows);
+    stream_rows_[m].resize(max_streams);
+    for (size_t r = 0; r < cindexes.size(); r++) {
+      int32 n = cindexes[r].second.n;
+      KALDI_ASSERT(n >= 0 && n < max_streams);
+      stream_rows_[m][n].push_back(r);
+    }
+  }
+
+  computer_ = new NnetComputer(info_.opts.compute_config, computation_,
+                               info_.nnet, NULL);  // NULL is 'nnet_to_update'
+  // The first two chunks have a different structure from the rest (the first
+  // chunk has extra left context, and the live matrices after it may differ),
+  // so we get them out of the way before any stream joins.
+  RunInitialStep(request1_);
+  RunInitialStep(request2_);
+}
+
+NnetMultiStreamLoopedComputer::~NnetMultiStreamLoopedComputer() {
+  for (size_t s = 0; s < streams_.size(); s++)
+    for (size_t i = 0; i < streams_[s].output.size(); i++)
+      delete streams_[s].output[i];
+  delete computer_;
+  if (num_steps_ != 0)
+    KALDI_VLOG(1) << "Did " << num_steps_ << " multi-stream looped "
+                  << "computations for " << num_stream_chunks_
+                  << " stream-chunks, average streams per computation was "
+                  << (num_stream_chunks_ * 1.0 / num_steps_)
+                  << " (max-streams=" << max_streams_ << ")";
+}
+
+void NnetMultiStreamLoopedComputer::RunInitialStep(
+    const ComputationRequest &request) {
+  CuMatrix<BaseFloat> input(
+      request.inputs[request.IndexForInput("input")].indexes.size(),
+      info_.nnet.InputDim("input"));
+  computer_->AcceptInput("input", &input);
+  if (info_.has_ivectors) {
+    CuMatrix<BaseFloat> ivectors(
+        request.inputs[request.IndexForInput("ivector")].indexes.size(),
+        info_.nnet.InputDim("ivector"));
+    computer_->AcceptInput("ivector", &ivectors);
+  }
+  computer_->Run();
+  CuMatrix<BaseFloat> output;
+  computer_->GetOutputDestructive("output", &output);
+}
+
+int32 NnetMultiStreamLoopedComputer::AddStream(
+    OnlineFeatureInterface *input_features,
+    OnlineFeatureInterface *ivector_features) {
+  KALDI_ASSERT(input_features != NULL);
+  int32 nnet_input_dim = info_.nnet.InputDim("input"),
+      nnet_ivector_dim = info_.nnet.InputDim("ivector"),
+      feat_input_dim = input_features->Dim(),
+      feat_ivector_dim = (ivector_features != NULL ?
+                          ivector_features->Dim() : -1);
+  if (nnet_input_dim != feat_input_dim)
+    KALDI_ERR << "Input feature dimension mismatch: got " << feat_input_dim
+              << " but network expects " << nnet_input_dim;
+  if (nnet_ivector_dim != feat_ivector_dim)
+    KALDI_ERR << "Ivector feature dimension mismatch: got " << feat_ivector_dim
+              << " but network expects " << nnet_ivector_dim;
+
+  int32 s = 0;
+  while (s < max_streams_ && streams_[s].active)
+    s++;
+  if (s == max_streams_)
+    KALDI_ERR << "Cannot add stream: all " << max_streams_
+              << " streams are in use.";
+  // Whatever the previous occupant of this stream-id left in the persistent
+  // activations is cleared; zero is what the computation would see before
+  // the start of an utterance.
+  ZeroStreamState(s);
+  StreamInfo &stream = streams_[s];
+  stream.active = true;
+  stream.input_features = input_features;
+  stream.ivector_features = ivector_features;
+  stream.next_chunk = -num_warmup_chunks_;
+  KALDI_ASSERT(stream.output.empty());
+  num_active_streams_++;
+  return s;
+}
+
+void NnetMultiStreamLoopedComputer::RemoveStream(int32 stream_id) {
+  KALDI_ASSERT(stream_id >= 0 && stream_id < max_streams_ &&
+               streams_[stream_id].active);
+  StreamInfo &stream = streams_[stream_id];
+  for (size_t i = 0; i < stream.output.size(); i++)
+    delete stream.output[i];
+  stream.output.clear();
+  stream.active = false;
+  stream.input_features = NULL;
+  stream.ivector_features = NULL;
+  num_active_streams_--;
+}
+
+bool NnetMultiStreamLoopedComputer::GetNextChunk(int32 stream_id,
+                                                 Matrix<BaseFloat> *output) {
+  KALDI_ASSERT(stream_id >= 0 && stream_id < max_streams_ &&
+               streams_[stream_id].active);
+  std::deque<Matrix<BaseFloat>*> &queue = streams_[stream_id].output;
+  if (queue.empty())
+    return false;
+  output->Swap(queue.front());
+  delete queue.front();
+  queue.pop_front();
+  return true;
+}
+
+bool NnetMultiStreamLoopedComputer::StreamIsReady(
+    const StreamInfo &stream) const {
+  int32 num_frames_ready = stream.input_features->NumFramesReady();
+  if (num_frames_ready == 0)
+    return false;
+  int32 chunk_size = info_.frames_per_chunk;
+  if (stream.input_features->IsLastFrame(num_frames_ready - 1)) {
+    // the input has finished; we'll pad with its last frame, so we can
+    // compute everything up to the end of the input.
+    return stream.next_chunk * chunk_size < num_frames_ready;
+  } else {
+    return (stream.next_chunk + 1) * chunk_size +
+        info_.frames_right_context <= num_frames_ready;
+  }
+}
+
+int32 NnetMultiStreamLoopedComputer::Compute() {
+  std::vector<bool> ready(max_streams_, false);
+  int32 num_ready = 0;
+  for (int32 s = 0; s < max_streams_; s++) {
+    if (streams_[s].active && StreamIsReady(streams_[s])) {
+      ready[s] = true;
+      num_ready++;
+    }
+  }
+  if (num_ready == 0)
+    return 0;
+  RunStep(ready);
+  num_steps_++;
+  num_stream_chunks_ += num_ready;
+  return num_ready;
+}
+
+void NnetMultiStreamLoopedComputer::GetLiveMatrices(
+    std::vector<int32> *matrices) {
+  matrices->clear();
+  int32 num_matrices = computation_.matrices.size();
+  for (int32 m = 1; m < num_matrices; m++)
+    if (computer_->GetMatrix(m).NumRows() != 0)
+      matrices->push_back(m);
+}
+
+void NnetMultiStreamLoopedComputer::ZeroStreamState(int32 s) {
+  std::vector<int32> live_matrices;
+  GetLiveMatrices(&live_matrices);
+  for (size_t i = 0; i < live_matrices.size(); i++) {
+    int32 m = live_matrices[i];
+    CuMatrix<BaseFloat> &mat = computer_->GetMatrix(m);
+    const std::vector<int32> &rows = stream_rows_[m][s];
+    for (size_t j = 0; j < rows.size(); j++)
+      mat.Row(rows[j]).SetZero();
+  }
+}
+
+bool NnetMultiStreamLoopedComputer::MatricesMatch(int32 m1, int32 m2,
+                                                  int32 shift) const {
+  if (computation_.matrices[m1].num_rows != computation_.matrices[m2].num_rows ||
+      computation_.matrices[m1].num_cols != computation_.matrices[m2].num_cols)
+    return false;
+  const std::vector<Cindex>
+      &cindexes1 = computation_.matrix_debug_info[m1].cindexes,
+      &cindexes2 = computation_.matrix_debug_info[m2].cindexes;
+  for (size_t r = 0; r < cindexes1.size(); r++) {
+    const Index &index1 = cindexes1[r].second, &index2 = cindexes2[r].second;
+    if (cindexes1[r].first != cindexes2[r].first ||
+        index1.n != index2.n || index1.x != index2.x)
+      return false;
+    if (index1.t == kNoTime ? index2.t != kNoTime :
+        index2.t != index1.t + shift)
+      return false;
+  }
+  return true;
+}
+
+const std::vector<std::pair<int32, int32> >&
+NnetMultiStreamLoopedComputer::GetStateMapping(
+    const std::vector<int32> &matrices1,
+    const std::vector<int32> &matrices2) {
+  std::map<std::vector<int32>,
+           std::vector<std::pair<int32, int32> > >::iterator iter =
+      state_mapping_cache_.find(matrices1);
+  if (iter != state_mapping_cache_.end())
+    return iter->second;
+
+  // All the persistent activations are shifted in time by the same amount
+  // (normally the chunk size, but a different multiple of it when the
+  // computation goes round its loop).  The candidates for this shift are the
+  // time differences between the first rows of matrices for the same node.
+  std::vector<int32> shifts;
+  for (size_t i = 0; i < matrices1.size(); i++) {
+    const Cindex &c1 = computation_.matrix_debug_info[matrices1[i]].cindexes[0];
+    for (size_t j = 0; j < matrices2.size(); j++) {
+      const Cindex &c2 =
+          computation_.matrix_debug_info[matrices2[j]].cindexes[0];
+      if (c1.first == c2.first && c1.second.t != kNoTime &&
+          c2.second.t != kNoTime)
+        shifts.push_back(c2.second.t - c1.second.t);
+    }
+  }
+  SortAndUniq(&shifts);
+
+  std::vector<std::pair<int32, int32> > best_mapping;
+  for (size_t k = 0; k < shifts.size(); k++) {
+    std::vector<std::pair<int32, int32> > mapping;
+    std::vector<bool> used(matrices1.size(), false);
+    for (size_t j = 0; j < matrices2.size(); j++) {
+      for (size_t i = 0; i < matrices1.size(); i++) {
+        if (!used[i] && MatricesMatch(matrices1[i], matrices2[j], shifts[k])) {
+          used[i] = true;
+          mapping.push_back(std::pair<int32, int32>(i, matrices2[j]));
+          break;
+        }
+      }
+    }
+    if (mapping.size() > best_mapping.size())
+      best_mapping.swap(mapping);
+  }
+  if (best_mapping.size() != matrices2.size())
+    KALDI_ERR << "Could not match the persistent activations of the looped "
+              << "computation from one chunk to the next ("
+              << best_mapping.size() << " of " << matrices2.size()
+              << " matrices matched); this type of model may not be "
+              << "supported by NnetMultiStreamLoopedComputer.";
+  std::vector<std::pair<int32, int32> > &ans =
+      state_mapping_cache_[matrices1];
+  ans.swap(best_mapping);
+  return ans;
+}
+
+void NnetMultiStreamLoopedComputer::RunStep(const std::vector<bool> &ready) {
+  // Save the rows of the persistent activations that belong to active
+  // streams that are not being advanced.
+  std::vector<int32> idle_streams;
+  for (int32 s = 0; s < max_streams_; s++)
+    if (streams_[s].active && !ready[s])
+      idle_streams.push_back(s);
+  std::vector<int32> live_matrices1;
+  // saved_state[i][j] is the state of idle_streams[i] in live_matrices1[j].
+  std::vector<std::vector<CuMatrix<BaseFloat> > > saved_state(
+      idle_streams.size());
+  if (!idle_streams.empty()) {
+    GetLiveMatrices(&live_matrices1);
+    for (size_t i = 0; i < idle_streams.size(); i++) {
+      saved_state[i].resize(live_matrices1.size());
+      for (size_t j = 0; j < live_matrices1.size(); j++) {
+        int32 m = live_matrices1[j];
+        const CuMatrix<BaseFloat> &mat = computer_->GetMatrix(m);
+        CuArray<MatrixIndexT> rows(stream_rows_[m][idle_streams[i]]);
+        saved_state[i][j].Resize(rows.Dim(), mat.NumCols(), kUndefined);
+        saved_state[i][j].CopyRows(mat, rows);
+      }
+    }
+  }
+
+  int32 chunk_size = info_.frames_per_chunk,
+      right_context = info_.frames_right_context,
+      subsampling_factor = info_.opts.frame_subsampling_factor;
+  std::vector<int32> num_frames_ready(max_streams_, 0);
+  for (int32 s = 0; s < max_streams_; s++)
+    if (ready[s])
+      num_frames_ready[s] = streams_[s].input_features->NumFramesReady();
+
+  { // Set up the input features; rows for streams that are not being
+    // advanced are left as zero.
+    Matrix<BaseFloat> input(input_rows_.size(),
+                            info_.nnet.InputDim("input"));
+    // For each stream, the frames it needs and the rows they go to; the
+    // frames are obtained with a single call to GetFrames().
+    std::vector<std::vector<int32> > frames(max_streams_),
+        rows(max_streams_);
+    for (size_t r = 0; r < input_rows_.size(); r++) {
+      int32 s = input_rows_[r].first;
+      if (!ready[s])
+        continue;
+      // while the stream is being warmed up, 't' will be negative and we use
+      // its first frame.
+      int32 t = streams_[s].next_chunk * chunk_size + right_context +
+          input_rows_[r].second;
+      if (t < 0) t = 0;
+      if (t >= num_frames_ready[s]) t = num_frames_ready[s] - 1;
+      frames[s].push_back(t);
+      rows[s].push_back(r);
+    }
+    for (int32 s = 0; s < max_streams_; s++) {
+      if (frames[s].empty())
+        continue;
+      Matrix<BaseFloat> feats(frames[s].size(), input.NumCols(), kUndefined);
+      streams_[s].input_features->GetFrames(frames[s], &feats);
+      for (size_t i = 0; i < rows[s].size(); i++)
+        input.Row(rows[s][i]).CopyFromVec(feats.Row(i));
+    }
+    CuMatrix<BaseFloat> cu_input;
+    cu_input.Swap(&input);
+    computer_->AcceptInput("input", &cu_input);
+  }
+
+  if (info_.has_ivectors) {
+    // As in DecodableNnetLoopedOnlineBase, we use the most recent iVector
+    // available for each stream.
+    Matrix<BaseFloat> ivectors(ivector_rows_.size(),
+                               info_.nnet.InputDim("ivector"));
+    std::vector<Vector<BaseFloat> > stream_ivectors(max_streams_);
+    for (int32 s = 0; s < max_streams_; s++) {
+      if (!ready[s])
+        continue;
+      OnlineFeatureInterface *ivector_features = streams_[s].ivector_features;
+      KALDI_ASSERT(ivector_features != NULL);
+      stream_ivectors[s].Resize(ivector_features->Dim());
+      int32 num_ivector_frames_ready = ivector_features->NumFramesReady();
+      if (num_ivector_frames_ready > 0)
+        ivector_features->GetFrame(
+            std::min<int32>(num_frames_ready[s] - 1,
+                            num_ivector_frames_ready - 1),
+            &(stream_ivectors[s]));
+    }
+    for (size_t r = 0; r < ivector_rows_.size(); r++) {
+      int32 s = ivector_rows_[r].first;
+      if (ready[s])
+        ivectors.Row(r).CopyFromVec(stream_ivectors[s]);
+    }
+    CuMatrix<BaseFloat> cu_ivectors;
+    cu_ivectors.Swap(&ivectors);
+    computer_->AcceptInput("ivector", &cu_ivectors);
+  }
+
+  computer_->Run();
+
+  {
+    CuMatrix<BaseFloat> cu_output;
+    computer_->GetOutputDestructive("output", &cu_output);
+    if (info_.log_priors.Dim() != 0) {
+      // subtract log-prior (divide by prior)
+      cu_output.AddVecToRows(-1.0, info_.log_priors);
+    }
+    // apply the acoustic scale
+    cu_output.Scale(info_.opts.acoustic_scale);
+    Matrix<BaseFloat> output;
+    output.Swap(&cu_output);
+
+    int32 rows_per_chunk = chunk_size / subsampling_factor;
+    std::vector<Matrix<BaseFloat>*> chunks(max_streams_, NULL);
+    for (int32 s = 0; s < max_streams_; s++) {
+      // the output of warm-up chunks is discarded.
+      if (ready[s] && streams_[s].next_chunk >= 0)
+        chunks[s] = new Matrix<BaseFloat>(rows_per_chunk, output.NumCols(),
+                                          kUndefined);
+    }
+    for (size_t r = 0; r < output_rows_.size(); r++) {
+      int32 s = output_rows_[r].first;
+      if (chunks[s] != NULL)
+        chunks[s]->Row(output_rows_[r].second).CopyFromVec(output.Row(r));
+    }
+    for (int32 s = 0; s < max_streams_; s++) {
+      if (ready[s]) {
+        if (chunks[s] != NULL)
+          streams_[s].output.push_back(chunks[s]);
+        streams_[s].next_chunk++;
+      }
+    }
+  }
+
+  if (!idle_streams.empty()) {
+    // Put back the saved state of the streams that were not advanced, into
+    // the matrices that now hold the persistent activations.
+    std::vector<int32> live_matrices2;
+    GetLiveMatrices(&live_matrices2);
+    const std::vector<std::pair<int32, int32> > &mapping =
+        GetStateMapping(live_matrices1, live_matrices2);
+    for (size_t k = 0; k < mapping.size(); k++) {
+      int32 j = mapping[k].first, m2 = mapping[k].second;
+      CuMatrix<BaseFloat> &mat = computer_->GetMatrix(m2);
+      for (size_t i = 0; i < idle_streams.size(); i++) {
+        const std::vector<int32> &rows = stream_rows_[m2][idle_streams[i]];
+        std::vector<BaseFloat*> row_pointers(rows.size());
+        for (size_t r = 0; r < rows.size(); r++)
+          row_pointers[r] = mat.RowData(rows[r]);
+        CuArray<BaseFloat*> cu_row_pointers(row_pointers);
+        saved_state[i][j].CopyToRows(cu_row_pointers);
+      }
+    }
+  }
+}
+
+
+}  // namespace nnet3
+}  // namespace kaldi
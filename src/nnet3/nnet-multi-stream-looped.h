@@ -0,0 +1,199 @@
+// nnet3/nnet-multi-stream-looped.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_MULTI_STREAM_LOOPED_H_
+#define KALDI_NNET3_NNET_MULTI_STREAM_LOOPED_H_
+
+#include <deque>
+#include <map>
+#include <utility>
+#include <vector>
+#include "itf/online-feature-itf.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/decodable-simple-looped.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+/**
+   NnetMultiStreamLoopedComputer does the 'looped' neural net computation (see
+   nnet-compile-looped.h) for many online streams at once, e.g. the concurrent
+   calls handled by a server.  Instead of each stream having its own
+   NnetComputer (as in DecodableNnetLoopedOnlineBase), the looped computation
+   is compiled for 'max_streams' sequences (the 'n' index), so the activations
+   that persist from chunk to chunk are stored for all streams in the same
+   stacked matrices, and each call to Compute() advances every stream that has
+   a chunk of input ready in a single computation, with matrix multiplications
+   that are 'max_streams' times larger.
+
+   Streams may join (AddStream()) and leave (RemoveStream()) at any time.
+   Streams that are not ready when Compute() is called still occupy their rows
+   of the computation, but the parts of the persistent activations that belong
+   to them are saved before the computation and restored afterwards, so they
+   are unaffected.  A stream that joins has its persistent activations zeroed
+   and is then 'warmed up' with enough chunks of its first frame, duplicated,
+   to cover the model's left and right context.  For non-recurrent models the
+   output is identical to that of the single-stream looped computation; for
+   recurrent models it differs only in that the recurrence sees a few more
+   frames of padding at the start of the stream.
+
+   Most users will not call Compute() directly, but will construct
+   DecodableAmNnetLoopedOnline (or SingleUtteranceNnet3Decoder) with a pointer
+   to this object; those classes call Compute() when they need the output of a
+   chunk that has not yet been computed.  To get the benefit of batching, a
+   server would typically give each stream its new audio and then call
+   Compute() until it returns 0, before advancing the decoders.
+
+   This class is not thread-safe: Compute() reads the features of all streams,
+   so all the streams and decoders that share it must be driven from the same
+   thread (or the caller must do the locking).
+*/
+class NnetMultiStreamLoopedComputer {
+ public:
+  /**
+     Constructor.
+       @param [in] info  Supplies the neural net and options (chunk size,
+                  context, priors and so on).  We compile our own version of
+                  the looped computation, for 'max_streams' sequences.  Must
+                  outlive this object.
+       @param [in] max_streams  The maximum number of streams that may be
+                  active at once.
+  */
+  NnetMultiStreamLoopedComputer(const DecodableNnetSimpleLoopedInfo &info,
+                                int32 max_streams);
+
+  /// Adds a stream and returns its stream-id, which will be in the range
+  /// [0, max_streams - 1].  It is an error if max_streams streams are already
+  /// active.  'ivector_features' must be NULL if and only if the model does
+  /// not take iVectors.  The features must outlive the stream, i.e. until
+  /// RemoveStream() is called.
+  int32 AddStream(OnlineFeatureInterface *input_features,
+                  OnlineFeatureInterface *ivector_features);
+
+  /// Removes a stream; any output not yet retrieved is discarded, and the
+  /// stream-id may be reused by a later call to AddStream().
+  void RemoveStream(int32 stream_id);
+
+  /// Advances by one chunk, in a single neural net computation, every active
+  /// stream that has enough input for its next chunk (a stream whose input
+  /// has finished is padded with its last frame).  Returns the number of
+  /// streams advanced, or zero if none could be (in which case no
+  /// computation is done).
+  int32 Compute();
+
+  /// If the stream has a computed chunk of output that has not been retrieved
+  /// yet, outputs the earliest such chunk and returns true; else returns false.
+  /// The output has info.frames_per_chunk / frame_subsampling_factor rows
+  /// (the last chunk may contain output for frames past the end of the input)
+  /// and has had the log-priors subtracted and the acoustic scale applied.
+  bool GetNextChunk(int32 stream_id, Matrix<BaseFloat> *output);
+
+  const DecodableNnetSimpleLoopedInfo &Info() const { return info_; }
+
+  int32 NumActiveStreams() const { return num_active_streams_; }
+
+  ~NnetMultiStreamLoopedComputer();
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetMultiStreamLoopedComputer);
+
+  struct StreamInfo {
+    bool active;
+    OnlineFeatureInterface *input_features;
+    OnlineFeatureInterface *ivector_features;
+    // The index of the next chunk to compute.  This is negative while the
+    // stream is being warmed up; chunk k >= 0 has output frames
+    // [k * frames_per_chunk, (k+1) * frames_per_chunk) (before subsampling)
+    // and consumes input frames from k * frames_per_chunk + right_context.
+    int32 next_chunk;
+    // Chunks of output that have been computed but not retrieved.
+    std::deque<Matrix<BaseFloat>*> output;
+    StreamInfo(): active(false), input_features(NULL),
+                  ivector_features(NULL), next_chunk(0) { }
+  };
+
+  // Returns true if the stream has enough input to compute its next chunk.
+  bool StreamIsReady(const StreamInfo &stream) const;
+
+  // Runs one step of the computation with all-zero input and discards the
+  // output; used in the constructor for the first two steps, whose structure
+  // is given by 'request' (request1_ or request2_).
+  void RunInitialStep(const ComputationRequest &request);
+
+  // Does one step of the computation (after the first two steps done in the
+  // constructor, all steps have the structure of 'request2_').  'ready'
+  // says which streams are to be advanced; other rows of the input are
+  // zero and other rows of the output are discarded.
+  void RunStep(const std::vector<bool> &ready);
+
+  // Outputs the indexes of matrices that are currently allocated in
+  // 'computer_'.  Between steps, these are the activations that persist
+  // from one chunk to the next.
+  void GetLiveMatrices(std::vector<int32> *matrices);
+
+  // The looped computation cycles through different matrix indexes at
+  // different chunks.  Given the matrices live before a step ('matrices1')
+  // and after it ('matrices2'), this works out the pairs (i, m2) such that
+  // matrices1[i] and m2 hold the same quantities, up to a fixed time shift.
+  // The result is cached.
+  const std::vector<std::pair<int32, int32> > &GetStateMapping(
+      const std::vector<int32> &matrices1,
+      const std::vector<int32> &matrices2);
+
+  // Returns true if the rows of matrices m1 and m2 have the same cindexes
+  // except that the 't' values in m2 are larger by 'shift'.
+  bool MatricesMatch(int32 m1, int32 m2, int32 shift) const;
+
+  // Sets to zero the rows that belong to stream 's' in the live matrices.
+  void ZeroStreamState(int32 s);
+
+  const DecodableNnetSimpleLoopedInfo &info_;
+  int32 max_streams_;
+  int32 num_active_streams_;
+  // The number of warm-up chunks for a stream that joins.
+  int32 num_warmup_chunks_;
+
+  ComputationRequest request1_, request2_, request3_;
+  NnetComputation computation_;
+  NnetComputer *computer_;
+
+  // For each row of the 'input', 'ivector' and 'output' matrices of a
+  // steady-state step, the stream (n index) and time offset within the
+  // chunk (in input or output frames).
+  std::vector<std::pair<int32, int32> > input_rows_, ivector_rows_,
+      output_rows_;
+
+  // stream_rows_[m][s] is the list of rows of matrix m that belong to stream
+  // s; worked out from the debug info of the computation.
+  std::vector<std::vector<std::vector<int32> > > stream_rows_;
+
+  // Cache for GetStateMapping(), indexed by 'matrices1'.
+  std::map<std::vector<int32>,
+           std::vector<std::pair<int32, int32> > > state_mapping_cache_;
+
+  std::vector<StreamInfo> streams_;
+
+  // Statistics, printed in the destructor.
+  int64 num_steps_;
+  int64 num_stream_chunks_;
+};
+
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+#endif  // KALDI_NNET3_NNET_MULTI_STREAM_LOOPED_H_
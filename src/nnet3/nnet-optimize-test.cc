@@ -23,6 +23,8 @@
 #include "nnet3/nnet-test-utils.h"
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-compute.h"
+#include "nnet3/nnet-utils.h"
+#include "nnet3/decodable-simple-looped.h"
 
 namespace kaldi {
 namespace nnet3 {
@@ -301,6 +303,202 @@ static void UnitTestNnetOptimize() {
 }
 
 
+// This tests FusePropagateCommands() on a network like a relu-renorm layer,
+// where the ReLU and the normalization should be fused; the output dim of the
+// affine layer is large enough that the fused commands are executed on several
+// blocks of rows.  Sometimes there is a SumBlockComponent before the ReLU,
+// which can't be done in-place, so it should start the fused sequence.
+static void UnitTestNnetFusePropagate() {
+  int32 input_dim = RandInt(5, 20), hidden_dim = RandInt(1000, 2000),
+      output_dim = RandInt(5, 20), num_rows = RandInt(1, 100);
+  bool use_sum_block = (RandInt(0, 1) == 0);
+  std::ostringstream os;
+  os << "component name=affine1 type=NaturalGradientAffineComponent input-dim="
+     << input_dim << " output-dim="
+     << (use_sum_block ? 2 * hidden_dim : hidden_dim) << std::endl;
+  if (use_sum_block)
+    os << "component name=sum1 type=SumBlockComponent input-dim="
+       << 2 * hidden_dim << " output-dim=" << hidden_dim << std::endl;
+  os << "component name=relu1 type=RectifiedLinearComponent dim="
+     << hidden_dim << std::endl;
+  os << "component name=renorm1 type=NormalizeComponent dim="
+     << hidden_dim << std::endl;
+  os << "component name=affine2 type=NaturalGradientAffineComponent input-dim="
+     << hidden_dim << " output-dim=" << output_dim << std::endl;
+  os << "input-node name=input dim=" << input_dim << std::endl;
+  os << "component-node name=affine1 component=affine1 input=input\n";
+  if (use_sum_block) {
+    os << "component-node name=sum1 component=sum1 input=affine1\n";
+    os << "component-node name=relu1 component=relu1 input=sum1\n";
+  } else {
+    os << "component-node name=relu1 component=relu1 input=affine1\n";
+  }
+  os << "component-node name=renorm1 component=renorm1 input=relu1\n";
+  os << "component-node name=affine2 component=affine2 input=renorm1\n";
+  os << "output-node name=output input=affine2\n";
+  Nnet nnet;
+  std::istringstream is(os.str());
+  nnet.ReadConfig(is);
+
+  ComputationRequest request;
+  request.inputs.push_back(IoSpecification("input", 0, num_rows));
+  request.outputs.push_back(IoSpecification("output", 0, num_rows));
+
+  NnetOptimizeOptions opt_config;
+  CachingOptimizingCompiler compiler(nnet, opt_config);
+  opt_config.fuse_propagate = true;
+  CachingOptimizingCompiler compiler_fused(nnet, opt_config);
+  std::shared_ptr<const NnetComputation> computation =
+      compiler.Compile(request),
+      computation_fused = compiler_fused.Compile(request);
+  {
+    std::ostringstream os;
+    computation_fused->Print(os, nnet);
+    KALDI_LOG << "Fused computation is: " << os.str();
+  }
+  int32 num_fused = 0;
+  for (size_t i = 0; i < computation_fused->commands.size(); i++)
+    if (computation_fused->commands[i].command_type == kPropagate &&
+        computation_fused->commands[i].arg7 > 0)
+      num_fused += computation_fused->commands[i].arg7;
+  KALDI_ASSERT(num_fused == (use_sum_block ? 2 : 1));
+
+  CuMatrix<BaseFloat> input(num_rows, input_dim), input_copy(num_rows,
+                                                             input_dim);
+  input.SetRandn();
+  input_copy.CopyFromMat(input);
+  NnetComputeOptions compute_opts;
+  NnetComputer computer(compute_opts, *computation, nnet, NULL),
+      computer_fused(compute_opts, *computation_fused, nnet, NULL);
+  computer.AcceptInput("input", &input);
+  computer.Run();
+  computer_fused.AcceptInput("input", &input_copy);
+  computer_fused.Run();
+  const CuMatrixBase<BaseFloat> &output(computer.GetOutput("output")),
+      &output_fused(computer_fused.GetOutput("output"));
+  KALDI_LOG << "Output sum (not fused) is " << output.Sum()
+            << ", (fused) is " << output_fused.Sum();
+  KALDI_ASSERT(ApproxEqual(output, output_fused));
+}
+
+static std::string ComputationToString(const NnetComputation &computation) {
+  std::ostringstream os;
+  computation.Write(os, true);
+  return os.str();
+}
+
+static void UnitTestNnetComputationCacheFile() {
+  int32 input_dim = RandInt(5, 20), hidden_dim = RandInt(5, 20),
+      output_dim = RandInt(5, 20), num_rows = RandInt(1, 100);
+  std::ostringstream os;
+  os << "component name=affine1 type=NaturalGradientAffineComponent input-dim="
+     << input_dim << " output-dim=" << hidden_dim << std::endl;
+  os << "component name=relu1 type=RectifiedLinearComponent dim="
+     << hidden_dim << std::endl;
+  os << "component name=affine2 type=NaturalGradientAffineComponent input-dim="
+     << hidden_dim << " output-dim=" << output_dim << std::endl;
+  os << "input-node name=input dim=" << input_dim << std::endl;
+  os << "component-node name=affine1 component=affine1 input=input\n";
+  os << "component-node name=relu1 component=relu1 input=affine1\n";
+  os << "component-node name=affine2 component=affine2 input=relu1\n";
+  os << "output-node name=output input=affine2\n";
+  Nnet nnet;
+  std::istringstream is(os.str());
+  nnet.ReadConfig(is);
+
+  ComputationRequest request;
+  request.inputs.push_back(IoSpecification("input", 0, num_rows));
+  request.outputs.push_back(IoSpecification("output", 0, num_rows));
+
+  std::string cache_filename = "tmp.computation_cache";
+  NnetOptimizeOptions opt_config;
+  {
+    CachingOptimizingCompiler compiler(nnet, opt_config);
+    KALDI_ASSERT(!compiler.ReadCacheFile(cache_filename));
+    compiler.Compile(request);
+    compiler.WriteCacheFile(cache_filename);
+  }
+  {
+    // The computation read from the cache must be the same as a freshly
+    // compiled one.
+    CachingOptimizingCompiler compiler(nnet, opt_config),
+        compiler_no_cache(nnet, opt_config);
+    KALDI_ASSERT(compiler.ReadCacheFile(cache_filename));
+    KALDI_ASSERT(ComputationToString(*compiler.Compile(request)) ==
+                 ComputationToString(*compiler_no_cache.Compile(request)));
+  }
+  {
+    // The cache is not used if the optimization options change...
+    NnetOptimizeOptions opt_config2(opt_config);
+    opt_config2.allow_left_merge = false;
+    CachingOptimizingCompiler compiler(nnet, opt_config2);
+    KALDI_ASSERT(!compiler.ReadCacheFile(cache_filename));
+  }
+  {
+    // ... or if the model changes.
+    Nnet nnet2(nnet);
+    PerturbParams(0.1, &nnet2);
+    KALDI_ASSERT(NnetHash(nnet2) != NnetHash(nnet));
+    CachingOptimizingCompiler compiler(nnet2, opt_config);
+    KALDI_ASSERT(!compiler.ReadCacheFile(cache_filename));
+  }
+  {
+    // A file that can't be read is ignored.
+    Output ko(cache_filename, false);
+    ko.Stream() << "<NnetHash> 0\n";
+  }
+  {
+    CachingOptimizingCompiler compiler(nnet, opt_config);
+    KALDI_ASSERT(!compiler.ReadCacheFile(cache_filename));
+  }
+  std::remove(cache_filename.c_str());
+}
+
+// Tests the --computation-cache option of the looped decodable objects.
+static void UnitTestNnetLoopedComputationCacheFile() {
+  std::string config =
+      "component name=affine1 type=NaturalGradientAffineComponent "
+      "input-dim=30 output-dim=20\n"
+      "component name=relu1 type=RectifiedLinearComponent dim=20\n"
+      "component name=affine2 type=NaturalGradientAffineComponent "
+      "input-dim=40 output-dim=10\n"
+      "input-node name=input dim=10\n"
+      "component-node name=affine1 component=affine1 "
+      "input=Append(Offset(input, -1), input, Offset(input, 1))\n"
+      "component-node name=relu1 component=relu1 input=affine1\n"
+      "component-node name=affine2 component=affine2 "
+      "input=Append(Offset(relu1, -2), relu1)\n"
+      "output-node name=output input=affine2\n";
+  Nnet nnet;
+  std::istringstream is(config);
+  nnet.ReadConfig(is);
+
+  NnetSimpleLoopedComputationOptions opts;
+  opts.frames_per_chunk = RandInt(5, 30);
+  NnetSimpleLoopedComputationOptions opts_no_cache(opts);
+  opts.computation_cache = "tmp.computation_cache";
+  std::remove(opts.computation_cache.c_str());
+
+  // The first one writes the cache and the second one reads it; both must
+  // give the same computation as one compiled without a cache.
+  DecodableNnetSimpleLoopedInfo info1(opts, &nnet), info2(opts, &nnet),
+      info_no_cache(opts_no_cache, &nnet);
+  std::string computation_str = ComputationToString(info_no_cache.computation);
+  KALDI_ASSERT(ComputationToString(info1.computation) == computation_str &&
+               ComputationToString(info2.computation) == computation_str);
+
+  // If the chunk size changes, the requests change, so the cache must not be
+  // used.
+  opts.frames_per_chunk += 5;
+  opts_no_cache.frames_per_chunk += 5;
+  DecodableNnetSimpleLoopedInfo info3(opts, &nnet),
+      info3_no_cache(opts_no_cache, &nnet);
+  KALDI_ASSERT(ComputationToString(info3.computation) ==
+               ComputationToString(info3_no_cache.computation) &&
+               ComputationToString(info3.computation) != computation_str);
+  std::remove(opts.computation_cache.c_str());
+}
+
 
 } // namespace nnet3
 } // namespace kaldi
@@ -317,6 +515,9 @@ int main() {
   CuDevice::Instantiate().SelectGpuId("yes");
 #endif
   UnitTestNnetOptimize();
+  UnitTestNnetFusePropagate();
+  UnitTestNnetComputationCacheFile();
+  UnitTestNnetLoopedComputationCacheFile();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
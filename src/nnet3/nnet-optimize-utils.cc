@@ -17,6 +17,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <map>
 #include "nnet3/nnet-optimize-utils.h"
 #include "nnet3/nnet-optimize.h"
@@ -4947,6 +4948,76 @@ void OptimizeMemoryCompression(const Nnet &nnet,
 }
 
 
+// Returns true if 'c' is a command that FusePropagateCommands() may include in
+// a fused sequence: the propagation of an element-wise type of component,
+// done either in-place or from a different matrix.  If 'is_first' is true,
+// 'c' would start the sequence, so it may also be a non-updatable component
+// that can't be done in-place, such as SumBlockComponent; we don't include
+// updatable ones like AffineComponent, whose matrix multiplication is faster
+// done all at once.
+static bool IsFusablePropagate(const Nnet &nnet,
+                               const NnetComputation &computation,
+                               const NnetComputation::Command &c,
+                               bool is_first) {
+  // NnetComputer::ExecuteFusedPropagate() passes NULL indexes to the
+  // component, so it must not have any precomputed indexes (arg2).
+  if (c.command_type != kPropagate || c.arg2 != 0 || c.arg5 > 0 ||
+      c.arg6 > 0)
+    return false;
+  int32 properties = nnet.GetComponent(c.arg1)->Properties();
+  if (!(properties & kSimpleComponent) ||
+      (properties & (kUsesMemo|kRandomComponent)))
+    return false;
+  if (!(properties & kPropagateInPlace) &&
+      (!is_first || (properties & kUpdatableComponent)))
+    return false;
+  // If it's not in-place, make sure the input and output can't overlap, or
+  // working on blocks of rows could change the result.
+  return (c.arg3 == c.arg4 ||
+          computation.submatrices[c.arg3].matrix_index !=
+          computation.submatrices[c.arg4].matrix_index);
+}
+
+void FusePropagateCommands(const Nnet &nnet,
+                           NnetComputation *computation) {
+  std::vector<NnetComputation::Command> &commands = computation->commands;
+  int32 num_commands = commands.size();
+  for (int32 c = 0; c < num_commands; c++)
+    if (commands[c].command_type == kBackprop ||
+        commands[c].command_type == kBackpropNoModelUpdate)
+      return;
+
+  int32 num_fused = 0;
+  for (int32 c = 0; c < num_commands; c++) {
+    NnetComputation::Command &first_command = commands[c];
+    if (!IsFusablePropagate(nnet, *computation, first_command, true))
+      continue;
+    // If the first command is not in-place, its input is usually deallocated
+    // right after it; we skip over such commands here, and if we find
+    // commands to fuse, we move them to the end of the sequence (deallocating
+    // a matrix later is always OK).
+    int32 submatrix_index = first_command.arg4, begin = c + 1;
+    while (begin < num_commands &&
+           commands[begin].command_type == kDeallocMatrix)
+      begin++;
+    int32 end = begin;
+    while (end < num_commands &&
+           IsFusablePropagate(nnet, *computation, commands[end], false) &&
+           commands[end].arg3 == submatrix_index &&
+           commands[end].arg4 == submatrix_index)
+      end++;
+    if (end > begin) {
+      std::rotate(commands.begin() + c + 1, commands.begin() + begin,
+                  commands.begin() + end);
+      commands[c].arg7 = end - begin;
+      num_fused += end - begin + 1;
+    }
+    c = end - 1;
+  }
+  KALDI_VLOG(3) << "Fused " << num_fused << " propagate commands.";
+}
+
+
 std::shared_ptr<const NnetComputation> ComputationCache::Find(
     const ComputationRequest &in_request) {
   std::lock_guard<std::mutex> lock(mutex_);
@@ -5021,8 +5092,7 @@ void ComputationCache::Read(std::istream &is, bool binary) {
   ExpectToken(is, binary, "<ComputationCacheSize>");
   ReadBasicType(is, binary, &computation_cache_size);
   KALDI_ASSERT(computation_cache_size >= 0);
-  computation_cache_.clear();
-  access_queue_.clear();
+  Clear();
   ExpectToken(is, binary, "<ComputationCache>");
   for (size_t c = 0; c < computation_cache_size; c++) {
     ComputationRequest request;
@@ -5058,7 +5128,8 @@ void ComputationCache::Write(std::ostream &os, bool binary) const {
   }
 }
 
-ComputationCache::~ComputationCache() {
+void ComputationCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
   CacheType::const_iterator iter = computation_cache_.begin(),
       end = computation_cache_.end();
   // We only need to explicitly delete the pointer to the ComputationRequest.
@@ -5066,6 +5137,12 @@ ComputationCache::~ComputationCache() {
   // when the reference count goes to zero.
   for (; iter != end; ++iter)
     delete iter->first;
+  computation_cache_.clear();
+  access_queue_.clear();
+}
+
+ComputationCache::~ComputationCache() {
+  Clear();
 }
 
 } // namespace nnet3
@@ -594,6 +594,27 @@ void OptimizeMemoryCompression(const Nnet &nnet,
                                NnetComputation *computation);
 
 
+/// This optimization, which is only applied to computations without a backprop
+/// pass, locates sequences of adjacent kPropagate commands for element-wise
+/// types of component (simple components that support in-place propagation,
+/// such as RectifiedLinearComponent and NormalizeComponent), where all but
+/// the first of them are done in-place on the output of the first.  The first
+/// one may also be a non-updatable simple component that can't be done
+/// in-place, such as SumBlockComponent, if its input is a different matrix
+/// from its output.  It marks each such sequence as fused by setting the arg7
+/// of its first command to the number of commands that follow it in the
+/// sequence; class NnetComputer then runs all of them on one block of rows at
+/// a time, which saves memory bandwidth on CPU.  Apart from setting arg7, it
+/// only moves kDeallocMatrix commands that come between the first command of a
+/// sequence and the rest of it to after the sequence.  Those commands are all
+/// kPropagate or kDeallocMatrix commands, so no label, marker or goto is moved
+/// and their command indexes stay the same; it is thus OK to do this after the
+/// other optimizations (and it must be done after them, as they may insert
+/// commands between the fused ones).
+void FusePropagateCommands(const Nnet &nnet,
+                           NnetComputation *computation);
+
+
 /// This function tries to optimize computation 'computation' for an 'looped'
 /// computation.  It expects as input a computation with no backprop but with
 /// multiple 'segments' separated by command kNoOperationLabel, where each
@@ -649,6 +670,9 @@ class ComputationCache {
   std::shared_ptr<const NnetComputation> Insert(const ComputationRequest &request,
                                                 const NnetComputation *computation);
 
+  // Removes all the cached computations.
+  void Clear();
+
   ~ComputationCache();
 
   // Checks the stored computation for correctness.
@@ -18,9 +18,12 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdio>
 #include <iomanip>
+#include <random>
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-optimize-utils.h"
+#include "nnet3/nnet-utils.h"
 #include "base/timer.h"
 
 namespace kaldi {
@@ -78,6 +81,10 @@ void NnetOptimizeOptions::Read(std::istream &is, bool binary) {
     ExpectToken(is, binary, "<MemoryCompressionLevel>");
     ReadBasicType(is, binary, &memory_compression_level);
   }
+  if (PeekToken(is, binary) == 'F') {
+    ExpectToken(is, binary, "<FusePropagate>");
+    ReadBasicType(is, binary, &fuse_propagate);
+  }
   ExpectToken(is, binary, "</NnetOptimizeOptions>");
 }
 
@@ -121,6 +128,8 @@ void NnetOptimizeOptions::Write(std::ostream &os, bool binary) const {
   WriteBasicType(os, binary, snip_row_ops);
   WriteToken(os, binary, "<MemoryCompressionLevel>");
   WriteBasicType(os, binary, memory_compression_level);
+  WriteToken(os, binary, "<FusePropagate>");
+  WriteBasicType(os, binary, fuse_propagate);
   WriteToken(os, binary, "</NnetOptimizeOptions>");
 }
 
@@ -142,7 +151,8 @@ bool NnetOptimizeOptions::operator == (const NnetOptimizeOptions &other) const {
           other.max_deriv_time == max_deriv_time &&
           other.max_deriv_time_relative == max_deriv_time_relative &&
           other.snip_row_ops == snip_row_ops &&
-          other.memory_compression_level == memory_compression_level);
+          other.memory_compression_level == memory_compression_level &&
+          other.fuse_propagate == fuse_propagate);
 }
 
 // move commands that resize and zero matrices to as late/early as possible.
@@ -623,6 +633,17 @@ void Optimize(const NnetOptimizeOptions &config,
       CheckComputation(nnet, *computation, false);
   }
 
+  // This has to come last, because it relies on the fused commands being
+  // adjacent.  Besides setting args of commands, it moves kDeallocMatrix
+  // commands past the propagate commands that follow them, using std::rotate
+  // on a range that only contains those two types of command; so no label is
+  // moved, and the command indexes that FixGotoLabel() set up remain valid.
+  if (config.optimize && config.fuse_propagate) {
+    FusePropagateCommands(nnet, computation);
+    if (GetVerboseLevel() >= 3)
+      CheckComputation(nnet, *computation, false);
+  }
+
   if (GetVerboseLevel() >= 3) {
     CheckComputation(nnet, *computation, false);
     KALDI_LOG << "After optimization, max memory use (bytes) = "
@@ -651,14 +672,14 @@ CachingOptimizingCompiler::CachingOptimizingCompiler(
     seconds_taken_io_(0.0), cache_(config.cache_capacity) { }
 
 
-void CachingOptimizingCompiler::ReadCache(std::istream &is, bool binary) {
+bool CachingOptimizingCompiler::ReadCache(std::istream &is, bool binary) {
   {
     Timer timer;
     NnetOptimizeOptions opt_config_cached;
     opt_config_cached.Read(is, binary);
     // we won't read cached computations if any optimize option has been changed.
     if (!(opt_config_ == opt_config_cached))
-      return;
+      return false;
     cache_.Read(is, binary);
     seconds_taken_io_ += timer.Elapsed();
   }
@@ -670,7 +691,7 @@ void CachingOptimizingCompiler::ReadCache(std::istream &is, bool binary) {
     // arbitrary but it only affects printed times-taken.
     seconds_taken_total_ += timer.Elapsed();
   }
-
+  return true;
 }
 
 void CachingOptimizingCompiler::WriteCache(std::ostream &os, bool binary) {
@@ -680,6 +701,110 @@ void CachingOptimizingCompiler::WriteCache(std::ostream &os, bool binary) {
   seconds_taken_io_ += timer.Elapsed();
 }
 
+bool CachingOptimizingCompiler::ReadCacheFile(const std::string &rxfilename) {
+  Timer timer;
+  bool ans;
+  try {
+    std::string contents;
+    ans = ReadComputationCacheFile(rxfilename, NnetHash(nnet_), &contents);
+    seconds_taken_io_ += timer.Elapsed();
+    if (!ans)
+      return false;
+    std::istringstream is(contents);
+    ans = ReadCache(is, true);
+  } catch (const std::exception &e) {
+    // e.g. the file was written by a version of the code with a different
+    // format for the computations.
+    KALDI_WARN << "Error reading computation cache from "
+               << PrintableRxfilename(rxfilename) << ", ignoring it.";
+    cache_.Clear();
+    return false;
+  }
+  if (ans)
+    KALDI_LOG << "Read computation cache from "
+              << PrintableRxfilename(rxfilename);
+  else
+    KALDI_LOG << "Not using computation cache from "
+              << PrintableRxfilename(rxfilename)
+              << " because the optimization options have changed.";
+  return ans;
+}
+
+void CachingOptimizingCompiler::WriteCacheFile(const std::string &wxfilename) {
+  Timer timer;
+  std::ostringstream os;
+  WriteCache(os, true);
+  WriteComputationCacheFile(wxfilename, NnetHash(nnet_), os.str());
+  seconds_taken_io_ += timer.Elapsed();
+}
+
+bool ReadComputationCacheFile(const std::string &rxfilename,
+                              uint64 nnet_hash,
+                              std::string *contents) {
+  bool binary;
+  Input ki;
+  if (!ki.Open(rxfilename, &binary)) {
+    // This is expected the first time a cache is used.
+    KALDI_LOG << "Computation cache " << PrintableRxfilename(rxfilename)
+              << " does not exist yet.";
+    return false;
+  }
+  std::istream &is = ki.Stream();
+  uint64 nnet_hash_cached;
+  if (!binary || PeekToken(is, binary) != 'N') {
+    KALDI_WARN << "File " << PrintableRxfilename(rxfilename)
+               << " is not a computation cache, ignoring it.";
+    return false;
+  }
+  ExpectToken(is, binary, "<NnetHash>");
+  ReadBasicType(is, binary, &nnet_hash_cached);
+  if (nnet_hash_cached != nnet_hash) {
+    KALDI_LOG << "Not using computation cache from "
+              << PrintableRxfilename(rxfilename)
+              << " because it was written for a different model.";
+    return false;
+  }
+  std::ostringstream os;
+  os << is.rdbuf();
+  *contents = os.str();
+  return true;
+}
+
+void WriteComputationCacheFile(const std::string &wxfilename,
+                               uint64 nnet_hash,
+                               const std::string &contents) {
+  std::string filename = wxfilename;
+  if (ClassifyWxfilename(wxfilename) == kFileOutput) {
+    std::ostringstream tmp;
+    tmp << wxfilename << ".tmp." << std::hex << std::random_device()();
+    filename = tmp.str();
+  }
+  // Failing to write the cache is not fatal, as it only costs time.
+  bool binary = true;
+  Output ko;
+  if (!ko.Open(filename, binary, true)) {
+    KALDI_WARN << "Could not write computation cache to "
+               << PrintableWxfilename(wxfilename);
+    return;
+  }
+  WriteToken(ko.Stream(), binary, "<NnetHash>");
+  WriteBasicType(ko.Stream(), binary, nnet_hash);
+  ko.Stream().write(contents.data(), contents.size());
+  bool ans = ko.Close();
+  if (filename != wxfilename) {
+    if (ans)
+      ans = (std::rename(filename.c_str(), wxfilename.c_str()) == 0);
+    if (!ans)
+      std::remove(filename.c_str());
+  }
+  if (ans)
+    KALDI_LOG << "Wrote computation cache to "
+              << PrintableWxfilename(wxfilename);
+  else
+    KALDI_WARN << "Could not write computation cache to "
+               << PrintableWxfilename(wxfilename);
+}
+
 CachingOptimizingCompiler::~CachingOptimizingCompiler() {
   if (seconds_taken_total_ > 0.0 || seconds_taken_io_ > 0.0) {
     std::ostringstream os;
@@ -54,6 +54,7 @@ struct NnetOptimizeOptions {
   int32 max_deriv_time_relative;
   bool snip_row_ops;
   int32 memory_compression_level;
+  bool fuse_propagate;
   // optimize_looped_computation is a 'hidden config' not available from
   // the command line; it's set to true to enable the optimization for
   // looped computation that turns a linear computation into a loop.
@@ -79,6 +80,7 @@ struct NnetOptimizeOptions {
       max_deriv_time_relative(std::numeric_limits<int32>::max()),
       snip_row_ops(true),
       memory_compression_level(1),
+      fuse_propagate(false),
       optimize_looped_computation(false) { }
 
   void Register(OptionsItf *opts) {
@@ -145,6 +147,12 @@ struct NnetOptimizeOptions {
                    "potentially at the expense of speed and the accuracy "
                    "of derivatives.  0 means no compression at all; 1 means "
                    "compression that shouldn't affect results at all.");
+    opts->Register("fuse-propagate", &fuse_propagate, "This is only relevant "
+                   "to decoding, not training.  If true, sequences of in-place "
+                   "propagations of element-wise components (e.g. "
+                   "RectifiedLinearComponent followed by NormalizeComponent) "
+                   "are done together on blocks of rows small enough to stay "
+                   "in cache, which reduces memory traffic on CPU.");
 
   }
   void Read(std::istream &is, bool binary);
@@ -189,6 +197,25 @@ void Optimize(const NnetOptimizeOptions &config,
 
 
 
+/// This function is used for cache files of computations that are shared
+/// between processes, e.g. see CachingOptimizingCompiler::ReadCacheFile().
+/// If 'rxfilename' exists and was written by WriteComputationCacheFile() with
+/// the same 'nnet_hash' (see NnetHash()), it outputs the contents that were
+/// written to 'contents' and returns true.  Otherwise (e.g. if the model has
+/// changed since the file was written) it returns false.
+bool ReadComputationCacheFile(const std::string &rxfilename,
+                              uint64 nnet_hash,
+                              std::string *contents);
+
+/// Writes 'contents' to a binary file, preceded by 'nnet_hash'; see
+/// ReadComputationCacheFile().  If 'wxfilename' is an ordinary file, we write
+/// to a temporary file and rename it, so that parallel jobs that write the
+/// same cache file will not leave it half written.
+void WriteComputationCacheFile(const std::string &wxfilename,
+                               uint64 nnet_hash,
+                               const std::string &contents);
+
+
 struct CachingOptimizingCompilerOptions {
   bool use_shortcut;
   int32 cache_capacity;
@@ -239,9 +266,27 @@ class CachingOptimizingCompiler {
   /// 'std::shared_ptr<const NnetComputation>' in the calling code.
   std::shared_ptr<const NnetComputation> Compile(
       const ComputationRequest &request);
-  void ReadCache(std::istream &is, bool binary);
+
+  /// Reads cached computations as written by WriteCache().  Returns false
+  /// (and reads nothing) if they were compiled with different optimization
+  /// options.  The caller is responsible for making sure they were compiled
+  /// for a neural net with the same structure as ours.
+  bool ReadCache(std::istream &is, bool binary);
   void WriteCache(std::ostream &os, bool binary);
 
+  /// Reads the cached computations from a file written by WriteCacheFile()
+  /// (this is the --computation-cache option of the decoding programs), if
+  /// it exists.  It is ignored if it was written for a different model
+  /// (see NnetHash()) or with different optimization options, or if it
+  /// can't be read.  Returns true if the computations were read.
+  bool ReadCacheFile(const std::string &rxfilename);
+
+  /// Writes the cached computations, keyed by the hash of the model, to a
+  /// file that can be read by ReadCacheFile().  See
+  /// WriteComputationCacheFile() for why it's safe for parallel jobs to
+  /// share the file.
+  void WriteCacheFile(const std::string &wxfilename);
+
  private:
 
   // This function just implements the work of Compile(); it's made a separate
@@ -3301,6 +3301,120 @@ void FixedAffineComponent::Read(std::istream &is, bool binary) {
   ExpectToken(is, binary, "</FixedAffineComponent>");
 }
 
+QuantizedAffineComponent::QuantizedAffineComponent(const AffineComponent &c) {
+  Init(c.LinearParams(), c.BiasParams());
+}
+
+QuantizedAffineComponent::QuantizedAffineComponent(const LinearComponent &c) {
+  Init(c.Params(), CuVector<BaseFloat>(c.OutputDim()));
+}
+
+QuantizedAffineComponent::QuantizedAffineComponent(
+    const FixedAffineComponent &c) {
+  Init(c.LinearParams(), c.BiasParams());
+}
+
+void QuantizedAffineComponent::Init(
+    const CuMatrixBase<BaseFloat> &linear_params,
+    const CuVectorBase<BaseFloat> &bias_params) {
+  KALDI_ASSERT(linear_params.NumRows() == bias_params.Dim() &&
+               linear_params.NumCols() > 0);
+  quantized_params_.Init(Matrix<BaseFloat>(linear_params));
+  bias_params_ = bias_params;
+  ComputeDerived();
+}
+
+void QuantizedAffineComponent::ComputeDerived() {
+  Matrix<BaseFloat> params(quantized_params_.NumRows(),
+                           quantized_params_.NumCols(), kUndefined);
+  quantized_params_.CopyToMat(&params);
+  linear_params_.Swap(&params);
+}
+
+void QuantizedAffineComponent::InitFromConfig(ConfigLine *cfl) {
+  KALDI_ERR << "QuantizedAffineComponent cannot be initialized from a config "
+            << "line; use nnet3-am-quantize to convert a trained model.";
+}
+
+std::string QuantizedAffineComponent::Info() const {
+  std::ostringstream stream;
+  stream << Component::Info();
+  PrintParameterStats(stream, "linear-params", linear_params_);
+  PrintParameterStats(stream, "bias", bias_params_, true);
+  return stream.str();
+}
+
+void* QuantizedAffineComponent::Propagate(
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &in,
+    CuMatrixBase<BaseFloat> *out) const {
+  out->CopyRowsFromVec(bias_params_); // Adds the bias term first.
+  if (quantization::QuantizedKernelsAvailable())
+    quantization::AddMatQuantizedMat(in.Mat(), quantized_params_, 0,
+                                     &(out->Mat()));
+  else
+    out->AddMatMat(1.0, in, kNoTrans, linear_params_, kTrans, 1.0);
+  return NULL;
+}
+
+void QuantizedAffineComponent::Backprop(
+    const std::string &debug_info,
+    const ComponentPrecomputedIndexes *indexes,
+    const CuMatrixBase<BaseFloat> &, //in_value
+    const CuMatrixBase<BaseFloat> &, //out_value
+    const CuMatrixBase<BaseFloat> &out_deriv,
+    void *memo,
+    Component *, //to_update
+    CuMatrixBase<BaseFloat> *in_deriv) const {
+  // kBackpropAdds is true. It's the user's responsibility to zero out
+  // <in_deriv> if they need it to be so.
+  if (in_deriv)
+    in_deriv->AddMatMat(1.0, out_deriv, kNoTrans,
+                        linear_params_, kNoTrans, 1.0);
+}
+
+Component* QuantizedAffineComponent::Copy() const {
+  QuantizedAffineComponent *ans = new QuantizedAffineComponent();
+  ans->quantized_params_ = quantized_params_;
+  ans->linear_params_ = linear_params_;
+  ans->bias_params_ = bias_params_;
+  return ans;
+}
+
+void QuantizedAffineComponent::Write(std::ostream &os, bool binary) const {
+  WriteToken(os, binary, "<QuantizedAffineComponent>");
+  WriteToken(os, binary, "<InputDim>");
+  WriteBasicType(os, binary, InputDim());
+  WriteToken(os, binary, "<LinearParams>");
+  WriteIntegerVector(os, binary, quantized_params_.Data());
+  WriteToken(os, binary, "<RowScales>");
+  quantized_params_.RowScales().Write(os, binary);
+  WriteToken(os, binary, "<BiasParams>");
+  bias_params_.Write(os, binary);
+  WriteToken(os, binary, "</QuantizedAffineComponent>");
+}
+
+void QuantizedAffineComponent::Read(std::istream &is, bool binary) {
+  int32 input_dim;
+  std::vector<int8> quantized;
+  Vector<BaseFloat> row_scales;
+  ExpectOneOrTwoTokens(is, binary, "<QuantizedAffineComponent>", "<InputDim>");
+  ReadBasicType(is, binary, &input_dim);
+  ExpectToken(is, binary, "<LinearParams>");
+  ReadIntegerVector(is, binary, &quantized);
+  ExpectToken(is, binary, "<RowScales>");
+  row_scales.Read(is, binary);
+  ExpectToken(is, binary, "<BiasParams>");
+  bias_params_.Read(is, binary);
+  ExpectToken(is, binary, "</QuantizedAffineComponent>");
+  int32 output_dim = row_scales.Dim();
+  if (input_dim <= 0 || output_dim <= 0 || bias_params_.Dim() != output_dim ||
+      quantized.size() != static_cast<size_t>(input_dim) * output_dim)
+    KALDI_ERR << "Invalid QuantizedAffineComponent.";
+  quantized_params_.Init(input_dim, row_scales, &quantized);
+  ComputeDerived();
+}
+
 void SumGroupComponent::Init(const std::vector<int32> &sizes) {
   KALDI_ASSERT(!sizes.empty());
   std::vector<Int32Pair> cpu_vec(sizes.size());
@@ -29,6 +29,7 @@
 #include "nnet3/nnet-common.h"
 #include "nnet3/nnet-component-itf.h"
 #include "nnet3/natural-gradient-online.h"
+#include "nnet3/quantization.h"
 #include <iostream>
 
 namespace kaldi {
@@ -1008,6 +1009,73 @@ class FixedAffineComponent: public Component {
   KALDI_DISALLOW_COPY_AND_ASSIGN(FixedAffineComponent);
 };
 
+
+/**
+   QuantizedAffineComponent is an affine transform whose linear parameters are
+   stored as 8-bit integers with a floating-point scale for each row (i.e. for
+   each output dimension), which makes models about 4 times smaller.  It is
+   intended for inference, and is not trainable.  It is not created from
+   config lines; you get it by converting an AffineComponent (or a
+   NaturalGradientAffineComponent), a LinearComponent or a
+   FixedAffineComponent in a trained model, see QuantizeNnet() in nnet-utils.h
+   and the program nnet3-am-quantize.
+
+   If quantization::QuantizedKernelsAvailable() (i.e. if the CPU supports
+   AVX2 and we are not using a GPU), Propagate() quantizes its input to 7 bits
+   and does the multiplication in integer arithmetic, see quantization.h.  Otherwise it uses the usual matrix multiplication with the
+   dequantized parameters, which we also keep for Backprop().
+*/
+class QuantizedAffineComponent: public Component {
+ public:
+  QuantizedAffineComponent() { }
+  explicit QuantizedAffineComponent(const AffineComponent &c);
+  explicit QuantizedAffineComponent(const LinearComponent &c);
+  explicit QuantizedAffineComponent(const FixedAffineComponent &c);
+
+  virtual std::string Type() const { return "QuantizedAffineComponent"; }
+  virtual std::string Info() const;
+
+  // This component cannot be initialized from a config line, see above.
+  virtual void InitFromConfig(ConfigLine *cfl);
+
+  virtual int32 Properties() const { return kSimpleComponent|kBackpropAdds; }
+  virtual int32 InputDim() const { return linear_params_.NumCols(); }
+  virtual int32 OutputDim() const { return linear_params_.NumRows(); }
+
+  virtual void* Propagate(const ComponentPrecomputedIndexes *indexes,
+                         const CuMatrixBase<BaseFloat> &in,
+                         CuMatrixBase<BaseFloat> *out) const;
+  virtual void Backprop(const std::string &debug_info,
+                        const ComponentPrecomputedIndexes *indexes,
+                        const CuMatrixBase<BaseFloat> &in_value,
+                        const CuMatrixBase<BaseFloat> &, // out_value
+                        const CuMatrixBase<BaseFloat> &out_deriv,
+                        void *memo,
+                        Component *to_update,
+                        CuMatrixBase<BaseFloat> *in_deriv) const;
+
+  virtual Component* Copy() const;
+  virtual void Read(std::istream &is, bool binary);
+  virtual void Write(std::ostream &os, bool binary) const;
+
+  // The dequantized linear parameters.
+  const CuMatrix<BaseFloat> &LinearParams() const { return linear_params_; }
+  const CuVector<BaseFloat> &BiasParams() const { return bias_params_; }
+ private:
+  // Sets up the parameters, quantizing 'linear_params'.
+  void Init(const CuMatrixBase<BaseFloat> &linear_params,
+            const CuVectorBase<BaseFloat> &bias_params);
+
+  // Sets linear_params_ from quantized_params_.
+  void ComputeDerived();
+
+  quantization::QuantizedMatrix quantized_params_;
+  CuMatrix<BaseFloat> linear_params_;  // quantized_params_, dequantized.
+  CuVector<BaseFloat> bias_params_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(QuantizedAffineComponent);
+};
+
 /// SumGroupComponent is used to sum up groups of posteriors.
 /// It's used to introduce a kind of Gaussian-mixture-model-like
 /// idea into neural nets.  This is basically a degenerate case of
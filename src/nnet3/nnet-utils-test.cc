@@ -20,6 +20,8 @@
 
 #include "nnet3/nnet-nnet.h"
 #include "nnet3/nnet-simple-component.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
 #include "nnet3/nnet-test-utils.h"
 
 namespace kaldi {
@@ -100,6 +102,79 @@ void UnitTestConvertRepeatedToBlockAffineComposite() {
   }
 }
 
+// Does the forward computation of 'nnet' for 'request' and outputs "output".
+static void ComputeSimpleOutput(const Nnet &nnet,
+                                const ComputationRequest &request,
+                                const Matrix<BaseFloat> &input,
+                                Matrix<BaseFloat> *output) {
+  CachingOptimizingCompiler compiler(nnet);
+  std::shared_ptr<const NnetComputation> computation =
+      compiler.Compile(request);
+  NnetComputer computer(NnetComputeOptions(), *computation, nnet, NULL);
+  CuMatrix<BaseFloat> cu_input(input);
+  computer.AcceptInput("input", &cu_input);
+  computer.Run();
+  const CuMatrixBase<BaseFloat> &nnet_output = computer.GetOutput("output");
+  output->Resize(nnet_output.NumRows(), nnet_output.NumCols());
+  output->CopyFromMat(nnet_output);
+}
+
+// Checks that QuantizeNnet() converts the convolutional and affine components,
+// and that the output of the network changes only slightly.
+void UnitTestQuantizeNnet() {
+  for (int32 n = 0; n < 5; n++) {
+    int32 num_filters_out = RandInt(1, 20), conv_dim = 10 * num_filters_out;
+    std::ostringstream config;
+    config << "component name=conv type=TimeHeightConvolutionComponent "
+           << "num-filters-in=4 num-filters-out=" << num_filters_out
+           << " height-in=10 height-out=10 height-offsets=-1,0,1 "
+           << "time-offsets=-1,0,1 bias-stddev=0.5";
+    if (n % 2 == 1)  // this tests the code that breaks up the computation.
+      config << " max-memory-mb=1.0e-04";
+    config << "\ncomponent name=relu type=RectifiedLinearComponent dim="
+           << conv_dim << "\n"
+           << "component name=affine type=NaturalGradientAffineComponent "
+           << "input-dim=" << conv_dim << " output-dim=" << RandInt(1, 30)
+           << "\n"
+           << "input-node name=input dim=40\n"
+           << "component-node name=conv component=conv input=input\n"
+           << "component-node name=relu component=relu input=conv\n"
+           << "component-node name=affine component=affine input=relu\n"
+           << "output-node name=output input=affine\n";
+    Nnet nnet;
+    std::istringstream is(config.str());
+    nnet.ReadConfig(is);
+    Nnet quantized_nnet(nnet);
+    KALDI_ASSERT(QuantizeNnet("*", &quantized_nnet) == 2);
+    KALDI_ASSERT(
+        quantized_nnet.GetComponent(0)->Type() ==
+        "QuantizedTimeHeightConvolutionComponent" &&
+        quantized_nnet.GetComponent(2)->Type() == "QuantizedAffineComponent");
+    {  // Check that we can read it back.
+      std::ostringstream os;
+      quantized_nnet.Write(os, true);
+      std::istringstream is(os.str());
+      quantized_nnet.Read(is, true);
+    }
+
+    ComputationRequest request;
+    std::vector<Matrix<BaseFloat> > inputs;
+    ComputeExampleComputationRequestSimple(nnet, &request, &inputs);
+    request.need_model_derivative = false;
+    request.store_component_stats = false;
+    request.inputs[0].has_deriv = false;
+    request.outputs[0].has_deriv = false;
+    Matrix<BaseFloat> output, quantized_output;
+    ComputeSimpleOutput(nnet, request, inputs[0], &output);
+    ComputeSimpleOutput(quantized_nnet, request, inputs[0], &quantized_output);
+    quantized_output.AddMat(-1.0, output);
+    BaseFloat relative_error =
+        quantized_output.FrobeniusNorm() / output.FrobeniusNorm();
+    KALDI_LOG << "Relative error of quantized output is " << relative_error;
+    KALDI_ASSERT(relative_error < 0.05);
+  }
+}
+
 } // namespace nnet3
 } // namespace kaldi
 
@@ -111,6 +186,7 @@ int main() {
   UnitTestNnetContext();
   UnitTestConvertRepeatedToBlockAffine();
   UnitTestConvertRepeatedToBlockAffineComposite();
+  UnitTestQuantizeNnet();
 
   KALDI_LOG << "Nnet tests succeeded.";
 
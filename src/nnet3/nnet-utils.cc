@@ -458,6 +458,38 @@ void ConvertRepeatedToBlockAffine(Nnet *nnet) {
   }
 }
 
+int32 QuantizeNnet(const std::string &name_pattern, Nnet *nnet) {
+  int32 num_quantized = 0;
+  for (int32 c = 0; c < nnet->NumComponents(); c++) {
+    if (!NameMatchesPattern(nnet->GetComponentName(c).c_str(),
+                            name_pattern.c_str()))
+      continue;
+    const Component *component = nnet->GetComponent(c);
+    const AffineComponent *affine =
+        dynamic_cast<const AffineComponent*>(component);
+    const LinearComponent *linear =
+        dynamic_cast<const LinearComponent*>(component);
+    const FixedAffineComponent *fixed_affine =
+        dynamic_cast<const FixedAffineComponent*>(component);
+    Component *quantized = NULL;
+    if (affine != NULL)
+      quantized = new QuantizedAffineComponent(*affine);
+    else if (linear != NULL)
+      quantized = new QuantizedAffineComponent(*linear);
+    else if (fixed_affine != NULL)
+      quantized = new QuantizedAffineComponent(*fixed_affine);
+    else if (component->Type() == "TimeHeightConvolutionComponent")
+      quantized = new QuantizedTimeHeightConvolutionComponent(
+          dynamic_cast<const TimeHeightConvolutionComponent&>(*component));
+    if (quantized != NULL) {
+      // the following call deletes the old component.
+      nnet->SetComponent(c, quantized);
+      num_quantized++;
+    }
+  }
+  return num_quantized;
+}
+
 std::string NnetInfo(const Nnet &nnet) {
   std::ostringstream ostr;
   if (IsSimpleNnet(nnet)) {
@@ -475,6 +507,40 @@ std::string NnetInfo(const Nnet &nnet) {
   return ostr.str();
 }
 
+namespace {
+// A stream buffer that discards what is written to it, keeping only the
+// 64-bit FNV-1a hash of the bytes; this saves us from having to hold a copy of
+// the model in memory in order to hash it.
+class HashingStreamBuf: public std::streambuf {
+ public:
+  HashingStreamBuf(): hash_(14695981039346656037ULL) { }
+  uint64 Hash() const { return hash_; }
+ protected:
+  virtual int_type overflow(int_type c) {
+    if (c != traits_type::eof())
+      Update(static_cast<unsigned char>(c));
+    return traits_type::not_eof(c);
+  }
+  virtual std::streamsize xsputn(const char *s, std::streamsize n) {
+    for (std::streamsize i = 0; i < n; i++)
+      Update(static_cast<unsigned char>(s[i]));
+    return n;
+  }
+ private:
+  inline void Update(unsigned char c) {
+    hash_ = (hash_ ^ c) * 1099511628211ULL;
+  }
+  uint64 hash_;
+};
+}
+
+uint64 NnetHash(const Nnet &nnet) {
+  HashingStreamBuf buf;
+  std::ostream os(&buf);
+  nnet.Write(os, true);
+  return buf.Hash();
+}
+
 void SetDropoutProportion(BaseFloat dropout_proportion,
                           Nnet *nnet) {
   for (int32 c = 0; c < nnet->NumComponents(); c++) {
@@ -1856,6 +1922,9 @@ class ModelCollapser {
         dynamic_cast<const AffineComponent*>(current_component);
     const TimeHeightConvolutionComponent *conv_component =
         dynamic_cast<const TimeHeightConvolutionComponent*>(current_component);
+    if (conv_component != NULL &&
+        !(conv_component->Properties() & kUpdatableComponent))
+      conv_component = NULL;  // QuantizedTimeHeightConvolutionComponent.
     if (affine_component != NULL) {
       // AffineComponent or NaturalGradientAffineComponent.
       CuVector<BaseFloat> bias_params(affine_component->BiasParams());
@@ -156,6 +156,19 @@ void FreezeNaturalGradient(bool freeze, Nnet *nnet);
 /// NaturalGradientRepeatedAffineComponent to BlockAffineComponent in nnet.
 void ConvertRepeatedToBlockAffine(Nnet *nnet);
 
+/// Replaces each component whose name matches 'name_pattern' (e.g. "*") and
+/// which is of type AffineComponent (or a child class such as
+/// NaturalGradientAffineComponent), LinearComponent or FixedAffineComponent
+/// with a QuantizedAffineComponent, and each TimeHeightConvolutionComponent
+/// with a QuantizedTimeHeightConvolutionComponent; these store their
+/// parameters with 8 bits per element, and use integer arithmetic in the
+/// forward computation where possible (see quantization.h).  Returns the
+/// number of components converted.  The result is
+/// not trainable, so this should only be done on a model that is ready for
+/// testing; call it after CollapseModel(), since that combines other
+/// components into the affine components.
+int32 QuantizeNnet(const std::string &name_pattern, Nnet *nnet);
+
 /// This function returns various info about the neural net.
 /// If the nnet satisfied IsSimpleNnet(nnet), the info includes "left-context=5\nright-context=3\n...".  The info includes
 /// the output of nnet.Info().
@@ -163,6 +176,12 @@ void ConvertRepeatedToBlockAffine(Nnet *nnet);
 /// Info() function (we need this in the CTC code).
 std::string NnetInfo(const Nnet &nnet);
 
+/// This function returns a hash of the neural net, computed from its binary
+/// form, so it changes if the structure or any parameter changes.  It is used
+/// to make sure that cached computations (see
+/// CachingOptimizingCompiler::ReadCacheFile()) were compiled for this model.
+uint64 NnetHash(const Nnet &nnet);
+
 /// This function sets the dropout proportion in all dropout components to
 /// dropout_proportion value.
 void SetDropoutProportion(BaseFloat dropout_proportion, Nnet *nnet);
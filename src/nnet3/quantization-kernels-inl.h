@@ -0,0 +1,138 @@
+// nnet3/quantization-kernels-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// This file has no include guard: it is included by quantization.cc several
+// times, each time in a different namespace, to compile the integer kernels
+// for a different instruction set.  Don't include it anywhere else.  Before
+// including it, quantization.cc defines KALDI_QUANTIZATION_TARGET as the
+// target attribute of the functions, and KALDI_QUANTIZATION_DPBUSD as the
+// VNNI intrinsic to use, if any.
+//
+// ComputeDotProducts(), which is what quantization.cc calls, ends with
+// _mm256_zeroupper(): GCC only inserts it itself with -O2 or higher, and
+// without it the SSE code that runs afterwards is much slower.
+
+
+// Adds the products of the unsigned bytes in x and the signed bytes in w to
+// the 32-bit integers in 'sum', in groups of 4.
+KALDI_QUANTIZATION_TARGET
+static inline __m256i MultiplyAdd(__m256i sum, __m256i x, __m256i w) {
+#ifdef KALDI_QUANTIZATION_DPBUSD
+  return KALDI_QUANTIZATION_DPBUSD(sum, x, w);
+#else
+  // _mm256_maddubs_epi16 adds pairs of products into 16-bit integers; the
+  // absolute value of the sums is at most 2 * 127 * 127 = 32258, so they
+  // cannot saturate.  _mm256_madd_epi16 then adds pairs of those.
+  return _mm256_add_epi32(sum, _mm256_madd_epi16(
+      _mm256_maddubs_epi16(x, w), _mm256_set1_epi16(1)));
+#endif
+}
+
+// Returns the sum of the 8 32-bit integers in v.
+KALDI_QUANTIZATION_TARGET
+static inline int32 HorizontalSum(__m256i v) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+KALDI_QUANTIZATION_TARGET
+static inline __m256i Load(const void *p) {
+  return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+}
+
+KALDI_QUANTIZATION_TARGET
+static inline int32 DotProduct(const uint8 *x, const int8 *w, int32 dim) {
+  int32 dim_simd = dim - dim % 32;
+  __m256i sum = _mm256_setzero_si256();
+  for (int32 j = 0; j < dim_simd; j += 32)
+    sum = MultiplyAdd(sum, Load(x + j), Load(w + j));
+  return HorizontalSum(sum) +
+      DotProductSimple(x + dim_simd, w + dim_simd, dim - dim_simd);
+}
+
+// Sets dots[r * num_w_rows + o] to the dot product of row r of x and row o
+// of w, which have dimension 'dim'; the rows of x are contiguous and those
+// of w are 'w_stride' apart.  We compute them in blocks of 2 rows of x by 4
+// rows of w, so that each vector we load is used several times.
+KALDI_QUANTIZATION_TARGET
+static void ComputeDotProducts(const uint8 *x, int32 num_x_rows,
+                               const int8 *w, int32 w_stride,
+                               int32 num_w_rows, int32 dim, int32 *dots) {
+  int32 dim_simd = dim - dim % 32, dim_rest = dim - dim_simd;
+  int32 o = 0;
+  for (; o + 4 <= num_w_rows; o += 4) {
+    const int8 *w0 = w + static_cast<size_t>(o) * w_stride,
+        *w1 = w0 + w_stride, *w2 = w1 + w_stride, *w3 = w2 + w_stride;
+    int32 r = 0;
+    for (; r + 2 <= num_x_rows; r += 2) {
+      const uint8 *x0 = x + static_cast<size_t>(r) * dim, *x1 = x0 + dim;
+      __m256i s00 = _mm256_setzero_si256(), s01 = s00, s02 = s00, s03 = s00,
+          s10 = s00, s11 = s00, s12 = s00, s13 = s00;
+      for (int32 j = 0; j < dim_simd; j += 32) {
+        __m256i vx0 = Load(x0 + j), vx1 = Load(x1 + j), vw = Load(w0 + j);
+        s00 = MultiplyAdd(s00, vx0, vw);
+        s10 = MultiplyAdd(s10, vx1, vw);
+        vw = Load(w1 + j);
+        s01 = MultiplyAdd(s01, vx0, vw);
+        s11 = MultiplyAdd(s11, vx1, vw);
+        vw = Load(w2 + j);
+        s02 = MultiplyAdd(s02, vx0, vw);
+        s12 = MultiplyAdd(s12, vx1, vw);
+        vw = Load(w3 + j);
+        s03 = MultiplyAdd(s03, vx0, vw);
+        s13 = MultiplyAdd(s13, vx1, vw);
+      }
+      const uint8 *x0_rest = x0 + dim_simd, *x1_rest = x1 + dim_simd;
+      int32 *d0 = dots + static_cast<size_t>(r) * num_w_rows + o,
+          *d1 = d0 + num_w_rows;
+      d0[0] = HorizontalSum(s00) +
+          DotProductSimple(x0_rest, w0 + dim_simd, dim_rest);
+      d0[1] = HorizontalSum(s01) +
+          DotProductSimple(x0_rest, w1 + dim_simd, dim_rest);
+      d0[2] = HorizontalSum(s02) +
+          DotProductSimple(x0_rest, w2 + dim_simd, dim_rest);
+      d0[3] = HorizontalSum(s03) +
+          DotProductSimple(x0_rest, w3 + dim_simd, dim_rest);
+      d1[0] = HorizontalSum(s10) +
+          DotProductSimple(x1_rest, w0 + dim_simd, dim_rest);
+      d1[1] = HorizontalSum(s11) +
+          DotProductSimple(x1_rest, w1 + dim_simd, dim_rest);
+      d1[2] = HorizontalSum(s12) +
+          DotProductSimple(x1_rest, w2 + dim_simd, dim_rest);
+      d1[3] = HorizontalSum(s13) +
+          DotProductSimple(x1_rest, w3 + dim_simd, dim_rest);
+    }
+    for (; r < num_x_rows; r++) {
+      const uint8 *x0 = x + static_cast<size_t>(r) * dim;
+      int32 *d0 = dots + static_cast<size_t>(r) * num_w_rows + o;
+      d0[0] = DotProduct(x0, w0, dim);
+      d0[1] = DotProduct(x0, w1, dim);
+      d0[2] = DotProduct(x0, w2, dim);
+      d0[3] = DotProduct(x0, w3, dim);
+    }
+  }
+  for (; o < num_w_rows; o++) {
+    const int8 *w0 = w + static_cast<size_t>(o) * w_stride;
+    for (int32 r = 0; r < num_x_rows; r++)
+      dots[static_cast<size_t>(r) * num_w_rows + o] =
+          DotProduct(x + static_cast<size_t>(r) * dim, w0, dim);
+  }
+  _mm256_zeroupper();
+}
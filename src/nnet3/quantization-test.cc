@@ -0,0 +1,118 @@
+// nnet3/quantization-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/quantization.h"
+#include "util/common-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+namespace quantization {
+
+
+void UnitTestQuantizedMatrix() {
+  int32 num_rows = RandInt(1, 20), num_cols = RandInt(1, 50);
+  Matrix<BaseFloat> M(num_rows, num_cols);
+  M.SetRandn();
+  M.Row(RandInt(0, num_rows - 1)).SetZero();
+  QuantizedMatrix Q(M);
+  KALDI_ASSERT(Q.NumRows() == num_rows && Q.NumCols() == num_cols);
+  Matrix<BaseFloat> M2(num_rows, num_cols);
+  Q.CopyToMat(&M2);
+  for (int32 i = 0; i < num_rows; i++) {
+    BaseFloat scale = Q.RowScales()(i);
+    for (int32 j = 0; j < num_cols; j++) {
+      KALDI_ASSERT(Q.RowData(i)[j] >= -127 && Q.RowData(i)[j] <= 127);
+      KALDI_ASSERT(std::abs(M(i, j) - M2(i, j)) <= 0.5001 * scale);
+    }
+  }
+
+  std::vector<int8> data(Q.Data());
+  QuantizedMatrix Q2;
+  Q2.Init(num_cols, Q.RowScales(), &data);
+  KALDI_ASSERT(Q2.Data() == Q.Data() &&
+               Q2.RowScales().ApproxEqual(Q.RowScales(), 0.0));
+}
+
+// Checks AddMatQuantizedMat() against a floating-point matrix multiplication
+// with the dequantized parameters, for each type of kernels that this CPU
+// supports.  The sizes are chosen to cover the different blocks and
+// remainders in the integer kernels.
+void UnitTestAddMatQuantizedMat() {
+  int32 num_rows = RandInt(1, 20), dim = RandInt(1, 100),
+      num_out = RandInt(1, 20), col_offset = RandInt(0, 10),
+      num_cols = col_offset + dim + RandInt(0, 10);
+  Matrix<BaseFloat> params(num_out, num_cols), in(num_rows, dim),
+      out(num_rows, num_out);
+  params.SetRandn();
+  in.SetRandn();
+  if (num_rows > 1)  // test the case where a row's scale is zero.
+    in.Row(RandInt(0, num_rows - 1)).SetZero();
+  out.SetRandn();
+  QuantizedMatrix quantized_params(params);
+  Matrix<BaseFloat> dequantized_params(num_out, num_cols);
+  quantized_params.CopyToMat(&dequantized_params);
+
+  Matrix<BaseFloat> product(num_rows, num_out), ref_out(out);
+  product.AddMatMat(1.0, in, kNoTrans,
+                    dequantized_params.ColRange(col_offset, dim), kTrans, 0.0);
+  ref_out.AddMat(1.0, product);
+
+  std::vector<QuantizedKernelType> kernel_types;
+  kernel_types.push_back(kNoQuantizedKernels);
+  if (GetQuantizedKernelType() != kNoQuantizedKernels) {
+    kernel_types.push_back(kAvx2Kernels);
+    if (GetQuantizedKernelType() != kAvx2Kernels)
+      kernel_types.push_back(GetQuantizedKernelType());
+  }
+  Matrix<BaseFloat> avx2_out;
+  for (size_t i = 0; i < kernel_types.size(); i++) {
+    Matrix<BaseFloat> out2(out);
+    AddMatQuantizedMat(in, quantized_params, col_offset, kernel_types[i],
+                       &out2);
+    if (kernel_types[i] == kAvx2Kernels) {
+      avx2_out = out2;
+    } else if (kernel_types[i] != kNoQuantizedKernels) {
+      // The VNNI kernels quantize the input in the same way as the AVX2
+      // ones, and integer arithmetic is exact, so they should agree exactly.
+      KALDI_ASSERT(out2.ApproxEqual(avx2_out, 0.0));
+    }
+    out2.AddMat(-1.0, ref_out);
+    BaseFloat relative_error = out2.FrobeniusNorm() / product.FrobeniusNorm();
+    KALDI_VLOG(2) << "Relative error with kernels of type "
+                  << QuantizedKernelTypeName(kernel_types[i]) << " is "
+                  << relative_error;
+    KALDI_ASSERT(relative_error < 0.05);
+  }
+}
+
+
+} // namespace quantization
+} // namespace nnet3
+} // namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3::quantization;
+  KALDI_LOG << "Integer kernels are of type "
+            << QuantizedKernelTypeName(GetQuantizedKernelType());
+  for (int32 i = 0; i < 100; i++) {
+    UnitTestQuantizedMatrix();
+    UnitTestAddMatQuantizedMat();
+  }
+  KALDI_LOG << "Tests succeeded.";
+}
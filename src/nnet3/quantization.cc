@@ -0,0 +1,383 @@
+// nnet3/quantization.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/quantization.h"
+#include "cudamatrix/cu-device.h"
+
+// The integer kernels are for x86 with AVX2, and the code that quantizes the
+// input assumes that BaseFloat is float.  We compile them with target
+// attributes, so they don't need -mavx2, and choose at runtime which ones the
+// CPU supports (see GetQuantizedKernelType()).  AVX-VNNI and AVX512-VNNI
+// need a recent enough compiler.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__)) && KALDI_DOUBLEPRECISION == 0
+#define KALDI_QUANTIZATION_X86 1
+#include <immintrin.h>
+#if defined(__clang__) ? __clang_major__ >= 16 : __GNUC__ >= 11
+#define KALDI_QUANTIZATION_AVXVNNI 1
+#endif
+#if defined(__clang__) ? __clang_major__ >= 8 : __GNUC__ >= 8
+#define KALDI_QUANTIZATION_AVX512VNNI 1
+#endif
+#endif
+
+namespace kaldi {
+namespace nnet3 {
+namespace quantization {
+
+
+void QuantizedMatrix::Init(const MatrixBase<BaseFloat> &M) {
+  num_rows_ = M.NumRows();
+  num_cols_ = M.NumCols();
+  data_.resize(static_cast<size_t>(num_rows_) * num_cols_);
+  row_scales_.Resize(num_rows_, kUndefined);
+  for (int32 i = 0; i < num_rows_; i++) {
+    SubVector<BaseFloat> row(M, i);
+    BaseFloat max_abs = (num_cols_ == 0 ? 0.0 :
+                         std::max(row.Max(), -row.Min())),
+        scale = max_abs / 127.0,
+        inv_scale = (scale == 0.0 ? 0.0 : 1.0 / scale);
+    row_scales_(i) = scale;
+    const BaseFloat *row_data = row.Data();
+    int8 *data = &(data_[static_cast<size_t>(i) * num_cols_]);
+    for (int32 j = 0; j < num_cols_; j++) {
+      BaseFloat value = std::floor(row_data[j] * inv_scale + 0.5);
+      data[j] = static_cast<int8>(std::max<BaseFloat>(
+          -127.0, std::min<BaseFloat>(127.0, value)));
+    }
+  }
+}
+
+void QuantizedMatrix::Init(int32 num_cols,
+                           const VectorBase<BaseFloat> &row_scales,
+                           std::vector<int8> *data) {
+  KALDI_ASSERT(num_cols >= 0 && data->size() ==
+               static_cast<size_t>(num_cols) * row_scales.Dim());
+  for (size_t i = 0; i < data->size(); i++)
+    if ((*data)[i] == -128)
+      KALDI_ERR << "Quantized parameters out of range.";
+  num_rows_ = row_scales.Dim();
+  num_cols_ = num_cols;
+  data_.swap(*data);
+  row_scales_ = row_scales;
+}
+
+void QuantizedMatrix::CopyToMat(MatrixBase<BaseFloat> *M) const {
+  KALDI_ASSERT(M->NumRows() == num_rows_ && M->NumCols() == num_cols_);
+  for (int32 i = 0; i < num_rows_; i++) {
+    BaseFloat *row_data = M->RowData(i), scale = row_scales_(i);
+    const int8 *data = RowData(i);
+    for (int32 j = 0; j < num_cols_; j++)
+      row_data[j] = scale * data[j];
+  }
+}
+
+
+static QuantizedKernelType DetectQuantizedKernelType() {
+#ifdef KALDI_QUANTIZATION_X86
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("avx2"))
+    return kNoQuantizedKernels;
+#ifdef KALDI_QUANTIZATION_AVXVNNI
+  if (__builtin_cpu_supports("avxvnni"))
+    return kAvxVnniKernels;
+#endif
+#ifdef KALDI_QUANTIZATION_AVX512VNNI
+  if (__builtin_cpu_supports("avx512vnni") &&
+      __builtin_cpu_supports("avx512vl"))
+    return kAvx512VnniKernels;
+#endif
+  return kAvx2Kernels;
+#else
+  return kNoQuantizedKernels;
+#endif
+}
+
+QuantizedKernelType GetQuantizedKernelType() {
+  static const QuantizedKernelType ans = DetectQuantizedKernelType();
+  return ans;
+}
+
+const char *QuantizedKernelTypeName(QuantizedKernelType type) {
+  switch (type) {
+    case kNoQuantizedKernels: return "none";
+    case kAvx2Kernels: return "AVX2";
+    case kAvxVnniKernels: return "AVX-VNNI";
+    case kAvx512VnniKernels: return "AVX512-VNNI";
+    default: KALDI_ERR << "Invalid kernel type " << static_cast<int>(type);
+  }
+  return NULL;
+}
+
+bool QuantizedKernelsAvailable() {
+  static bool logged = false;
+  if (!logged) {
+    logged = true;  // a race here would just mean we log twice.
+    KALDI_VLOG(1) << "Integer kernels for quantized components: "
+                  << QuantizedKernelTypeName(GetQuantizedKernelType());
+  }
+#if HAVE_CUDA == 1
+  if (CuDevice::Instantiate().Enabled())
+    return false;
+#endif
+  return GetQuantizedKernelType() != kNoQuantizedKernels;
+}
+
+
+static BaseFloat MaxAbsSimple(const BaseFloat *x, int32 dim) {
+  BaseFloat ans = 0.0;
+  for (int32 j = 0; j < dim; j++)
+    ans = std::max(ans, std::abs(x[j]));
+  return ans;
+}
+
+// Sets out[j] = 64 + max(-63, min(63, round(x[j] * inv_scale))).
+static void QuantizeRowSimple(const BaseFloat *x, int32 dim,
+                              BaseFloat inv_scale, uint8 *out) {
+  for (int32 j = 0; j < dim; j++) {
+    BaseFloat value = std::floor(x[j] * inv_scale + 0.5);
+    out[j] = static_cast<uint8>(64 + std::max<BaseFloat>(
+        -63.0, std::min<BaseFloat>(63.0, value)));
+  }
+}
+
+#ifdef KALDI_QUANTIZATION_X86
+
+// Like the kernels in quantization-kernels-inl.h, the AVX2 functions here end
+// with _mm256_zeroupper() so that the SSE code after them is not slowed down.
+
+// This does the same as MaxAbsSimple().
+__attribute__((target("avx2")))
+static BaseFloat MaxAbsAvx2(const BaseFloat *x, int32 dim) {
+  int32 dim_simd = dim - dim % 8;
+  __m256 sign_mask = _mm256_set1_ps(-0.0f), max = _mm256_setzero_ps();
+  for (int32 j = 0; j < dim_simd; j += 8)
+    max = _mm256_max_ps(max, _mm256_andnot_ps(sign_mask,
+                                              _mm256_loadu_ps(x + j)));
+  __m128 max4 = _mm_max_ps(_mm256_castps256_ps128(max),
+                           _mm256_extractf128_ps(max, 1));
+  max4 = _mm_max_ps(max4, _mm_movehl_ps(max4, max4));
+  max4 = _mm_max_ss(max4, _mm_shuffle_ps(max4, max4, 1));
+  BaseFloat ans = _mm_cvtss_f32(max4);
+  _mm256_zeroupper();
+  return std::max(ans, MaxAbsSimple(x + dim_simd, dim - dim_simd));
+}
+
+// This does the same as QuantizeRowSimple(), except that halfway cases may be
+// rounded differently.
+__attribute__((target("avx2")))
+static void QuantizeRowAvx2(const BaseFloat *x, int32 dim,
+                            BaseFloat inv_scale, uint8 *out) {
+  int32 dim_simd = dim - dim % 32;
+  __m256 scale = _mm256_set1_ps(inv_scale);
+  __m256i min = _mm256_set1_epi8(-63), max = _mm256_set1_epi8(63),
+      offset = _mm256_set1_epi8(64),
+      order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  for (int32 j = 0; j < dim_simd; j += 32) {
+    __m256i a = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + j),
+                                                 scale)),
+        b = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + j + 8),
+                                             scale)),
+        c = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + j + 16),
+                                             scale)),
+        d = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(x + j + 24),
+                                             scale));
+    // The packing instructions saturate, and work within 128-bit lanes, so
+    // we need to permute the result to get the original order.
+    __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(a, b),
+                                        _mm256_packs_epi32(c, d));
+    packed = _mm256_permutevar8x32_epi32(packed, order);
+    packed = _mm256_min_epi8(_mm256_max_epi8(packed, min), max);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j),
+                        _mm256_add_epi8(packed, offset));
+  }
+  _mm256_zeroupper();
+  QuantizeRowSimple(x + dim_simd, dim - dim_simd, inv_scale, out + dim_simd);
+}
+
+#endif  // KALDI_QUANTIZATION_X86
+
+// Quantizes each row of 'in' to integers q in the range [-63, 63] times a
+// scale, which is output to 'row_scales', and outputs q + 64 (which is in the
+// range [1, 127]) to 'quantized', row by row.  We add 64 because the AVX2
+// instructions multiply unsigned by signed bytes; it is subtracted again
+// in AddMatQuantizedMat().  (We use 7 bits rather than 8 so that the
+// instruction _mm256_maddubs_epi16, which adds pairs of products as 16-bit
+// integers, cannot saturate).  An extra row with all elements equal to 64 is
+// output at the end, which is what AddMatQuantizedMat() uses to subtract it.
+// If 'use_avx2' is true we use the AVX2 versions of the functions, which the
+// caller must have checked that the CPU supports.
+static void QuantizeInput(const MatrixBase<BaseFloat> &in,
+                          bool use_avx2,
+                          std::vector<uint8> *quantized,
+                          Vector<BaseFloat> *row_scales) {
+  int32 num_rows = in.NumRows(), num_cols = in.NumCols();
+  quantized->resize(static_cast<size_t>(num_rows + 1) * num_cols);
+  row_scales->Resize(num_rows, kUndefined);
+  for (int32 i = 0; i < num_rows; i++) {
+    const BaseFloat *row_data = in.RowData(i);
+    uint8 *quantized_row = &((*quantized)[static_cast<size_t>(i) * num_cols]);
+    BaseFloat max_abs;
+#ifdef KALDI_QUANTIZATION_X86
+    if (use_avx2)
+      max_abs = MaxAbsAvx2(row_data, num_cols);
+    else
+#endif
+      max_abs = MaxAbsSimple(row_data, num_cols);
+    BaseFloat scale = max_abs / 63.0,
+        inv_scale = (scale == 0.0 ? 0.0 : 1.0 / scale);
+    (*row_scales)(i) = scale;
+#ifdef KALDI_QUANTIZATION_X86
+    if (use_avx2)
+      QuantizeRowAvx2(row_data, num_cols, inv_scale, quantized_row);
+    else
+#endif
+      QuantizeRowSimple(row_data, num_cols, inv_scale, quantized_row);
+  }
+  std::fill(quantized->begin() + static_cast<size_t>(num_rows) * num_cols,
+            quantized->end(), 64);
+}
+
+
+// Returns the dot product of the vectors x and w of dimension 'dim'.
+static inline int32 DotProductSimple(const uint8 *x, const int8 *w,
+                                     int32 dim) {
+  int32 sum = 0;
+  for (int32 j = 0; j < dim; j++)
+    sum += static_cast<int32>(x[j]) * w[j];
+  return sum;
+}
+
+
+// Portable version of the ComputeDotProducts() functions in
+// quantization-kernels-inl.h; see the comment there.
+static void ComputeDotProductsSimple(const uint8 *x, int32 num_x_rows,
+                                     const int8 *w, int32 w_stride,
+                                     int32 num_w_rows, int32 dim,
+                                     int32 *dots) {
+  for (int32 r = 0; r < num_x_rows; r++)
+    for (int32 o = 0; o < num_w_rows; o++)
+      dots[static_cast<size_t>(r) * num_w_rows + o] = DotProductSimple(
+          x + static_cast<size_t>(r) * dim,
+          w + static_cast<size_t>(o) * w_stride, dim);
+}
+
+
+#ifdef KALDI_QUANTIZATION_X86
+
+namespace avx2 {
+#define KALDI_QUANTIZATION_TARGET __attribute__((target("avx2")))
+#include "nnet3/quantization-kernels-inl.h"
+#undef KALDI_QUANTIZATION_TARGET
+}  // namespace avx2
+
+#ifdef KALDI_QUANTIZATION_AVXVNNI
+namespace avxvnni {
+#define KALDI_QUANTIZATION_TARGET __attribute__((target("avx2,avxvnni")))
+#define KALDI_QUANTIZATION_DPBUSD _mm256_dpbusd_avx_epi32
+#include "nnet3/quantization-kernels-inl.h"
+#undef KALDI_QUANTIZATION_TARGET
+#undef KALDI_QUANTIZATION_DPBUSD
+}  // namespace avxvnni
+#endif
+
+#ifdef KALDI_QUANTIZATION_AVX512VNNI
+namespace avx512vnni {
+#define KALDI_QUANTIZATION_TARGET \
+  __attribute__((target("avx2,avx512vnni,avx512vl")))
+#define KALDI_QUANTIZATION_DPBUSD _mm256_dpbusd_epi32
+#include "nnet3/quantization-kernels-inl.h"
+#undef KALDI_QUANTIZATION_TARGET
+#undef KALDI_QUANTIZATION_DPBUSD
+}  // namespace avx512vnni
+#endif
+
+#endif  // KALDI_QUANTIZATION_X86
+
+
+void AddMatQuantizedMat(const MatrixBase<BaseFloat> &in,
+                        const QuantizedMatrix &params,
+                        int32 col_offset,
+                        MatrixBase<BaseFloat> *out) {
+  AddMatQuantizedMat(in, params, col_offset, GetQuantizedKernelType(), out);
+}
+
+void AddMatQuantizedMat(const MatrixBase<BaseFloat> &in,
+                        const QuantizedMatrix &params,
+                        int32 col_offset,
+                        QuantizedKernelType kernel_type,
+                        MatrixBase<BaseFloat> *out) {
+  int32 num_rows = in.NumRows(), dim = in.NumCols(),
+      num_out = params.NumRows();
+  KALDI_ASSERT(col_offset >= 0 && col_offset + dim <= params.NumCols() &&
+               out->NumRows() == num_rows && out->NumCols() == num_out);
+  // The dot products (of numbers up to 127) must fit in 32-bit integers.
+  KALDI_ASSERT(dim < 100000);
+  if (num_rows == 0 || num_out == 0 || dim == 0)
+    return;
+  std::vector<uint8> quantized_in;
+  Vector<BaseFloat> in_scales;
+  QuantizeInput(in, kernel_type != kNoQuantizedKernels, &quantized_in,
+                &in_scales);
+  std::vector<int32> dots(static_cast<size_t>(num_rows + 1) * num_out);
+  const uint8 *x = &(quantized_in[0]);
+  const int8 *w = params.RowData(0) + col_offset;
+  switch (kernel_type) {
+    case kNoQuantizedKernels:
+      ComputeDotProductsSimple(x, num_rows + 1, w, params.NumCols(), num_out,
+                               dim, &(dots[0]));
+      break;
+#ifdef KALDI_QUANTIZATION_X86
+    case kAvx2Kernels:
+      avx2::ComputeDotProducts(x, num_rows + 1, w, params.NumCols(), num_out,
+                               dim, &(dots[0]));
+      break;
+#ifdef KALDI_QUANTIZATION_AVXVNNI
+    case kAvxVnniKernels:
+      avxvnni::ComputeDotProducts(x, num_rows + 1, w, params.NumCols(),
+                                  num_out, dim, &(dots[0]));
+      break;
+#endif
+#ifdef KALDI_QUANTIZATION_AVX512VNNI
+    case kAvx512VnniKernels:
+      avx512vnni::ComputeDotProducts(x, num_rows + 1, w, params.NumCols(),
+                                     num_out, dim, &(dots[0]));
+      break;
+#endif
+#endif  // KALDI_QUANTIZATION_X86
+    default:
+      KALDI_ERR << "Integer kernels of type "
+                << QuantizedKernelTypeName(kernel_type)
+                << " were not compiled in.";
+  }
+  // The last row of 'dots' contains the dot products of the parameters with
+  // the 64 that QuantizeInput() added to the input.
+  const int32 *offset_dots = &(dots[static_cast<size_t>(num_rows) * num_out]);
+  const BaseFloat *params_scales = params.RowScales().Data();
+  for (int32 r = 0; r < num_rows; r++) {
+    BaseFloat in_scale = in_scales(r), *out_data = out->RowData(r);
+    const int32 *row_dots = &(dots[static_cast<size_t>(r) * num_out]);
+    for (int32 o = 0; o < num_out; o++)
+      out_data[o] += in_scale * params_scales[o] *
+          (row_dots[o] - offset_dots[o]);
+  }
+}
+
+
+} // namespace quantization
+} // namespace nnet3
+} // namespace kaldi
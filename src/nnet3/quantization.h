@@ -0,0 +1,135 @@
+// nnet3/quantization.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_QUANTIZATION_H_
+#define KALDI_NNET3_QUANTIZATION_H_
+
+#include <vector>
+#include "base/kaldi-common.h"
+#include "matrix/matrix-lib.h"
+
+namespace kaldi {
+namespace nnet3 {
+namespace quantization {
+
+/// @file  quantization.h
+///
+/// This file contains the lower-level code for 8-bit inference, which is used
+/// by QuantizedAffineComponent and QuantizedTimeHeightConvolutionComponent.
+/// The parameters are stored as 8-bit integers with a floating-point scale
+/// for each row (i.e. for each output dimension); the input is quantized to 7
+/// bits on the fly, with a scale for each row (i.e. for each frame), and the
+/// products are computed in integer arithmetic.
+///
+/// The integer kernels use AVX2 instructions, and the AVX-VNNI or AVX512-VNNI
+/// instructions if the CPU supports them.  They are compiled in on x86 with
+/// GCC or clang, in single precision, without needing special compiler flags;
+/// which of them to use is decided at runtime, see GetQuantizedKernelType().
+/// If the CPU doesn't support AVX2, or we are using a GPU, the components fall
+/// back to a normal floating-point matrix multiplication with the dequantized
+/// parameters; see QuantizedKernelsAvailable().
+
+
+/// A matrix of 8-bit integers in the range [-127, 127] with a floating-point
+/// scale for each row, representing the matrix whose (i, j)'th element is
+/// RowScales()(i) * RowData(i)[j].
+class QuantizedMatrix {
+ public:
+  QuantizedMatrix(): num_rows_(0), num_cols_(0) { }
+
+  /// Quantizes M; the largest absolute value of each row maps to 127.
+  explicit QuantizedMatrix(const MatrixBase<BaseFloat> &M) { Init(M); }
+
+  /// Quantizes M; the largest absolute value of each row maps to 127.
+  void Init(const MatrixBase<BaseFloat> &M);
+
+  /// Initializes from the integers 'data', which are in row-major order (we
+  /// take its contents), and the scales 'row_scales'.
+  void Init(int32 num_cols, const VectorBase<BaseFloat> &row_scales,
+            std::vector<int8> *data);
+
+  int32 NumRows() const { return num_rows_; }
+  int32 NumCols() const { return num_cols_; }
+  const int8 *RowData(int32 r) const {
+    return &(data_[static_cast<size_t>(r) * num_cols_]);
+  }
+  /// Returns the integers in row-major order.
+  const std::vector<int8> &Data() const { return data_; }
+  const Vector<BaseFloat> &RowScales() const { return row_scales_; }
+
+  /// Outputs the matrix this represents; M must have the right size.
+  void CopyToMat(MatrixBase<BaseFloat> *M) const;
+
+ private:
+  int32 num_rows_;
+  int32 num_cols_;
+  std::vector<int8> data_;
+  Vector<BaseFloat> row_scales_;
+};
+
+
+/// The types of integer kernels.  All except kNoQuantizedKernels need AVX2.
+enum QuantizedKernelType {
+  kNoQuantizedKernels,  // portable code, which is slow.
+  kAvx2Kernels,
+  kAvxVnniKernels,
+  kAvx512VnniKernels
+};
+
+/// Returns the fastest type of integer kernels that were compiled in and that
+/// this CPU supports; this is worked out the first time it is called.
+QuantizedKernelType GetQuantizedKernelType();
+
+/// Returns a name such as "AVX2" for printing.
+const char *QuantizedKernelTypeName(QuantizedKernelType type);
+
+/// Returns true if GetQuantizedKernelType() is not kNoQuantizedKernels and we
+/// are not using a GPU.  The callers of AddMatQuantizedMat() check this, and
+/// otherwise do the computation in floating point.  The first call prints the
+/// kernel type at verbose level 1.
+bool QuantizedKernelsAvailable();
+
+
+/// Does *out += in * P^T, where P is the sub-matrix of the columns
+/// [col_offset, col_offset + in.NumCols()) of the matrix that 'params'
+/// represents.  'in' is quantized to 7 bits with a scale for each row before
+/// multiplying, so this is approximate; the relative error of the result is
+/// typically about 1%.  This is portable, but only fast if
+/// QuantizedKernelsAvailable() returns true.
+void AddMatQuantizedMat(const MatrixBase<BaseFloat> &in,
+                        const QuantizedMatrix &params,
+                        int32 col_offset,
+                        MatrixBase<BaseFloat> *out);
+
+/// As AddMatQuantizedMat() above, but using the kernels of type
+/// 'kernel_type' rather than GetQuantizedKernelType(); this is for testing.
+/// The CPU must support them; kNoQuantizedKernels and, if
+/// GetQuantizedKernelType() is not kNoQuantizedKernels, kAvx2Kernels are
+/// always OK.
+void AddMatQuantizedMat(const MatrixBase<BaseFloat> &in,
+                        const QuantizedMatrix &params,
+                        int32 col_offset,
+                        QuantizedKernelType kernel_type,
+                        MatrixBase<BaseFloat> *out);
+
+
+} // namespace quantization
+} // namespace nnet3
+} // namespace kaldi
+
+
+#endif  // KALDI_NNET3_QUANTIZATION_H_
@@ -123,6 +123,8 @@ int main(int argc, char *argv[]) {
       // different utterances.
       CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
                                          decodable_opts.optimize_config);
+      if (!decodable_opts.computation_cache.empty())
+        compiler.ReadCacheFile(decodable_opts.computation_cache);
 
       RandomAccessBaseFloatMatrixReader online_ivector_reader(
           online_ivector_rspecifier);
@@ -195,6 +197,8 @@ int main(int argc, char *argv[]) {
                               &num_done, &num_err, &num_retry,
                               &tot_like, &frame_count, &per_frame_acwt_writer);
       }
+      if (!decodable_opts.computation_cache.empty())
+        compiler.WriteCacheFile(decodable_opts.computation_cache);
       KALDI_LOG << "Overall log-likelihood per frame is "
                 << (tot_like/frame_count)
                 << " over " << frame_count<< " frames.";
@@ -0,0 +1,103 @@
+// nnet3bin/nnet3-am-quantize.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-utils.h"
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Prepare an nnet3 acoustic model for test time and convert its\n"
+        "affine and linear components (AffineComponent,\n"
+        "NaturalGradientAffineComponent, LinearComponent and\n"
+        "FixedAffineComponent) to QuantizedAffineComponent, and its\n"
+        "TimeHeightConvolutionComponents to\n"
+        "QuantizedTimeHeightConvolutionComponent; these store the linear\n"
+        "parameters as 8-bit integers with a scale per row, and if the CPU\n"
+        "supports AVX2, do the forward computation in integer arithmetic.\n"
+        "This makes the model about 4 times smaller; the output of the\n"
+        "network changes slightly, so check the WER of the converted model.\n"
+        "The output cannot be trained further.  Batch-norm and dropout are\n"
+        "set to test mode and the model is collapsed first (as with\n"
+        "nnet3-am-copy --prepare-for-test=true), so that batch-norm scales\n"
+        "are included in the quantized parameters.\n"
+        "\n"
+        "Usage:  nnet3-am-quantize [options] <nnet-in> <nnet-out>\n"
+        "e.g.:\n"
+        " nnet3-am-quantize final.mdl final_quantized.mdl\n"
+        "See also: nnet3-am-copy\n";
+
+    bool binary_write = true,
+        raw = false;
+    std::string name_pattern = "*";
+
+    ParseOptions po(usage);
+    po.Register("binary", &binary_write, "Write output in binary mode");
+    po.Register("raw", &raw, "If true, write only 'raw' neural net "
+                "without transition model and priors.");
+    po.Register("name", &name_pattern, "Only convert components whose names "
+                "match this pattern, which may contain the wildcard '*'.");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string nnet_rxfilename = po.GetArg(1),
+        nnet_wxfilename = po.GetArg(2);
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+    }
+
+    SetBatchnormTestMode(true, &am_nnet.GetNnet());
+    SetDropoutTestMode(true, &am_nnet.GetNnet());
+    CollapseModel(CollapseModelConfig(), &am_nnet.GetNnet());
+
+    int32 num_quantized = QuantizeNnet(name_pattern, &am_nnet.GetNnet());
+    KALDI_LOG << "Converted " << num_quantized
+              << " components to quantized components.";
+
+    if (raw) {
+      WriteKaldiObject(am_nnet.GetNnet(), nnet_wxfilename, binary_write);
+    } else {
+      Output ko(nnet_wxfilename, binary_write);
+      trans_model.Write(ko.Stream(), binary_write);
+      am_nnet.Write(ko.Stream(), binary_write);
+    }
+    KALDI_LOG << "Quantized neural net from " << nnet_rxfilename
+              << " and wrote it to " << nnet_wxfilename;
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -22,6 +22,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-batch-compute.h"
 #include "base/timer.h"
 #include "nnet3/nnet-utils.h"
 
@@ -38,6 +39,9 @@ int main(int argc, char *argv[]) {
         "and write the output.\n"
         "If --apply-exp=true, apply the Exp() function to the output "
         "before writing it out.\n"
+        "If --minibatch-size is more than 1, chunks from several utterances\n"
+        "are evaluated together, which is faster; the output is written\n"
+        "in the same order as the input.\n"
         "\n"
         "Usage: nnet3-compute [options] <nnet-in> <features-rspecifier> <matrix-wspecifier>\n"
         " e.g.: nnet3-compute final.raw scp:feats.scp ark:nnet_prediction.ark\n"
@@ -46,8 +50,9 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     Timer timer;
 
-    NnetSimpleComputationOptions opts;
+    NnetBatchComputerOptions opts;
     opts.acoustic_scale = 1.0; // by default do no scaling in this recipe.
+    opts.minibatch_size = 1; // by default do no batching across utterances.
 
     bool apply_exp = false, use_priors = false;
     std::string use_gpu = "yes";
@@ -119,6 +124,12 @@ int main(int argc, char *argv[]) {
         ivector_rspecifier, utt2spk_rspecifier);
 
     CachingOptimizingCompiler compiler(nnet, opts.optimize_config);
+    NnetBatchInference *batch_inference = NULL;
+    if (opts.minibatch_size > 1)
+      batch_inference = new NnetBatchInference(opts, nnet, priors);
+    else if (!opts.computation_cache.empty())
+      // (NnetBatchInference deals with the cache itself).
+      compiler.ReadCacheFile(opts.computation_cache);
 
     BaseFloatMatrixWriter matrix_writer(matrix_wspecifier);
 
@@ -156,6 +167,21 @@ int main(int argc, char *argv[]) {
         }
       }
 
+      if (batch_inference != NULL) {
+        batch_inference->AcceptInput(utt, features, ivector, online_ivectors,
+                                     online_ivector_period);
+        std::string output_utt;
+        Matrix<BaseFloat> matrix;
+        while (batch_inference->GetOutput(&output_utt, &matrix)) {
+          if (apply_exp)
+            matrix.ApplyExp();
+          matrix_writer.Write(output_utt, matrix);
+        }
+        frame_count += features.NumRows();
+        num_success++;
+        continue;
+      }
+
       DecodableNnetSimple nnet_computer(
           opts, nnet, priors,
           features, &compiler,
@@ -178,6 +204,20 @@ int main(int argc, char *argv[]) {
       num_success++;
     }
 
+    if (batch_inference != NULL) {
+      batch_inference->Finished();
+      std::string output_utt;
+      Matrix<BaseFloat> matrix;
+      while (batch_inference->GetOutput(&output_utt, &matrix)) {
+        if (apply_exp)
+          matrix.ApplyExp();
+        matrix_writer.Write(output_utt, matrix);
+      }
+      delete batch_inference;
+    } else if (!opts.computation_cache.empty()) {
+      compiler.WriteCacheFile(opts.computation_cache);
+    }
+
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
 #endif
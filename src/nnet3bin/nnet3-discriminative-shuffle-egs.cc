@@ -20,6 +20,7 @@
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/table-shuffler.h"
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-discriminative-example.h"
 
@@ -34,6 +35,8 @@ int main(int argc, char *argv[]) {
         "Copy nnet3 discriminative training examples from the input to output,\n"
         "while randomly shuffling the order.  This program will keep all of the examples\n"
         "in memory at once, unless you use the --buffer-size option\n"
+        "(partial randomization) or --max-memory-mb (full randomization using\n"
+        "temporary files).\n"
         "\n"
         "Usage:  nnet3-discriminative-shuffle-egs [options] <egs-rspecifier> <egs-wspecifier>\n"
         "\n"
@@ -46,6 +49,8 @@ int main(int argc, char *argv[]) {
     po.Register("buffer-size", &buffer_size, "If >0, size of a buffer we use "
                 "to do limited-memory partial randomization.  Otherwise, do "
                 "full randomization.");
+    TableShufflerOptions shuffle_opts;
+    shuffle_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -55,6 +60,8 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    if (buffer_size != 0 && shuffle_opts.max_memory_mb > 0)
+      KALDI_ERR << "--buffer-size and --max-memory-mb cannot both be set.";
 
     std::string examples_rspecifier = po.GetArg(1),
         examples_wspecifier = po.GetArg(2);
@@ -66,15 +73,11 @@ int main(int argc, char *argv[]) {
     SequentialNnetDiscriminativeExampleReader example_reader(examples_rspecifier);
     NnetDiscriminativeExampleWriter example_writer(examples_wspecifier);
     if (buffer_size == 0) { // Do full randomization
-      // Putting in an extra level of indirection here to avoid excessive
-      // computation and memory demands when we have to resize the vector.
-
+      TableShuffler<KaldiObjectHolder<NnetDiscriminativeExample> > shuffler(
+          shuffle_opts, &example_writer);
       for (; !example_reader.Done(); example_reader.Next())
-        egs.push_back(std::pair<std::string, NnetDiscriminativeExample*>(
-            example_reader.Key(),
-            new NnetDiscriminativeExample(example_reader.Value())));
-
-      std::random_shuffle(egs.begin(), egs.end());
+        shuffler.Add(example_reader.Key(), example_reader.Value());
+      num_done = shuffler.Finish();
     } else {
       KALDI_ASSERT(buffer_size > 0);
       egs.resize(buffer_size,
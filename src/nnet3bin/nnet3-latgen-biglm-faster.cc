@@ -0,0 +1,311 @@
+// nnet3bin/nnet3-latgen-biglm-faster.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "tree/context-dep.h"
+#include "hmm/transition-model.h"
+#include "fstext/fstext-lib.h"
+#include "fstext/kaldi-fst-io.h"
+#include "decoder/decoder-wrappers.h"
+#include "lm/const-arpa-lm.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-utils.h"
+#include "base/timer.h"
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+    using fst::SymbolTable;
+    using fst::Fst;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Generate lattices using nnet3 neural net model, composing the\n"
+        "decoding graph with the language model on the fly, so that HCLG\n"
+        "never has to be built for a big language model.  <fst-in> is HCL,\n"
+        "i.e. the decoding graph built without G (with self-loops added, and\n"
+        "without disambiguation symbols), and <lm-in> is G: an FST or, with\n"
+        "--use-const-arpa=true, a const-arpa LM (see arpa-to-const-arpa),\n"
+        "which can handle LMs much larger than is practical as an FST.\n"
+        "Before decoding we add label-lookahead weights to HCL (see\n"
+        "PushLookaheadWeights() in fstext/deterministic-fst.h): the LM cost\n"
+        "of the cheapest word reachable from each state is applied in\n"
+        "advance, so that pruning stays effective.  This doesn't change the\n"
+        "scores of complete paths.\n"
+        "Alternatively, with --old-lm=<fst>, <fst-in> is an HCLG compiled\n"
+        "with a small LM (e.g. a heavily pruned one), whose scores act as the\n"
+        "look-ahead; as each word is decoded, its score under the small LM is\n"
+        "subtracted and its score under <lm-in> is added (as in\n"
+        "gmm-latgen-biglm-faster).\n"
+        "\n"
+        "Usage: nnet3-latgen-biglm-faster [options] <nnet-in> <fst-in> \\\n"
+        "          <lm-in> <features-rspecifier> <lattice-wspecifier> \\\n"
+        "          [ <words-wspecifier> [<alignments-wspecifier>] ]\n"
+        "e.g.: nnet3-latgen-biglm-faster --use-const-arpa=true final.mdl \\\n"
+        "    graph/HCL.fst data/lang_big/G.carpa ark:feats.ark ark:lat.ark\n"
+        " or: nnet3-latgen-biglm-faster --old-lm=data/lang_small/G.fst \\\n"
+        "    final.mdl graph_small/HCLG.fst data/lang_big/G.fst \\\n"
+        "    ark:feats.ark ark:lat.ark\n";
+    ParseOptions po(usage);
+    Timer timer;
+    bool allow_partial = false;
+    bool use_const_arpa = false;
+    std::string old_lm_fst_rxfilename;
+    LatticeBiglmFasterDecoderConfig config;
+    NnetSimpleComputationOptions decodable_opts;
+
+    std::string word_syms_filename;
+    std::string ivector_rspecifier,
+        online_ivector_rspecifier,
+        utt2spk_rspecifier;
+    int32 online_ivector_period = 0;
+    config.Register(&po);
+    decodable_opts.Register(&po);
+    po.Register("word-symbol-table", &word_syms_filename,
+                "Symbol table for words [for debug output]");
+    po.Register("allow-partial", &allow_partial,
+                "If true, produce output even if end state was not reached.");
+    po.Register("use-const-arpa", &use_const_arpa, "If true, read <lm-in> "
+                "as a const-arpa file as opposed to an FST file");
+    po.Register("old-lm", &old_lm_fst_rxfilename, "If set, the LM (as an FST) "
+                "that <fst-in> was compiled with, in which case <fst-in> is "
+                "HCLG and we replace the scores of this LM with those of "
+                "<lm-in>.  If not set, <fst-in> is HCL.");
+    po.Register("ivectors", &ivector_rspecifier, "Rspecifier for "
+                "iVectors as vectors (i.e. not estimated online); per "
+                "utterance by default, or per speaker if you provide the "
+                "--utt2spk option.");
+    po.Register("utt2spk", &utt2spk_rspecifier, "Rspecifier for "
+                "utt2spk option used to get ivectors per speaker");
+    po.Register("online-ivectors", &online_ivector_rspecifier,
+                "Rspecifier for iVectors estimated online, as matrices.  If "
+                "you supply this, you must set the --online-ivector-period "
+                "option.");
+    po.Register("online-ivector-period", &online_ivector_period,
+                "Number of frames between iVectors in matrices supplied to "
+                "the --online-ivectors option");
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() < 5 || po.NumArgs() > 7) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        fst_in_filename = po.GetArg(2),
+        lm_rxfilename = po.GetArg(3),
+        feature_rspecifier = po.GetArg(4),
+        lattice_wspecifier = po.GetArg(5),
+        words_wspecifier = po.GetOptArg(6),
+        alignment_wspecifier = po.GetOptArg(7);
+
+    if (ClassifyRspecifier(fst_in_filename, NULL, NULL) != kNoRspecifier)
+      KALDI_ERR << "This program expects a single decoding graph, not a table "
+                << "of them: " << fst_in_filename;
+
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    KALDI_LOG << "Reading LMs...";
+    // ReadAndPrepareLmFst() projects on the output, removing the
+    // disambiguation symbols, and sorts the arcs.
+    VectorFst<StdArc> *old_lm_fst = NULL;
+    fst::BackoffDeterministicOnDemandFst<StdArc> *old_lm_dfst = NULL;
+    if (!old_lm_fst_rxfilename.empty()) {
+      old_lm_fst = fst::ReadAndPrepareLmFst(old_lm_fst_rxfilename);
+      ApplyProbabilityScale(-1.0, old_lm_fst); // Negate old LM probs...
+      old_lm_dfst = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+          *old_lm_fst);
+    }
+
+    VectorFst<StdArc> *lm_fst = NULL;
+    fst::BackoffDeterministicOnDemandFst<StdArc> *lm_backoff_dfst = NULL;
+    ConstArpaLm const_arpa;
+    if (use_const_arpa) {
+      const_arpa.ReadMapped(lm_rxfilename);
+    } else {
+      lm_fst = fst::ReadAndPrepareLmFst(lm_rxfilename);
+      lm_backoff_dfst =
+          new fst::BackoffDeterministicOnDemandFst<StdArc>(*lm_fst);
+    }
+    KALDI_LOG << "Done.";
+
+    bool determinize = config.determinize_lattice;
+    CompactLatticeWriter compact_lattice_writer;
+    LatticeWriter lattice_writer;
+    if (! (determinize ? compact_lattice_writer.Open(lattice_wspecifier)
+           : lattice_writer.Open(lattice_wspecifier)))
+      KALDI_ERR << "Could not open table for writing lattices: "
+                 << lattice_wspecifier;
+
+    RandomAccessBaseFloatMatrixReader online_ivector_reader(
+        online_ivector_rspecifier);
+    RandomAccessBaseFloatVectorReaderMapped ivector_reader(
+        ivector_rspecifier, utt2spk_rspecifier);
+
+    Int32VectorWriter words_writer(words_wspecifier);
+    Int32VectorWriter alignment_writer(alignment_wspecifier);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_filename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_filename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                   << word_syms_filename;
+
+    double tot_like = 0.0;
+    kaldi::int64 frame_count = 0;
+    int num_success = 0, num_fail = 0;
+    // this compiler object allows caching of computations across
+    // different utterances.
+    CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                       decodable_opts.optimize_config);
+    if (!decodable_opts.computation_cache.empty())
+      compiler.ReadCacheFile(decodable_opts.computation_cache);
+
+    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    Fst<StdArc> *decode_fst = fst::ReadFstKaldiGeneric(fst_in_filename);
+    if (old_lm_dfst == NULL) {
+      // <fst-in> is HCL; we need a VectorFst to add the look-ahead weights.
+      VectorFst<StdArc> *hcl_fst = new VectorFst<StdArc>(*decode_fst);
+      delete decode_fst;
+      ConstArpaLmDeterministicFst *lm_carpa_dfst =
+          (use_const_arpa ? new ConstArpaLmDeterministicFst(const_arpa) :
+           NULL);
+      fst::DeterministicOnDemandFst<StdArc> *lm_dfst =
+          (use_const_arpa ?
+           static_cast<fst::DeterministicOnDemandFst<StdArc>*>(
+               lm_carpa_dfst) : lm_backoff_dfst);
+      fst::PushLookaheadWeights(lm_dfst, hcl_fst);
+      delete lm_carpa_dfst;
+      decode_fst = hcl_fst;
+    }
+    timer.Reset();
+
+    for (; !feature_reader.Done(); feature_reader.Next()) {
+      std::string utt = feature_reader.Key();
+      const Matrix<BaseFloat> &features (feature_reader.Value());
+      if (features.NumRows() == 0) {
+        KALDI_WARN << "Zero-length utterance: " << utt;
+        num_fail++;
+        continue;
+      }
+      const Matrix<BaseFloat> *online_ivectors = NULL;
+      const Vector<BaseFloat> *ivector = NULL;
+      if (!ivector_rspecifier.empty()) {
+        if (!ivector_reader.HasKey(utt)) {
+          KALDI_WARN << "No iVector available for utterance " << utt;
+          num_fail++;
+          continue;
+        } else {
+          ivector = &ivector_reader.Value(utt);
+        }
+      }
+      if (!online_ivector_rspecifier.empty()) {
+        if (!online_ivector_reader.HasKey(utt)) {
+          KALDI_WARN << "No online iVector available for utterance " << utt;
+          num_fail++;
+          continue;
+        } else {
+          online_ivectors = &online_ivector_reader.Value(utt);
+        }
+      }
+
+      // The composed LM FST (and ConstArpaLmDeterministicFst) remember every
+      // LM state they have seen, so to stop the memory growing with time we
+      // reconstruct them, and hence the decoder, for each utterance.
+      ConstArpaLmDeterministicFst *lm_carpa_dfst =
+          (use_const_arpa ? new ConstArpaLmDeterministicFst(const_arpa) :
+           NULL);
+      fst::DeterministicOnDemandFst<StdArc> *lm_dfst =
+          (use_const_arpa ?
+           static_cast<fst::DeterministicOnDemandFst<StdArc>*>(
+               lm_carpa_dfst) : lm_backoff_dfst);
+      fst::ComposeDeterministicOnDemandFst<StdArc> *compose_dfst =
+          (old_lm_dfst != NULL ?
+           new fst::ComposeDeterministicOnDemandFst<StdArc>(old_lm_dfst,
+                                                            lm_dfst) : NULL);
+      fst::CacheDeterministicOnDemandFst<StdArc> cache_dfst(
+          compose_dfst != NULL ?
+          static_cast<fst::DeterministicOnDemandFst<StdArc>*>(compose_dfst) :
+          lm_dfst);
+
+      LatticeBiglmFasterDecoder decoder(*decode_fst, config, &cache_dfst);
+
+      DecodableAmNnetSimple nnet_decodable(
+          decodable_opts, trans_model, am_nnet,
+          features, ivector, online_ivectors,
+          online_ivector_period, &compiler);
+
+      double like;
+      if (DecodeUtteranceLatticeFaster(
+              decoder, nnet_decodable, trans_model, word_syms, utt,
+              decodable_opts.acoustic_scale, determinize, allow_partial,
+              &alignment_writer, &words_writer, &compact_lattice_writer,
+              &lattice_writer, &like)) {
+        tot_like += like;
+        frame_count += nnet_decodable.NumFramesReady();
+        num_success++;
+      } else num_fail++;
+      delete compose_dfst;
+      delete lm_carpa_dfst;
+    }
+    delete decode_fst;
+    delete old_lm_dfst;
+    delete old_lm_fst;
+    delete lm_backoff_dfst;
+    delete lm_fst;
+
+    if (!decodable_opts.computation_cache.empty())
+      compiler.WriteCacheFile(decodable_opts.computation_cache);
+
+    kaldi::int64 input_frame_count =
+        frame_count * decodable_opts.frame_subsampling_factor;
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken "<< elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed * 100.0 / input_frame_count);
+    KALDI_LOG << "Done " << num_success << " utterances, failed for "
+              << num_fail;
+    KALDI_LOG << "Overall log-likelihood per frame is "
+              << (tot_like / frame_count) << " over "
+              << frame_count << " frames.";
+
+    delete word_syms;
+    if (num_success != 0) return 0;
+    else return 1;
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
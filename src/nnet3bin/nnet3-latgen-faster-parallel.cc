@@ -19,18 +19,85 @@
 // limitations under the License.
 
 
+#include <list>
 #include "base/timer.h"
 #include "base/kaldi-common.h"
+#include "decoder/decodable-matrix.h"
 #include "decoder/decoder-wrappers.h"
 #include "fstext/fstext-lib.h"
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/nnet-batch-compute.h"
 #include "nnet3/nnet-utils.h"
 #include "util/kaldi-thread.h"
 #include "tree/context-dep.h"
 #include "util/common-utils.h"
 
 
+namespace kaldi {
+namespace nnet3 {
+
+// The things that are the same for all the utterances we decode: the
+// options, the model, the outputs and the totals that the decoding tasks
+// update.
+struct DecodeTaskInfo {
+  const TransitionModel *trans_model;
+  const fst::SymbolTable *word_syms;
+  BaseFloat acoustic_scale;
+  bool determinize;
+  bool allow_partial;
+  Int32VectorWriter *alignment_writer;
+  Int32VectorWriter *words_writer;
+  CompactLatticeWriter *compact_lattice_writer;
+  LatticeWriter *lattice_writer;
+  double *tot_like;
+  int64 *frame_count;
+  int32 *num_success;
+  int32 *num_fail;
+
+  // Returns a task that decodes utterance 'utt'; the task takes ownership of
+  // 'decoder' and 'decodable'.
+  DecodeUtteranceLatticeFasterClass *NewTask(
+      const std::string &utt,
+      LatticeFasterDecoder *decoder,
+      DecodableInterface *decodable) const {
+    return new DecodeUtteranceLatticeFasterClass(
+        decoder, decodable, *trans_model, word_syms, utt, acoustic_scale,
+        determinize, allow_partial, alignment_writer, words_writer,
+        compact_lattice_writer, lattice_writer, tot_like, frame_count,
+        num_success, num_fail, NULL);
+  }
+};
+
+// This is used in --minibatch-size mode.  It takes each utterance whose
+// neural net output is ready from 'inference' and gives it to 'sequencer' to
+// decode, using the decoder that was created for it when it was read (these
+// are in 'decoders', in the same order as the utterances).
+void DecodeReadyUtterances(
+    const DecodeTaskInfo &info,
+    NnetBatchInference *inference,
+    std::list<LatticeFasterDecoder*> *decoders,
+    TaskSequencer<DecodeUtteranceLatticeFasterClass> *sequencer) {
+  std::string utt;
+  Matrix<BaseFloat> *loglikes = new Matrix<BaseFloat>();
+  while (inference->GetOutput(&utt, loglikes)) {
+    KALDI_ASSERT(!decoders->empty());
+    LatticeFasterDecoder *decoder = decoders->front();
+    decoders->pop_front();
+    // The acoustic scale was already applied by 'inference'; this
+    // constructor takes ownership of 'loglikes'.
+    DecodableInterface *nnet_decodable = new DecodableMatrixScaledMapped(
+        *info.trans_model, 1.0, loglikes);
+    sequencer->Run(info.NewTask(utt, decoder, nnet_decodable));
+    // 'sequencer' takes ownership of the task, and will delete it when done.
+    loglikes = new Matrix<BaseFloat>();
+  }
+  delete loglikes;
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
+
 
 int main(int argc, char *argv[]) {
   // note: making this program work with GPUs is as simple as initializing the
@@ -47,14 +114,19 @@ int main(int argc, char *argv[]) {
     const char *usage =
         "Generate lattices using nnet3 neural net model.\n"
         "Usage: nnet3-latgen-faster-parallel [options] <nnet-in> <fst-in|fsts-rspecifier> <features-rspecifier>"
-        " <lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n";
+        " <lattice-wspecifier> [ <words-wspecifier> [<alignments-wspecifier>] ]\n"
+        "If --minibatch-size is more than 1, the neural net is evaluated in the\n"
+        "main thread on chunks from several utterances at once, and the\n"
+        "decoding is done in --num-threads background threads.\n";
     ParseOptions po(usage);
 
     Timer timer;
     bool allow_partial = false;
     TaskSequencerConfig sequencer_config; // has --num-threads option
     LatticeFasterDecoderConfig config;
-    NnetSimpleComputationOptions decodable_opts;
+    NnetBatchComputerOptions decodable_opts;
+    decodable_opts.minibatch_size = 1; // by default do no batching across
+                                       // utterances.
 
     std::string word_syms_filename;
     std::string ivector_rspecifier,
@@ -92,7 +164,6 @@ int main(int argc, char *argv[]) {
         words_wspecifier = po.GetOptArg(5),
         alignment_wspecifier = po.GetOptArg(6);
 
-    TaskSequencer<DecodeUtteranceLatticeFasterClass> sequencer(sequencer_config);
     TransitionModel trans_model;
     AmNnetSimple am_nnet;
     {
@@ -104,6 +175,17 @@ int main(int argc, char *argv[]) {
       SetDropoutTestMode(true, &(am_nnet.GetNnet()));
       CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
     }
+    // This compiler is shared by the decoding threads, so computations are
+    // cached across utterances.  (In --minibatch-size mode, NnetBatchInference
+    // uses its own compiler, which also handles --computation-cache).
+    CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                       decodable_opts.optimize_config,
+                                       decodable_opts.compiler_config);
+    if (decodable_opts.minibatch_size <= 1 &&
+        !decodable_opts.computation_cache.empty())
+      compiler.ReadCacheFile(decodable_opts.computation_cache);
+    // Declared after 'am_nnet' and 'compiler' because the tasks use them.
+    TaskSequencer<DecodeUtteranceLatticeFasterClass> sequencer(sequencer_config);
 
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
@@ -131,6 +213,30 @@ int main(int argc, char *argv[]) {
     kaldi::int64 frame_count = 0;
     int num_success = 0, num_fail = 0;
 
+    DecodeTaskInfo task_info;
+    task_info.trans_model = &trans_model;
+    task_info.word_syms = word_syms;
+    task_info.acoustic_scale = decodable_opts.acoustic_scale;
+    task_info.determinize = determinize;
+    task_info.allow_partial = allow_partial;
+    task_info.alignment_writer = &alignment_writer;
+    task_info.words_writer = &words_writer;
+    task_info.compact_lattice_writer = &compact_lattice_writer;
+    task_info.lattice_writer = &lattice_writer;
+    task_info.tot_like = &tot_like;
+    task_info.frame_count = &frame_count;
+    task_info.num_success = &num_success;
+    task_info.num_fail = &num_fail;
+
+    NnetBatchInference *batch_inference = NULL;
+    // in --minibatch-size mode, the decoders for utterances whose neural net
+    // output is not yet ready, in order.
+    std::list<LatticeFasterDecoder*> pending_decoders;
+    if (decodable_opts.minibatch_size > 1)
+      batch_inference = new NnetBatchInference(decodable_opts,
+                                               am_nnet.GetNnet(),
+                                               am_nnet.Priors());
+
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
 
@@ -171,24 +277,31 @@ int main(int argc, char *argv[]) {
           LatticeFasterDecoder *decoder =
               new LatticeFasterDecoder(*decode_fst, config);
 
+          if (batch_inference != NULL) {
+            batch_inference->AcceptInput(utt, features, ivector,
+                                         online_ivectors,
+                                         online_ivector_period);
+            pending_decoders.push_back(decoder);
+            DecodeReadyUtterances(task_info, batch_inference,
+                                  &pending_decoders, &sequencer);
+            continue;
+          }
+
           DecodableInterface *nnet_decodable = new
               DecodableAmNnetSimpleParallel(
                   decodable_opts, trans_model, am_nnet,
                   features, ivector, online_ivectors,
-                  online_ivector_period);
-
-          DecodeUtteranceLatticeFasterClass *task =
-              new DecodeUtteranceLatticeFasterClass(
-                  decoder, nnet_decodable, // takes ownership of these two.
-                  trans_model, word_syms, utt, decodable_opts.acoustic_scale,
-                  determinize, allow_partial, &alignment_writer, &words_writer,
-                   &compact_lattice_writer, &lattice_writer,
-                   &tot_like, &frame_count, &num_success, &num_fail, NULL);
-
-          sequencer.Run(task); // takes ownership of "task",
-                               // and will delete it when done.
+                  online_ivector_period, &compiler);
+
+          // takes ownership of "task", and will delete it when done.
+          sequencer.Run(task_info.NewTask(utt, decoder, nnet_decodable));
         }
       }
+      if (batch_inference != NULL) {
+        batch_inference->Finished();
+        DecodeReadyUtterances(task_info, batch_inference, &pending_decoders,
+                              &sequencer);
+      }
       sequencer.Wait(); // Waits for all tasks to be done.
       delete decode_fst;
     } else { // We have different FSTs for different utterances.
@@ -235,25 +348,36 @@ int main(int argc, char *argv[]) {
         LatticeFasterDecoder *decoder =
             new LatticeFasterDecoder(config, fst_reader.Value().Copy());
 
+        if (batch_inference != NULL) {
+          batch_inference->AcceptInput(utt, features, ivector,
+                                       online_ivectors,
+                                       online_ivector_period);
+          pending_decoders.push_back(decoder);
+          DecodeReadyUtterances(task_info, batch_inference,
+                                &pending_decoders, &sequencer);
+          continue;
+        }
+
         DecodableInterface *nnet_decodable = new
             DecodableAmNnetSimpleParallel(
                 decodable_opts, trans_model, am_nnet,
                 features, ivector, online_ivectors,
-                online_ivector_period);
-
-        DecodeUtteranceLatticeFasterClass *task =
-            new DecodeUtteranceLatticeFasterClass(
-                decoder, nnet_decodable, // takes ownership of these two.
-                trans_model, word_syms, utt, decodable_opts.acoustic_scale,
-                determinize, allow_partial, &alignment_writer, &words_writer,
-                &compact_lattice_writer, &lattice_writer,
-                &tot_like, &frame_count, &num_success, &num_fail, NULL);
-
-        sequencer.Run(task); // takes ownership of "task",
-        // and will delete it when done.
+                online_ivector_period, &compiler);
+
+        // takes ownership of "task", and will delete it when done.
+        sequencer.Run(task_info.NewTask(utt, decoder, nnet_decodable));
+      }
+      if (batch_inference != NULL) {
+        batch_inference->Finished();
+        DecodeReadyUtterances(task_info, batch_inference, &pending_decoders,
+                              &sequencer);
       }
       sequencer.Wait(); // Waits for all tasks to be done.
     }
+    delete batch_inference;
+    if (decodable_opts.minibatch_size <= 1 &&
+        !decodable_opts.computation_cache.empty())
+      compiler.WriteCacheFile(decodable_opts.computation_cache);
 
     kaldi::int64 input_frame_count =
         frame_count * decodable_opts.frame_subsampling_factor;
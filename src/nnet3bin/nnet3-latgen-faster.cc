@@ -130,6 +130,8 @@ int main(int argc, char *argv[]) {
     // different utterances.
     CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
                                        decodable_opts.optimize_config);
+    if (!decodable_opts.computation_cache.empty())
+      compiler.ReadCacheFile(decodable_opts.computation_cache);
 
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
       SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
@@ -248,6 +250,9 @@ int main(int argc, char *argv[]) {
       }
     }
 
+    if (!decodable_opts.computation_cache.empty())
+      compiler.WriteCacheFile(decodable_opts.computation_cache);
+
     kaldi::int64 input_frame_count =
         frame_count * decodable_opts.frame_subsampling_factor;
 
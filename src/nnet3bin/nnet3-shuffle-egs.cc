@@ -20,6 +20,7 @@
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/table-shuffler.h"
 #include "hmm/transition-model.h"
 #include "nnet3/nnet-example.h"
 
@@ -34,7 +35,8 @@ int main(int argc, char *argv[]) {
         "Copy examples (typically single frames or small groups of frames) for\n"
         "neural network training, from the input to output, but randomly shuffle the order.\n"
         "This program will keep all of the examples in memory at once, unless you\n"
-        "use the --buffer-size option\n"
+        "use the --buffer-size option (partial randomization) or --max-memory-mb\n"
+        "(full randomization using temporary files).\n"
         "\n"
         "Usage:  nnet3-shuffle-egs [options] <egs-rspecifier> <egs-wspecifier>\n"
         "\n"
@@ -47,6 +49,8 @@ int main(int argc, char *argv[]) {
     po.Register("buffer-size", &buffer_size, "If >0, size of a buffer we use "
                 "to do limited-memory partial randomization.  Otherwise, do "
                 "full randomization.");
+    TableShufflerOptions shuffle_opts;
+    shuffle_opts.Register(&po);
 
     po.Read(argc, argv);
 
@@ -56,6 +60,8 @@ int main(int argc, char *argv[]) {
       po.PrintUsage();
       exit(1);
     }
+    if (buffer_size != 0 && shuffle_opts.max_memory_mb > 0)
+      KALDI_ERR << "--buffer-size and --max-memory-mb cannot both be set.";
 
     std::string examples_rspecifier = po.GetArg(1),
         examples_wspecifier = po.GetArg(2);
@@ -67,14 +73,11 @@ int main(int argc, char *argv[]) {
     SequentialNnetExampleReader example_reader(examples_rspecifier);
     NnetExampleWriter example_writer(examples_wspecifier);
     if (buffer_size == 0) { // Do full randomization
-      // Putting in an extra level of indirection here to avoid excessive
-      // computation and memory demands when we have to resize the vector.
-
+      TableShuffler<KaldiObjectHolder<NnetExample> > shuffler(
+          shuffle_opts, &example_writer);
       for (; !example_reader.Done(); example_reader.Next())
-        egs.push_back(std::make_pair(example_reader.Key(),
-                                    new NnetExample(example_reader.Value())));
-
-      std::random_shuffle(egs.begin(), egs.end());
+        shuffler.Add(example_reader.Key(), example_reader.Value());
+      num_done = shuffler.Finish();
     } else {
       KALDI_ASSERT(buffer_size > 0);
       egs.resize(buffer_size,
@@ -135,6 +135,8 @@ int main(int argc, char *argv[]) {
     CollapseModel(CollapseModelConfig(), &nnet);
 
     CachingOptimizingCompiler compiler(nnet, opts.optimize_config, compiler_config);
+    if (!opts.computation_cache.empty())
+      compiler.ReadCacheFile(opts.computation_cache);
 
     BaseFloatVectorWriter vector_writer(vector_wspecifier);
 
@@ -213,6 +215,8 @@ int main(int argc, char *argv[]) {
       frame_count += features.NumRows();
       num_success++;
     }
+    if (!opts.computation_cache.empty())
+      compiler.WriteCacheFile(opts.computation_cache);
 
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
@@ -174,22 +174,31 @@ void OnlineIvectorFeature::UpdateFrameWeights(
   delta_weights_provided_ = true;
 }
 
-void OnlineIvectorFeature::UpdateStatsForFrame(int32 t,
-                                               BaseFloat weight) {
-  int32 feat_dim = lda_normalized_->Dim();
-  Vector<BaseFloat> feat(feat_dim),  // features given to iVector extractor
-      log_likes(info_.diag_ubm.NumGauss());
-  lda_normalized_->GetFrame(t, &feat);
-  info_.diag_ubm.LogLikelihoods(feat, &log_likes);
-  // "posterior" stores the pruned posteriors for Gaussians in the UBM.
-  std::vector<std::pair<int32, BaseFloat> > posterior;
-  tot_ubm_loglike_ += weight *
-      VectorToPosteriorEntry(log_likes, info_.num_gselect,
-                             info_.min_post, &posterior);
-  for (size_t i = 0; i < posterior.size(); i++)
-    posterior[i].second *= info_.posterior_scale * weight;
-  lda_->GetFrame(t, &feat); // get feature without CMN.
-  ivector_stats_.AccStats(info_.extractor, feat, posterior);
+void OnlineIvectorFeature::UpdateStatsForFrames(
+    const std::vector<std::pair<int32, BaseFloat> > &frame_weights) {
+  int32 num_frames = frame_weights.size();
+  if (num_frames == 0)
+    return;
+  std::vector<int32> frames(num_frames);
+  for (int32 i = 0; i < num_frames; i++)
+    frames[i] = frame_weights[i].first;
+  // features given to iVector extractor
+  Matrix<BaseFloat> feats(num_frames, lda_normalized_->Dim(), kUndefined),
+      log_likes;
+  lda_normalized_->GetFrames(frames, &feats);
+  info_.diag_ubm.LogLikelihoods(feats, &log_likes);
+  lda_->GetFrames(frames, &feats);  // get features without CMN.
+  for (int32 i = 0; i < num_frames; i++) {
+    BaseFloat weight = frame_weights[i].second;
+    // "posterior" stores the pruned posteriors for Gaussians in the UBM.
+    std::vector<std::pair<int32, BaseFloat> > posterior;
+    tot_ubm_loglike_ += weight *
+        VectorToPosteriorEntry(log_likes.Row(i), info_.num_gselect,
+                               info_.min_post, &posterior);
+    for (size_t j = 0; j < posterior.size(); j++)
+      posterior[j].second *= info_.posterior_scale * weight;
+    ivector_stats_.AccStats(info_.extractor, feats.Row(i), posterior);
+  }
 }
 
 void OnlineIvectorFeature::UpdateStatsUntilFrame(int32 frame) {
@@ -200,9 +209,21 @@ void OnlineIvectorFeature::UpdateStatsUntilFrame(int32 frame) {
   int32 ivector_period = info_.ivector_period;
   int32 num_cg_iters = info_.num_cg_iters;
 
-  for (; num_frames_stats_ <= frame; num_frames_stats_++) {
+  std::vector<std::pair<int32, BaseFloat> > frame_weights;
+  while (num_frames_stats_ <= frame) {
+    // We accumulate stats for the frames up to the next one where we have to
+    // estimate the iVector, all at once.
     int32 t = num_frames_stats_;
-    UpdateStatsForFrame(t, 1.0);
+    if (info_.use_most_recent_ivector)
+      t = frame;
+    else
+      t = std::min(frame, ((t + ivector_period - 1) / ivector_period) *
+                   ivector_period);
+    frame_weights.clear();
+    for (; num_frames_stats_ <= t; num_frames_stats_++)
+      frame_weights.push_back(
+          std::pair<int32, BaseFloat>(num_frames_stats_, 1.0));
+    UpdateStatsForFrames(frame_weights);
     if ((!info_.use_most_recent_ivector && t % ivector_period == 0) ||
         (info_.use_most_recent_ivector && t == frame)) {
       ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
@@ -229,19 +250,21 @@ void OnlineIvectorFeature::UpdateStatsUntilFrameWeighted(int32 frame) {
     int32 t = num_frames_stats_;
     // Instead of just updating frame t, we update all frames that need updating
     // with index <= 1, in case old frames were reclassified as silence/nonsilence.
+    std::vector<std::pair<int32, BaseFloat> > frame_weights;
     while (!delta_weights_.empty() &&
            delta_weights_.top().first <= t) {
       std::pair<int32, BaseFloat> p = delta_weights_.top();
       delta_weights_.pop();
+      frame_weights.push_back(p);
       int32 frame = p.first;
       BaseFloat weight = p.second;
-      UpdateStatsForFrame(frame, weight);
       if (debug_weights) {
         if (current_frame_weight_debug_.size() <= frame)
           current_frame_weight_debug_.resize(frame + 1, 0.0);
         current_frame_weight_debug_[frame] += weight;
       }
     }
+    UpdateStatsForFrames(frame_weights);
     if ((!info_.use_most_recent_ivector && t % ivector_period == 0) ||
         (info_.use_most_recent_ivector && t == frame)) {
       ivector_stats_.GetIvector(num_cg_iters, &current_ivector_);
@@ -311,9 +311,12 @@ class OnlineIvectorFeature: public OnlineFeatureInterface {
       const std::vector<std::pair<int32, BaseFloat> > &delta_weights);
   
  private:
-  // this function adds "weight" to the stats for frame "frame".
-  void UpdateStatsForFrame(int32 frame,
-                           BaseFloat weight);
+  // this function adds "weight" to the stats for frame "frame", for each
+  // (frame, weight) pair in 'frame_weights'.  The features for all the frames
+  // are obtained with one call to GetFrames(), and the UBM log-likelihoods are
+  // computed for all of them at once.
+  void UpdateStatsForFrames(
+      const std::vector<std::pair<int32, BaseFloat> > &frame_weights);
 
   // This is the original UpdateStatsUntilFrame that is called when there is
   // no data-weighting involved.
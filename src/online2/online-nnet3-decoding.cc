@@ -29,8 +29,10 @@ SingleUtteranceNnet3Decoder::SingleUtteranceNnet3Decoder(
     const TransitionModel &trans_model,
     const nnet3::DecodableNnetSimpleLoopedInfo &info,
     const fst::Fst<fst::StdArc> &fst,
-    OnlineNnet2FeaturePipeline *features):
+    OnlineNnet2FeaturePipeline *features,
+    const IncrementalDeterminizeConfig &incremental_opts):
     decoder_opts_(decoder_opts),
+    incremental_opts_(incremental_opts),
     input_feature_frame_shift_in_seconds_(features->FrameShiftInSeconds()),
     trans_model_(trans_model),
     decodable_(trans_model_, info,
@@ -39,6 +41,23 @@ SingleUtteranceNnet3Decoder::SingleUtteranceNnet3Decoder(
   decoder_.InitDecoding();
 }
 
+SingleUtteranceNnet3Decoder::SingleUtteranceNnet3Decoder(
+    const LatticeFasterDecoderConfig &decoder_opts,
+    const TransitionModel &trans_model,
+    nnet3::NnetMultiStreamLoopedComputer *computer,
+    const fst::Fst<fst::StdArc> &fst,
+    OnlineNnet2FeaturePipeline *features,
+    const IncrementalDeterminizeConfig &incremental_opts):
+    decoder_opts_(decoder_opts),
+    incremental_opts_(incremental_opts),
+    input_feature_frame_shift_in_seconds_(features->FrameShiftInSeconds()),
+    trans_model_(trans_model),
+    decodable_(trans_model_, computer,
+               features->InputFeature(), features->IvectorFeature()),
+    decoder_(fst, decoder_opts_) {
+  decoder_.InitDecoding();
+}
+
 void SingleUtteranceNnet3Decoder::AdvanceDecoding() {
   decoder_.AdvanceDecoding(&decodable_);
 }
@@ -52,15 +71,20 @@ int32 SingleUtteranceNnet3Decoder::NumFramesDecoded() const {
 }
 
 void SingleUtteranceNnet3Decoder::GetLattice(bool end_of_utterance,
-                                             CompactLattice *clat) const {
+                                             CompactLattice *clat) {
   if (NumFramesDecoded() == 0)
     KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
-  Lattice raw_lat;
-  decoder_.GetRawLattice(&raw_lat, end_of_utterance);
-
   if (!decoder_opts_.determinize_lattice)
     KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
 
+  if (incremental_opts_.incremental_determinize) {
+    decoder_.GetLatticeIncremental(trans_model_, incremental_opts_,
+                                   end_of_utterance, clat);
+    return;
+  }
+  Lattice raw_lat;
+  decoder_.GetRawLattice(&raw_lat, end_of_utterance);
+
   BaseFloat lat_beam = decoder_opts_.lattice_beam;
   DeterminizeLatticePhonePrunedWrapper(
       trans_model_, &raw_lat, lat_beam, clat, decoder_opts_.det_opts);
@@ -50,12 +50,30 @@ class SingleUtteranceNnet3Decoder {
  public:
 
   // Constructor. The pointer 'features' is not being given to this class to own
-  // and deallocate, it is owned externally.
+  // and deallocate, it is owned externally.  'incremental_opts' is only
+  // needed if you want the lattice to be determinized incrementally (see
+  // GetLattice()).
   SingleUtteranceNnet3Decoder(const LatticeFasterDecoderConfig &decoder_opts,
                               const TransitionModel &trans_model,
                               const nnet3::DecodableNnetSimpleLoopedInfo &info,
                               const fst::Fst<fst::StdArc> &fst,
-                              OnlineNnet2FeaturePipeline *features);
+                              OnlineNnet2FeaturePipeline *features,
+                              const IncrementalDeterminizeConfig
+                              &incremental_opts =
+                              IncrementalDeterminizeConfig());
+
+  // Constructor for when the neural net computation is shared with other
+  // decoders (e.g. the concurrent streams of a server) through 'computer',
+  // which must outlive this object and is not thread-safe: all decoders that
+  // share it must be driven from the same thread.
+  SingleUtteranceNnet3Decoder(const LatticeFasterDecoderConfig &decoder_opts,
+                              const TransitionModel &trans_model,
+                              nnet3::NnetMultiStreamLoopedComputer *computer,
+                              const fst::Fst<fst::StdArc> &fst,
+                              OnlineNnet2FeaturePipeline *features,
+                              const IncrementalDeterminizeConfig
+                              &incremental_opts =
+                              IncrementalDeterminizeConfig());
 
   /// advance the decoding as far as we can.
   void AdvanceDecoding();
@@ -71,9 +89,13 @@ class SingleUtteranceNnet3Decoder {
   /// (which will typically be desirable in an online-decoding context); if you
   /// want an un-scaled lattice, scale it using ScaleLattice() with the inverse
   /// of the acoustic weight.  "end_of_utterance" will be true if you want the
-  /// final-probs to be included.
+  /// final-probs to be included.  If the constructor was given
+  /// --incremental-determinize=true, the lattice is determinized incrementally
+  /// (see LatticeFasterOnlineDecoder::GetLatticeIncremental()), so that
+  /// calling this repeatedly on a long utterance stays cheap; this is why it
+  /// is not const.
   void GetLattice(bool end_of_utterance,
-                  CompactLattice *clat) const;
+                  CompactLattice *clat);
 
   /// Outputs an FST corresponding to the single best path through the current
   /// lattice. If "use_final_probs" is true AND we reached the final-state of
@@ -94,6 +116,8 @@ class SingleUtteranceNnet3Decoder {
 
   const LatticeFasterDecoderConfig &decoder_opts_;
 
+  IncrementalDeterminizeConfig incremental_opts_;
+
   // this is remembered from the constructor; it's ultimately
   // derived from calling FrameShiftInSeconds() on the feature pipeline.
   BaseFloat input_feature_frame_shift_in_seconds_;
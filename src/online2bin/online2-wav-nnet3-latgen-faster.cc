@@ -102,6 +102,7 @@ int main(int argc, char *argv[]) {
     OnlineNnet2FeaturePipelineConfig feature_opts;
     nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
     LatticeFasterDecoderConfig decoder_opts;
+    IncrementalDeterminizeConfig incremental_opts;
     OnlineEndpointConfig endpoint_opts;
 
     BaseFloat chunk_length_secs = 0.18;
@@ -130,6 +131,7 @@ int main(int argc, char *argv[]) {
     feature_opts.Register(&po);
     decodable_opts.Register(&po);
     decoder_opts.Register(&po);
+    incremental_opts.Register(&po);
     endpoint_opts.Register(&po);
 
 
@@ -218,7 +220,8 @@ int main(int argc, char *argv[]) {
 
         SingleUtteranceNnet3Decoder decoder(decoder_opts, trans_model,
                                             decodable_info,
-                                            *decode_fst, &feature_pipeline);
+                                            *decode_fst, &feature_pipeline,
+                                            incremental_opts);
         OnlineTimer decoding_timer(utt);
 
         BaseFloat samp_freq = wave_data.SampFreq();
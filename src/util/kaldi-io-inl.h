@@ -35,7 +35,7 @@ bool Input::IsOpen() {
   return impl_ != NULL;
 }
 
-bool Output::IsOpen() {
+bool Output::IsOpen() const {
   return impl_ != NULL;
 }
 
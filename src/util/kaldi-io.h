@@ -139,8 +139,9 @@ class Output {
   /// closing the old stream failed it will throw).
   bool Open(const std::string &wxfilename, bool binary, bool write_header);
 
-  inline bool IsOpen();  // return true if we have an open stream.  Does not
-  // imply stream is good for writing.
+  // return true if we have an open stream.  Does not imply stream is good for
+  // writing.
+  inline bool IsOpen() const;
 
   std::ostream &Stream();  // will throw if not open; else returns stream.
 
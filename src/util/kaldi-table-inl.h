@@ -24,8 +24,13 @@
 #define KALDI_UTIL_KALDI_TABLE_INL_H_
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 #include <errno.h>
@@ -696,8 +701,19 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
   } state_;
 };
 
-// this is for when someone adds the 'th' modifier; it wraps around the basic
-// implementation and allows it to do the reading in a background thread.
+// this is for when someone adds the 'bg' modifier; it wraps around the basic
+// implementation and does the reading in a background thread, which reads
+// ahead by up to 'queue_size' objects (the 'bg=N' modifier sets the queue
+// size; plain 'bg' means 1).  Note that the reading thread also does the
+// parsing of the objects (e.g. decompression of compressed matrices when
+// reading a Matrix), so all the consumer thread has to do is a shallow swap.
+//
+// The queue is a ring of queue_size + 1 slots: the consumer owns the slot
+// that holds the current object, and the reading thread may fill up to
+// queue_size slots ahead of it.  empty_sem_ counts the slots the reading
+// thread may fill and full_sem_ counts the filled slots not yet taken by the
+// consumer.  The end of the input (or an error) is marked by a slot with an
+// empty key.
 template<class Holder>
 class SequentialTableReaderBackgroundImpl:
       public SequentialTableReaderImplBase<Holder> {
@@ -705,8 +721,16 @@ class SequentialTableReaderBackgroundImpl:
   typedef typename Holder::T T;
 
   SequentialTableReaderBackgroundImpl(
-      SequentialTableReaderImplBase<Holder> *base_reader):
-      base_reader_(base_reader) {}
+      SequentialTableReaderImplBase<Holder> *base_reader,
+      const std::string &rspecifier,
+      int32 queue_size):
+      base_reader_(base_reader), rspecifier_(rspecifier),
+      slots_(queue_size + 1), empty_sem_(queue_size), consumer_pos_(0),
+      have_object_(false), at_end_(false), stop_(false), error_(false),
+      num_ready_(0), num_takes_(0), tot_queue_depth_(0),
+      num_consumer_waits_(0), num_producer_waits_(0) {
+    KALDI_ASSERT(queue_size > 0);
+  }
 
   // This function ignores the rxfilename argument.
   // We use the same function signature as the regular Open(),
@@ -714,13 +738,9 @@ class SequentialTableReaderBackgroundImpl:
   virtual bool Open(const std::string &rxfilename) {
     KALDI_ASSERT(base_reader_ != NULL &&
                  base_reader_->IsOpen());  // or code error.
-    {
-      thread_ = std::thread(SequentialTableReaderBackgroundImpl<Holder>::run,
-                            this);
-    }
-
-    if (!base_reader_->Done())
-      Next();
+    thread_ = std::thread(SequentialTableReaderBackgroundImpl<Holder>::run,
+                          this);
+    Next();
     return true;
   }
 
@@ -731,92 +751,107 @@ class SequentialTableReaderBackgroundImpl:
   }
 
   void RunInBackground() {
-    try {
-      // This function is called in the background thread.  The whole point of
-      // the background thread is that we don't want to do the actual reading
-      // (inside Next()) in the foreground.
-      while (base_reader_ != NULL && !base_reader_->Done()) {
-        consumer_sem_.Signal();
-        // Here is where the consumer process (parent thread) gets to do its
-        // stuff.  Principally it calls SwapHolder()-- a shallow swap that is
-        // cheap.
-        producer_sem_.Wait();
-        // we check that base_reader_ is not NULL in case Close() was
-        // called in the main thread.
-        if (base_reader_ != NULL)
-          base_reader_->Next();   //  here is where the work happens.
+    // This function is called in the background thread.  The whole point of
+    // the background thread is that we don't want to do the actual reading
+    // (inside Next()) in the foreground.
+    size_t producer_pos = 0;
+    while (true) {
+      if (!empty_sem_.TryWait()) {
+        num_producer_waits_++;  // the queue is full: the consumer is slower.
+        empty_sem_.Wait();
       }
-      // this signal will be waited on in the Next() function of the foreground
-      // thread if it is still running, or Close() otherwise.
-      consumer_sem_.Signal();
-      // this signal may be waited on in Close().
-      consumer_sem_.Signal();
-    } catch (...) {
-      // There is nothing we called above that could potentially throw due to
-      // user data.  So we treat reaching this point as a code-error condition.
-      // Closing base_reader_ will trigger an exception in Next() in the main
-      // thread when it checks that base_reader_->IsOpen().
-      if (base_reader_->IsOpen()) {
-        base_reader_->Close();
-        delete base_reader_;
-        base_reader_ = NULL;
+      if (stop_)  // Close() was called in the main thread.
+        return;
+      Slot &slot = slots_[producer_pos];
+      bool done = true;
+      try {
+        done = base_reader_->Done();
+        if (!done) {
+          slot.key = base_reader_->Key();
+          base_reader_->SwapHolder(&slot.holder);
+          base_reader_->Next();   //  here is where the work happens.
+        }
+      } catch (...) {
+        // There is nothing we called above that could potentially throw due to
+        // user data.  So we treat reaching this point as a code-error
+        // condition, which will be reported by Next() in the main thread.
+        error_ = true;
+        done = true;
       }
-      consumer_sem_.Signal();
-      return;
+      if (done)
+        slot.key = "";  // marks the end of the input.
+      num_ready_++;
+      full_sem_.Signal();
+      if (done)
+        return;
+      producer_pos = (producer_pos + 1) % slots_.size();
     }
   }
   static void run(SequentialTableReaderBackgroundImpl<Holder> *object) {
     object->RunInBackground();
   }
   virtual bool Done() const {
-    return key_.empty();
+    return !have_object_;
   }
   virtual std::string Key() {
-    if (key_.empty())
+    if (!have_object_)
       KALDI_ERR << "Calling Key() at the wrong time.";
-    return key_;
+    return slots_[consumer_pos_].key;
   }
   virtual T &Value() {
-    if (key_.empty())
+    if (!have_object_)
       KALDI_ERR << "Calling Value() at the wrong time.";
-    return holder_.Value();
+    return slots_[consumer_pos_].holder.Value();
   }
   void SwapHolder(Holder *other_holder) {
     KALDI_ERR << "SwapHolder() should not be called on this class.";
   }
   virtual void FreeCurrent() {
-    if (key_.empty())
+    if (!have_object_)
       KALDI_ERR << "Calling FreeCurrent() at the wrong time.";
     // note: ideally a call to Value() should crash if you have just called
     // FreeCurrent().  For typical holders such as KaldiObjectHolder this will
     // happen inside the holder_.Value() call.  This won't be the case for all
     // holders, but it's not a great loss (just a missed opportunity to spot a
     // code error).
-    holder_.Clear();
+    slots_[consumer_pos_].holder.Clear();
   }
   virtual void Next() {
-    consumer_sem_.Wait();
-    if (base_reader_ == NULL || !base_reader_->IsOpen())
+    if (at_end_)
+      KALDI_ERR << "Next() called on TableReader that was done.";
+    if (have_object_) {
+      // give the current slot back to the reading thread.
+      slots_[consumer_pos_].holder.Clear();
+      consumer_pos_ = (consumer_pos_ + 1) % slots_.size();
+      empty_sem_.Signal();
+    }
+    num_takes_++;
+    tot_queue_depth_ += num_ready_;
+    if (!full_sem_.TryWait()) {
+      num_consumer_waits_++;  // the queue is empty: the reading is slower.
+      full_sem_.Wait();
+    }
+    num_ready_--;
+    have_object_ = !slots_[consumer_pos_].key.empty();
+    at_end_ = !have_object_;
+    // The reading thread sets error_ before it queues the end marker, so we
+    // only report the error once the objects read before it are used up.
+    if (at_end_ && error_)
       KALDI_ERR << "Error detected (likely code error) in background "
                 << "reader (',bg' option)";
-    if (base_reader_->Done()) {
-      // there is nothing else to read.
-      key_ = "";
-    } else {
-      key_ = base_reader_->Key();
-      base_reader_->SwapHolder(&holder_);
-    }
-    // this Signal() tells the producer thread, in the background,
-    // that it's now safe to read the next value.
-    producer_sem_.Signal();
   }
 
   // note: we can be sure that Close() won't be called twice, as the TableReader
   // object will delete this object after calling Close.
   virtual bool Close() {
     KALDI_ASSERT(base_reader_ != NULL && thread_.joinable());
-    // wait until the producer thread is idle.
-    consumer_sem_.Wait();
+    // Stop the reading thread if it has not already finished; it checks stop_
+    // after waiting for an empty slot, so this Signal() wakes it up if it was
+    // waiting.
+    stop_ = true;
+    empty_sem_.Signal();
+    thread_.join();
+    PrintStats();
     bool ans = true;
     try {
       ans = base_reader_->Close();
@@ -824,12 +859,7 @@ class SequentialTableReaderBackgroundImpl:
       ans = false;
     }
     delete base_reader_;
-    // setting base_reader_ to NULL will cause the loop in the producer thread
-    // to exit.
     base_reader_ = NULL;
-    producer_sem_.Signal();
-
-    thread_.join();
     return ans;
   }
   ~SequentialTableReaderBackgroundImpl() {
@@ -841,16 +871,52 @@ class SequentialTableReaderBackgroundImpl:
     }
   }
  private:
-  std::string key_;
-  Holder holder_;
-  // I couldn't figure out what to call these semaphores.  consumer_sem_ is the
-  // one that the consumer (main thread) waits on; producer_sem_ is the one
-  // that the producer (background thread) waits on.
-  Semaphore consumer_sem_;
-  Semaphore producer_sem_;
-  std::thread thread_;
-  SequentialTableReaderImplBase<Holder> *base_reader_;
+  // Prints (at verbose level 1) statistics that tell us whether the reading or
+  // the processing of the objects was the bottleneck.  If the consumer often
+  // had to wait for the reading thread, the program is I/O-bound and a larger
+  // queue will not help; if the queue was usually full, the reading is keeping
+  // up.
+  void PrintStats() const {
+    if (num_takes_ == 0)
+      return;
+    int32 queue_size = static_cast<int32>(slots_.size()) - 1;
+    KALDI_VLOG(1) << "Background reader for " << rspecifier_
+                  << " (queue size " << queue_size
+                  << "): average queue depth was "
+                  << (tot_queue_depth_ / static_cast<double>(num_takes_))
+                  << "; the program waited for input " << num_consumer_waits_
+                  << " out of " << num_takes_ << " times, and the reader "
+                  << "waited for the program " << num_producer_waits_
+                  << " times.";
+  }
+
+  struct Slot {
+    std::string key;  // empty if this slot marks the end of the input.
+    Holder holder;
+  };
 
+  SequentialTableReaderImplBase<Holder> *base_reader_;
+  std::string rspecifier_;  // only used in the statistics message.
+  std::vector<Slot> slots_;
+  // empty_sem_ is the one that the producer (background thread) waits on, for
+  // a slot to fill; full_sem_ is the one that the consumer (main thread) waits
+  // on, for a filled slot.
+  Semaphore empty_sem_;
+  Semaphore full_sem_;
+  std::thread thread_;
+  size_t consumer_pos_;  // the slot of the current object, if have_object_.
+  bool have_object_;
+  bool at_end_;  // true once we have taken the end-of-input slot.
+  std::atomic<bool> stop_;  // set by Close() to stop the reading thread.
+  std::atomic<bool> error_;  // set by the reading thread on error.
+
+  // statistics.
+  std::atomic<int32> num_ready_;  // number of filled slots not yet consumed.
+  int64 num_takes_;  // number of slots taken by the consumer.
+  int64 tot_queue_depth_;
+  int64 num_consumer_waits_;
+  int64 num_producer_waits_;  // only accessed by the reading thread before
+                              // thread_.join().
 };
 
 template<class Holder>
@@ -887,7 +953,7 @@ bool SequentialTableReader<Holder>::Open(const std::string &rspecifier) {
   }
   if (opts.background) {
     impl_ = new SequentialTableReaderBackgroundImpl<Holder>(
-        impl_);
+        impl_, rspecifier, opts.background_queue_size);
     if (!impl_->Open("")) {
       // the rxfilename is ignored in that Open() call.
       // It should only return false on code error.
@@ -1017,6 +1083,11 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
 
     if (output_.Open(archive_wxfilename_, opts_.binary, false)) {  // false
                                                       // means no binary header.
+      if (opts_.indexed && !index_writer_.Open(archive_wxfilename_)) {
+        output_.Close();  // Don't care about status: error anyway.
+        state_ = kUninitialized;
+        return false;
+      }
       state_ = kOpen;
       return true;
     } else {
@@ -1052,13 +1123,22 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     // state is now kOpen or kWriteError.
     if (!IsToken(key))  // e.g. empty string or has spaces...
       KALDI_ERR << "Using invalid key " << key;
-    output_.Stream() << key << ' ';
-    if (!Holder::Write(output_.Stream(), opts_.binary, value)) {
+    std::ostream &os = output_.Stream();
+    os << key << ' ';
+    // offset of the object, only needed for the index.
+    int64 offset = (opts_.indexed ? static_cast<int64>(os.tellp()) : 0);
+    if (!Holder::Write(os, opts_.binary, value)) {
       KALDI_WARN << "Write failure to "
                  << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
       return false;
     }
+    if (opts_.indexed &&
+        !index_writer_.Write(key, offset,
+                             static_cast<int64>(os.tellp()) - offset)) {
+      state_ = kWriteError;
+      return false;
+    }
     if (state_ == kWriteError) return false;  // Even if this Write seems to
     // have succeeded, we fail because a previous Write failed and the archive
     // may be corrupted and unreadable.
@@ -1084,7 +1164,17 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     if (!this->IsOpen() || !output_.IsOpen())
       KALDI_ERR << "Close called on a stream that was not open."
                 << this->IsOpen() << ", " << output_.IsOpen();
+    int64 archive_size = (opts_.indexed ?
+                          static_cast<int64>(output_.Stream().tellp()) : 0);
     bool close_success = output_.Close();
+    if (opts_.indexed) {
+      // Only complete the index if the archive is complete; otherwise
+      // readers will reject it.
+      if (close_success && state_ == kOpen)
+        close_success = index_writer_.Close(archive_size);
+      else
+        index_writer_.Abort();
+    }
     if (!close_success) {
       KALDI_WARN << "Error closing stream: wspecifier is " << wspecifier_;
       state_ = kUninitialized;
@@ -1112,6 +1202,7 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
 
  private:
   Output output_;
+  ArchiveIndexWriter index_writer_;  // only used if opts_.indexed.
   WspecifierOptions opts_;
   std::string wspecifier_;
   std::string archive_wxfilename_;
@@ -1324,6 +1415,12 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
       state_ = kUninitialized;
       return false;
     }
+    if (opts_.indexed && !index_writer_.Open(archive_wxfilename_)) {
+      archive_output_.Close();
+      script_output_.Close();
+      state_ = kUninitialized;
+      return false;
+    }
     state_ = kOpen;
     return true;
   }
@@ -1388,6 +1485,15 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
       return false;
     }
 
+    if (opts_.indexed) {
+      int64 offset = static_cast<int64>(archive_os_pos);
+      int64 length = static_cast<int64>(archive_os.tellp()) - offset;
+      if (!index_writer_.Write(key, offset, length)) {
+        state_ = kWriteError;
+        return false;
+      }
+    }
+
     if (script_os.fail()) {
       KALDI_WARN << "Write failure to script file detected: "
                  << PrintableWxfilename(script_wxfilename_);
@@ -1428,10 +1534,19 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
     if (!this->IsOpen())
       KALDI_ERR << "Close called on a stream that was not open.";
     bool close_success = true;
+    int64 archive_size = 0;
+    if (opts_.indexed && archive_output_.IsOpen())
+      archive_size = static_cast<int64>(archive_output_.Stream().tellp());
     if (archive_output_.IsOpen())
       if (!archive_output_.Close()) close_success = false;
     if (script_output_.IsOpen())
       if (!script_output_.Close()) close_success = false;
+    if (opts_.indexed) {
+      if (close_success && state_ == kOpen)
+        close_success = index_writer_.Close(archive_size);
+      else
+        index_writer_.Abort();
+    }
     bool ans = close_success && (state_ != kWriteError);
     state_ = kUninitialized;
     return ans;
@@ -1451,6 +1566,7 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
  private:
   Output archive_output_;
   Output script_output_;
+  ArchiveIndexWriter index_writer_;  // only used if opts_.indexed.
   WspecifierOptions opts_;
   std::string archive_wxfilename_;
   std::string script_wxfilename_;
@@ -1463,6 +1579,180 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
 };
 
 
+// This is for when someone adds the 'async' modifier to the wspecifier; it
+// wraps around one of the other implementations and does the writing in a
+// background thread, so that the program does not have to wait for slow file
+// systems.  Write() copies the object into a queue of up to 'queue_size'
+// objects ('async=N' sets the queue size), and only blocks if the queue is
+// full.  The background thread writes the objects to the underlying writer,
+// which does the actual serialization.  If the 'f' (flush) modifier was given
+// we only flush when the queue becomes empty, rather than after every object.
+//
+// Errors in the background thread are reported by the next call to Write() and
+// by Close(), which waits until all queued objects have been written.
+//
+// This requires the object type to have an accessible copy constructor;
+// TableWriter::Open() refuses the 'async' modifier for other types (e.g.
+// AmDiagGmm), and the copy is done via CopyObject() so that the class still
+// compiles for them.
+template<class Holder>
+class TableWriterBackgroundImpl: public TableWriterImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  // Takes ownership of 'base_writer', which must already be open and must not
+  // flush after each object, as we take care of that.
+  TableWriterBackgroundImpl(TableWriterImplBase<Holder> *base_writer,
+                            int32 queue_size, bool flush):
+      base_writer_(base_writer), queue_size_(queue_size), flush_(flush),
+      busy_(false), closing_(false), error_(false) {
+    KALDI_ASSERT(queue_size > 0);
+  }
+
+  // This function ignores the wspecifier argument (the base writer was opened
+  // already); we use the same function signature as the regular Open(), for
+  // convenience.
+  virtual bool Open(const std::string &wspecifier) {
+    KALDI_ASSERT(base_writer_ != NULL && base_writer_->IsOpen());
+    thread_ = std::thread(TableWriterBackgroundImpl<Holder>::run, this);
+    return true;
+  }
+
+  virtual bool IsOpen() const {
+    // Close() sets base_writer_ to NULL.
+    return base_writer_ != NULL;
+  }
+
+  virtual bool Write(const std::string &key, const T &value) {
+    if (base_writer_ == NULL)
+      KALDI_ERR << "Write called on invalid stream";
+    if (!IsToken(key))  // e.g. empty string or has spaces...
+      KALDI_ERR << "Using invalid key " << key;
+    if (error_) {
+      // the user should have known from the last call to Write() that there
+      // was a problem.
+      KALDI_WARN << "Attempting to write to invalid stream.";
+      return false;
+    }
+    // copy outside the lock.
+    T *copy = CopyObject(value, std::is_copy_constructible<T>());
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (queue_.size() >= static_cast<size_t>(queue_size_))
+      space_cond_.wait(lock);
+    queue_.push_back(std::pair<std::string, T*>(key, copy));
+    work_cond_.notify_one();
+    return !error_;
+  }
+
+  // Waits until everything in the queue has been written, and then flushes the
+  // underlying writer.
+  virtual void Flush() {
+    WaitUntilIdle();
+    base_writer_->Flush();  // safe, as the background thread is idle.
+  }
+
+  // Waits until everything in the queue has been written and closes the
+  // underlying writer.  Returns false if there was any error writing.
+  virtual bool Close() {
+    KALDI_ASSERT(base_writer_ != NULL && thread_.joinable());
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      closing_ = true;
+      work_cond_.notify_one();
+    }
+    // the background thread only exits once the queue is empty.
+    thread_.join();
+    bool ans = !error_;
+    try {
+      if (!base_writer_->Close())
+        ans = false;
+    } catch (...) {
+      ans = false;
+    }
+    delete base_writer_;
+    base_writer_ = NULL;
+    return ans;
+  }
+
+  virtual ~TableWriterBackgroundImpl() {
+    if (base_writer_ != NULL && !Close())
+      KALDI_ERR << "Error detected closing background writer "
+                << "(relates to ',async' modifier)";
+  }
+
+ private:
+  void RunInBackground() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (queue_.empty() && !closing_)
+        work_cond_.wait(lock);
+      if (queue_.empty())  // closing_ is set and there is nothing to write.
+        return;
+      std::pair<std::string, T*> item = queue_.front();
+      queue_.pop_front();
+      busy_ = true;
+      space_cond_.notify_all();
+      lock.unlock();
+      if (!error_) {  // after an error, we just discard the objects.
+        try {
+          if (!base_writer_->Write(item.first, *item.second))
+            error_ = true;  // a warning will have been printed.
+        } catch (...) {
+          // the error will have been printed by KALDI_ERR.
+          error_ = true;
+        }
+      }
+      delete item.second;
+      lock.lock();
+      if (queue_.empty() && flush_ && !error_) {
+        // batch the flushes: we only flush when we have caught up.
+        lock.unlock();
+        base_writer_->Flush();
+        lock.lock();
+      }
+      busy_ = false;
+      space_cond_.notify_all();
+    }
+  }
+  static void run(TableWriterBackgroundImpl<Holder> *object) {
+    object->RunInBackground();
+  }
+
+  static T *CopyObject(const T &value, std::true_type) {
+    return new T(value);
+  }
+  static T *CopyObject(const T &value, std::false_type) {
+    // TableWriter::Open() should have prevented this.
+    KALDI_ERR << "The 'async' wspecifier option is not supported for this "
+              << "type of object.";
+    return NULL;
+  }
+
+  void WaitUntilIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!queue_.empty() || busy_)
+      space_cond_.wait(lock);
+  }
+
+  TableWriterImplBase<Holder> *base_writer_;
+  int32 queue_size_;
+  bool flush_;  // if true, flush when the queue becomes empty.
+
+  std::mutex mutex_;  // protects queue_, busy_ and closing_.
+  // The objects waiting to be written, with their keys; we own the pointers.
+  std::deque<std::pair<std::string, T*> > queue_;
+  bool busy_;  // true while the background thread is writing an object.
+  bool closing_;  // set by Close() to tell the background thread to finish.
+  // work_cond_ is the one that the background thread waits on, for objects
+  // to write; space_cond_ is the one that the main thread waits on, for space
+  // in the queue (or for the queue to be empty, in Flush()).
+  std::condition_variable work_cond_;
+  std::condition_variable space_cond_;
+  std::atomic<bool> error_;  // set by the background thread on write error.
+  std::thread thread_;
+};
+
+
 template<class Holder>
 TableWriter<Holder>::TableWriter(const std::string &wspecifier): impl_(NULL) {
   if (wspecifier != "" && !Open(wspecifier))
@@ -1483,7 +1773,14 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       KALDI_ERR << "Failed to close previously open writer.";
   }
   KALDI_ASSERT(impl_ == NULL);
-  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, NULL);
+  WspecifierOptions opts;
+  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, &opts);
+  if (opts.async && !std::is_copy_constructible<typename Holder::T>::value) {
+    // TableWriterBackgroundImpl queues copies of the objects.
+    KALDI_WARN << "The 'async' option is not supported for this type of "
+               << "object (it can't be copied), in wspecifier " << wspecifier;
+    return false;
+  }
   switch (wtype) {
     case kBothWspecifier:
       impl_ = new TableWriterBothImpl<Holder>();
@@ -1498,13 +1795,32 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       KALDI_WARN << "ClassifyWspecifier: invalid wspecifier " << wspecifier;
       return false;
   }
-  if (impl_->Open(wspecifier)) {
-    return true;
-  } else {  // The class will have printed a more specific warning.
+  std::string base_wspecifier = wspecifier;
+  if (opts.async && opts.flush) {
+    // In the async case the flushing is done by TableWriterBackgroundImpl, so
+    // we add the "nf" option, which overrides any earlier "f", to stop the
+    // underlying writer from flushing after every object.
+    size_t pos = wspecifier.find(':');
+    base_wspecifier = std::string(wspecifier, 0, pos) + ",nf" +
+        std::string(wspecifier, pos);
+  }
+  if (!impl_->Open(base_wspecifier)) {
+    // The class will have printed a more specific warning.
     delete impl_;
     impl_ = NULL;
     return false;
   }
+  if (opts.async) {
+    impl_ = new TableWriterBackgroundImpl<Holder>(impl_, opts.async_queue_size,
+                                                  opts.flush);
+    if (!impl_->Open(wspecifier)) {
+      // It should only return false on code error.
+      delete impl_;
+      impl_ = NULL;
+      return false;
+    }
+  }
+  return true;
 }
 
 template<class Holder>
@@ -2501,6 +2817,214 @@ class RandomAccessTableReaderUnsortedArchiveImpl:
 };
 
 
+// RandomAccessTableReaderIndexedArchiveImpl is for random-access reading of
+// archives that were written with an index (the "idx" option), when the "idx"
+// option is given in the rspecifier.  It reads the index into memory, sorted
+// on the key, and reads each object directly from its offset in the archive
+// when it is asked for, so unlike the other archive readers it never has to
+// read through the archive or store more than one object, and it does not care
+// about the sorted, called-sorted or once options.  The archive must be an
+// actual file, not a pipe or the standard input.
+template<class Holder>
+class RandomAccessTableReaderIndexedArchiveImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessTableReaderIndexedArchiveImpl(): last_found_(0),
+                                               state_(kUninitialized) { }
+
+  // Returns false, with a warning, if the index could not be read or is out of
+  // date, in which case the caller may fall back to one of the other archive
+  // readers.
+  virtual bool Open(const std::string &rspecifier) {
+    if (state_ != kUninitialized)
+      KALDI_ERR << "Opening already open RandomAccessTableReader:"
+                   " call Close first.";
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier,
+                                           &archive_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kArchiveRspecifier && opts_.indexed);
+    if (ClassifyRxfilename(archive_rxfilename_) != kFileInput) {
+      KALDI_WARN << "The idx option requires the archive to be an actual "
+                 << "file: rspecifier is " << rspecifier;
+      return false;
+    }
+    int64 archive_size;
+    if (!ReadArchiveIndex(archive_rxfilename_, true, &index_, &archive_size))
+      return false;
+
+    bool ans;
+    // NULL means don't expect binary-mode header
+    if (Holder::IsReadInBinary())
+      ans = input_.Open(archive_rxfilename_, NULL);
+    else
+      ans = input_.OpenTextMode(archive_rxfilename_);
+    if (!ans) {
+      KALDI_WARN << "Failed to open stream "
+                 << PrintableRxfilename(archive_rxfilename_);
+      index_.clear();
+      return false;
+    }
+    std::istream &is = input_.Stream();
+    is.seekg(0, std::ios::end);
+    if (static_cast<int64>(is.tellg()) != archive_size) {
+      KALDI_WARN << "Archive " << PrintableRxfilename(archive_rxfilename_)
+                 << " does not match its index (size is " << is.tellg()
+                 << " bytes, expected " << archive_size << "); the index is "
+                 << "probably out of date.";
+      input_.Close();
+      index_.clear();
+      return false;
+    }
+    // The index is in the order the objects were written, which is often
+    // sorted already.
+    if (!std::is_sorted(index_.begin(), index_.end()))
+      std::sort(index_.begin(), index_.end());
+    for (size_t i = 0; i + 1 < index_.size(); i++) {
+      if (index_[i].key == index_[i+1].key) {
+        KALDI_WARN << "Archive " << PrintableRxfilename(archive_rxfilename_)
+                   << " contains duplicate key: " << index_[i].key;
+        input_.Close();
+        index_.clear();
+        return false;
+      }
+    }
+    state_ = kNoObject;
+    return true;
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    if (!IsOpen())
+      KALDI_ERR << "HasKey called on RandomAccessTableReader object that is"
+                   " not open.";
+    if (state_ == kHaveObject && key == key_)
+      return true;
+    size_t index_pos;
+    if (!LookupKey(key, &index_pos))
+      return false;
+    // In permissive mode, we have to check that we can read the object
+    // before we assert that the key is there.
+    return (!opts_.permissive || LoadObject(index_pos));
+  }
+
+  virtual const T &Value(const std::string &key) {
+    if (!IsOpen())
+      KALDI_ERR << "Value called on RandomAccessTableReader object that is"
+                   " not open.";
+    if (!(state_ == kHaveObject && key == key_)) {
+      size_t index_pos;
+      if (!LookupKey(key, &index_pos))
+        KALDI_ERR << "Value() called but no such key " << key
+                  << " in archive " << PrintableRxfilename(archive_rxfilename_);
+      if (!LoadObject(index_pos))
+        KALDI_ERR << "Could not get item for key " << key
+                  << ", rspecifier is " << rspecifier_ << " [to ignore this, "
+                  << "add the p, (permissive) option to the rspecifier.";
+    }
+    return holder_.Value();
+  }
+
+  virtual bool Close() {
+    if (!IsOpen())
+      KALDI_ERR << "Close() called on RandomAccessTableReader that was not"
+                   " open.";
+    holder_.Clear();
+    input_.Close();
+    index_.clear();
+    last_found_ = 0;
+    key_ = "";
+    state_ = kUninitialized;
+    // Any errors reading objects will already have been reported.
+    return true;
+  }
+
+  bool IsOpen() const { return state_ != kUninitialized; }
+
+  virtual ~RandomAccessTableReaderIndexedArchiveImpl() { }
+
+ private:
+  // Looks up 'key' in the sorted index; if found, returns true and puts its
+  // position in index_ into 'index_pos'.
+  bool LookupKey(const std::string &key, size_t *index_pos) {
+    // As in RandomAccessTableReaderScriptImpl, first test whether the key is
+    // the same as, or the one after, the last one we found, as this is the
+    // common case.
+    if (last_found_ < index_.size() && index_[last_found_].key == key) {
+      *index_pos = last_found_;
+      return true;
+    }
+    if (last_found_ + 1 < index_.size() && index_[last_found_ + 1].key == key) {
+      *index_pos = ++last_found_;
+      return true;
+    }
+    ArchiveIndexEntry entry;
+    entry.key = key;
+    std::vector<ArchiveIndexEntry>::const_iterator iter =
+        std::lower_bound(index_.begin(), index_.end(), entry);
+    if (iter != index_.end() && iter->key == key) {
+      last_found_ = *index_pos = iter - index_.begin();
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  // Reads the object at position 'index_pos' in index_ into holder_.  Returns
+  // true on success; on failure, prints a warning and returns false.
+  bool LoadObject(size_t index_pos) {
+    const ArchiveIndexEntry &entry = index_[index_pos];
+    holder_.Clear();
+    state_ = kNoObject;
+    std::istream &is = input_.Stream();
+    is.clear();  // in case an earlier read failed or hit end of file.
+    is.seekg(entry.offset);
+    if (is.fail() || !holder_.Read(is)) {
+      KALDI_WARN << "Failed to read object for key " << entry.key
+                 << " at offset " << entry.offset << " in archive "
+                 << PrintableRxfilename(archive_rxfilename_);
+      holder_.Clear();
+      return false;
+    }
+    // Check that the object was no longer than the index says; reading past
+    // the end would mean the index does not match the archive.  (tellg()
+    // may return -1 if the last object was read up to the end of file).
+    int64 end = static_cast<int64>(is.tellg());
+    if (end != -1 && end - entry.offset > entry.length) {
+      KALDI_WARN << "Object for key " << entry.key << " in archive "
+                 << PrintableRxfilename(archive_rxfilename_) << " has length "
+                 << (end - entry.offset) << ", expected " << entry.length;
+      holder_.Clear();
+      return false;
+    }
+    key_ = entry.key;
+    state_ = kHaveObject;
+    return true;
+  }
+
+  Input input_;  // the archive, which we keep open and seek in.
+  RspecifierOptions opts_;
+  std::string rspecifier_;  // rspecifier used to open this object; used in
+                            // debug messages
+  std::string archive_rxfilename_;
+
+  // The index of the archive, sorted on the key.
+  std::vector<ArchiveIndexEntry> index_;
+  size_t last_found_;  // for an optimization in LookupKey().
+
+  std::string key_;  // the key of the object in holder_, if state_ ==
+                     // kHaveObject.
+  Holder holder_;
+
+  enum {
+    kUninitialized,  // not open.
+    kNoObject,       // open, holder_ is empty.
+    kHaveObject      // open, holder_ contains the object for key_.
+  } state_;
+};
+
+
 
 
 
@@ -2524,6 +3048,16 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
       impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
       break;
     case kArchiveRspecifier:
+      if (opts.indexed) {
+        impl_ = new RandomAccessTableReaderIndexedArchiveImpl<Holder>();
+        if (impl_->Open(rspecifier))
+          return true;
+        // A warning will already have been printed.
+        delete impl_;
+        impl_ = NULL;
+        KALDI_WARN << "Not using the index for rspecifier " << rspecifier
+                   << ": reading the archive instead.";
+      }
       if (opts.sorted) {
         if (opts.called_sorted)  // "doubly" sorted case.
           impl_ = new RandomAccessTableReaderDSortedArchiveImpl<Holder>();
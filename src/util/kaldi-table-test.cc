@@ -89,6 +89,32 @@ void UnitTestReadScriptFile() {
 
 
 void UnitTestClassifyWspecifier() {
+  {
+    std::string a = "ark,scp,idx:foo.ark,foo.scp";
+    std::string ark = "x", scp = "y";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kBothWspecifier && ark == "foo.ark" &&
+                 scp == "foo.scp" && opts.indexed);
+  }
+
+  {
+    std::string a = "scp,idx:foo";  // idx only makes sense for archives.
+    WspecifierType ans = ClassifyWspecifier(a, NULL, NULL, NULL);
+    KALDI_ASSERT(ans == kNoWspecifier);
+  }
+
+  {
+    std::string a = "ark,async=5,f:foo";
+    std::string ark = "x", scp = "y";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kArchiveWspecifier && ark == "foo" && opts.async &&
+                 opts.async_queue_size == 5 && opts.flush);
+    KALDI_ASSERT(ClassifyWspecifier("ark,async=x:foo", NULL, NULL, NULL) ==
+                 kNoWspecifier);
+  }
+
   {
     std::string a = "b,ark:foo|";
     std::string ark = "x", scp = "y";
@@ -189,6 +215,31 @@ void UnitTestClassifyRspecifier() {
     KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo|");
   }
 
+  {
+    std::string a = "ark,bg=4:foo";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo" &&
+                 opts.background && opts.background_queue_size == 4);
+    KALDI_ASSERT(ClassifyRspecifier("ark,bg=0:foo", NULL, NULL) ==
+                 kNoRspecifier);
+  }
+
+  {
+    std::string a = "ark,idx:foo";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo" && opts.indexed);
+  }
+
+  {
+    std::string a = "scp,idx:foo";  // idx only makes sense for archives.
+    RspecifierType ans = ClassifyRspecifier(a, NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
+
 
   {
     std::string a = "b,ark:foo|";  // b, is ignored.
@@ -414,7 +465,8 @@ void UnitTestTableSequentialDouble(bool binary) {
   ans = bw.Close();
   KALDI_ASSERT(ans);
 
-  SequentialDoubleReader sbr(RandInt(0, 1) == 0 ? "ark:tmpf" : "ark,bg:tmpf");
+  const char *rspecifiers[] = { "ark:tmpf", "ark,bg:tmpf", "ark,bg=3:tmpf" };
+  SequentialDoubleReader sbr(rspecifiers[RandInt(0, 2)]);
   std::vector<std::string> k2;
   std::vector<double> v2;
   for (; !sbr.Done(); sbr.Next()) {
@@ -433,6 +485,95 @@ void UnitTestTableSequentialDouble(bool binary) {
 }
 
 
+// Tests reading with a read-ahead queue, including closing the reader before
+// the end, while the background thread may still be reading.
+void UnitTestTableSequentialBackground() {
+  int32 sz = RandInt(0, 100);
+  Int32Writer bw("ark:tmpf");
+  for (int32 i = 0; i < sz; i++)
+    bw.Write(std::string("key") + std::to_string(i), i);
+  KALDI_ASSERT(bw.Close());
+
+  std::string rspecifier = "ark,bg=" + std::to_string(RandInt(1, 5)) + ":tmpf";
+  int32 num_to_read = RandInt(0, sz);
+  SequentialInt32Reader sbr(rspecifier);
+  int32 i = 0;
+  for (; !sbr.Done() && i < num_to_read; sbr.Next(), i++) {
+    KALDI_ASSERT(sbr.Key() == std::string("key") + std::to_string(i));
+    KALDI_ASSERT(sbr.Value() == i);
+    if (i % 2 == 0)
+      sbr.FreeCurrent();
+  }
+  KALDI_ASSERT(i == num_to_read);
+  KALDI_ASSERT(sbr.Close());
+  unlink("tmpf");
+}
+
+
+// Tests writing in a background thread (the "async" option).
+void UnitTestTableWriteAsync(bool binary, bool write_scp) {
+  int32 sz = RandInt(0, 50);
+  std::vector<std::string> k;
+  std::vector<std::vector<int32> > v(sz);
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back(std::string("key") + std::to_string(i));
+    for (int32 j = RandInt(0, 20); j > 0; j--)
+      v[i].push_back(Rand());
+  }
+  std::string wspecifier = std::string(binary ? "b," : "t,") +
+      (RandInt(0, 1) == 0 ? "async," :
+       "async=" + std::to_string(RandInt(1, 5)) + ",") +
+      (RandInt(0, 1) == 0 ? "f," : "") +
+      (write_scp ? "ark,scp:tmpf,tmpf.scp" : "ark:tmpf");
+  Int32VectorWriter bw(wspecifier);
+  for (int32 i = 0; i < sz; i++) {
+    bw.Write(k[i], v[i]);
+    if (i == sz / 2)
+      bw.Flush();
+  }
+  KALDI_ASSERT(bw.Close());
+
+  SequentialInt32VectorReader sbr(write_scp ? "scp:tmpf.scp" : "ark:tmpf");
+  std::vector<std::string> k2;
+  std::vector<std::vector<int32> > v2;
+  for (; !sbr.Done(); sbr.Next()) {
+    k2.push_back(sbr.Key());
+    v2.push_back(sbr.Value());
+  }
+  KALDI_ASSERT(sbr.Close());
+  KALDI_ASSERT(k2 == k && v2 == v);
+  unlink("tmpf");
+  unlink("tmpf.scp");
+}
+
+// A type with a private copy constructor, like AmDiagGmm.
+class NonCopyableInt {
+ public:
+  NonCopyableInt(): value_(0) { }
+  void Write(std::ostream &os, bool binary) const {
+    WriteBasicType(os, binary, value_);
+  }
+  void Read(std::istream &is, bool binary) {
+    ReadBasicType(is, binary, &value_);
+  }
+ private:
+  int32 value_;
+  NonCopyableInt(const NonCopyableInt &other);
+};
+
+// The "async" option needs to copy the objects, so it should be refused for
+// types that can't be copied, but they should still be writable without it.
+void UnitTestTableWriteAsyncNonCopyable() {
+  TableWriter<KaldiObjectHolder<NonCopyableInt> > writer;
+  KALDI_ASSERT(!writer.Open("ark,async:tmpf") && !writer.IsOpen());
+  NonCopyableInt value;
+  KALDI_ASSERT(writer.Open("ark:tmpf"));
+  writer.Write("foo", value);
+  KALDI_ASSERT(writer.Close());
+  unlink("tmpf");
+}
+
+
 // Writing as both and reading as archive.
 void UnitTestTableSequentialDoubleBoth(bool binary, bool read_scp) {
   int32 sz = Rand() % 10;
@@ -1049,9 +1190,59 @@ void UnitTestTableRandomBothDoubleMatrix(bool binary, bool read_scp,
 }
 
 
+void UnitTestTableRandomIndexedDoubleMatrix(bool binary, bool write_scp) {
+  int32 sz = Rand() % 10;
+  std::vector<std::string> k;
+  std::vector<Matrix<double> > v;
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back(CharToString('a' + static_cast<char>(i)));
+    if (i % 2 == 0) k.back() = k.back() + CharToString('a' + i);
+    v.push_back(Matrix<double>(RandInt(1, 3), RandInt(1, 3)));
+    v.back().SetRandn();
+  }
+  // The index does not require the archive to be sorted.
+  std::vector<int32> order(sz);
+  for (int32 i = 0; i < sz; i++) order[i] = i;
+  RandomizeVector(&order);
+
+  std::string wspecifier = std::string(binary ? "b," : "t,") +
+      (write_scp ? "ark,scp,idx:tmpf,tmpf.scp" : "ark,idx:tmpf");
+  DoubleMatrixWriter bw(wspecifier);
+  for (int32 i = 0; i < sz; i++)
+    bw.Write(k[order[i]], v[order[i]]);
+  KALDI_ASSERT(bw.Close());
+
+  for (int32 pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      // Rewrite the archive without the last object and without an index:
+      // the index is now out of date, and the reader should fall back to
+      // reading the archive.
+      if (sz == 0) break;
+      DoubleMatrixWriter bw2(binary ? "b,ark:tmpf" : "t,ark:tmpf");
+      for (int32 i = 0; i + 1 < sz; i++)
+        bw2.Write(k[order[i]], v[order[i]]);
+      KALDI_ASSERT(bw2.Close());
+    }
+    RandomAccessDoubleMatrixReader sbr("ark,idx:tmpf");
+    for (int32 n = 0; n < 10 && sz != 0; n++) {
+      int32 i = RandInt(0, sz - 1);
+      bool present = (pass == 0 || k[i] != k[order[sz - 1]]);
+      KALDI_ASSERT(sbr.HasKey(k[i]) == present);
+      if (present) {
+        const Matrix<double> &value = sbr.Value(k[i]);
+        if (binary) KALDI_ASSERT(value.ApproxEqual(v[i], 0.0));
+        else KALDI_ASSERT(value.ApproxEqual(v[i], 1.0e-05));
+      }
+    }
+    KALDI_ASSERT(!sbr.HasKey("xyz"));
+  }
+  unlink("tmpf");
+  unlink("tmpf.scp");
+  unlink("tmpf.idx");
+}
+
 
 }  // end namespace kaldi.
-
 int main() {
   using namespace kaldi;
   UnitTestReadScriptFile();
@@ -1063,6 +1254,8 @@ int main() {
     UnitTestTableSequentialInt32(b);
     UnitTestTableSequentialInt32Script(b);
     UnitTestTableSequentialDouble(b);
+    UnitTestTableSequentialBackground();
+    UnitTestTableWriteAsyncNonCopyable();
     UnitTestRangesMatrix(b);
     for (int j = 0; j < 2; j++) {
       bool c = (j == 0);
@@ -1072,6 +1265,8 @@ int main() {
       UnitTestTableSequentialInt32PairVectorBoth(b, c);
       UnitTestTableSequentialInt32VectorVectorBoth(b, c);
       UnitTestTableSequentialBaseFloatVectorBoth(b, c);
+      UnitTestTableRandomIndexedDoubleMatrix(b, c);
+      UnitTestTableWriteAsync(b, c);
       for (int k = 0; k < 2; k++) {
         bool d = (k == 0);
         for (int l = 0; l < 2; l++) {
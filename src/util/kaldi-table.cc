@@ -131,6 +131,92 @@ bool WriteScriptFile(const std::string &wxfilename,
 }
 
 
+bool ArchiveIndexWriter::Open(const std::string &archive_wxfilename) {
+  if (ClassifyWxfilename(archive_wxfilename) != kFileOutput) {
+    KALDI_WARN << "Cannot write an index for archive "
+               << PrintableWxfilename(archive_wxfilename)
+               << " because it is not an actual file.";
+    return false;
+  }
+  index_wxfilename_ = archive_wxfilename + ".idx";
+  if (!output_.Open(index_wxfilename_, true, true))  // binary, with header.
+    return false;
+  WriteToken(output_.Stream(), true, "<ArchiveIndex>");
+  return true;
+}
+
+bool ArchiveIndexWriter::Write(const std::string &key, int64 offset,
+                               int64 length) {
+  std::ostream &os = output_.Stream();
+  WriteToken(os, true, key);
+  WriteBasicType(os, true, offset);
+  WriteBasicType(os, true, length);
+  if (os.fail()) {
+    KALDI_WARN << "Write failure to archive index "
+               << PrintableWxfilename(index_wxfilename_);
+    return false;
+  }
+  return true;
+}
+
+bool ArchiveIndexWriter::Close(int64 archive_size) {
+  WriteToken(output_.Stream(), true, "</ArchiveIndex>");
+  WriteBasicType(output_.Stream(), true, archive_size);
+  if (!output_.Close()) {
+    KALDI_WARN << "Error closing archive index "
+               << PrintableWxfilename(index_wxfilename_);
+    return false;
+  }
+  return true;
+}
+
+void ArchiveIndexWriter::Abort() {
+  if (output_.IsOpen())
+    output_.Close();  // Don't care about status: error anyway.
+}
+
+bool ReadArchiveIndex(const std::string &archive_rxfilename,
+                      bool print_warnings,
+                      std::vector<ArchiveIndexEntry> *index,
+                      int64 *archive_size) {
+  std::string index_rxfilename = archive_rxfilename + ".idx";
+  index->clear();
+  bool binary;
+  Input input;
+  if (!input.Open(index_rxfilename, &binary) || !binary) {
+    if (print_warnings)
+      KALDI_WARN << "Could not open archive index "
+                 << PrintableRxfilename(index_rxfilename);
+    return false;
+  }
+  std::istream &is = input.Stream();
+  try {
+    ExpectToken(is, true, "<ArchiveIndex>");
+    std::string key;
+    while (true) {
+      ReadToken(is, true, &key);
+      if (key == "</ArchiveIndex>")
+        break;
+      ArchiveIndexEntry entry;
+      entry.key.swap(key);
+      ReadBasicType(is, true, &entry.offset);
+      ReadBasicType(is, true, &entry.length);
+      index->push_back(entry);
+    }
+    ReadBasicType(is, true, archive_size);
+  } catch (const std::exception &e) {
+    // This is what we'd expect if the program writing the archive did not
+    // finish, because the end marker would be missing.
+    if (print_warnings)
+      KALDI_WARN << "Archive index " << PrintableRxfilename(index_rxfilename)
+                 << " is incomplete or corrupted.";
+    index->clear();
+    return false;
+  }
+  return true;
+}
+
+
 
 WspecifierType ClassifyWspecifier(const std::string &wspecifier,
                                   std::string *archive_wxfilename,
@@ -148,6 +234,8 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
   //  ark,scp,f:filename, wxfilename ->  kBothWspecifier
   // or:
   //  scp,t,nf:rxfilename -> kScriptWspecifier
+  // The idx option (write an index of the archive) is only allowed with ark:
+  //  ark,idx:filename -> kArchiveWspecifier
 
   if (archive_wxfilename) archive_wxfilename->clear();
   if (script_wxfilename) script_wxfilename->clear();
@@ -164,6 +252,7 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
   // don't omit empty strings between commas.
 
   WspecifierType ws = kNoWspecifier;
+  bool indexed = false;  // the "idx" option only makes sense for archives.
 
   if (opts != NULL)
     *opts = WspecifierOptions();  // Make sure all the defaults are as in the
@@ -183,6 +272,20 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       if (opts) opts->binary = false;
     } else if (!strcmp(c, "p")) {
       if (opts) opts->permissive = true;
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->indexed = true;
+      indexed = true;
+    } else if (!strcmp(c, "async")) {
+      if (opts) opts->async = true;
+    } else if (!strncmp(c, "async=", 6)) {
+      int32 queue_size;
+      if (!ConvertStringToInteger(str.substr(6), &queue_size) ||
+          queue_size <= 0)
+        return kNoWspecifier;
+      if (opts) {
+        opts->async = true;
+        opts->async_queue_size = queue_size;
+      }
     } else if (!strcmp(c, "ark")) {
       if (ws == kNoWspecifier) ws = kArchiveWspecifier;
       else
@@ -197,6 +300,8 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       return kNoWspecifier;  // Could not interpret this option.
     }
   }
+  if (indexed && ws == kScriptWspecifier)
+    return kNoWspecifier;
 
   switch (ws) {
     case kArchiveWspecifier:
@@ -267,6 +372,7 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
   // don't omit empty strings between commas.
 
   RspecifierType rs = kNoRspecifier;
+  bool indexed = false;  // the "idx" option only makes sense for archives.
 
   for (size_t i = 0; i < split_first_part.size(); i++) {
     const std::string &str = split_first_part[i];  // e.g. "b", "t", "f", "ark",
@@ -293,6 +399,18 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       if (opts) opts->called_sorted = false;
     } else if (!strcmp(c, "bg")) {
       if (opts) opts->background = true;
+    } else if (!strncmp(c, "bg=", 3)) {
+      int32 queue_size;
+      if (!ConvertStringToInteger(str.substr(3), &queue_size) ||
+          queue_size <= 0)
+        return kNoRspecifier;
+      if (opts) {
+        opts->background = true;
+        opts->background_queue_size = queue_size;
+      }
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->indexed = true;
+      indexed = true;
     } else if (!strcmp(c, "ark")) {
       if (rs == kNoRspecifier) rs = kArchiveRspecifier;
       else
@@ -307,6 +425,8 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       return kNoRspecifier;  // Could not interpret this option.
     }
   }
+  if (indexed && rs == kScriptRspecifier)
+    return kNoRspecifier;
   if ((rs == kArchiveRspecifier || rs == kScriptRspecifier)
      && wxfilename != NULL)
     *wxfilename = after_colon;
@@ -71,12 +71,25 @@ typedef std::vector<std::string> KeyList;
 //  p means permissive mode, when writing to an "scp" file only: will ignore
 //     missing scp entries, i.e. won't write anything for those files but will
 //     return success status).
+//  idx means also write an index of the archive to the file whose name is the
+//     archive filename plus ".idx" (e.g. foo.ark.idx), which makes it possible
+//     to read the archive as "ark,idx:foo.ark" with a RandomAccessTableReader
+//     without scanning through it.  Only valid when writing an archive, and the
+//     archive must be an actual file.
+//  async means write in a background thread ("write-behind"), so the program
+//     does not wait for the file system: objects are copied into a queue of
+//     up to 10 objects, and errors are reported by a later Write() or by
+//     Close().  With async=N the queue holds up to N objects.  If f is also
+//     given, we flush when the queue becomes empty rather than after each
+//     object.  Not supported for types that can't be copied, e.g. AmDiagGmm.
 //
 //  So the following are valid wspecifiers:
 //  ark,b,f:foo
 //  "ark,b,b:| gzip -c > foo"
 //  "ark,scp,t,nf:foo.ark,|gzip -c > foo.scp.gz"
 //  ark,b:-
+//  ark,idx:foo.ark
+//  ark,async=100:foo.ark
 //
 //  The meanings of rxfilename and wxfilename are as described in
 //  kaldi-stream.h (they are filenames but include pipes, stdin/stdout
@@ -114,7 +127,11 @@ struct WspecifierOptions {
   bool binary;
   bool flush;
   bool permissive;  // will ignore absent scp entries.
-  WspecifierOptions(): binary(true), flush(false), permissive(false) { }
+  bool indexed;  // will write an index of the archive (see ArchiveIndexWriter).
+  bool async;  // will write in a background thread.
+  int32 async_queue_size;  // max number of objects queued, if 'async'.
+  WspecifierOptions(): binary(true), flush(false), permissive(false),
+                       indexed(false), async(false), async_queue_size(10) { }
 };
 
 // ClassifyWspecifier returns the type of the wspecifier string,
@@ -161,6 +178,63 @@ bool WriteScriptFile(std::ostream &os,
                      const std::vector<std::pair<std::string, std::string> >
                      &script);
 
+
+// An entry in the index of an archive (see the "idx" option of wspecifiers and
+// rspecifiers).  'offset' is the byte offset in the archive of the start of
+// the object (i.e. just after the key and the space), which is the same as the
+// offset that would be written to the scp file by "ark,scp", and 'length' is
+// the number of bytes in the archive taken up by the object.
+struct ArchiveIndexEntry {
+  std::string key;
+  int64 offset;
+  int64 length;
+  bool operator < (const ArchiveIndexEntry &other) const {
+    return key < other.key;
+  }
+};
+
+// ArchiveIndexWriter writes the index of an archive, to the file whose name is
+// the archive filename plus ".idx".  The index is in binary format: the token
+// <ArchiveIndex>, then for each object the key, offset and length, then the
+// token </ArchiveIndex> and the total size of the archive in bytes.  The
+// entries are written as the archive is written, so we never hold them in
+// memory.  The end marker is only written by Close(), so an index whose
+// archive was not completely written will be rejected by ReadArchiveIndex(),
+// and the archive size lets the reader detect an index that is out of date.
+class ArchiveIndexWriter {
+ public:
+  // 'archive_wxfilename' must be an actual filename.  Returns true on success.
+  bool Open(const std::string &archive_wxfilename);
+
+  bool IsOpen() const { return output_.IsOpen(); }
+
+  // Writes an entry to the index.  Returns false on write error.
+  bool Write(const std::string &key, int64 offset, int64 length);
+
+  // Writes the end marker including the total size of the archive, which
+  // should be called after the archive has been successfully written, and
+  // closes the file.  Returns true on success.
+  bool Close(int64 archive_size);
+
+  // Closes the file without writing the end marker, which leaves an index that
+  // readers will reject; for use if there was an error writing the archive.
+  void Abort();
+
+ private:
+  Output output_;
+  std::string index_wxfilename_;
+};
+
+// Reads the index of the archive 'archive_rxfilename' (written by
+// ArchiveIndexWriter) into 'index', in the order the entries were written, and
+// outputs the size of the archive that it describes to 'archive_size'.
+// Returns false, printing a warning if 'print_warnings' is true, if the index
+// could not be read or was not complete.
+bool ReadArchiveIndex(const std::string &archive_rxfilename,
+                      bool print_warnings,
+                      std::vector<ArchiveIndexEntry> *index,
+                      int64 *archive_size);
+
 // Documentation for "rspecifier"
 // "rspecifier" describes how we read a set of objects indexed by keys.
 // The possibilities are:
@@ -189,6 +263,19 @@ bool WriteScriptFile(std::ostream &os,
 //       value, in a background thread.  Recommended when reading larger objects
 //       such as neural-net training examples, especially when you want to
 //       maximize GPU usage.
+//   bg=N is like bg but reads ahead by up to N values, which smooths out
+//       variations in the speed of reading (e.g. from a network file system or
+//       a pipe).  When the reader is closed it prints statistics about the
+//       queue, from which you can tell whether the program was waiting for
+//       input.
+//   idx means that the archive has an index (written by giving the "idx"
+//       option to the wspecifier), and for random-access readers it causes the
+//       objects to be looked up in the index and read from the archive on
+//       demand, so the memory used is proportional to the number of keys
+//       rather than the size of the archive and the call order does not
+//       matter.  The archive must be an actual file.  If the index is missing
+//       or out of date we print a warning and read the archive as if the
+//       option had not been given.  It has no effect for sequential readers.
 //
 //   b   is ignored [for scripting convenience]
 //   t   is ignored [for scripting convenience]
@@ -197,6 +284,7 @@ bool WriteScriptFile(std::ostream &os,
 //  So for instance the following would be a valid rspecifier:
 //
 //   "o, s, p, ark:gunzip -c foo.gz|"
+//   "ark,idx:foo.ark"
 
 struct  RspecifierOptions {
   // These options only make a difference for the RandomAccessTableReader class.
@@ -211,9 +299,15 @@ struct  RspecifierOptions {
   bool background;  // For sequential readers, if the background option ("bg")
                     // is provided, it will read ahead to the next object in a
                     // background thread.
+  int32 background_queue_size;  // The number of objects to read ahead if
+                                // 'background' is set, see "bg=N".
+  bool indexed;  // For random-access readers of archives, if the "idx" option
+                 // is provided, it will look up objects in the archive's index
+                 // instead of reading through the archive.
   RspecifierOptions(): once(false), sorted(false),
                        called_sorted(false), permissive(false),
-                       background(false) { }
+                       background(false), background_queue_size(1),
+                       indexed(false) { }
 };
 
 enum RspecifierType  {
@@ -0,0 +1,130 @@
+// util/kaldi-thread-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/kaldi-thread.h"
+
+// This program compares the time taken to run many short jobs by creating a
+// thread for each one, which is what TaskSequencer used to do, with the time
+// taken by ThreadPool and TaskSequencer.
+
+namespace kaldi {
+
+// A job that does a small, fixed amount of work.
+static int64 ShortJob(int32 seed) {
+  int64 ans = seed;
+  for (int32 i = 0; i < 1000; i++)
+    ans = (ans * 1103515245 + 12345) % 2147483648;
+  return ans;
+}
+
+class SpeedTestTaskClass {
+ public:
+  SpeedTestTaskClass(int32 i, int64 *tot): i_(i), tot_(tot), sum_(0) { }
+  void operator() () { sum_ = ShortJob(i_); }
+  ~SpeedTestTaskClass() { *tot_ += sum_; }
+ private:
+  int32 i_;
+  int64 *tot_;
+  int64 sum_;
+};
+
+void TestThreadSpeed(int32 num_threads) {
+  int32 num_jobs = 2000;
+  int64 tot1 = 0, tot2 = 0;
+  double time1, time2;
+  {  // A thread for each job, num_threads at a time.
+    Timer timer;
+    for (int32 i = 0; i < num_jobs; i += num_threads) {
+      std::vector<std::thread> threads;
+      std::vector<int64> sums(num_threads);
+      for (int32 j = 0; j < num_threads; j++)
+        threads.push_back(std::thread([&sums, j]() {
+              sums[j] = ShortJob(j); }));
+      for (int32 j = 0; j < num_threads; j++) {
+        threads[j].join();
+        tot1 += sums[j];
+      }
+    }
+    time1 = timer.Elapsed();
+  }
+  {
+    Timer timer;
+    ThreadPool pool(num_threads);
+    for (int32 i = 0; i < num_jobs; i += num_threads) {
+      std::vector<std::future<int64> > futures;
+      for (int32 j = 0; j < num_threads; j++)
+        futures.push_back(pool.Submit(std::bind(ShortJob, j)));
+      for (int32 j = 0; j < num_threads; j++)
+        tot2 += futures[j].get();
+    }
+    time2 = timer.Elapsed();
+  }
+  KALDI_ASSERT(tot1 == tot2);
+  KALDI_LOG << "For " << num_jobs << " short jobs with " << num_threads
+            << " threads, new threads took "
+            << time1 << "s, with ThreadPool took " << time2 << "s.";
+}
+
+void TestTaskSequencerSpeed(int32 num_threads) {
+  int32 num_jobs = 2000;
+  int64 tot1 = 0, tot2 = 0;
+  double time1, time2;
+  {  // A thread for each job, deleting the jobs in order.
+    Timer timer;
+    std::deque<std::pair<SpeedTestTaskClass*, std::thread> > jobs;
+    for (int32 i = 0; i < num_jobs; i++) {
+      if (jobs.size() == static_cast<size_t>(num_threads)) {
+        jobs.front().second.join();
+        delete jobs.front().first;
+        jobs.pop_front();
+      }
+      SpeedTestTaskClass *c = new SpeedTestTaskClass(i, &tot1);
+      jobs.push_back(std::make_pair(c, std::thread(std::ref(*c))));
+    }
+    for (; !jobs.empty(); jobs.pop_front()) {
+      jobs.front().second.join();
+      delete jobs.front().first;
+    }
+    time1 = timer.Elapsed();
+  }
+  {
+    Timer timer;
+    TaskSequencerConfig config;
+    config.num_threads = num_threads;
+    TaskSequencer<SpeedTestTaskClass> sequencer(config);
+    for (int32 i = 0; i < num_jobs; i++)
+      sequencer.Run(new SpeedTestTaskClass(i, &tot2));
+    sequencer.Wait();
+    time2 = timer.Elapsed();
+  }
+  KALDI_ASSERT(tot1 == tot2);
+  KALDI_LOG << "For " << num_jobs << " short jobs with " << num_threads
+            << " threads, TaskSequencer with new threads took "
+            << time1 << "s, with ThreadPool took " << time2 << "s.";
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  for (int32 num_threads = 1; num_threads <= 8; num_threads *= 2) {
+    TestThreadSpeed(num_threads);
+    TestTaskSequencerSpeed(num_threads);
+  }
+}
@@ -80,6 +80,34 @@ void TestThreads() {
   }
 }
 
+// Each job runs a MultiThreader of its own, which has to share the pool with
+// the jobs of the outer one.
+class NestedThreadClass : public MultiThreadable {
+ public:
+  explicit NestedThreadClass(int32 *tot): tot_(tot), private_tot_(0) { }
+  NestedThreadClass(const NestedThreadClass &other):
+      MultiThreadable(other), tot_(other.tot_), private_tot_(0) { }
+
+  void operator() () {
+    MyThreadClass c(1000, &private_tot_);
+    MultiThreader<MyThreadClass> m(4, c);
+  }
+
+  ~NestedThreadClass() { *tot_ += private_tot_; }
+ private:
+  int32 *tot_;
+  int32 private_tot_;
+};
+
+void TestNestedThreads() {
+  int32 tot = 0;
+  NestedThreadClass c(&tot);
+  {
+    MultiThreader<NestedThreadClass> m(8, c);
+  }
+  KALDI_ASSERT(tot == 8 * (1000 * (1000 - 1)) / 2);
+}
+
 class MyTaskClass { // spins for a while, then outputs a pre-given integer.
  public:
   MyTaskClass(int32 i, std::vector<int32> *vec):
@@ -122,12 +150,201 @@ void TestTaskSequencer() {
     KALDI_ASSERT(task_output[i] == i);
 }
 
+class MyFailingTaskClass {  // throws if i is 'fail'.
+ public:
+  MyFailingTaskClass(int32 i, int32 fail, std::vector<int32> *vec):
+      i_(i), fail_(fail), vec_(vec) { }
+  void operator() () {
+    if (i_ == fail_)
+      KALDI_ERR << "Task " << i_ << " failed (this is expected).";
+  }
+  ~MyFailingTaskClass() { vec_->push_back(i_); }
+ private:
+  int32 i_;
+  int32 fail_;
+  std::vector<int32> *vec_;
+};
+
+void TestTaskSequencerError() {
+  TaskSequencerConfig config;
+  config.num_threads = 1 + Rand() % 4;
+  int32 num_tasks = 10, fail = Rand() % num_tasks;
+  std::vector<int32> task_output;
+  bool caught = false;
+  try {
+    TaskSequencer<MyFailingTaskClass> sequencer(config);
+    for (int32 i = 0; i < num_tasks; i++)
+      sequencer.Run(new MyFailingTaskClass(i, fail, &task_output));
+    sequencer.Wait();
+  } catch (const std::runtime_error &e) {
+    caught = true;
+  }
+  // The other tasks are still output, in order.
+  KALDI_ASSERT(caught && task_output.size() < static_cast<size_t>(num_tasks));
+  for (int32 i = 0; i < static_cast<int32>(task_output.size()); i++)
+    KALDI_ASSERT(task_output[i] == (i < fail ? i : i + 1));
+}
+
+
+
+void TestOrderedParallelMap() {
+  TaskSequencerConfig config;
+  config.num_threads = Rand() % 5;
+  int32 num_items = Rand() % 100;
+  std::vector<std::string> output_keys;
+  int64 tot = 0;
+  {
+    OrderedParallelMap<std::vector<int32>, int64> map(
+        config,
+        [](const std::string &key, std::vector<int32> *input, int64 *output) {
+          *output = 0;
+          for (size_t i = 0; i < input->size(); i++)
+            *output += (*input)[i];
+        },
+        [&output_keys, &tot](const std::string &key, int64 *output) {
+          output_keys.push_back(key);
+          tot += *output;
+        });
+    for (int32 i = 0; i < num_items; i++) {
+      std::vector<int32> input(Rand() % 1000, i);
+      tot -= static_cast<int64>(input.size()) * i;
+      if (i % 2 == 0)
+        map.Run(std::to_string(i), input);
+      else
+        map.Run(std::to_string(i), std::move(input));
+    }
+  }  // the destructor outputs any remaining items.
+  KALDI_ASSERT(tot == 0 && output_keys.size() == num_items);
+  for (int32 i = 0; i < num_items; i++)
+    KALDI_ASSERT(output_keys[i] == std::to_string(i));
+}
+
+// Checks that an error in the output function is rethrown by Wait(), and
+// that the items before it are still output.
+void TestOrderedParallelMapError() {
+  TaskSequencerConfig config;
+  config.num_threads = Rand() % 5;
+  int32 num_items = 10, fail = Rand() % num_items;
+  std::vector<int32> output;
+  bool caught = false;
+  try {
+    OrderedParallelMap<int32, int32> map(
+        config,
+        [](const std::string &key, int32 *input, int32 *output) {
+          *output = *input;
+        },
+        [&output, fail](const std::string &key, int32 *i) {
+          if (*i == fail)
+            KALDI_ERR << "Output " << *i << " failed (this is expected).";
+          output.push_back(*i);
+        });
+    for (int32 i = 0; i < num_items; i++)
+      map.Run(std::to_string(i), i);
+    map.Wait();
+  } catch (const std::runtime_error &e) {
+    caught = true;
+  }
+  KALDI_ASSERT(caught && output.size() >= static_cast<size_t>(fail));
+  for (int32 i = 0; i < fail; i++)
+    KALDI_ASSERT(output[i] == i);
+}
+
+// Computes the sum of i from 'begin' to 'end' - 1, splitting the range into
+// sub-tasks that are run in 'pool' if it is large.
+static int64 SumRange(ThreadPool *pool, int64 begin, int64 end) {
+  if (end - begin < 1000) {
+    int64 sum = 0;
+    for (int64 i = begin; i < end; i++)
+      sum += i;
+    return sum;
+  }
+  int64 middle = (begin + end) / 2;
+  std::future<int64> first = pool->Submit(std::bind(SumRange, pool,
+                                                    begin, middle));
+  int64 second = SumRange(pool, middle, end);
+  pool->Wait(first);  // runs 'first' here if no worker has started it.
+  return first.get() + second;
+}
+
+void TestThreadPool() {
+  int32 num_threads = 1 + Rand() % 8;
+  ThreadPool pool(num_threads);
+  KALDI_ASSERT(pool.NumThreads() == num_threads);
+  {
+    std::vector<std::future<int32> > futures;
+    for (int32 i = 0; i < 100; i++)
+      futures.push_back(pool.Submit([i]() { return i * i; }));
+    for (int32 i = 0; i < 100; i++)
+      KALDI_ASSERT(futures[i].get() == i * i);
+  }
+  {
+    // nested tasks.
+    std::future<int64> sum = pool.Submit(std::bind(SumRange, &pool,
+                                                   0, 100000));
+    pool.Wait(sum);
+    KALDI_ASSERT(sum.get() == int64(100000) * 99999 / 2);
+  }
+  {
+    // exceptions are passed to the future.
+    std::future<void> future = pool.Submit([]() {
+        throw std::runtime_error("error");
+      });
+    bool caught = false;
+    try {
+      future.get();
+    } catch (const std::runtime_error &e) {
+      caught = true;
+    }
+    KALDI_ASSERT(caught);
+  }
+}
+
+void TestThreadPoolWait() {
+  // Wait() may run tasks that the waiting thread submitted, but not tasks
+  // that other threads submitted.
+  ThreadPool pool(1);
+  std::promise<void> started, release;
+  std::shared_future<void> released(release.get_future());
+  std::future<void> blocker = pool.Submit([&started, released]() {
+      started.set_value();
+      released.wait();
+    });
+  started.get_future().wait();  // the only worker is now busy.
+  std::thread::id other_id;
+  std::future<void> other;
+  std::thread thread([&pool, &other, &other_id]() {
+      other = pool.Submit([&other_id]() {
+          other_id = std::this_thread::get_id();
+        });
+    });
+  thread.join();
+  std::future<int32> mine = pool.Submit([]() { return 1; });
+  pool.Wait(mine);
+  KALDI_ASSERT(mine.get() == 1 &&
+               other.wait_for(std::chrono::seconds(0)) !=
+               std::future_status::ready);
+  release.set_value();
+  blocker.get();
+  other.get();
+  KALDI_ASSERT(other_id != std::this_thread::get_id());
+}
 
 }  // end namespace kaldi.
 
 int main() {
   using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestThreadPool();
+  TestThreadPoolWait();
   TestThreads();
+  for (int32 i = 0; i < 10; i++)
+    TestNestedThreads();
   for (int32 i = 0; i < 1000; i++)
     TestTaskSequencer();
+  for (int32 i = 0; i < 10; i++)
+    TestTaskSequencerError();
+  for (int32 i = 0; i < 100; i++) {
+    TestOrderedParallelMap();
+    TestOrderedParallelMapError();
+  }
 }
@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <iterator>
 #include "base/kaldi-common.h"
 #include "util/kaldi-thread.h"
 
@@ -28,6 +29,158 @@ MultiThreadable::~MultiThreadable() {
   // default implementation does nothing
 }
 
+ThreadPool *GetMultiThreaderPool(int32 num_threads) {
+  static std::mutex mutex;
+  static ThreadPool *pool = NULL;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (pool == NULL || pool->NumThreads() < num_threads) {
+    // A smaller pool that we replace may still have jobs of other
+    // MultiThreader objects in it, and they may be running in its threads, so
+    // we never delete it.  This only happens if the number of threads asked
+    // for goes up, which is rare.
+    pool = new ThreadPool(num_threads);
+  }
+  return pool;
+}
+
+// The pool that the current thread is a worker of, if any, and its index in
+// that pool.
+static thread_local ThreadPool *tls_pool = NULL;
+static thread_local int32 tls_index = -1;
+
+// Identifies what the current thread is doing, for the purposes of
+// ThreadPool::Wait(): while a worker is running a task this is a number that
+// is unique to that task, and otherwise a number that is unique to the thread.
+// It is zero until it is first needed.
+static thread_local int64 tls_owner = 0;
+static std::atomic<int64> next_owner(1);
+
+static int64 CurrentOwner() {
+  if (tls_owner == 0)
+    tls_owner = next_owner++;
+  return tls_owner;
+}
+
+ThreadPool::ThreadPool(int32 num_threads):
+    next_queue_(0), num_queued_(0), stop_(false) {
+  KALDI_ASSERT(num_threads > 0);
+  queues_.resize(num_threads);
+  for (int32 i = 0; i < num_threads; i++)
+    queues_[i] = new TaskQueue();
+  threads_.resize(num_threads);
+  for (int32 i = 0; i < num_threads; i++)
+    threads_[i] = std::thread(&ThreadPool::RunWorker, this, i);
+}
+
+void ThreadPool::Push(std::function<void()> run) {
+  Task task;
+  task.run = std::move(run);
+  task.owner = CurrentOwner();
+  size_t index = (tls_pool == this ? tls_index :
+                  next_queue_++ % queues_.size());
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  num_queued_++;
+  // Taking the lock ensures that a worker can't miss the notification between
+  // checking num_queued_ and starting to wait.
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  cond_.notify_one();
+}
+
+bool ThreadPool::Pop(int32 index, Task *task) {
+  int32 num_queues = queues_.size();
+  if (index >= 0) {
+    TaskQueue &queue = *(queues_[index]);
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      num_queued_--;
+      return true;
+    }
+  }
+  // Steal from the other queues, starting with the next one.
+  for (int32 i = 1; i <= num_queues; i++) {
+    int32 other = (index + i) % num_queues;
+    if (other < 0) other += num_queues;
+    if (other == index) continue;
+    TaskQueue &queue = *(queues_[other]);
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      num_queued_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::RunOwnTask() {
+  int64 owner = CurrentOwner();
+  int32 num_queues = queues_.size();
+  // Start with our own queue, if we are a worker, since that is where tasks
+  // we submitted will be.
+  int32 first = (tls_pool == this ? tls_index : 0);
+  for (int32 i = 0; i < num_queues; i++) {
+    TaskQueue &queue = *(queues_[(first + i) % num_queues]);
+    Task task;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      std::deque<Task>::reverse_iterator iter = queue.tasks.rbegin(),
+          end = queue.tasks.rend();
+      for (; iter != end; ++iter)
+        if (iter->owner == owner)
+          break;
+      if (iter == end)
+        continue;
+      task = std::move(*iter);
+      queue.tasks.erase(std::next(iter).base());
+      num_queued_--;
+    }
+    RunTask(&task);
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::RunTask(Task *task) {
+  // Tasks that 'task' submits are identified by a new number.
+  int64 saved_owner = tls_owner;
+  tls_owner = next_owner++;
+  task->run();
+  tls_owner = saved_owner;
+}
+
+void ThreadPool::RunWorker(int32 index) {
+  tls_pool = this;
+  tls_index = index;
+  while (true) {
+    Task task;
+    if (Pop(index, &task)) {
+      RunTask(&task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stop_ && num_queued_ <= 0)
+      return;
+    cond_.wait(lock, [this]() { return num_queued_ > 0 || stop_; });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+  for (size_t i = 0; i < queues_.size(); i++)
+    delete queues_[i];
+}
 
 
 }  // end namespace kaldi
@@ -22,17 +22,35 @@
 #ifndef KALDI_THREAD_KALDI_THREAD_H_
 #define KALDI_THREAD_KALDI_THREAD_H_ 1
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include "itf/options-itf.h"
 #include "util/kaldi-semaphore.h"
 
 // This header provides convenient mechanisms for parallelization.
 //
+// The class ThreadPool is a persistent set of worker threads that run tasks
+// given to it, returning a std::future for each one.
+//
 // The class MultiThreader, and the function RunMultiThreaded provide a
 // mechanism to run a specified number of jobs in parellel and wait for them
 // all to finish. They accept objects of some class C that derives from the
 // base class MultiThreadable. C needs to define the operator () that takes
-// no arguments. See ExampleClass below.
+// no arguments. See ExampleClass below.  The jobs are run by a thread pool
+// that is shared by all MultiThreader objects and kept for the lifetime of
+// the program, so the jobs must not wait for each other (they may wait for
+// the thread that created the MultiThreader, though).
 //
 // The class TaskSequencer addresses a different problem typically encountered
 // in Kaldi command-line programs that process a sequence of items. The items
@@ -43,13 +61,13 @@
 // of some class C with an operator () that takes no arguments. C may also have
 // a destructor with side effects (typically some kind of output).
 // TaskSequencer is responsible for running the jobs in parallel. It has a
-// function Run() that will accept a new object of class C; this will block
-// until a thread is free, at which time it will spawn a thread that starts
-// running the operator () of the object. When threads are finished running,
-// the objects will be deleted. TaskSequencer guarantees that the destructors
-// will be called sequentially (not in parallel) and in the same order the
-// objects were given to the Run() function, so that it is safe for the
-// destructor to have side effects such as outputting data.
+// function Run() that will accept a new object of class C and give it to
+// a thread pool of its own to run its operator ().  When jobs are finished
+// running, the objects will be deleted.  TaskSequencer guarantees that the
+// destructors will be called sequentially (not in parallel) and in the same
+// order the objects were given to the Run() function, so that it is safe for
+// the destructor to have side effects such as outputting data.  Each object
+// is deleted as soon as it and the objects before it are finished.
 // Note: the destructor of TaskSequencer will wait for any remaining jobs that
 // are still running and will call the destructors.
 
@@ -63,6 +81,102 @@ extern int32 g_num_threads;  // Maximum number of threads (for programs that
 // should register it with their ParseOptions, as something like:
 // po.Register("num-threads", &g_num_threads, "Number of threads to use.");
 
+/// ThreadPool is a persistent set of worker threads that run the tasks given
+/// to Submit().  Each worker has its own queue of tasks.  Tasks submitted from
+/// outside the pool are given to the queues in turn and tasks submitted from
+/// inside a task go to the queue of the worker running it; a worker whose
+/// queue is empty takes ("steals") tasks from the back of the other queues.
+/// Tasks should not wait for things other than their own subtasks (see
+/// Wait()), or the pool may run out of threads.
+class ThreadPool {
+ public:
+  /// Creates a pool with num_threads > 0 worker threads.
+  explicit ThreadPool(int32 num_threads);
+
+  int32 NumThreads() const { return threads_.size(); }
+
+  /// Schedules f() to be run in one of the worker threads and returns a
+  /// future for its result.  F may be a function object or a
+  /// std::reference_wrapper to one (e.g. std::ref(c)), in which case the
+  /// object must outlive the task.  If f() throws, the exception is rethrown
+  /// by the get() function of the future.
+  template<class F>
+  std::future<typename std::result_of<F()>::type> Submit(F f);
+
+  /// Waits until 'future', which must have been returned by Submit(), is
+  /// ready.  While waiting, the calling thread runs any tasks that it
+  /// submitted itself (from inside the task it is running, if it is a worker
+  /// of a pool) and that have not been started yet, since 'future' may
+  /// depend on them; it never runs other tasks.  This makes it safe for a
+  /// task to wait for subtasks that it submitted to the same pool.
+  template<class R> void Wait(const std::future<R> &future);
+
+  /// The destructor waits for all the tasks that were submitted to finish.
+  ~ThreadPool();
+ private:
+  struct Task {
+    std::function<void()> run;
+    // Identifies the thread, or the task, that submitted this task; see
+    // CurrentOwner() in kaldi-thread.cc.
+    int64 owner;
+  };
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void Push(std::function<void()> run);
+
+  // Takes a task from the front of queue 'index' or, if it is empty, from the
+  // back of another queue.  'index' is -1 for threads outside the pool.
+  bool Pop(int32 index, Task *task);
+
+  // Takes the most recently submitted task from any of the queues that was
+  // submitted by the current thread (or the task it is running), and runs it.
+  // Returns false if there was none.
+  bool RunOwnTask();
+
+  // Runs 'task' in the calling thread.
+  static void RunTask(Task *task);
+
+  void RunWorker(int32 index);
+
+  std::vector<TaskQueue*> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> next_queue_;
+  // The number of tasks that have been pushed and not yet popped.
+  std::atomic<int64> num_queued_;
+  // Workers wait on cond_ while there are no tasks.
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+template<class F>
+std::future<typename std::result_of<F()>::type> ThreadPool::Submit(F f) {
+  typedef typename std::result_of<F()>::type R;
+  // std::function needs a copyable object, and std::packaged_task is not.
+  std::shared_ptr<std::packaged_task<R()> > task(
+      new std::packaged_task<R()>(f));
+  std::future<R> ans = task->get_future();
+  Push([task]() { (*task)(); });
+  return ans;
+}
+
+template<class R> void ThreadPool::Wait(const std::future<R> &future) {
+  while (future.wait_for(std::chrono::seconds(0)) !=
+         std::future_status::ready) {
+    if (!RunOwnTask()) {
+      // Any of our tasks that remain have been started by other threads.
+      future.wait();
+      return;
+    }
+  }
+}
+
+
 class MultiThreadable {
   // To create a function object that does part of the job, inherit from this
   // class, implement a copy constructor calling the default copy constructor
@@ -112,11 +226,16 @@ class ExampleClass: public MultiThreadable {
 };
 
 
+/// Returns the thread pool that MultiThreader runs its jobs on, making sure
+/// that it has at least num_threads threads.  It is created the first time it
+/// is needed and never deleted.
+ThreadPool *GetMultiThreaderPool(int32 num_threads);
+
 template<class C>
 class MultiThreader {
  public:
   MultiThreader(int32 num_threads, const C &c_in) :
-    threads_(std::max<int32>(1, num_threads)),
+    pool_(NULL),
     cvec_(std::max<int32>(1, num_threads), c_in) {
     if (num_threads == 0) {
       // This is a special case with num_threads == 0, which behaves like with
@@ -126,20 +245,29 @@ class MultiThreader {
       cvec_[0].num_threads_ = 1;
       (cvec_[0])();
     } else {
-      for (int32 i = 0; i < threads_.size(); i++) {
+      pool_ = GetMultiThreaderPool(num_threads);
+      futures_.resize(cvec_.size());
+      for (int32 i = 0; i < cvec_.size(); i++) {
         cvec_[i].thread_id_ = i;
-        cvec_[i].num_threads_ = threads_.size();
-        threads_[i] = std::thread(std::ref(cvec_[i]));
+        cvec_[i].num_threads_ = cvec_.size();
+        futures_[i] = pool_->Submit(std::ref(cvec_[i]));
       }
     }
   }
   ~MultiThreader() {
-    for (size_t i = 0; i < threads_.size(); i++)
-      if (threads_[i].joinable())
-        threads_[i].join();
+    // Wait() runs any of our jobs that no worker has started yet in this
+    // thread, so this can't deadlock if the pool is busy, e.g. because we are
+    // in a job of another MultiThreader.  If a job threw an exception, get()
+    // rethrows it and the program terminates, as it did when each job had a
+    // std::thread of its own.
+    for (size_t i = 0; i < futures_.size(); i++) {
+      pool_->Wait(futures_[i]);
+      futures_[i].get();
+    }
   }
  private:
-  std::vector<std::thread> threads_;
+  ThreadPool *pool_;
+  std::vector<std::future<void> > futures_;
   std::vector<C> cvec_;
 };
 
@@ -160,123 +288,239 @@ struct TaskSequencerConfig {
     opts->Register("num-threads", &num_threads, "Number of actively processing "
                    "threads to run in parallel");
     opts->Register("num-threads-total", &num_threads_total, "Total number of "
-                   "threads, including those that are waiting on other threads "
-                   "to produce their output.  Controls memory use.  If <= 0, "
-                   "defaults to --num-threads plus 20.  Otherwise, must "
-                   "be >= num-threads.");
+                   "jobs in progress, including those that are waiting on "
+                   "earlier jobs to produce their output.  Controls memory "
+                   "use.  If <= 0, defaults to --num-threads plus 20.  "
+                   "Otherwise, must be >= num-threads.");
   }
 };
 
+namespace internal {
+// Calls c->Output() if C has such a member function, and does nothing
+// otherwise; see TaskSequencer.  Call as CallTaskOutput(c, 0).
+template<class C>
+auto CallTaskOutput(C *c, int) -> decltype(c->Output(), void()) {
+  c->Output();
+}
+template<class C>
+void CallTaskOutput(C *c, long) { }
+}  // namespace internal
+
 // C should have an operator () taking no arguments, that does some kind
-// of computation, and a destructor that produces some kind of output (the
-// destructors will be run sequentially in the same order Run as called.
+// of computation, and either a member function Output() or a destructor that
+// produces some kind of output (Output(), if present, and the destructors
+// will be run sequentially in the same order Run was called).  Prefer
+// Output() for anything that may fail, e.g. writing to a table: an exception
+// thrown from Output() is rethrown by Run() or Wait() like an exception from
+// operator (), but an exception thrown from a destructor terminates the
+// program.
 template<class C>
 class TaskSequencer {
  public:
   TaskSequencer(const TaskSequencerConfig &config):
       num_threads_(config.num_threads),
-      threads_avail_(config.num_threads),
-      tot_threads_avail_(config.num_threads_total > 0 ? config.num_threads_total :
-                         config.num_threads + 20),
-      thread_list_(NULL) {
+      max_tasks_(config.num_threads_total > 0 ? config.num_threads_total :
+                 config.num_threads + 20),
+      outputting_(false),
+      error_rethrown_(false),
+      pool_(config.num_threads > 0 ? new ThreadPool(config.num_threads) :
+            NULL) {
     KALDI_ASSERT((config.num_threads_total <= 0 ||
                   config.num_threads_total >= config.num_threads) &&
                  "num-threads-total, if specified, must be >= num-threads");
   }
 
-  /// This function takes ownership of the pointer "c", and will delete it
-  /// in the same sequence as Run was called on the jobs.
+  /// This function takes ownership of the pointer "c", and will call its
+  /// Output() function (if any) and delete it in the same sequence as Run was
+  /// called on the jobs.  If an earlier job threw an exception, it is
+  /// rethrown here.
   void Run(C *c) {
     // run in main thread
     if (num_threads_ == 0) {
+      std::unique_ptr<C> ptr(c);
       (*c)();
-      delete c;
+      internal::CallTaskOutput(c, 0);
       return;
     }
-
-    threads_avail_.Wait(); // wait till we have a thread for computation free.
-    tot_threads_avail_.Wait(); // this ensures we don't have too many threads
-    // waiting on I/O, and consume too much memory.
-
-    // put the new RunTaskArgsList object at head of the singly
-    // linked list thread_list_.
-    thread_list_ = new RunTaskArgsList(this, c, thread_list_);
-    thread_list_->thread = std::thread(TaskSequencer<C>::RunTask,
-                                       thread_list_);
+    TaskInfo *info;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // Wait if we have too many jobs, which would consume too much memory.
+      cond_.wait(lock, [this]() {
+          return tasks_.size() < static_cast<size_t>(max_tasks_) ||
+              (error_ && !error_rethrown_);
+        });
+      CheckError();
+      tasks_.push_back(TaskInfo(c));
+      // Elements of a std::deque stay where they are when elements are
+      // added or removed at the ends.
+      info = &(tasks_.back());
+    }
+    pool_->Submit([this, info]() { RunTask(info); });
   }
 
   void Wait() { // You call this at the end if it's more convenient
-    // than waiting for the destructor.  It waits for all tasks to finish.
-    if (thread_list_ != NULL) {
-      thread_list_->thread.join();
-      KALDI_ASSERT(thread_list_->tail == NULL); // thread would not
-      // have exited without setting tail to NULL.
-      delete thread_list_;
-      thread_list_ = NULL;
-    }
+    // than waiting for the destructor.  It waits for all tasks to finish,
+    // and rethrows any exception that a job threw.
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]() { return tasks_.empty() && !outputting_; });
+    CheckError();
   }
 
-  /// The destructor waits for the last thread to exit.
+  /// The destructor waits for the remaining jobs to finish.  (If a job threw
+  /// an exception that was not rethrown by Run() or Wait(), the program
+  /// terminates, as it would if the job had been running in a thread of its
+  /// own).
   ~TaskSequencer() {
     Wait();
   }
  private:
-  struct RunTaskArgsList {
-    TaskSequencer *me; // Think of this as a "this" pointer.
-    C *c; // Clist element of the task we're expected
-    std::thread thread;
-    RunTaskArgsList *tail;
-    RunTaskArgsList(TaskSequencer *me, C *c, RunTaskArgsList *tail):
-        me(me), c(c), tail(tail) {}
+  struct TaskInfo {
+    C *c;
+    bool done;  // true if c's operator () has returned (or thrown).
+    bool failed;  // true if c's operator () threw.
+    explicit TaskInfo(C *c): c(c), done(false), failed(false) { }
   };
-  // This static function gets run in the threads that we create.
-  static void RunTask(RunTaskArgsList *args) {
-    // (1) run the job.
-    (*(args->c))(); // call operator () on args->c, which does the computation.
-    args->me->threads_avail_.Signal(); // Signal that the compute-intensive
-    // part of the thread is done (we want to run no more than
-    // config_.num_threads of these.)
-
-    // (2) we want to destroy the object "c" now, by deleting it.  But for
-    //     correct sequencing (this is the whole point of this class, it
-    //     is intended to ensure the output of the program is in correct order),
-    //     we first wait till the previous thread, whose details will be in "tail",
-    //     is finished.
-    if (args->tail != NULL) {
-      args->tail->thread.join();
+
+  // This is run in the thread pool.  It runs the job and then outputs and
+  // deletes the jobs at the front of tasks_ that are done, unless another
+  // thread is already doing so.  So Output() and the destructors are called
+  // one at a time, in order, but not necessarily from the same thread.
+  void RunTask(TaskInfo *info) {
+    std::exception_ptr error;
+    try {
+      (*(info->c))();
+    } catch (...) {
+      error = std::current_exception();
     }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (error) {
+      if (!error_)
+        error_ = error;
+      info->failed = true;
+    }
+    info->done = true;
+    if (outputting_)
+      return;  // the thread that is outputting will delete info->c.
+    outputting_ = true;
+    while (!tasks_.empty() && tasks_.front().done) {
+      TaskInfo front = tasks_.front();
+      tasks_.pop_front();
+      lock.unlock();
+      // This may cause some output, e.g. to a stream.  Only one thread does
+      // this at a time (the one that set outputting_).  The job that failed
+      // is not output or deleted, because its output would be incomplete.
+      std::exception_ptr output_error;
+      if (!front.failed) {
+        try {
+          internal::CallTaskOutput(front.c, 0);
+        } catch (...) {
+          output_error = std::current_exception();
+        }
+        delete front.c;
+      }
+      lock.lock();
+      if (output_error && !error_)
+        error_ = output_error;
+      cond_.notify_all();
+    }
+    outputting_ = false;
+    cond_.notify_all();
+  }
 
-    delete args->c; // delete the object "c".  This may cause some output,
-    // e.g. to a stream.  We don't need to worry about concurrent access to
-    // the output stream, because each thread waits for the previous thread
-    // to be done, before doing this.  So there is no risk of concurrent
-    // access.
-    args->c = NULL;
-
-    if (args->tail != NULL) {
-      KALDI_ASSERT(args->tail->tail == NULL); // Because we already
-      // did join on args->tail->thread, which means that
-      // thread was done, and before it exited, it would have
-      // deleted and set to NULL its tail (which is the next line of code).
-      delete args->tail;
-      args->tail = NULL;
+  // Rethrows the first exception thrown by a job, if it has not been
+  // rethrown already.  Must be called with mutex_ locked.
+  void CheckError() {
+    if (error_ && !error_rethrown_) {
+      error_rethrown_ = true;
+      std::rethrow_exception(error_);
     }
-    // At this point we are exiting from the thread.  Signal the
-    // "tot_threads_avail_" semaphore which is used to limit the total number of threads that are alive, including
-    // not onlhy those that are in active computation in c->operator (), but those
-    // that are waiting on I/O or other threads.
-    args->me->tot_threads_avail_.Signal();
   }
 
-  int32 num_threads_; // copy of config.num_threads (since Semaphore doesn't store original count)
+  int32 num_threads_;  // copy of config.num_threads
+
+  // The maximum number of jobs that have been given to Run() and not yet
+  // deleted (this is what --num-threads-total controls).
+  int32 max_tasks_;
+
+  std::mutex mutex_;
+  // Notified when a job is output and deleted.
+  std::condition_variable cond_;
+  // The jobs that are not yet deleted, in the order Run() was called.
+  std::deque<TaskInfo> tasks_;
+  // True while a thread is outputting and deleting jobs.
+  bool outputting_;
+  // The first exception thrown by a job's operator () or Output().  Later
+  // ones are ignored (they will usually have been logged already by
+  // KALDI_ERR).
+  std::exception_ptr error_;
+  bool error_rethrown_;
+
+  // This is declared last so that it is destroyed first, which ensures that
+  // the worker threads have finished with our other members.
+  std::unique_ptr<ThreadPool> pool_;
+};
 
-  Semaphore threads_avail_; // Initialized to the number of threads we are
-  // supposed to run with; the function Run() waits on this.
+/// OrderedParallelMap is a convenient interface to TaskSequencer for programs
+/// that read a table, process each item independently, and write the results
+/// in the same order as the input, e.g. lattice rescoring programs.  You give
+/// it two functions: 'map', which processes one item and is called from the
+/// thread pool, so several may run at once; and 'output', which is called with
+/// the result of 'map' for each item, one at a time and in the order the items
+/// were given to Run().  'output' is called from the thread pool too (or from
+/// the calling thread if --num-threads=0), but never concurrently with
+/// itself, so it can write to table writers and update statistics without
+/// locking, as long as the calling thread does not touch them until Wait()
+/// has returned; 'map' should only read shared data.  This makes the output
+/// independent of the number of threads.  An exception thrown by 'map' or
+/// 'output' is rethrown by a later call to Run() or by Wait(), so call Wait()
+/// at the end rather than relying on the destructor.
+template<class In, class Out>
+class OrderedParallelMap {
+ public:
+  typedef std::function<void(const std::string &key, In *input,
+                             Out *output)> MapFunction;
+  typedef std::function<void(const std::string &key, Out *output)>
+      OutputFunction;
+
+  OrderedParallelMap(const TaskSequencerConfig &config,
+                     const MapFunction &map,
+                     const OutputFunction &output):
+      map_(map), output_(output), sequencer_(config) { }
+
+  /// Schedules map(key, &input, &output) to be run, followed by
+  /// output(key, &output) in order.  'input' is copied, or moved if you pass
+  /// an rvalue, e.g. std::move(input).
+  void Run(const std::string &key, In input) {
+    sequencer_.Run(new Task(this, key, std::move(input)));
+  }
+
+  /// Waits for all the items to be processed and output.
+  void Wait() { sequencer_.Wait(); }
 
-  Semaphore tot_threads_avail_; // We use this semaphore to ensure we don't
-  // consume too much memory...
-  RunTaskArgsList *thread_list_;
+ private:
+  class Task {
+   public:
+    Task(const OrderedParallelMap *map, const std::string &key, In &&input):
+        map_(map), key_(key), input_(std::move(input)) { }
+    void operator () () {
+      map_->map_(key_, &input_, &output_);
+      input_ = In();  // free memory as soon as possible.
+    }
+    // Called by TaskSequencer, in order.
+    void Output() { map_->output_(key_, &output_); }
+   private:
+    const OrderedParallelMap *map_;
+    std::string key_;
+    In input_;
+    Out output_;
+  };
 
+  MapFunction map_;
+  OutputFunction output_;
+  // This is declared last so that it is destroyed first, which outputs the
+  // remaining items.
+  TaskSequencer<Task> sequencer_;
 };
 
 } // namespace kaldi
@@ -0,0 +1,91 @@
+// util/slab-allocator-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_SLAB_ALLOCATOR_INL_H_
+#define KALDI_UTIL_SLAB_ALLOCATOR_INL_H_
+
+// Do not include this file directly.  It is included by slab-allocator.h
+
+#include <new>
+#include <sstream>
+
+namespace kaldi {
+
+template<class T> SlabAllocator<T>::SlabAllocator(size_t slab_size):
+    slab_size_(slab_size), free_head_(NULL), cur_slab_(0), cur_pos_(0),
+    num_in_use_(0), max_in_use_(0), num_allocations_(0) {
+  KALDI_ASSERT(slab_size > 0);
+}
+
+template<class T> inline void *SlabAllocator<T>::GetSlot() {
+  if (free_head_ != NULL) {
+    Slot *ans = free_head_;
+    free_head_ = free_head_->next_free;
+    return ans;
+  }
+  if (cur_slab_ < slabs_.size() && cur_pos_ == slab_size_) {
+    cur_slab_++;
+    cur_pos_ = 0;
+  }
+  if (cur_slab_ == slabs_.size())
+    slabs_.push_back(new Slot[slab_size_]);
+  return slabs_[cur_slab_] + cur_pos_++;
+}
+
+template<class T> inline T *SlabAllocator<T>::New(const T &t) {
+  void *slot = GetSlot();
+  num_allocations_++;
+  if (++num_in_use_ > max_in_use_)
+    max_in_use_ = num_in_use_;
+  return new (slot) T(t);
+}
+
+template<class T> inline void SlabAllocator<T>::Delete(T *t) {
+  t->~T();
+  Slot *slot = reinterpret_cast<Slot*>(t);
+  slot->next_free = free_head_;
+  free_head_ = slot;
+  num_in_use_--;
+}
+
+template<class T> void SlabAllocator<T>::DeleteAll() {
+  static_assert(std::is_trivially_destructible<T>::value,
+                "SlabAllocator::DeleteAll() requires a trivially "
+                "destructible type");
+  free_head_ = NULL;
+  cur_slab_ = 0;
+  cur_pos_ = 0;
+  num_in_use_ = 0;
+}
+
+template<class T> std::string SlabAllocator<T>::Info() const {
+  std::ostringstream os;
+  os << num_allocations_ << " allocations, " << num_in_use_
+     << " in use (max " << max_in_use_ << "), " << slabs_.size()
+     << " slabs (" << (MemoryUsage() / 1024) << " KB)";
+  return os.str();
+}
+
+template<class T> SlabAllocator<T>::~SlabAllocator() {
+  for (size_t i = 0; i < slabs_.size(); i++)
+    delete[] slabs_[i];
+}
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_SLAB_ALLOCATOR_INL_H_
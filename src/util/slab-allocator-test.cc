@@ -0,0 +1,90 @@
+// util/slab-allocator-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/slab-allocator.h"
+#include <set>
+
+namespace kaldi {
+
+struct TestObject {
+  int32 a;
+  double b;
+  TestObject *next;
+  TestObject(int32 a, double b, TestObject *next): a(a), b(b), next(next) { }
+};
+
+void TestSlabAllocator() {
+  int32 slab_size = 1 + Rand() % 20;
+  SlabAllocator<TestObject> allocator(slab_size);
+  std::vector<TestObject*> objects;
+  for (int32 iter = 0; iter < 5; iter++) {
+    size_t num_allocations = 0;
+    for (int32 i = 0; i < 200; i++) {
+      if (!objects.empty() && Rand() % 3 == 0) {
+        // delete a random object.
+        size_t j = Rand() % objects.size();
+        allocator.Delete(objects[j]);
+        objects[j] = objects.back();
+        objects.pop_back();
+      } else {
+        int32 a = Rand();
+        TestObject *next = (objects.empty() ? NULL : objects.back());
+        TestObject *t = allocator.New(TestObject(a, 0.5 * a, next));
+        KALDI_ASSERT(t->a == a && t->b == 0.5 * a && t->next == next);
+        KALDI_ASSERT(reinterpret_cast<size_t>(t) % alignof(TestObject) == 0);
+        objects.push_back(t);
+        num_allocations++;
+      }
+      KALDI_ASSERT(allocator.NumInUse() == objects.size());
+    }
+    KALDI_ASSERT(allocator.NumAllocations() == num_allocations);
+    KALDI_ASSERT(allocator.MaxInUse() >= objects.size());
+    KALDI_ASSERT(allocator.NumSlabs() * slab_size >= allocator.MaxInUse());
+
+    // check that the live objects are distinct and have not been
+    // overwritten.
+    std::set<TestObject*> distinct(objects.begin(), objects.end());
+    KALDI_ASSERT(distinct.size() == objects.size());
+    for (size_t i = 0; i < objects.size(); i++)
+      KALDI_ASSERT(objects[i]->b == 0.5 * objects[i]->a);
+    KALDI_LOG << allocator.Info();
+
+    if (iter % 2 == 0) {
+      // DeleteAll() should reuse the existing slabs.
+      size_t num_slabs = allocator.NumSlabs(), num_objects = objects.size();
+      allocator.DeleteAll();
+      objects.clear();
+      KALDI_ASSERT(allocator.NumInUse() == 0);
+      for (size_t i = 0; i < num_objects; i++)
+        objects.push_back(allocator.New(TestObject(1, 0.5, NULL)));
+      KALDI_ASSERT(allocator.NumSlabs() == num_slabs);
+    }
+    allocator.ResetStats();
+    KALDI_ASSERT(allocator.NumAllocations() == 0 &&
+                 allocator.MaxInUse() == allocator.NumInUse());
+  }
+}
+
+}  // end namespace kaldi
+
+
+int main() {
+  for (int32 i = 0; i < 10; i++)
+    kaldi::TestSlabAllocator();
+  KALDI_LOG << "Test OK.";
+}
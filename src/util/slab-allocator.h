@@ -0,0 +1,132 @@
+// util/slab-allocator.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_SLAB_ALLOCATOR_H_
+#define KALDI_UTIL_SLAB_ALLOCATOR_H_
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "base/kaldi-common.h"
+
+
+/* This header provides a simple allocator for large numbers of small objects
+   of a single type, such as the tokens and links in the decoders.  Objects are
+   carved out of large blocks ("slabs") which are never returned to the system
+   until the allocator is destroyed; deleted objects go on a free list for
+   reuse.  This avoids the cost of calling the global new and delete for each
+   object, which in multi-threaded programs also involves contention between
+   threads, and it keeps objects allocated at around the same time close
+   together in memory.
+
+   In addition to deleting objects one by one, you can recycle all of them at
+   once by calling DeleteAll(), which takes constant time; this is useful when
+   the objects form a structure that is discarded as a whole.
+
+   The object is not thread-safe; the intention is that each decoder (for
+   instance) has its own.  See slab-allocator-test.cc for an example of how to
+   use it.
+*/
+
+
+namespace kaldi {
+
+template<class T> class SlabAllocator {
+ public:
+  /// Constructor.  'slab_size' is the number of objects in each slab; it
+  /// should be large enough that the number of slabs stays small.
+  explicit SlabAllocator(size_t slab_size = 1024);
+
+  /// Allocates an object and copy-constructs it from 't'; think of it like
+  /// 'new T(t)'.  Typical usage is allocator.New(T(arg1, arg2, ...)).
+  inline T *New(const T &t);
+
+  /// Destroys an object that was returned by New() and puts its memory on the
+  /// free list; think of it like 'delete t'.
+  inline void Delete(T *t);
+
+  /// Recycles the memory of all objects that were allocated by this object and
+  /// not deleted, after which any pointers to them are invalid.  Their
+  /// destructors are not called, so this may only be used if T is trivially
+  /// destructible.
+  void DeleteAll();
+
+  /// Returns the number of objects currently allocated.
+  size_t NumInUse() const { return num_in_use_; }
+
+  /// Returns the maximum of NumInUse() since construction or the last call to
+  /// ResetStats().
+  size_t MaxInUse() const { return max_in_use_; }
+
+  /// Returns the number of calls to New() since construction or the last call
+  /// to ResetStats().
+  size_t NumAllocations() const { return num_allocations_; }
+
+  /// Returns the number of slabs that have been allocated.
+  size_t NumSlabs() const { return slabs_.size(); }
+
+  /// Returns the number of bytes of memory held in slabs.
+  size_t MemoryUsage() const {
+    return slabs_.size() * slab_size_ * sizeof(Slot);
+  }
+
+  /// Resets the statistics returned by NumAllocations() and MaxInUse().
+  void ResetStats() {
+    num_allocations_ = 0;
+    max_in_use_ = num_in_use_;
+  }
+
+  /// Returns a one-line human-readable summary of the statistics, for
+  /// logging.
+  std::string Info() const;
+
+  ~SlabAllocator();
+ private:
+  // An object or, while it is free, the link in the free list.
+  union Slot {
+    Slot *next_free;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  // Returns memory for a new object, from the free list if it is nonempty and
+  // otherwise from the unused part of the slabs, allocating a new slab if
+  // needed.
+  inline void *GetSlot();
+
+  size_t slab_size_;
+  std::vector<Slot*> slabs_;
+  // The free list: slots that were allocated and then deleted.
+  Slot *free_head_;
+  // The slots in slabs_[cur_slab_] from cur_pos_ onwards, and all the slots in
+  // later slabs, have never been used since construction or the last call to
+  // DeleteAll().
+  size_t cur_slab_;
+  size_t cur_pos_;
+
+  size_t num_in_use_;
+  size_t max_in_use_;
+  size_t num_allocations_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SlabAllocator);
+};
+
+
+}  // end namespace kaldi
+
+#include "util/slab-allocator-inl.h"
+
+#endif  // KALDI_UTIL_SLAB_ALLOCATOR_H_
@@ -0,0 +1,178 @@
+// util/table-shuffler-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_TABLE_SHUFFLER_INL_H_
+#define KALDI_UTIL_TABLE_SHUFFLER_INL_H_
+
+// Do not include this file directly.  It is included by table-shuffler.h
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace kaldi {
+
+template<class Holder>
+TableShuffler<Holder>::TableShuffler(const TableShufflerOptions &opts,
+                                     TableWriter<Holder> *writer):
+    opts_(opts), writer_(writer), num_written_(0) {
+  KALDI_ASSERT(writer_ != NULL && writer_->IsOpen());
+  if (opts_.max_memory_mb > 0 && opts_.num_buckets < 1)
+    KALDI_ERR << "--num-buckets must be positive, got " << opts_.num_buckets;
+}
+
+template<class Holder>
+void TableShuffler<Holder>::Add(const std::string &key, const T &value) {
+  if (opts_.max_memory_mb <= 0) {
+    // Putting in an extra level of indirection here to avoid excessive
+    // computation and memory demands when we have to resize the vector.
+    objects_.push_back(std::pair<std::string, T*>(key, new T(value)));
+    return;
+  }
+  if (buckets_.empty())
+    CreateBuckets(opts_.num_buckets, &buckets_);
+  Bucket &bucket = buckets_[RandInt(0, buckets_.size() - 1)];
+  bucket.writer->Write(key, value);
+  bucket.num_objects++;
+}
+
+template<class Holder>
+int64 TableShuffler<Holder>::Finish() {
+  if (opts_.max_memory_mb <= 0) {
+    ShuffleAndWriteObjects();
+  } else {
+    CloseBuckets(&buckets_);
+    for (size_t i = 0; i < buckets_.size(); i++)
+      ShuffleBucket(buckets_[i], 0);
+    buckets_.clear();
+  }
+  return num_written_;
+}
+
+template<class Holder>
+void TableShuffler<Holder>::CreateBuckets(int32 num_buckets,
+                                          std::vector<Bucket> *buckets) {
+  KALDI_ASSERT(buckets->empty());
+  buckets->resize(num_buckets);
+  for (int32 i = 0; i < num_buckets; i++) {
+    Bucket &bucket = (*buckets)[i];
+    bucket.filename = CreateTempFile(opts_.temp_dir, "shuffle");
+    temp_files_.push_back(bucket.filename);
+    bucket.writer = new TableWriter<Holder>("ark:" + bucket.filename);
+    bucket.num_objects = 0;
+  }
+}
+
+template<class Holder>
+void TableShuffler<Holder>::CloseBuckets(std::vector<Bucket> *buckets) {
+  for (size_t i = 0; i < buckets->size(); i++) {
+    Bucket &bucket = (*buckets)[i];
+    if (bucket.writer != NULL) {
+      if (!bucket.writer->Close())
+        KALDI_ERR << "Error closing temporary archive " << bucket.filename;
+      delete bucket.writer;
+      bucket.writer = NULL;
+    }
+  }
+}
+
+template<class Holder>
+void TableShuffler<Holder>::ShuffleBucket(const Bucket &bucket, int32 depth) {
+  // Beyond this depth we stop splitting; we should only get here if the
+  // objects are very unevenly sized.
+  const int32 kMaxDepth = 4;
+  if (bucket.num_objects == 0) {
+    std::remove(bucket.filename.c_str());
+    return;
+  }
+  int64 max_bytes = static_cast<int64>(opts_.max_memory_mb) * 1048576,
+      num_bytes;
+  {
+    std::ifstream is(bucket.filename.c_str(),
+                     std::ios::binary | std::ios::ate);
+    num_bytes = is.tellg();
+    if (!is || num_bytes < 0)
+      KALDI_ERR << "Error getting size of temporary archive "
+                << bucket.filename;
+  }
+
+  SequentialTableReader<Holder> reader("ark:" + bucket.filename);
+  if (num_bytes <= max_bytes || bucket.num_objects == 1 ||
+      depth >= kMaxDepth) {
+    if (num_bytes > max_bytes)
+      KALDI_WARN << "Shuffling " << bucket.num_objects << " objects of "
+                 << "total size " << (num_bytes / 1048576) << " MB in "
+                 << "memory, which exceeds --max-memory-mb="
+                 << opts_.max_memory_mb;
+    for (; !reader.Done(); reader.Next())
+      objects_.push_back(std::pair<std::string, T*>(reader.Key(),
+                                                    new T(reader.Value())));
+    if (!reader.Close())
+      KALDI_ERR << "Error reading temporary archive " << bucket.filename;
+    std::remove(bucket.filename.c_str());
+    if (static_cast<int64>(objects_.size()) != bucket.num_objects)
+      KALDI_ERR << "Expected " << bucket.num_objects << " objects in "
+                << bucket.filename << ", read " << objects_.size();
+    ShuffleAndWriteObjects();
+  } else {
+    // Split the bucket so that each part is about half the memory limit; this
+    // leaves a margin for the randomness in the sizes of the parts.
+    int64 num_parts = std::min<int64>(2 * num_bytes / max_bytes + 1,
+                                      bucket.num_objects);
+    std::vector<Bucket> parts;
+    CreateBuckets(num_parts, &parts);
+    int64 num_read = 0;
+    for (; !reader.Done(); reader.Next(), num_read++) {
+      Bucket &part = parts[RandInt(0, num_parts - 1)];
+      part.writer->Write(reader.Key(), reader.Value());
+      part.num_objects++;
+    }
+    if (!reader.Close() || num_read != bucket.num_objects)
+      KALDI_ERR << "Error reading temporary archive " << bucket.filename;
+    std::remove(bucket.filename.c_str());
+    CloseBuckets(&parts);
+    for (size_t i = 0; i < parts.size(); i++)
+      ShuffleBucket(parts[i], depth + 1);
+  }
+}
+
+template<class Holder>
+void TableShuffler<Holder>::ShuffleAndWriteObjects() {
+  std::random_shuffle(objects_.begin(), objects_.end());
+  for (size_t i = 0; i < objects_.size(); i++) {
+    writer_->Write(objects_[i].first, *(objects_[i].second));
+    delete objects_[i].second;
+    objects_[i].second = NULL;
+    num_written_++;
+  }
+  objects_.clear();
+}
+
+template<class Holder>
+TableShuffler<Holder>::~TableShuffler() {
+  for (size_t i = 0; i < objects_.size(); i++)
+    delete objects_[i].second;
+  for (size_t i = 0; i < buckets_.size(); i++)
+    delete buckets_[i].writer;
+  for (size_t i = 0; i < temp_files_.size(); i++)
+    std::remove(temp_files_[i].c_str());
+}
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_TABLE_SHUFFLER_INL_H_
@@ -0,0 +1,93 @@
+// util/table-shuffler-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/table-shuffler.h"
+#include "matrix/kaldi-vector.h"
+#include <map>
+
+namespace kaldi {
+
+void TestCreateTempFile() {
+  std::string a = CreateTempFile(".", "tmpf"), b = CreateTempFile("", "tmpf");
+  KALDI_ASSERT(a != b && a.find("./tmpf.") == 0);
+  {
+    Output ko(a, true);
+    WriteToken(ko.Stream(), true, "<Foo>");
+  }
+  bool binary;
+  Input ki(a, &binary);
+  ExpectToken(ki.Stream(), binary, "<Foo>");
+  unlink(a.c_str());
+  unlink(b.c_str());
+}
+
+// If 'out_of_core' is true, we set a memory limit small enough that the
+// buckets have to be split.
+void TestTableShuffler(bool out_of_core) {
+  typedef KaldiObjectHolder<Vector<BaseFloat> > Holder;
+  TableShufflerOptions opts;
+  int32 num_objects = RandInt(0, 200), dim = 1;
+  if (out_of_core) {
+    opts.max_memory_mb = 1;
+    opts.num_buckets = RandInt(1, 3);
+    opts.temp_dir = ".";
+    dim = 10000;  // 40 KB per object.
+  }
+  std::map<std::string, Vector<BaseFloat> > objects;
+  std::vector<std::string> keys;
+  {
+    TableWriter<Holder> writer("ark:tmpf");
+    TableShuffler<Holder> shuffler(opts, &writer);
+    for (int32 i = 0; i < num_objects; i++) {
+      std::ostringstream os;
+      os << "key" << i;
+      Vector<BaseFloat> &v = objects[os.str()];
+      v.Resize(dim);
+      v.SetRandn();
+      keys.push_back(os.str());
+      shuffler.Add(os.str(), v);
+    }
+    KALDI_ASSERT(shuffler.Finish() == num_objects);
+  }
+  std::vector<std::string> shuffled_keys;
+  SequentialTableReader<Holder> reader("ark:tmpf");
+  for (; !reader.Done(); reader.Next()) {
+    std::string key = reader.Key();
+    KALDI_ASSERT(objects.count(key) == 1);
+    KALDI_ASSERT(reader.Value().ApproxEqual(objects[key], 0.0));
+    objects.erase(key);
+    shuffled_keys.push_back(key);
+  }
+  KALDI_ASSERT(objects.empty() && shuffled_keys.size() == keys.size());
+  if (num_objects >= 20)  // fails with probability 1/20!.
+    KALDI_ASSERT(shuffled_keys != keys);
+  unlink("tmpf");
+}
+
+}  // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  TestCreateTempFile();
+  for (int32 i = 0; i < 5; i++) {
+    TestTableShuffler(false);
+    TestTableShuffler(true);
+  }
+  KALDI_LOG << "Test OK.";
+}
@@ -0,0 +1,61 @@
+// util/table-shuffler.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#ifdef _MSC_VER
+#include <cstdio>
+#else
+#include <unistd.h>
+#endif
+#include "util/table-shuffler.h"
+
+namespace kaldi {
+
+std::string CreateTempFile(const std::string &temp_dir,
+                           const std::string &prefix) {
+  std::string dir = temp_dir;
+  if (dir.empty()) {
+    const char *tmpdir = getenv("TMPDIR");
+    dir = (tmpdir != NULL && *tmpdir != '\0' ? tmpdir : "/tmp");
+  }
+#ifdef _MSC_VER
+  char *name = _tempnam(dir.c_str(), prefix.c_str());
+  if (name == NULL)
+    KALDI_ERR << "Could not create temporary file in directory " << dir;
+  std::string ans(name);
+  free(name);
+  FILE *f = fopen(ans.c_str(), "wb");
+  if (f == NULL)
+    KALDI_ERR << "Could not create temporary file " << ans;
+  fclose(f);
+  return ans;
+#else
+  std::string pattern = dir + "/" + prefix + ".XXXXXX";
+  std::vector<char> name(pattern.begin(), pattern.end());
+  name.push_back('\0');
+  int fd = mkstemp(&(name[0]));
+  if (fd == -1)
+    KALDI_ERR << "Could not create temporary file in directory " << dir
+              << ": " << strerror(errno);
+  close(fd);
+  return std::string(&(name[0]));
+#endif
+}
+
+}  // end namespace kaldi
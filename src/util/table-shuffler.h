@@ -0,0 +1,139 @@
+// util/table-shuffler.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_TABLE_SHUFFLER_H_
+#define KALDI_UTIL_TABLE_SHUFFLER_H_
+#include <string>
+#include <utility>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "util/kaldi-table.h"
+
+
+/* This header provides class TableShuffler, which writes the objects given to
+   it to a TableWriter in a random order.  It is used by programs such as
+   nnet3-shuffle-egs.
+
+   By default all the objects are kept in memory and shuffled at the end.  If
+   --max-memory-mb is set, the shuffle is done out of core: in a first pass
+   each object is appended to one of --num-buckets temporary archives chosen
+   uniformly at random, and in a second pass each archive is read back,
+   shuffled in memory and written out.  Any archive that is larger than the
+   memory limit is split again in the same way before being shuffled.  All the
+   I/O is sequential, and the output is a uniformly random permutation of the
+   input, just as with the in-memory shuffle.
+
+   The memory limit is applied to the size of the temporary archives on disk,
+   which for the binary objects we use it for is close to their size in
+   memory.
+*/
+
+
+namespace kaldi {
+
+struct TableShufflerOptions {
+  int32 max_memory_mb;
+  int32 num_buckets;
+  std::string temp_dir;
+
+  TableShufflerOptions(): max_memory_mb(0), num_buckets(100) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("max-memory-mb", &max_memory_mb, "If >0, shuffle out of "
+                   "core using temporary files, keeping approximately at most "
+                   "this many megabytes of objects in memory at once.");
+    opts->Register("num-buckets", &num_buckets, "Number of temporary files "
+                   "to partition the objects into when --max-memory-mb is "
+                   "set.");
+    opts->Register("temp-dir", &temp_dir, "Directory for temporary files "
+                   "when --max-memory-mb is set (default: $TMPDIR, or /tmp "
+                   "if that is not set).");
+  }
+};
+
+
+template<class Holder> class TableShuffler {
+ public:
+  typedef typename Holder::T T;
+
+  /// Constructor.  The writer must be open; this class does not take
+  /// ownership of it.
+  TableShuffler(const TableShufflerOptions &opts, TableWriter<Holder> *writer);
+
+  /// Adds an object to be shuffled.  Nothing is written to 'writer' until
+  /// Finish() is called.
+  void Add(const std::string &key, const T &value);
+
+  /// Writes all the objects that were added to the writer, in a random order,
+  /// and returns the number written.  Randomness comes from Rand(), so the
+  /// order is determined by the seed given to srand().
+  int64 Finish();
+
+  /// The destructor deletes any temporary files that remain, e.g. if an
+  /// exception was thrown.
+  ~TableShuffler();
+
+ private:
+  // A temporary archive holding part of the objects.
+  struct Bucket {
+    std::string filename;
+    TableWriter<Holder> *writer;
+    int64 num_objects;
+  };
+
+  // Creates 'num_buckets' temporary archives, open for writing.
+  void CreateBuckets(int32 num_buckets, std::vector<Bucket> *buckets);
+
+  // Closes the writers of the buckets, checking for errors.
+  void CloseBuckets(std::vector<Bucket> *buckets);
+
+  // Shuffles the objects in this bucket (which must be closed) and writes them
+  // to writer_, splitting it first if it is too large; deletes its file.
+  void ShuffleBucket(const Bucket &bucket, int32 depth);
+
+  // Shuffles the objects in objects_, writes them to writer_ and frees them.
+  void ShuffleAndWriteObjects();
+
+  TableShufflerOptions opts_;
+  TableWriter<Holder> *writer_;
+  int64 num_written_;
+
+  // The objects currently held in memory.
+  std::vector<std::pair<std::string, T*> > objects_;
+  // The first-level buckets, if we are shuffling out of core.
+  std::vector<Bucket> buckets_;
+  // All the temporary files we created; the destructor deletes them.
+  std::vector<std::string> temp_files_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(TableShuffler);
+};
+
+
+/// Creates a new, empty temporary file with a unique name in directory
+/// 'temp_dir' (or in $TMPDIR or /tmp if 'temp_dir' is empty), and returns its
+/// name.  The caller is responsible for deleting it.
+std::string CreateTempFile(const std::string &temp_dir,
+                           const std::string &prefix);
+
+
+}  // end namespace kaldi
+
+#include "util/table-shuffler-inl.h"
+
+#endif  // KALDI_UTIL_TABLE_SHUFFLER_H_